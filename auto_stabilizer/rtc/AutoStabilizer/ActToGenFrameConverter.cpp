@@ -11,7 +11,8 @@ bool ActToGenFrameConverter::convertFrame(const GaitParam& gaitParam, double dt,
 
   {
     // FootOrigin座標系を用いてactRobotRawをgenerate frameに投影しactRobotとする
-    cnoidbodyutil::copyRobotState(gaitParam.actRobotRaw, actRobot);
+    //   FKはrpyOffsetを適用した後の1回のみ行い、generate frameへの投影は全linkの剛体変換で行う. 重心もその後1回のみ計算する
+    cnoidbodyutil::copyRobotStateWithoutFK(gaitParam.actRobotRaw, actRobot);
     actRobot->rootLink()->R() = (actRobot->rootLink()->R() * cnoid::rotFromRpy(this->rpyOffset)).eval(); // rpyOffsetを適用
     actRobot->calcForwardKinematics();
     cnoid::DeviceList<cnoid::ForceSensor> actForceSensors(gaitParam.actRobotRaw->devices());
@@ -30,8 +31,7 @@ bool ActToGenFrameConverter::convertFrame(const GaitParam& gaitParam, double dt,
     cnoid::Position genFootMidCoords = mathutil::calcMidCoords(std::vector<cnoid::Position>{gaitParam.abcEETargetPose[RLEG], gaitParam.abcEETargetPose[LLEG]},
                                                                std::vector<double>{rlegweight, llegweight});  // 1周期前のabcTargetPoseを使っているが、abcTargetPoseは不連続に変化するものではないのでよい
     cnoid::Position genFootOriginCoords = mathutil::orientCoordToAxis(genFootMidCoords, cnoid::Vector3::UnitZ());
-    cnoidbodyutil::moveCoords(actRobot, genFootOriginCoords, actFootOriginCoords);
-    actRobot->calcForwardKinematics();
+    cnoidbodyutil::moveCoordsAllLinks(actRobot, genFootOriginCoords, actFootOriginCoords);
     actRobot->calcCenterOfMass();
   }
 
@@ -82,3 +82,31 @@ bool ActToGenFrameConverter::convertFrame(const GaitParam& gaitParam, double dt,
 
   return true;
 }
+
+bool ActToGenFrameConverter::predictActState(const GaitParam& gaitParam, // input
+                                             cnoid::Vector3& o_predActCog, cnoid::Vector3& o_predActCogVel) const{ // output
+  o_predActCog = gaitParam.actCog;
+  o_predActCogVel = gaitParam.actCogVel.value();
+
+  double delay = this->latencyCompensationTime + (this->useMeasuredActDelay ? std::max(gaitParam.actDelay, 0.0) : 0.0);
+  double cogTime = mathutil::clamp(delay, 0.0, this->latencyCompensationMaxTime);
+  double cogVelTime = mathutil::clamp(delay + this->cogVelFilterLagTime, 0.0, this->latencyCompensationMaxTime);
+  if(cogTime <= 0.0 && cogVelTime <= 0.0) return true;
+  if(!gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[LLEG]) return true; // 支持脚が無い間はZMPが定まらないので予測しない
+
+  /*
+    dx = w ( x - z - l). 前周期のstTargetZmp(z)が一定とすると、p = z + lとして
+      DCM(t) = p + (DCM(0) - p) e^{wt}
+      cog(t) = p + (cog(0) - p) e^{-wt} + (DCM(0) - p) sinh(wt)
+      cogVel(t) = w (DCM(t) - cog(t)) = w ((DCM(0) - p) cosh(wt) - (cog(0) - p) e^{-wt})
+   */
+  double w = gaitParam.omega;
+  cnoid::Vector3 p = gaitParam.stTargetZmp + gaitParam.l;
+  cnoid::Vector3 cog0 = gaitParam.actCog - p;
+  cnoid::Vector3 dcm0 = gaitParam.actCog + gaitParam.actCogVel.value() / w - p;
+
+  o_predActCog.head<2>() = (p + cog0 * std::exp(-w * cogTime) + dcm0 * std::sinh(w * cogTime)).head<2>();
+  cnoid::Vector3 cogVel = w * (dcm0 * std::cosh(w * cogVelTime) - cog0 * std::exp(-w * cogVelTime));
+  o_predActCogVel.head<2>() = cogVel.head<2>();
+  return true;
+}
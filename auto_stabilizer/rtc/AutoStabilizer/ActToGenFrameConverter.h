@@ -8,6 +8,11 @@ class ActToGenFrameConverter {
 public:
   // ActToGenFrameConverterだけでつかうパラメータ
   cnoid::Vector3 rpyOffset = cnoid::Vector3::Zero(); // [roll, pitch, yaw]. rootLink Frame. Actual robotのrootLinkの姿勢に加えるオフセット. IMUの取り付け位置のオフセットを考慮するためのものではない(それはモデルファイルを変えれば良い). 全身のキャリブのずれなど次第に出てくるなにかしらのずれをごますためのもの. 本来このようなパラメータは必要ないのが望ましいが、実用上は確かに必要.
+  // latency compensation. actCog, actCogVelを倒立振子モデルで遅延の分だけ先に進めたもの(predActCog, predActCogVel)を、Stabilizer::calcZMPとFootStepGeneratorのDCMフィードバックに使う. 全て0/falseなら補償しない
+  double latencyCompensationTime = 0.0; // [s]. 0以上. 固定の遅延. 指令関節角度が実際に関節に反映されるまでの遅延など
+  bool useMeasuredActDelay = false; // trueなら、qAct, actImuの時刻から計測したセンサの遅延(gaitParam.actDelay)をlatencyCompensationTimeに加える
+  double cogVelFilterLagTime = 0.0; // [s]. 0以上. actCogVelのローパスフィルタによる遅れ. 速度のみ、この時間だけさらに先に進める. cutoff周波数fcに対して1/(2π fc)程度
+  double latencyCompensationMaxTime = 0.1; // [s]. 0以上. 先に進める時間の上限
 
 public:
   // constant
@@ -31,6 +36,10 @@ public:
   // actual frameで表現されたactRobotRawをgenerate frameに投影しactRobotとし、各種actual値をgenerate frameに変換する
   bool convertFrame(const GaitParam& gaitParam, double dt, // input
                     cnoid::BodyPtr& actRobot, std::vector<cnoid::Position>& o_actEEPose, std::vector<cnoid::Vector6>& o_actEEWrench, cpp_filters::FirstOrderLowPassFilter<cnoid::Vector3>& o_actCogVel) const; // output
+
+  // 前周期のstTargetZmpが遅延の間も続くものとして、actCog, actCogVelを倒立振子モデルで先に進める. 水平成分のみ. ExternalForceHandler::handleExternalForceの後に呼ぶ
+  bool predictActState(const GaitParam& gaitParam, // input
+                       cnoid::Vector3& o_predActCog, cnoid::Vector3& o_predActCogVel) const; // output
 };
 
 #endif
@@ -6,7 +6,11 @@
 #include <cnoid/EigenUtil>
 #include "MathUtil.h"
 #include "CnoidBodyUtil.h"
+#include "RealtimeUtil.h"
 #include <limits>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
 
 static const char* AutoStabilizer_spec[] = {
   "implementation_id", "AutoStabilizer",
@@ -57,12 +61,41 @@ AutoStabilizer::Ports::Ports() :
   m_steppableRegionNumLogOut_("steppableRegionNumLogOut", m_steppableRegionNumLog_),
   m_strideLimitationHullOut_("strideLimitationHullOut", m_strideLimitationHull_),
   m_cpViewerLogOut_("cpViewerLogOut", m_cpViewerLog_),
+  m_ikStatOut_("ikStatOut", m_ikStat_),
+  m_perfStatOut_("perfStatOut", m_perfStat_),
 
   m_AutoStabilizerServicePort_("AutoStabilizerService"),
 
   m_RobotHardwareServicePort_("RobotHardwareService"){
 }
 
+void AutoStabilizer::Ports::addLogPort(const std::string& name, RTC::OutPortBase* port){
+  LogPort logPort;
+  logPort.name = name;
+  logPort.port = port;
+  this->logPorts_.push_back(logPort);
+}
+
+bool AutoStabilizer::Ports::setLogPortDecimation(const std::string& name, int decimation){
+  bool found = false;
+  for(int i=0;i<this->logPorts_.size();i++){
+    if(name == "*" || this->logPorts_[i].name == name){
+      this->logPorts_[i].decimation = std::max(0, decimation);
+      found = true;
+    }
+  }
+  return found;
+}
+
+void AutoStabilizer::Ports::updateLogPorts(){
+  for(int i=0;i<this->logPorts_.size();i++){
+    LogPort& logPort = this->logPorts_[i];
+    // connectors()はmutexを取るので、間引かれる周期には呼ばない
+    logPort.isActive = (logPort.decimation > 0) && (this->logLoop_ % logPort.decimation == 0) && (logPort.port->connectors().size() > 0);
+  }
+  this->logLoop_++;
+}
+
 AutoStabilizer::AutoStabilizer(RTC::Manager* manager) : RTC::DataFlowComponentBase(manager),
   ports_(),
   debugLevel_(0)
@@ -105,22 +138,266 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
   this->addOutPort("steppableRegionNumLogOut", this->ports_.m_steppableRegionNumLogOut_);
   this->addOutPort("strideLimitationHullOut", this->ports_.m_strideLimitationHullOut_);
   this->addOutPort("cpViewerLogOut", this->ports_.m_cpViewerLogOut_);
+  this->addOutPort("ikStatOut", this->ports_.m_ikStatOut_);
+  this->addOutPort("perfStatOut", this->ports_.m_perfStatOut_);
+  this->ports_.addLogPort("genCogOut", &this->ports_.m_genCogOut_);
+  this->ports_.addLogPort("genDcmOut", &this->ports_.m_genDcmOut_);
+  this->ports_.addLogPort("genZmpOut", &this->ports_.m_genZmpOut_);
+  this->ports_.addLogPort("tgtZmpOut", &this->ports_.m_tgtZmpOut_);
+  this->ports_.addLogPort("actCogOut", &this->ports_.m_actCogOut_);
+  this->ports_.addLogPort("actDcmOut", &this->ports_.m_actDcmOut_);
+  this->ports_.addLogPort("dstLandingPosOut", &this->ports_.m_dstLandingPosOut_);
+  this->ports_.addLogPort("remainTimeOut", &this->ports_.m_remainTimeOut_);
+  this->ports_.addLogPort("genCoordsOut", &this->ports_.m_genCoordsOut_);
+  this->ports_.addLogPort("captureRegionOut", &this->ports_.m_captureRegionOut_);
+  this->ports_.addLogPort("steppableRegionLogOut", &this->ports_.m_steppableRegionLogOut_);
+  this->ports_.addLogPort("steppableRegionNumLogOut", &this->ports_.m_steppableRegionNumLogOut_);
+  this->ports_.addLogPort("strideLimitationHullOut", &this->ports_.m_strideLimitationHullOut_);
+  this->ports_.addLogPort("cpViewerLogOut", &this->ports_.m_cpViewerLogOut_);
+  this->ports_.addLogPort("ikStatOut", &this->ports_.m_ikStatOut_);
+  this->ports_.addLogPort("perfStatOut", &this->ports_.m_perfStatOut_);
   this->ports_.m_AutoStabilizerServicePort_.registerProvider("service0", "AutoStabilizerService", this->ports_.m_service0_);
   this->addPort(this->ports_.m_AutoStabilizerServicePort_);
   this->ports_.m_RobotHardwareServicePort_.registerConsumer("service0", "RobotHardwareService", this->ports_.m_robotHardwareService0_);
   this->addPort(this->ports_.m_RobotHardwareServicePort_);
+
+  // load dt, robot model, end_effectors
+  if(!AutoStabilizer::initGaitParam([this](const std::string& key, std::string& ret){ return this->getProperty(key, ret); }, std::string(this->m_profile.instance_name), this->dt_, this->gaitParam_)) return RTC::RTC_ERROR;
+  this->ports_.inPortData_.init(this->gaitParam_);
+
+  {
+    // add more ports (ロボットモデルやEndEffectorの情報を使って)
+
+    // 各EndEffectorにつき、ref<name>WrenchInというInPortをつくる
+    this->ports_.m_refEEWrenchIn_.resize(this->gaitParam_.eeName.size());
+    this->ports_.m_refEEWrench_.resize(this->gaitParam_.eeName.size());
+    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+      std::string name = "ref"+this->gaitParam_.eeName[i]+"WrenchIn";
+      this->ports_.m_refEEWrenchIn_[i] = std::make_unique<RTC::InPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_refEEWrench_[i]);
+      this->addInPort(name.c_str(), *(this->ports_.m_refEEWrenchIn_[i]));
+    }
+
+    // 各ForceSensorにつき、act<name>InというInportをつくる
+    cnoid::DeviceList<cnoid::ForceSensor> forceSensors(this->gaitParam_.actRobotRaw->devices());
+    this->ports_.m_actWrenchIn_.resize(forceSensors.size());
+    this->ports_.m_actWrench_.resize(forceSensors.size());
+    for(int i=0;i<forceSensors.size();i++){
+      std::string name = "act"+forceSensors[i]->name()+"In";
+      this->ports_.m_actWrenchIn_[i] = std::make_unique<RTC::InPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_actWrench_[i]);
+      this->addInPort(name.c_str(), *(this->ports_.m_actWrenchIn_[i]));
+    }
+
+    // 各EndEffectorにつき、ref<name>PoseInというInPortをつくる
+    this->ports_.m_refEEPoseIn_.resize(this->gaitParam_.eeName.size());
+    this->ports_.m_refEEPose_.resize(this->gaitParam_.eeName.size());
+    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+      std::string name = "ref"+this->gaitParam_.eeName[i]+"PoseIn";
+      this->ports_.m_refEEPoseIn_[i] = std::make_unique<RTC::InPort<RTC::TimedPose3D> >(name.c_str(), this->ports_.m_refEEPose_[i]);
+      this->addInPort(name.c_str(), *(this->ports_.m_refEEPoseIn_[i]));
+    }
+
+    // 各EndEffectorにつき、act<name>PoseOutというOutPortをつくる
+    this->ports_.m_actEEPoseOut_.resize(this->gaitParam_.eeName.size());
+    this->ports_.m_actEEPose_.resize(this->gaitParam_.eeName.size());
+    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+      std::string name = "act"+this->gaitParam_.eeName[i]+"PoseOut";
+      this->ports_.m_actEEPoseOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedPose3D> >(name.c_str(), this->ports_.m_actEEPose_[i]);
+      this->addOutPort(name.c_str(), *(this->ports_.m_actEEPoseOut_[i]));
+    }
+
+    // 各EndEffectorにつき、tgt<name>WrenchOutというOutPortをつくる
+    this->ports_.m_tgtEEWrenchOut_.resize(this->gaitParam_.eeName.size());
+    this->ports_.m_tgtEEWrench_.resize(this->gaitParam_.eeName.size());
+    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+      std::string name = "tgt"+this->gaitParam_.eeName[i]+"WrenchOut";
+      this->ports_.m_tgtEEWrenchOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_tgtEEWrench_[i]);
+      this->addOutPort(name.c_str(), *(this->ports_.m_tgtEEWrenchOut_[i]));
+      this->ports_.addLogPort(name, this->ports_.m_tgtEEWrenchOut_[i].get());
+    }
+
+    // 各EndEffectorにつき、act<name>WrenchOutというOutPortをつくる
+    this->ports_.m_actEEWrenchOut_.resize(this->gaitParam_.eeName.size());
+    this->ports_.m_actEEWrench_.resize(this->gaitParam_.eeName.size());
+    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+      std::string name = "act"+this->gaitParam_.eeName[i]+"WrenchOut";
+      this->ports_.m_actEEWrenchOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_actEEWrench_[i]);
+      this->addOutPort(name.c_str(), *(this->ports_.m_actEEWrenchOut_[i]));
+    }
+
+  }
+
+  {
+    // init realtime
+    //   rt_cpusでExecutionContextのスレッドを固定するCPUをカンマ区切りで指定できる. rt_priorityが1以上なら、そのスレッドをその優先度のSCHED_FIFOにする. これらはactivate後の初回のonExecuteで、そのスレッドに対して設定する
+    //     このスレッドは同じExecutionContextの他のRTCと共有しているので、設定前のaffinityとスケジューリングポリシーを保存しておき、deactivate時に元に戻す
+    //   worker_priorityが1以上なら、PipelineWorkerのスレッドをその優先度のSCHED_FIFOにする. PipelineWorkerは待機中に短い時間だけspin-waitし、その後はブロックする
+    //   rt_lock_memoryが1なら、activate時にmlockallする. さらに初回のonExecuteでstackをrt_prefault_stack[byte]書き込んでおく
+    //   rt_malloc_tuningが1なら、activate時にmalloptでfreeした領域をOSに返さないようにし、heapをrt_prefault_heap[byte]確保して書き込んでおく.
+    //     malloptはプロセス全体の設定なので、同じプロセス(rtcd等)の他のRTCのmallocにも影響し、heapが縮まなくなる. rt_lock_memoryとは別に明示的に有効にすること
+    std::string buf;
+    long value;
+    if(this->getProperty("rt_cpus", buf)) this->rtCpus_ = realtimeutil::parseCpuList(buf);
+    value = this->rtPriority_; if(this->getProperty("rt_priority", value)) this->rtPriority_ = value;
+    value = this->rtWorkerPriority_; if(this->getProperty("worker_priority", value)) this->rtWorkerPriority_ = value;
+    value = this->rtLockMemory_; if(this->getProperty("rt_lock_memory", value)) this->rtLockMemory_ = value != 0;
+    value = this->rtMallocTuning_; if(this->getProperty("rt_malloc_tuning", value)) this->rtMallocTuning_ = value != 0;
+    value = this->rtPrefaultHeapSize_; if(this->getProperty("rt_prefault_heap", value)) this->rtPrefaultHeapSize_ = std::max(value, 0L);
+    value = this->rtPrefaultStackSize_; if(this->getProperty("rt_prefault_stack", value)) this->rtPrefaultStackSize_ = std::max(value, 0L);
+  }
+
+  {
+    // init PerfCounter
+    //   perf_countersが1なら、毎周期のexecAutoStabilizerのcycles, instructions, cache-references, cache-missesと、onExecute中のminor, major page faultの回数をperfStatOutに出力する
+    //   perfStatOutの最後の要素は、footstepNodesListが容量を超えて変更を破棄した回数の累計. perf_countersによらず出力する
+    long perfCounters = 0;
+    if(this->getProperty("perf_counters", perfCounters) && perfCounters != 0){
+      this->perfCounter_ = std::make_shared<PerfCounter>();
+    }
+  }
+
+  {
+    // init JointShmChannel
+    //   joint_shm_portsにqRef, refTau, qAct, dqAct, q, genTauのうち共有メモリで受け渡すものをカンマ区切りで与えると、<joint_shm_prefix>_<port名>というファイルを作り、JointShmChannelとして使う
+    //   joint_shm_prefixのdefaultは/dev/shm/<instance名>. 相手側はonInitializeの後にそのファイルをopenする
+    std::string shmPorts;
+    if(this->getProperty("joint_shm_ports", shmPorts) && shmPorts != ""){
+      std::string prefix = "/dev/shm/" + std::string(this->m_profile.instance_name);
+      std::string buf;
+      if(this->getProperty("joint_shm_prefix", buf) && buf != "") prefix = buf;
+      long capacity = 4;
+      this->getProperty("joint_shm_capacity", capacity);
+      std::map<std::string, JointShmChannel*> channels{{"qRef", &this->ports_.m_qRefShm_}, {"refTau", &this->ports_.m_refTauShm_}, {"qAct", &this->ports_.m_qActShm_}, {"dqAct", &this->ports_.m_dqActShm_}, {"q", &this->ports_.m_qShm_}, {"genTau", &this->ports_.m_genTauShm_}};
+      std::stringstream ss_shmPorts(shmPorts);
+      while(std::getline(ss_shmPorts, buf, ',')){
+        std::map<std::string, JointShmChannel*>::iterator it = channels.find(buf);
+        if(it == channels.end() || !it->second->create(prefix + "_" + buf, this->gaitParam_.refRobotRaw->numJoints(), capacity)){
+          std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "invalid joint_shm_ports: " << buf << "\x1b[39m" << std::endl;
+        }
+      }
+    }
+  }
+
+  {
+    // init TelemetryRecorder
+    //   telemetry_fileが与えられたら、ABC中の毎周期の主要な値をそのファイルにバイナリで記録する. telemetry_capacity周期ぶん(default 10000)を記録し、古いものから上書きする
+    //   region類の頂点はtelemetry_vertex_capacity個ぶん(default telemetry_capacity×32)を記録する
+    //   telemetry_fileが/を含まなければ/dev/shm/以下に作る. page faultを避けるため、/を含む場合もtmpfs上のパスを与えること
+    //   ファイル全体(約1.6KB×telemetry_capacity + 16B×telemetry_vertex_capacity. defaultで約21MB)が常駐し、rt_lock_memory時はlockされる
+    //   AutoStabilizerTelemetryToLogでdatalogger形式のログに変換できる
+    std::string telemetryFile;
+    if(this->getProperty("telemetry_file", telemetryFile) && telemetryFile != ""){
+      if(telemetryFile.find('/') == std::string::npos) telemetryFile = "/dev/shm/" + telemetryFile;
+      long capacity = 10000;
+      this->getProperty("telemetry_capacity", capacity);
+      capacity = std::max(capacity, 0L);
+      long vertexCapacity = capacity * 32;
+      this->getProperty("telemetry_vertex_capacity", vertexCapacity);
+      vertexCapacity = std::max(vertexCapacity, 0L);
+      this->telemetryRecorder_ = std::make_shared<TelemetryRecorder>();
+      if(!this->telemetryRecorder_->open(telemetryFile, capacity, vertexCapacity, this->gaitParam_.eeName)){
+        std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "failed to open telemetry_file [" << telemetryFile << "]" << "\x1b[39m" << std::endl;
+        this->telemetryRecorder_ = nullptr;
+      }
+    }
+  }
+
+  {
+    // init log ports
+    //   log_port_decimationに<port名>:<n>をカンマ区切りで与えると、そのportにはn周期に1回書き込む. nが0なら書き込まない. port名が*なら全てのport. 前から順に適用される
+    //   例: "*:0,genCogOut:1,cpViewerLogOut:10"
+    std::string logPortDecimation;
+    if(this->getProperty("log_port_decimation", logPortDecimation)){
+      std::stringstream ss_logPortDecimation(logPortDecimation);
+      std::string buf;
+      while(std::getline(ss_logPortDecimation, buf, ',')){
+        size_t pos = buf.find(':');
+        long decimation;
+        if(pos == std::string::npos || !AutoStabilizer::parseNumber(buf.substr(pos+1), decimation) || !this->ports_.setLogPortDecimation(buf.substr(0,pos), decimation)){
+          std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "invalid log_port_decimation: " << buf << "\x1b[39m" << std::endl;
+        }
+      }
+    }
+  }
+
+  {
+    // init InPortMonitor
+    //   inport_stale_thresholdに<port名>:<秒>をカンマ区切りで与えると、そのInPortにその時間dataが届かなければstaleとする. 0なら判定しない. port名が*なら全てのInPort. 前から順に適用される
+    //   例: "*:0.1,steppableRegionIn:2.0,selfCollisionIn:0"
+    std::string inportStaleThreshold;
+    if(this->getProperty("inport_stale_threshold", inportStaleThreshold)){
+      std::stringstream ss_inportStaleThreshold(inportStaleThreshold);
+      std::string buf;
+      while(std::getline(ss_inportStaleThreshold, buf, ',')){
+        size_t pos = buf.find(':');
+        double threshold;
+        if(pos == std::string::npos || !AutoStabilizer::parseNumber(buf.substr(pos+1), threshold) || !this->ports_.inPortData_.monitor.setStaleThreshold(buf.substr(0,pos), threshold)){
+          std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "invalid inport_stale_threshold: " << buf << "\x1b[39m" << std::endl;
+        }
+      }
+    }
+  }
+
+  // init ActToGenFrameConverter, ImpedanceController, Stabilizer, FullbodyIKSolver
+  AutoStabilizer::initControllers(this->gaitParam_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_, this->fullbodyIKSolver_);
+
+  {
+    // init PipelineWorker
+    //   pipeline_modeが1なら、1周期の処理を前段(座標変換, 歩容生成)と後段(Stabilizer, IK)に分け、後段をpipeline_cpu番のCPUに固定した専用スレッドで、次の周期の前段と並行に実行する
+    //   qの出力は1周期遅れる(今周期のqは前の周期のIKの結果). また前段が参照するstTargetZmpは2周期前のものになる. startAutoBalancer, stopStabilizer直後の初回等は逐次実行する
+    //   initControllersの後に行うこと
+    long pipelineMode = 0;
+    if(this->getProperty("pipeline_mode", pipelineMode) && pipelineMode != 0){
+      long cpu = -1;
+      std::string buf;
+      if(this->getProperty("pipeline_cpu", buf) && buf != "" && !AutoStabilizer::parseNumber(buf, cpu)){
+        std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "pipeline_cpu is not an integer. the worker is not pinned" << "\x1b[39m" << std::endl;
+      }
+      this->pipelineGaitParam_ = this->gaitParam_;
+      this->pipelineGaitParam_.refRobotRaw = this->gaitParam_.refRobotRaw->clone();
+      this->pipelineGaitParam_.actRobotRaw = this->gaitParam_.actRobotRaw->clone();
+      this->pipelineGaitParam_.refRobot = this->gaitParam_.refRobot->clone();
+      this->pipelineGaitParam_.actRobot = this->gaitParam_.actRobot->clone();
+      // Stabilizer, FullbodyIKSolver, jointLimitTablesがlinkを保持しているgenRobot, actRobotTqcは後段のものとし、gaitParam_には別のcloneを持たせる. gaitParam_側には後段が終わるたびに結果をコピーする. これにより、後段の実行中に前段やserviceが後段のrobotを読むことはない
+      this->gaitParam_.genRobot = this->gaitParam_.genRobot->clone();
+      this->gaitParam_.actRobotTqc = this->gaitParam_.actRobotTqc->clone();
+      this->isPipelineGaitParamSynced_ = false;
+      this->pipelineTask_ = [this](){
+        AutoStabilizer::updateExecutionControllers(this->pipelineMode_, this->dt_, this->fullbodyIKSolver_);
+        AutoStabilizer::execExecutionStage(this->pipelineMode_, this->pipelineGaitParam_, this->dt_, this->stabilizer_, this->fullbodyIKSolver_);
+      };
+      this->pipelineWorker_ = std::make_shared<PipelineWorker>();
+      this->pipelineWorker_->start(cpu, this->rtWorkerPriority_);
+    }
+  }
+
+  {
+    // init FootStepStateSnapshot
+    FootStepStateSnapshot snapshot;
+    snapshot.genJointAngle.resize(this->gaitParam_.genRobot->numJoints());
+    AutoStabilizer::copyFootStepStateSnapshot(this->mode_, this->gaitParam_, snapshot);
+    this->footStepStateSnapshot_.init(snapshot);
+  }
+
+  // initialize parameters
+  this->loop_ = 0;
+
+  return RTC::RTC_OK;
+}
+
+// static function
+bool AutoStabilizer::initGaitParam(const std::function<bool(const std::string&, std::string&)>& getProperty, const std::string& instanceName, double& o_dt, GaitParam& o_gaitParam){
   {
     // load dt
-    std::string buf; this->getProperty("dt", buf);
-    this->dt_ = std::stod(buf);
-    if(this->dt_ <= 0.0){
-      this->getProperty("exec_cxt.periodic.rate", buf);
+    std::string buf; getProperty("dt", buf);
+    o_dt = std::stod(buf);
+    if(o_dt <= 0.0){
+      getProperty("exec_cxt.periodic.rate", buf);
       double rate = std::stod(buf);
       if(rate > 0.0){
-        this->dt_ = 1.0/rate;
+        o_dt = 1.0/rate;
       }else{
-        std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "dt is invalid" << "\x1b[39m" << std::endl;
-        return RTC::RTC_ERROR;
+        std::cerr << "\x1b[31m[" << instanceName << "] " << "dt is invalid" << "\x1b[39m" << std::endl;
+        return false;
       }
     }
   }
@@ -128,28 +405,28 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
   {
     // load robot model
     cnoid::BodyLoader bodyLoader;
-    std::string fileName; this->getProperty("model", fileName);
+    std::string fileName; getProperty("model", fileName);
     if (fileName.find("file://") == 0) fileName.erase(0, strlen("file://"));
     cnoid::BodyPtr robot = bodyLoader.load(fileName);
     if(!robot){
-      std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "failed to load model[" << fileName << "]" << "\x1b[39m" << std::endl;
-      return RTC::RTC_ERROR;
+      std::cerr << "\x1b[31m[" << instanceName << "] " << "failed to load model[" << fileName << "]" << "\x1b[39m" << std::endl;
+      return false;
     }
     if(!robot->rootLink()->isFreeJoint()){
-      std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << "rootLink is not FreeJoint [" << fileName << "]" << "\x1b[39m" << std::endl;
-      return RTC::RTC_ERROR;
+      std::cerr << "\x1b[31m[" << instanceName << "] " << "rootLink is not FreeJoint [" << fileName << "]" << "\x1b[39m" << std::endl;
+      return false;
     }
-    this->gaitParam_.init(robot);
+    o_gaitParam.init(robot);
 
     // generate JointParams
-    for(int i=0;i<this->gaitParam_.genRobot->numJoints();i++){
-      cnoid::LinkPtr joint = this->gaitParam_.genRobot->joint(i);
+    for(int i=0;i<o_gaitParam.genRobot->numJoints();i++){
+      cnoid::LinkPtr joint = o_gaitParam.genRobot->joint(i);
       double climit = 0.0, gearRatio = 0.0, torqueConst = 0.0;
       joint->info()->read("climit",climit); joint->info()->read("gearRatio",gearRatio); joint->info()->read("torqueConst",torqueConst);
-      this->gaitParam_.maxTorque[i] = std::max(climit * gearRatio * torqueConst, 0.0);
+      o_gaitParam.maxTorque[i] = std::max(climit * gearRatio * torqueConst, 0.0);
     }
-    std::string jointLimitTableStr; this->getProperty("joint_limit_table",jointLimitTableStr);
-    std::vector<std::shared_ptr<joint_limit_table::JointLimitTable> > jointLimitTables = joint_limit_table::readJointLimitTablesFromProperty (this->gaitParam_.genRobot, jointLimitTableStr);
+    std::string jointLimitTableStr; getProperty("joint_limit_table",jointLimitTableStr);
+    std::vector<std::shared_ptr<joint_limit_table::JointLimitTable> > jointLimitTables = joint_limit_table::readJointLimitTablesFromProperty (o_gaitParam.genRobot, jointLimitTableStr);
     for(size_t i=0;i<jointLimitTables.size();i++){
       // apply margin
       for(size_t j=0;j<jointLimitTables[i]->lLimitTable().size();j++){
@@ -158,12 +435,12 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
           jointLimitTables[i]->lLimitTable()[j] += 0.001;
         }
       }
-      this->gaitParam_.jointLimitTables[jointLimitTables[i]->getSelfJoint()->jointId()].push_back(jointLimitTables[i]);
+      o_gaitParam.jointLimitTables[jointLimitTables[i]->getSelfJoint()->jointId()].push_back(jointLimitTables[i]);
     }
 
     // apply margin to jointlimit
-    for(int i=0;i<this->gaitParam_.genRobot->numJoints();i++){
-      cnoid::LinkPtr joint = this->gaitParam_.genRobot->joint(i);
+    for(int i=0;i<o_gaitParam.genRobot->numJoints();i++){
+      cnoid::LinkPtr joint = o_gaitParam.genRobot->joint(i);
       if(joint->q_upper() - joint->q_lower() > 0.002){
         joint->setJointRange(joint->q_lower()+0.001,joint->q_upper()-0.001);
       }
@@ -177,7 +454,7 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
 
   {
     // load end_effector
-    std::string endEffectors; this->getProperty("end_effectors", endEffectors);
+    std::string endEffectors; getProperty("end_effectors", endEffectors);
     std::stringstream ss_endEffectors(endEffectors);
     std::string buf;
     while(std::getline(ss_endEffectors, buf, ',')){
@@ -202,9 +479,9 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
       // check validity
       name.erase(std::remove(name.begin(), name.end(), ' '), name.end()); // remove whitespace
       parentLink.erase(std::remove(parentLink.begin(), parentLink.end(), ' '), parentLink.end()); // remove whitespace
-      if(!this->gaitParam_.refRobotRaw->link(parentLink)){
-        std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << " link [" << parentLink << "]" << " is not found for " << name << "\x1b[39m" << std::endl;
-        return RTC::RTC_ERROR;
+      if(!o_gaitParam.refRobotRaw->link(parentLink)){
+        std::cerr << "\x1b[31m[" << instanceName << "] " << " link [" << parentLink << "]" << " is not found for " << name << "\x1b[39m" << std::endl;
+        return false;
       }
       cnoid::Matrix3 localR;
       if(localaxis.norm() == 0) localR = cnoid::Matrix3::Identity();
@@ -213,98 +490,43 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
       localT.translation() = localp;
       localT.linear() = localR;
 
-      this->gaitParam_.push_backEE(name, parentLink, localT);
+      o_gaitParam.push_backEE(name, parentLink, localT);
     }
 
     // 0番目が右脚. 1番目が左脚. という仮定がある.
-    if(this->gaitParam_.eeName.size() < NUM_LEGS || this->gaitParam_.eeName[RLEG] != "rleg" || this->gaitParam_.eeName[LLEG] != "lleg"){
-      std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << " this->gaitParam_.eeName.size() < 2 || this->gaitParams.eeName[0] != \"rleg\" || this->gaitParam_.eeName[1] != \"lleg\" not holds" << "\x1b[39m" << std::endl;
-      return RTC::RTC_ERROR;
+    if(o_gaitParam.eeName.size() < NUM_LEGS || o_gaitParam.eeName[RLEG] != "rleg" || o_gaitParam.eeName[LLEG] != "lleg"){
+      std::cerr << "\x1b[31m[" << instanceName << "] " << " this->gaitParam_.eeName.size() < 2 || this->gaitParams.eeName[0] != \"rleg\" || this->gaitParam_.eeName[1] != \"lleg\" not holds" << "\x1b[39m" << std::endl;
+      return false;
     }
   }
 
   {
     // generate LegParams
     // init-poseのとき両脚が同一平面上で, Y軸方向に横に並んでいるという仮定がある
-    cnoid::Position defautFootMidCoords = mathutil::calcMidCoords(std::vector<cnoid::Position>{cnoid::Position(this->gaitParam_.refRobot->link(this->gaitParam_.eeParentLink[RLEG])->T()*this->gaitParam_.eeLocalT[RLEG]),cnoid::Position(this->gaitParam_.refRobot->link(this->gaitParam_.eeParentLink[LLEG])->T()*this->gaitParam_.eeLocalT[LLEG])},
+    cnoid::Position defautFootMidCoords = mathutil::calcMidCoords(std::vector<cnoid::Position>{cnoid::Position(o_gaitParam.refRobot->link(o_gaitParam.eeParentLink[RLEG])->T()*o_gaitParam.eeLocalT[RLEG]),cnoid::Position(o_gaitParam.refRobot->link(o_gaitParam.eeParentLink[LLEG])->T()*o_gaitParam.eeLocalT[LLEG])},
                                                             std::vector<double>{1,1});
     for(int i=0; i<NUM_LEGS; i++){
-      cnoid::Position defaultPose = this->gaitParam_.refRobot->link(this->gaitParam_.eeParentLink[i])->T()*this->gaitParam_.eeLocalT[i];
+      cnoid::Position defaultPose = o_gaitParam.refRobot->link(o_gaitParam.eeParentLink[i])->T()*o_gaitParam.eeLocalT[i];
       cnoid::Vector3 defaultTranslatePos = defautFootMidCoords.inverse() * defaultPose.translation();
       defaultTranslatePos[0] = 0.0;
       defaultTranslatePos[2] = 0.0;
-      this->gaitParam_.defaultTranslatePos[i].reset(defaultTranslatePos);
+      o_gaitParam.defaultTranslatePos[i].reset(defaultTranslatePos);
     }
   }
 
-  {
-    // add more ports (ロボットモデルやEndEffectorの情報を使って)
-
-    // 各EndEffectorにつき、ref<name>WrenchInというInPortをつくる
-    this->ports_.m_refEEWrenchIn_.resize(this->gaitParam_.eeName.size());
-    this->ports_.m_refEEWrench_.resize(this->gaitParam_.eeName.size());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
-      std::string name = "ref"+this->gaitParam_.eeName[i]+"WrenchIn";
-      this->ports_.m_refEEWrenchIn_[i] = std::make_unique<RTC::InPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_refEEWrench_[i]);
-      this->addInPort(name.c_str(), *(this->ports_.m_refEEWrenchIn_[i]));
-    }
-
-    // 各ForceSensorにつき、act<name>InというInportをつくる
-    cnoid::DeviceList<cnoid::ForceSensor> forceSensors(this->gaitParam_.actRobotRaw->devices());
-    this->ports_.m_actWrenchIn_.resize(forceSensors.size());
-    this->ports_.m_actWrench_.resize(forceSensors.size());
-    for(int i=0;i<forceSensors.size();i++){
-      std::string name = "act"+forceSensors[i]->name()+"In";
-      this->ports_.m_actWrenchIn_[i] = std::make_unique<RTC::InPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_actWrench_[i]);
-      this->addInPort(name.c_str(), *(this->ports_.m_actWrenchIn_[i]));
-    }
-
-    // 各EndEffectorにつき、ref<name>PoseInというInPortをつくる
-    this->ports_.m_refEEPoseIn_.resize(this->gaitParam_.eeName.size());
-    this->ports_.m_refEEPose_.resize(this->gaitParam_.eeName.size());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
-      std::string name = "ref"+this->gaitParam_.eeName[i]+"PoseIn";
-      this->ports_.m_refEEPoseIn_[i] = std::make_unique<RTC::InPort<RTC::TimedPose3D> >(name.c_str(), this->ports_.m_refEEPose_[i]);
-      this->addInPort(name.c_str(), *(this->ports_.m_refEEPoseIn_[i]));
-    }
-
-    // 各EndEffectorにつき、act<name>PoseOutというOutPortをつくる
-    this->ports_.m_actEEPoseOut_.resize(this->gaitParam_.eeName.size());
-    this->ports_.m_actEEPose_.resize(this->gaitParam_.eeName.size());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
-      std::string name = "act"+this->gaitParam_.eeName[i]+"PoseOut";
-      this->ports_.m_actEEPoseOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedPose3D> >(name.c_str(), this->ports_.m_actEEPose_[i]);
-      this->addOutPort(name.c_str(), *(this->ports_.m_actEEPoseOut_[i]));
-    }
-
-    // 各EndEffectorにつき、tgt<name>WrenchOutというOutPortをつくる
-    this->ports_.m_tgtEEWrenchOut_.resize(this->gaitParam_.eeName.size());
-    this->ports_.m_tgtEEWrench_.resize(this->gaitParam_.eeName.size());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
-      std::string name = "tgt"+this->gaitParam_.eeName[i]+"WrenchOut";
-      this->ports_.m_tgtEEWrenchOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_tgtEEWrench_[i]);
-      this->addOutPort(name.c_str(), *(this->ports_.m_tgtEEWrenchOut_[i]));
-    }
-
-    // 各EndEffectorにつき、act<name>WrenchOutというOutPortをつくる
-    this->ports_.m_actEEWrenchOut_.resize(this->gaitParam_.eeName.size());
-    this->ports_.m_actEEWrench_.resize(this->gaitParam_.eeName.size());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
-      std::string name = "act"+this->gaitParam_.eeName[i]+"WrenchOut";
-      this->ports_.m_actEEWrenchOut_[i] = std::make_unique<RTC::OutPort<RTC::TimedDoubleSeq> >(name.c_str(), this->ports_.m_actEEWrench_[i]);
-      this->addOutPort(name.c_str(), *(this->ports_.m_actEEWrenchOut_[i]));
-    }
-
-  }
+  return true;
+}
 
+// static function
+void AutoStabilizer::initControllers(const GaitParam& gaitParam, ActToGenFrameConverter& actToGenFrameConverter, ImpedanceController& impedanceController, Stabilizer& stabilizer, FullbodyIKSolver& fullbodyIKSolver){
   {
     // init ActToGenFrameConverter
-    this->actToGenFrameConverter_.eeForceSensor.resize(this->gaitParam_.eeName.size());
-    cnoid::DeviceList<cnoid::ForceSensor> forceSensors(this->gaitParam_.refRobotRaw->devices());
-    for(int i=0;i<this->gaitParam_.eeName.size();i++){
+    actToGenFrameConverter.eeForceSensor.resize(gaitParam.eeName.size());
+    cnoid::DeviceList<cnoid::ForceSensor> forceSensors(gaitParam.refRobotRaw->devices());
+    for(int i=0;i<gaitParam.eeName.size();i++){
       // 各EndEffectorsから親リンク側に遡っていき、最初に見つかったForceSensorをEndEffectorに対応付ける. 以後、ForceSensorの値を座標変換したものがEndEffectorが受けている力とみなされる. 見つからなければ受けている力は常に0とみなされる
       std::string forceSensor = "";
-      cnoid::LinkPtr link = this->gaitParam_.refRobotRaw->link(this->gaitParam_.eeParentLink[i]);
+      cnoid::LinkPtr link = gaitParam.refRobotRaw->link(gaitParam.eeParentLink[i]);
       bool found = false;
       while (link != nullptr && found == false) {
         for (size_t j = 0; j < forceSensors.size(); j++) {
@@ -315,92 +537,277 @@ RTC::ReturnCode_t AutoStabilizer::onInitialize(){
           }
         }
       }
-      this->actToGenFrameConverter_.eeForceSensor[i] = forceSensor;
+      actToGenFrameConverter.eeForceSensor[i] = forceSensor;
     }
   }
 
   // init ImpedanceController
-  for(int i=0;i<this->gaitParam_.eeName.size();i++) this->impedanceController_.push_backEE();
+  for(int i=0;i<gaitParam.eeName.size();i++) impedanceController.push_backEE();
 
   // init Stabilizer
-  this->stabilizer_.init(this->gaitParam_, this->gaitParam_.actRobotTqc);
+  stabilizer.init(gaitParam, gaitParam.actRobotTqc);
 
   // init FullbodyIKSolver
-  this->fullbodyIKSolver_.init(this->gaitParam_.genRobot, this->gaitParam_);
+  fullbodyIKSolver.init(gaitParam.genRobot, gaitParam);
+}
 
-  // initialize parameters
-  this->loop_ = 0;
+void AutoStabilizer::InPortData::init(const GaitParam& gaitParam){
+  cnoid::DeviceList<cnoid::ForceSensor> forceSensors(gaitParam.actRobotRaw->devices());
+  this->refEEWrench.resize(gaitParam.eeName.size(), nullptr);
+  this->refEEPose.resize(gaitParam.eeName.size(), nullptr);
+  this->actWrench.resize(forceSensors.size(), nullptr);
+  this->actForceSensor.resize(forceSensors.size());
+  for(int i=0;i<forceSensors.size();i++) this->actForceSensor[i] = forceSensors[i];
+  this->actImuSensor = gaitParam.actRobotRaw->findDevice<cnoid::RateGyroSensor>("gyrometer");
+  if(this->actImuSensor) this->actImuPath = std::make_shared<cnoid::JointPath>(gaitParam.actRobotRaw->rootLink(), this->actImuSensor->link());
+  else this->actImuPath = nullptr;
+  this->selfCollisionLinkCache.clear();
+
+  // monitor_enumの順に追加する
+  this->monitor.clear();
+  this->monitor.addPort("qRef");
+  this->monitor.addPort("refTauIn");
+  this->monitor.addPort("refBasePosIn");
+  this->monitor.addPort("refBaseRpyIn");
+  this->monitor.addPort("qAct");
+  this->monitor.addPort("dqAct");
+  this->monitor.addPort("actImuIn");
+  this->monitor.addPort("selfCollisionIn");
+  this->monitor.addPort("steppableRegionIn", 2.0, InPortMonitor::CLEAR); // 2秒間届かなければ捨てる
+  this->monitor.addPort("landingHeightIn", 0.0, InPortMonitor::CLEAR);
+  for(int i=0;i<gaitParam.eeName.size();i++) this->monitor.addPort("ref"+gaitParam.eeName[i]+"WrenchIn");
+  for(int i=0;i<gaitParam.eeName.size();i++) this->monitor.addPort("ref"+gaitParam.eeName[i]+"PoseIn");
+  for(int i=0;i<forceSensors.size();i++) this->monitor.addPort("act"+forceSensors[i]->name()+"In");
+}
 
-  return RTC::RTC_OK;
+// static function
+bool AutoStabilizer::readInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::Ports& ports, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal, double& actDelay){
+  AutoStabilizer::InPortData& inPortData = ports.inPortData_;
+  inPortData.qRef = nullptr;
+  if(ports.m_qRefShm_.isOpened()){
+    if(AutoStabilizer::readJointShm(ports.m_qRefShm_, ports.m_qRef_)) inPortData.qRef = &ports.m_qRef_;
+  }else if(ports.m_qRefIn_.isNew()){
+    ports.m_qRefIn_.read();
+    inPortData.qRef = &ports.m_qRef_;
+  }
+  inPortData.tm = ports.m_qRef_.tm;
+  inPortData.refTau = nullptr;
+  if(ports.m_refTauShm_.isOpened()){
+    if(AutoStabilizer::readJointShm(ports.m_refTauShm_, ports.m_refTau_)) inPortData.refTau = &ports.m_refTau_;
+  }else if(ports.m_refTauIn_.isNew()){
+    ports.m_refTauIn_.read();
+    inPortData.refTau = &ports.m_refTau_;
+  }
+  inPortData.refBasePos = nullptr;
+  if(ports.m_refBasePosIn_.isNew()){
+    ports.m_refBasePosIn_.read();
+    inPortData.refBasePos = &ports.m_refBasePos_;
+  }
+  inPortData.refBaseRpy = nullptr;
+  if(ports.m_refBaseRpyIn_.isNew()){
+    ports.m_refBaseRpyIn_.read();
+    inPortData.refBaseRpy = &ports.m_refBaseRpy_;
+  }
+  for(int i=0;i<ports.m_refEEWrenchIn_.size();i++){
+    inPortData.refEEWrench[i] = nullptr;
+    if(ports.m_refEEWrenchIn_[i]->isNew()){
+      ports.m_refEEWrenchIn_[i]->read();
+      inPortData.refEEWrench[i] = &ports.m_refEEWrench_[i];
+    }
+  }
+  for(int i=0;i<ports.m_refEEPoseIn_.size();i++){
+    inPortData.refEEPose[i] = nullptr;
+    if(ports.m_refEEPoseIn_[i]->isNew()){
+      ports.m_refEEPoseIn_[i]->read();
+      inPortData.refEEPose[i] = &ports.m_refEEPose_[i];
+    }
+  }
+  inPortData.qAct = nullptr;
+  if(ports.m_qActShm_.isOpened()){
+    if(AutoStabilizer::readJointShm(ports.m_qActShm_, ports.m_qAct_)) inPortData.qAct = &ports.m_qAct_;
+  }else if(ports.m_qActIn_.isNew()){
+    ports.m_qActIn_.read();
+    inPortData.qAct = &ports.m_qAct_;
+  }
+  inPortData.dqAct = nullptr;
+  if(ports.m_dqActShm_.isOpened()){
+    if(AutoStabilizer::readJointShm(ports.m_dqActShm_, ports.m_dqAct_)) inPortData.dqAct = &ports.m_dqAct_;
+  }else if(ports.m_dqActIn_.isNew()){
+    ports.m_dqActIn_.read();
+    inPortData.dqAct = &ports.m_dqAct_;
+  }
+  inPortData.actImu = nullptr;
+  if(ports.m_actImuIn_.isNew()){
+    ports.m_actImuIn_.read();
+    inPortData.actImu = &ports.m_actImu_;
+  }
+  for(int i=0;i<ports.m_actWrenchIn_.size();i++){
+    inPortData.actWrench[i] = nullptr;
+    if(ports.m_actWrenchIn_[i]->isNew()){
+      ports.m_actWrenchIn_[i]->read();
+      inPortData.actWrench[i] = &ports.m_actWrench_[i];
+    }
+  }
+  inPortData.selfCollision = nullptr;
+  if(ports.m_selfCollisionIn_.isNew()){
+    ports.m_selfCollisionIn_.read();
+    inPortData.selfCollision = &ports.m_selfCollision_;
+  }
+  inPortData.steppableRegion = nullptr;
+  if(ports.m_steppableRegionIn_.isNew()){
+    ports.m_steppableRegionIn_.read();
+    inPortData.steppableRegion = &ports.m_steppableRegion_;
+  }
+  inPortData.landingHeight = nullptr;
+  if(ports.m_landingHeightIn_.isNew()){
+    ports.m_landingHeightIn_.read();
+    inPortData.landingHeight = &ports.m_landingHeight_;
+  }
+
+  return AutoStabilizer::applyInPortData(dt, gaitParam, mode, inPortData, refRobotRaw, actRobotRaw, refEEWrenchOrigin, refEEPoseRaw, selfCollision, steppableRegion, steppableHeight, relLandingHeight, relLandingNormal, actDelay);
 }
 
 // static function
-bool AutoStabilizer::readInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::Ports& ports, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal){
+bool AutoStabilizer::readJointShm(JointShmChannel& channel, RTC::TimedDoubleSeq& o_data){
+  if(o_data.data.length() != channel.numJoints()) o_data.data.length(channel.numJoints()); // 初回のみ確保する
+  int64_t sec, nsec;
+  if(!channel.read(sec, nsec, o_data.data.get_buffer())) return false;
+  o_data.tm.sec = sec;
+  o_data.tm.nsec = nsec;
+  return true;
+}
+
+// static function
+void AutoStabilizer::writeJointShm(JointShmChannel& channel, const RTC::TimedDoubleSeq& data){
+  if(data.data.length() != channel.numJoints()) return;
+  channel.write(data.tm.sec, data.tm.nsec, data.data.get_buffer());
+}
+
+// static function
+int AutoStabilizer::resolveLinkIndex(const cnoid::BodyPtr& robot, const char* name, std::pair<std::string, int>& cache){
+  if(cache.first.compare(name) != 0){ // link名が前回と異なる場合のみ探索する
+    cache.first = name;
+    cnoid::Link* link = robot->link(cache.first);
+    cache.second = link ? link->index() : -1;
+  }
+  return cache.second;
+}
+
+// static function
+void AutoStabilizer::updateInPortMonitor(AutoStabilizer::InPortData& inPortData){
+  // RTC::Timeはunsigned long型なので、doubleに変換してから引き算する
+  InPortMonitor& monitor = inPortData.monitor;
+  double now = inPortData.tm.sec + 1e-9 * inPortData.tm.nsec;
+  if(inPortData.qRef) monitor.arrive(InPortData::MONITOR_QREF, now, inPortData.qRef->tm.sec + 1e-9 * inPortData.qRef->tm.nsec);
+  if(inPortData.refTau) monitor.arrive(InPortData::MONITOR_REFTAU, now, inPortData.refTau->tm.sec + 1e-9 * inPortData.refTau->tm.nsec);
+  if(inPortData.refBasePos) monitor.arrive(InPortData::MONITOR_REFBASEPOS, now, inPortData.refBasePos->tm.sec + 1e-9 * inPortData.refBasePos->tm.nsec);
+  if(inPortData.refBaseRpy) monitor.arrive(InPortData::MONITOR_REFBASERPY, now, inPortData.refBaseRpy->tm.sec + 1e-9 * inPortData.refBaseRpy->tm.nsec);
+  if(inPortData.qAct) monitor.arrive(InPortData::MONITOR_QACT, now, inPortData.qAct->tm.sec + 1e-9 * inPortData.qAct->tm.nsec);
+  if(inPortData.dqAct) monitor.arrive(InPortData::MONITOR_DQACT, now, inPortData.dqAct->tm.sec + 1e-9 * inPortData.dqAct->tm.nsec);
+  if(inPortData.actImu) monitor.arrive(InPortData::MONITOR_ACTIMU, now, inPortData.actImu->tm.sec + 1e-9 * inPortData.actImu->tm.nsec);
+  if(inPortData.selfCollision) monitor.arrive(InPortData::MONITOR_SELFCOLLISION, now, inPortData.selfCollision->tm.sec + 1e-9 * inPortData.selfCollision->tm.nsec);
+  if(inPortData.steppableRegion) monitor.arrive(InPortData::MONITOR_STEPPABLEREGION, now, inPortData.steppableRegion->tm.sec + 1e-9 * inPortData.steppableRegion->tm.nsec);
+  if(inPortData.landingHeight) monitor.arrive(InPortData::MONITOR_LANDINGHEIGHT, now, inPortData.landingHeight->tm.sec + 1e-9 * inPortData.landingHeight->tm.nsec);
+  for(int i=0;i<inPortData.refEEWrench.size();i++){
+    if(inPortData.refEEWrench[i]) monitor.arrive(inPortData.refEEWrenchMonitorIdx(i), now, inPortData.refEEWrench[i]->tm.sec + 1e-9 * inPortData.refEEWrench[i]->tm.nsec);
+  }
+  for(int i=0;i<inPortData.refEEPose.size();i++){
+    if(inPortData.refEEPose[i]) monitor.arrive(inPortData.refEEPoseMonitorIdx(i), now, inPortData.refEEPose[i]->tm.sec + 1e-9 * inPortData.refEEPose[i]->tm.nsec);
+  }
+  for(int i=0;i<inPortData.actWrench.size();i++){
+    if(inPortData.actWrench[i]) monitor.arrive(inPortData.actWrenchMonitorIdx(i), now, inPortData.actWrench[i]->tm.sec + 1e-9 * inPortData.actWrench[i]->tm.nsec);
+  }
+  monitor.update(now);
+  for(int i=0;i<monitor.ports().size();i++){
+    if(monitor.ports()[i].isNewlyStale) std::cerr << "[InPortMonitor] " << monitor.ports()[i].name << " is stale. no data for " << monitor.ports()[i].staleThreshold << " [s]" << std::endl;
+  }
+}
+
+// static function
+bool AutoStabilizer::applyInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::InPortData& inPortData, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal, double& actDelay){
+  AutoStabilizer::updateInPortMonitor(inPortData);
+  if(inPortData.qAct || inPortData.actImu){
+    const std::vector<InPortMonitor::Port>& monitorPorts = inPortData.monitor.ports();
+    actDelay = 0.0;
+    if(monitorPorts[InPortData::MONITOR_QACT].count > 0) actDelay = std::max(actDelay, monitorPorts[InPortData::MONITOR_QACT].age);
+    if(monitorPorts[InPortData::MONITOR_ACTIMU].count > 0) actDelay = std::max(actDelay, monitorPorts[InPortData::MONITOR_ACTIMU].age);
+  }
+
+  // 届いたdataのみを処理する. refRobotRawはここでしか変更されないので、姿勢が変化したときのみFKを行う
   bool qRef_updated = false;
-  if(ports.m_qRefIn_.isNew()){
-    ports.m_qRefIn_.read();
-    if(ports.m_qRef_.data.length() == refRobotRaw->numJoints()){
-      for(int i=0;i<ports.m_qRef_.data.length();i++){
-        if(std::isfinite(ports.m_qRef_.data[i])) refRobotRaw->joint(i)->q() = ports.m_qRef_.data[i];
+  bool refRobotRaw_moved = false;
+  if(inPortData.qRef){
+    const RTC::TimedDoubleSeq& qRef = *inPortData.qRef;
+    if(qRef.data.length() == refRobotRaw->numJoints()){
+      bool isFinite = mathutil::isAllFinite(qRef.data.get_buffer(), qRef.data.length());
+      for(int i=0;i<qRef.data.length();i++){
+        if(isFinite || std::isfinite(qRef.data[i])) refRobotRaw->joint(i)->q() = qRef.data[i];
         else std::cerr << "m_qRef is not finite!" << std::endl;
       }
       qRef_updated = true;
+      refRobotRaw_moved = true;
     }
   }
-  if(ports.m_refTauIn_.isNew()){
-    ports.m_refTauIn_.read();
-    if(ports.m_refTau_.data.length() == refRobotRaw->numJoints()){
-      for(int i=0;i<ports.m_refTau_.data.length();i++){
-        if(std::isfinite(ports.m_refTau_.data[i])) refRobotRaw->joint(i)->u() = ports.m_refTau_.data[i];
+  if(inPortData.refTau){
+    const RTC::TimedDoubleSeq& refTau = *inPortData.refTau;
+    if(refTau.data.length() == refRobotRaw->numJoints()){
+      bool isFinite = mathutil::isAllFinite(refTau.data.get_buffer(), refTau.data.length());
+      for(int i=0;i<refTau.data.length();i++){
+        if(isFinite || std::isfinite(refTau.data[i])) refRobotRaw->joint(i)->u() = refTau.data[i];
         else std::cerr << "m_refTau is not finite!" << std::endl;
       }
     }
   }
-  if(ports.m_refBasePosIn_.isNew()){
-    ports.m_refBasePosIn_.read();
-    if(std::isfinite(ports.m_refBasePos_.data.x) && std::isfinite(ports.m_refBasePos_.data.y) && std::isfinite(ports.m_refBasePos_.data.z)){
-      refRobotRaw->rootLink()->p()[0] = ports.m_refBasePos_.data.x;
-      refRobotRaw->rootLink()->p()[1] = ports.m_refBasePos_.data.y;
-      refRobotRaw->rootLink()->p()[2] = ports.m_refBasePos_.data.z;
+  if(inPortData.refBasePos){
+    const RTC::TimedPoint3D& refBasePos = *inPortData.refBasePos;
+    if(std::isfinite(refBasePos.data.x) && std::isfinite(refBasePos.data.y) && std::isfinite(refBasePos.data.z)){
+      refRobotRaw->rootLink()->p()[0] = refBasePos.data.x;
+      refRobotRaw->rootLink()->p()[1] = refBasePos.data.y;
+      refRobotRaw->rootLink()->p()[2] = refBasePos.data.z;
+      refRobotRaw_moved = true;
     } else {
       std::cerr << "m_refBasePos is not finite!" << std::endl;
     }
   }
-  if(ports.m_refBaseRpyIn_.isNew()){
-    ports.m_refBaseRpyIn_.read();
-    if(std::isfinite(ports.m_refBaseRpy_.data.r) && std::isfinite(ports.m_refBaseRpy_.data.p) && std::isfinite(ports.m_refBaseRpy_.data.y)){
-      refRobotRaw->rootLink()->R() = cnoid::rotFromRpy(ports.m_refBaseRpy_.data.r, ports.m_refBaseRpy_.data.p, ports.m_refBaseRpy_.data.y);
+  if(inPortData.refBaseRpy){
+    const RTC::TimedOrientation3D& refBaseRpy = *inPortData.refBaseRpy;
+    if(std::isfinite(refBaseRpy.data.r) && std::isfinite(refBaseRpy.data.p) && std::isfinite(refBaseRpy.data.y)){
+      refRobotRaw->rootLink()->R() = cnoid::rotFromRpy(refBaseRpy.data.r, refBaseRpy.data.p, refBaseRpy.data.y);
+      refRobotRaw_moved = true;
     } else {
       std::cerr << "m_refBaseRpy is not finite!" << std::endl;
     }
   }
-  refRobotRaw->calcForwardKinematics();
-  refRobotRaw->calcCenterOfMass();
+  if(refRobotRaw_moved){
+    refRobotRaw->calcForwardKinematics();
+    refRobotRaw->calcCenterOfMass();
+  }
 
-  for(int i=0;i<ports.m_refEEWrenchIn_.size();i++){
-    if(ports.m_refEEWrenchIn_[i]->isNew()){
-      ports.m_refEEWrenchIn_[i]->read();
-      if(ports.m_refEEWrench_[i].data.length() == 6){
+  for(int i=0;i<inPortData.refEEWrench.size();i++){
+    if(inPortData.refEEWrench[i]){
+      const RTC::TimedDoubleSeq& refEEWrench = *inPortData.refEEWrench[i];
+      if(refEEWrench.data.length() == 6){
+        bool isFinite = mathutil::isAllFinite(refEEWrench.data.get_buffer(), 6);
         for(int j=0;j<6;j++){
-          if(std::isfinite(ports.m_refEEWrench_[i].data[j])) refEEWrenchOrigin[i][j] = ports.m_refEEWrench_[i].data[j];
+          if(isFinite || std::isfinite(refEEWrench.data[j])) refEEWrenchOrigin[i][j] = refEEWrench.data[j];
           else std::cerr << "m_refEEWrench is not finite!" << std::endl;
         }
       }
     }
   }
 
-  for(int i=0;i<ports.m_refEEPoseIn_.size();i++){
-    if(ports.m_refEEPoseIn_[i]->isNew()){
-      ports.m_refEEPoseIn_[i]->read();
-      if(std::isfinite(ports.m_refEEPose_[i].data.position.x) && std::isfinite(ports.m_refEEPose_[i].data.position.y) && std::isfinite(ports.m_refEEPose_[i].data.position.z) &&
-         std::isfinite(ports.m_refEEPose_[i].data.orientation.r) && std::isfinite(ports.m_refEEPose_[i].data.orientation.p) && std::isfinite(ports.m_refEEPose_[i].data.orientation.y)){
+  for(int i=0;i<inPortData.refEEPose.size();i++){
+    if(inPortData.refEEPose[i]){
+      const RTC::TimedPose3D& refEEPose = *inPortData.refEEPose[i];
+      if(std::isfinite(refEEPose.data.position.x) && std::isfinite(refEEPose.data.position.y) && std::isfinite(refEEPose.data.position.z) &&
+         std::isfinite(refEEPose.data.orientation.r) && std::isfinite(refEEPose.data.orientation.p) && std::isfinite(refEEPose.data.orientation.y)){
         cnoid::Position pose;
-        pose.translation()[0] = ports.m_refEEPose_[i].data.position.x;
-        pose.translation()[1] = ports.m_refEEPose_[i].data.position.y;
-        pose.translation()[2] = ports.m_refEEPose_[i].data.position.z;
-        pose.linear() = cnoid::rotFromRpy(ports.m_refEEPose_[i].data.orientation.r, ports.m_refEEPose_[i].data.orientation.p, ports.m_refEEPose_[i].data.orientation.y);
+        pose.translation()[0] = refEEPose.data.position.x;
+        pose.translation()[1] = refEEPose.data.position.y;
+        pose.translation()[2] = refEEPose.data.position.z;
+        pose.linear() = cnoid::rotFromRpy(refEEPose.data.orientation.r, refEEPose.data.orientation.p, refEEPose.data.orientation.y);
         refEEPoseRaw[i].setGoal(pose, 0.3); // 0.3秒で補間
-        ports.refEEPoseLastUpdateTime_ = ports.m_qRef_.tm;
+        inPortData.refEEPoseLastUpdateTime = inPortData.tm;
       } else {
         std::cerr << "m_refEEPose is not finite!" << std::endl;
       }
@@ -408,81 +815,86 @@ bool AutoStabilizer::readInPortData(const double& dt, const GaitParam& gaitParam
     refEEPoseRaw[i].interpolate(dt);
   }
 
-  if(ports.m_qActIn_.isNew()){
-    ports.m_qActIn_.read();
-    if(ports.m_qAct_.data.length() == actRobotRaw->numJoints()){
-      for(int i=0;i<ports.m_qAct_.data.length();i++){
-        if(std::isfinite(ports.m_qAct_.data[i])) actRobotRaw->joint(i)->q() = ports.m_qAct_.data[i];
+  // actRobotRawはActToGenFrameConverterがrootLinkと関節角度をactRobotにコピーしてからFKを行うので、ここではFKも重心の計算も行わない. IMUの姿勢の計算には、gyrometerのlinkまでのFKのみを行う
+  if(inPortData.qAct){
+    const RTC::TimedDoubleSeq& qAct = *inPortData.qAct;
+    if(qAct.data.length() == actRobotRaw->numJoints()){
+      bool isFinite = mathutil::isAllFinite(qAct.data.get_buffer(), qAct.data.length());
+      for(int i=0;i<qAct.data.length();i++){
+        if(isFinite || std::isfinite(qAct.data[i])) actRobotRaw->joint(i)->q() = qAct.data[i];
         else std::cerr << "m_qAct is not finite!" << std::endl;
       }
     }
   }
-  if(ports.m_dqActIn_.isNew()){
-    ports.m_dqActIn_.read();
-
-    if(ports.m_dqAct_.data.length() == actRobotRaw->numJoints()){
-      for(int i=0;i<ports.m_dqAct_.data.length();i++){
-        if(std::isfinite(ports.m_dqAct_.data[i])) actRobotRaw->joint(i)->dq() = ports.m_dqAct_.data[i];
+  if(inPortData.dqAct){
+    const RTC::TimedDoubleSeq& dqAct = *inPortData.dqAct;
+    if(dqAct.data.length() == actRobotRaw->numJoints()){
+      bool isFinite = mathutil::isAllFinite(dqAct.data.get_buffer(), dqAct.data.length());
+      for(int i=0;i<dqAct.data.length();i++){
+        if(isFinite || std::isfinite(dqAct.data[i])) actRobotRaw->joint(i)->dq() = dqAct.data[i];
         else  std::cerr << "m_dqAct is not finite!" << std::endl;
       }
     }
   }
-  if(ports.m_actImuIn_.isNew()){
-    ports.m_actImuIn_.read();
-    if(std::isfinite(ports.m_actImu_.data.r) && std::isfinite(ports.m_actImu_.data.p) && std::isfinite(ports.m_actImu_.data.y)){
-      actRobotRaw->calcForwardKinematics();
-      cnoid::RateGyroSensorPtr imu = actRobotRaw->findDevice<cnoid::RateGyroSensor>("gyrometer");
+  if(inPortData.actImu){
+    const RTC::TimedOrientation3D& actImu = *inPortData.actImu;
+    if(!inPortData.actImuSensor){
+      std::cerr << "gyrometer is not found!" << std::endl;
+    }else if(std::isfinite(actImu.data.r) && std::isfinite(actImu.data.p) && std::isfinite(actImu.data.y)){
+      inPortData.actImuPath->calcForwardKinematics();
+      const cnoid::RateGyroSensorPtr& imu = inPortData.actImuSensor;
       cnoid::Matrix3 imuR = imu->link()->R() * imu->R_local();
-      cnoid::Matrix3 actR = cnoid::rotFromRpy(ports.m_actImu_.data.r, ports.m_actImu_.data.p, ports.m_actImu_.data.y);
+      cnoid::Matrix3 actR = cnoid::rotFromRpy(actImu.data.r, actImu.data.p, actImu.data.y);
       actRobotRaw->rootLink()->R() = Eigen::Matrix3d(Eigen::AngleAxisd(actR) * Eigen::AngleAxisd(imuR.transpose() * actRobotRaw->rootLink()->R())); // 単純に3x3行列の空間でRを積算していると、だんだん数値誤差によって回転行列でなくなってしまう恐れがあるので念の為
     }else{
       std::cerr << "m_actImu is not finite!" << std::endl;
     }
   }
-  actRobotRaw->calcForwardKinematics();
-  actRobotRaw->calcCenterOfMass();
 
-  cnoid::DeviceList<cnoid::ForceSensor> forceSensors(actRobotRaw->devices());
-  for(int i=0;i<ports.m_actWrenchIn_.size();i++){
-    if(ports.m_actWrenchIn_[i]->isNew()){
-      ports.m_actWrenchIn_[i]->read();
-      if(ports.m_actWrench_[i].data.length() == 6){
+  for(int i=0;i<inPortData.actWrench.size();i++){
+    if(inPortData.actWrench[i]){
+      const RTC::TimedDoubleSeq& actWrench = *inPortData.actWrench[i];
+      if(actWrench.data.length() == 6){
+        bool isFinite = mathutil::isAllFinite(actWrench.data.get_buffer(), 6);
         for(int j=0;j<6;j++){
-          if(std::isfinite(ports.m_actWrench_[i].data[j])) forceSensors[i]->F()[j] = ports.m_actWrench_[i].data[j];
+          if(isFinite || std::isfinite(actWrench.data[j])) inPortData.actForceSensor[i]->F()[j] = actWrench.data[j];
           else std::cerr << "m_actWrench is not finite!" << std::endl;
         }
       }
     }
   }
 
-  if(ports.m_selfCollisionIn_.isNew()) {
-    ports.m_selfCollisionIn_.read();
-    selfCollision.resize(ports.m_selfCollision_.data.length());
+  if(inPortData.selfCollision) {
+    const collision_checker_msgs::TimedCollisionSeq& selfCollisionIn = *inPortData.selfCollision;
+    selfCollision.resize(selfCollisionIn.data.length());
+    if(inPortData.selfCollisionLinkCache.size() < 2 * selfCollision.size()) inPortData.selfCollisionLinkCache.resize(2 * selfCollision.size(), std::pair<std::string, int>("", -1));
     for (int i=0; i<selfCollision.size(); i++){
-      if(refRobotRaw->link(std::string(ports.m_selfCollision_.data[i].link1)) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point1.x) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point1.y) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point1.z) &&
-         refRobotRaw->link(std::string(ports.m_selfCollision_.data[i].link2)) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point2.x) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point2.y) &&
-         std::isfinite(ports.m_selfCollision_.data[i].point2.z) &&
-         std::isfinite(ports.m_selfCollision_.data[i].direction21.x) &&
-         std::isfinite(ports.m_selfCollision_.data[i].direction21.y) &&
-         std::isfinite(ports.m_selfCollision_.data[i].direction21.z) &&
-         std::isfinite(ports.m_selfCollision_.data[i].distance)){
-        selfCollision[i].link1 = ports.m_selfCollision_.data[i].link1;
-        selfCollision[i].point1[0] = ports.m_selfCollision_.data[i].point1.x;
-        selfCollision[i].point1[1] = ports.m_selfCollision_.data[i].point1.y;
-        selfCollision[i].point1[2] = ports.m_selfCollision_.data[i].point1.z;
-        selfCollision[i].link2 = ports.m_selfCollision_.data[i].link2;
-        selfCollision[i].point2[0] = ports.m_selfCollision_.data[i].point2.x;
-        selfCollision[i].point2[1] = ports.m_selfCollision_.data[i].point2.y;
-        selfCollision[i].point2[2] = ports.m_selfCollision_.data[i].point2.z;
-        selfCollision[i].direction21[0] = ports.m_selfCollision_.data[i].direction21.x;
-        selfCollision[i].direction21[1] = ports.m_selfCollision_.data[i].direction21.y;
-        selfCollision[i].direction21[2] = ports.m_selfCollision_.data[i].direction21.z;
-        selfCollision[i].distance = ports.m_selfCollision_.data[i].distance;
+      int link1 = AutoStabilizer::resolveLinkIndex(refRobotRaw, selfCollisionIn.data[i].link1, inPortData.selfCollisionLinkCache[2*i]);
+      int link2 = AutoStabilizer::resolveLinkIndex(refRobotRaw, selfCollisionIn.data[i].link2, inPortData.selfCollisionLinkCache[2*i+1]);
+      if(link1 >= 0 &&
+         std::isfinite(selfCollisionIn.data[i].point1.x) &&
+         std::isfinite(selfCollisionIn.data[i].point1.y) &&
+         std::isfinite(selfCollisionIn.data[i].point1.z) &&
+         link2 >= 0 &&
+         std::isfinite(selfCollisionIn.data[i].point2.x) &&
+         std::isfinite(selfCollisionIn.data[i].point2.y) &&
+         std::isfinite(selfCollisionIn.data[i].point2.z) &&
+         std::isfinite(selfCollisionIn.data[i].direction21.x) &&
+         std::isfinite(selfCollisionIn.data[i].direction21.y) &&
+         std::isfinite(selfCollisionIn.data[i].direction21.z) &&
+         std::isfinite(selfCollisionIn.data[i].distance)){
+        selfCollision[i].link1 = link1;
+        selfCollision[i].point1[0] = selfCollisionIn.data[i].point1.x;
+        selfCollision[i].point1[1] = selfCollisionIn.data[i].point1.y;
+        selfCollision[i].point1[2] = selfCollisionIn.data[i].point1.z;
+        selfCollision[i].link2 = link2;
+        selfCollision[i].point2[0] = selfCollisionIn.data[i].point2.x;
+        selfCollision[i].point2[1] = selfCollisionIn.data[i].point2.y;
+        selfCollision[i].point2[2] = selfCollisionIn.data[i].point2.z;
+        selfCollision[i].direction21[0] = selfCollisionIn.data[i].direction21.x;
+        selfCollision[i].direction21[1] = selfCollisionIn.data[i].direction21.y;
+        selfCollision[i].direction21[2] = selfCollisionIn.data[i].direction21.z;
+        selfCollision[i].distance = selfCollisionIn.data[i].distance;
       }else{
         std::cerr << "m_selfCollision is not finite or has unknown link name!" << std::endl;
         selfCollision.resize(0);
@@ -491,59 +903,61 @@ bool AutoStabilizer::readInPortData(const double& dt, const GaitParam& gaitParam
     }
   }
 
-  if(ports.m_steppableRegionIn_.isNew()){
-    ports.m_steppableRegionIn_.read();
+  if(inPortData.steppableRegion){
+    const auto_stabilizer_msgs::TimedSteppableRegion& steppableRegionIn = *inPortData.steppableRegion;
     //steppableRegionを送るのは片足支持期のみ
     if (mode.isABCRunning() && // ABC起動中でないと現在支持脚という概念が無い
-        ((gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && (ports.m_steppableRegion_.data.l_r == auto_stabilizer_msgs::RLEG)) ||
-         (gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && (ports.m_steppableRegion_.data.l_r == auto_stabilizer_msgs::LLEG))) //現在支持脚と計算時支持脚が同じ
+        ((gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && (steppableRegionIn.data.l_r == auto_stabilizer_msgs::RLEG)) ||
+         (gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && (steppableRegionIn.data.l_r == auto_stabilizer_msgs::LLEG))) //現在支持脚と計算時支持脚が同じ
         ){
       int swingLeg = gaitParam.footstepNodesList[0].isSupportPhase[RLEG] ? LLEG : RLEG;
       int supportLeg = (swingLeg == RLEG) ? LLEG : RLEG;
       cnoid::Position supportPose = gaitParam.genCoords[supportLeg].value(); // TODO. 支持脚のgenCoordsとdstCoordsが異なることは想定していない
       cnoid::Position supportPoseHorizontal = mathutil::orientCoordToAxis(supportPose, cnoid::Vector3::UnitZ());
-      steppableRegion.resize(ports.m_steppableRegion_.data.region.length());
-      steppableHeight.resize(ports.m_steppableRegion_.data.region.length());
+      steppableRegion.resize(steppableRegionIn.data.region.length());
+      steppableHeight.resize(steppableRegionIn.data.region.length());
+      std::vector<cnoid::Vector3>& vertices = inPortData.steppableRegionVertices;
       for (int i=0; i<steppableRegion.size(); i++){
         double heightSum = 0.0;
-        std::vector<cnoid::Vector3> vertices;
-        for (int j=0; j<ports.m_steppableRegion_.data.region[i].length()/3; j++){
-          if(!std::isfinite(ports.m_steppableRegion_.data.region[i][3*j]) || !std::isfinite(ports.m_steppableRegion_.data.region[i][3*j+1]) || !std::isfinite(ports.m_steppableRegion_.data.region[i][3*j+2])){
+        vertices.clear();
+        for (int j=0; j<steppableRegionIn.data.region[i].length()/3; j++){
+          if(!std::isfinite(steppableRegionIn.data.region[i][3*j]) || !std::isfinite(steppableRegionIn.data.region[i][3*j+1]) || !std::isfinite(steppableRegionIn.data.region[i][3*j+2])){
             std::cerr << "m_steppableRegion is not finite!" << std::endl;
             vertices.clear();
             break;
           }
-          cnoid::Vector3 p = supportPoseHorizontal * cnoid::Vector3(ports.m_steppableRegion_.data.region[i][3*j],ports.m_steppableRegion_.data.region[i][3*j+1],ports.m_steppableRegion_.data.region[i][3*j+2]);
+          cnoid::Vector3 p = supportPoseHorizontal * cnoid::Vector3(steppableRegionIn.data.region[i][3*j],steppableRegionIn.data.region[i][3*j+1],steppableRegionIn.data.region[i][3*j+2]);
           heightSum += p[2];
           p[2] = 0.0;
           vertices.push_back(p);
         }
-        double heightAverage = (ports.m_steppableRegion_.data.region[i].length()/3>0) ? heightSum / (ports.m_steppableRegion_.data.region[i].length()/3) : 0;
+        double heightAverage = (steppableRegionIn.data.region[i].length()/3>0) ? heightSum / (steppableRegionIn.data.region[i].length()/3) : 0;
         steppableRegion[i] = mathutil::calcConvexHull(vertices);
         steppableHeight[i] = heightAverage;
       }
-      ports.steppableRegionLastUpdateTime_ = ports.m_qRef_.tm;
+      inPortData.steppableRegionLastUpdateTime = inPortData.tm;
     }
-  }else{ //ports.m_steppableRegionIn_.isNew()
-    if(std::abs(((long long)ports.steppableRegionLastUpdateTime_.sec - (long long)ports.m_qRef_.tm.sec) + 1e-9 * ((long long)ports.steppableRegionLastUpdateTime_.nsec - (long long)ports.m_qRef_.tm.nsec)) > 2.0){ // 2秒間steppableRegionが届いていない.  RTC::Timeはunsigned long型なので、符号付きの型に変換してから引き算
+  }else{ //inPortData.steppableRegion
+    if(std::abs(((long long)inPortData.steppableRegionLastUpdateTime.sec - (long long)inPortData.tm.sec) + 1e-9 * ((long long)inPortData.steppableRegionLastUpdateTime.nsec - (long long)inPortData.tm.nsec)) > 2.0 || // 2秒間支持脚が一致するsteppableRegionが届いていない. RTC::Timeはunsigned long型なので、符号付きの型に変換してから引き算
+       (inPortData.monitor.isStale(InPortData::MONITOR_STEPPABLEREGION) && inPortData.monitor.ports()[InPortData::MONITOR_STEPPABLEREGION].fallback == InPortMonitor::CLEAR)){ // inport_stale_thresholdの間steppableRegionが届いていない
       steppableRegion.clear();
       steppableHeight.clear();
     }
   }
 
-  if(ports.m_landingHeightIn_.isNew()) {
-    ports.m_landingHeightIn_.read();
-    if(std::isfinite(ports.m_landingHeight_.data.x) && std::isfinite(ports.m_landingHeight_.data.y) && std::isfinite(ports.m_landingHeight_.data.z) && std::isfinite(ports.m_landingHeight_.data.nx) && std::isfinite(ports.m_landingHeight_.data.ny) && std::isfinite(ports.m_landingHeight_.data.nz)){
-      cnoid::Vector3 normal = cnoid::Vector3(ports.m_landingHeight_.data.nx, ports.m_landingHeight_.data.ny, ports.m_landingHeight_.data.nz);
+  if(inPortData.landingHeight) {
+    const auto_stabilizer_msgs::TimedLandingPosition& landingHeight = *inPortData.landingHeight;
+    if(std::isfinite(landingHeight.data.x) && std::isfinite(landingHeight.data.y) && std::isfinite(landingHeight.data.z) && std::isfinite(landingHeight.data.nx) && std::isfinite(landingHeight.data.ny) && std::isfinite(landingHeight.data.nz)){
+      cnoid::Vector3 normal = cnoid::Vector3(landingHeight.data.nx, landingHeight.data.ny, landingHeight.data.nz);
       if(normal.norm() > 1.0 - 1e-2 && normal.norm() < 1.0 + 1e-2){ // ノルムがほぼ1
         if(mode.isABCRunning()){ // ABC起動中でないと現在支持脚という概念が無い
-          if(ports.m_landingHeight_.data.l_r == auto_stabilizer_msgs::RLEG && gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[LLEG]) { //現在支持脚と計算時支持脚が同じ
+          if(landingHeight.data.l_r == auto_stabilizer_msgs::RLEG && gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[LLEG]) { //現在支持脚と計算時支持脚が同じ
             cnoid::Position supportPoseHorizontal = mathutil::orientCoordToAxis(gaitParam.genCoords[RLEG].value(), cnoid::Vector3::UnitZ());
-            relLandingHeight = supportPoseHorizontal.translation()[2] + ports.m_landingHeight_.data.z;
+            relLandingHeight = supportPoseHorizontal.translation()[2] + landingHeight.data.z;
             relLandingNormal = supportPoseHorizontal.linear() * normal.normalized();
-          }else if(ports.m_landingHeight_.data.l_r == auto_stabilizer_msgs::LLEG && gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[RLEG]) { //現在支持脚と計算時支持脚が同じ
+          }else if(landingHeight.data.l_r == auto_stabilizer_msgs::LLEG && gaitParam.footstepNodesList[0].isSupportPhase[LLEG] && !gaitParam.footstepNodesList[0].isSupportPhase[RLEG]) { //現在支持脚と計算時支持脚が同じ
             cnoid::Position supportPoseHorizontal = mathutil::orientCoordToAxis(gaitParam.genCoords[LLEG].value(), cnoid::Vector3::UnitZ());
-            relLandingHeight = supportPoseHorizontal.translation()[2] + ports.m_landingHeight_.data.z;
+            relLandingHeight = supportPoseHorizontal.translation()[2] + landingHeight.data.z;
             relLandingNormal = supportPoseHorizontal.linear() * normal.normalized();
           }
         }
@@ -553,13 +967,54 @@ bool AutoStabilizer::readInPortData(const double& dt, const GaitParam& gaitParam
     }else{
       std::cerr << "m_landingHeight is not finite!" << std::endl;
     }
+  }else if(inPortData.monitor.ports()[InPortData::MONITOR_LANDINGHEIGHT].isNewlyStale){ // staleThresholdの間landingHeightが届いていない. 計画通りの着地位置に戻す
+    relLandingHeight = -1e15;
+    relLandingNormal = cnoid::Vector3::UnitZ();
   }
 
   return qRef_updated;
 }
 
+// static function
+void AutoStabilizer::updateControllers(AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, RefToGenFrameConverter& refToGenFrameConverter, ActToGenFrameConverter& actToGenFrameConverter, ExternalForceHandler& externalForceHandler, FootStepGenerator& footStepGenerator, ImpedanceController& impedanceController, FullbodyIKSolver& fullbodyIKSolver){
+  AutoStabilizer::updatePlanningControllers(mode, gaitParam, dt, refToGenFrameConverter, actToGenFrameConverter, externalForceHandler, footStepGenerator, impedanceController);
+  AutoStabilizer::updateExecutionControllers(mode, dt, fullbodyIKSolver);
+}
+
 // static function
 bool AutoStabilizer::execAutoStabilizer(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const FootStepGenerator& footStepGenerator, const LegCoordsGenerator& legCoordsGenerator, const RefToGenFrameConverter& refToGenFrameConverter, const ActToGenFrameConverter& actToGenFrameConverter, const ImpedanceController& impedanceController, const Stabilizer& stabilizer, const ExternalForceHandler& externalForceHandler, const FullbodyIKSolver& fullbodyIKSolver,const LegManualController& legManualController, const CmdVelGenerator& cmdVelGenerator) {
+  AutoStabilizer::execPlanningStage(mode, gaitParam, dt, footStepGenerator, legCoordsGenerator, refToGenFrameConverter, actToGenFrameConverter, impedanceController, stabilizer, externalForceHandler, legManualController, cmdVelGenerator);
+  AutoStabilizer::execExecutionStage(mode, gaitParam, dt, stabilizer, fullbodyIKSolver);
+  return true;
+}
+
+// static function
+void AutoStabilizer::updatePlanningControllers(AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, RefToGenFrameConverter& refToGenFrameConverter, ActToGenFrameConverter& actToGenFrameConverter, ExternalForceHandler& externalForceHandler, FootStepGenerator& footStepGenerator, ImpedanceController& impedanceController){
+  mode.update(dt);
+  gaitParam.update(dt);
+  refToGenFrameConverter.update(dt);
+
+  if(mode.isABCRunning() && mode.isSyncToABCInit()){ // startAutoBalancer直後の初回. 内部パラメータのリセット
+    gaitParam.reset();
+    refToGenFrameConverter.reset();
+    actToGenFrameConverter.reset();
+    externalForceHandler.reset();
+    footStepGenerator.reset();
+    impedanceController.reset();
+  }
+}
+
+// static function
+void AutoStabilizer::updateExecutionControllers(const AutoStabilizer::ControlMode& mode, double dt, FullbodyIKSolver& fullbodyIKSolver){
+  fullbodyIKSolver.update(dt);
+
+  if(mode.isABCRunning() && mode.isSyncToABCInit()){ // startAutoBalancer直後の初回. 内部パラメータのリセット
+    fullbodyIKSolver.reset();
+  }
+}
+
+// static function
+void AutoStabilizer::execPlanningStage(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const FootStepGenerator& footStepGenerator, const LegCoordsGenerator& legCoordsGenerator, const RefToGenFrameConverter& refToGenFrameConverter, const ActToGenFrameConverter& actToGenFrameConverter, const ImpedanceController& impedanceController, const Stabilizer& stabilizer, const ExternalForceHandler& externalForceHandler, const LegManualController& legManualController, const CmdVelGenerator& cmdVelGenerator) {
   if(mode.isSyncToABCInit()){ // startAutoBalancer直後の初回. gaitParamのリセット
     refToGenFrameConverter.initGenRobot(gaitParam,
                                         gaitParam.genRobot, gaitParam.footMidCoords, gaitParam.genCogVel, gaitParam.genCogAcc);
@@ -584,9 +1039,13 @@ bool AutoStabilizer::execAutoStabilizer(const AutoStabilizer::ControlMode& mode,
                                       gaitParam.actRobot, gaitParam.actEEPose, gaitParam.actEEWrench, gaitParam.actCogVel);
 
   // 目標外力に応じてオフセットを計算する
-  externalForceHandler.handleExternalForce(gaitParam, mode.isSTRunning(), dt,
+  externalForceHandler.handleExternalForce(gaitParam, mode.isSTRunning(), dt, gaitParam.isPlanningCycle(),
                                            gaitParam.omega, gaitParam.l, gaitParam.sbpOffset, gaitParam.actCog);
 
+  // センサと指令の遅延の分だけactualの重心位置・速度を先に進める
+  actToGenFrameConverter.predictActState(gaitParam,
+                                         gaitParam.predActCog, gaitParam.predActCogVel);
+
   // Impedance Controller
   impedanceController.calcImpedanceControl(dt, gaitParam,
                                            gaitParam.icEEOffset, gaitParam.icEETargetPose);
@@ -602,18 +1061,22 @@ bool AutoStabilizer::execAutoStabilizer(const AutoStabilizer::ControlMode& mode,
   // AutoBalancer
   footStepGenerator.procFootStepNodesList(gaitParam, dt, mode.isSTRunning(),
                                           gaitParam.footstepNodesList, gaitParam.srcCoords, gaitParam.dstCoordsOrg, gaitParam.remainTimeOrg, gaitParam.swingState, gaitParam.elapsedTime, gaitParam.prevSupportPhase, gaitParam.relLandingHeight);
-  footStepGenerator.calcFootSteps(gaitParam, dt, mode.isSTRunning(),
+  footStepGenerator.calcFootSteps(gaitParam, dt, mode.isSTRunning(), gaitParam.isPlanningCycle(), // 着地位置修正等の計画系の処理はplanningDecimation周期に1回のみ行う. emergency stepの判断は毎周期行う
                                   gaitParam.debugData, //for log
-                                  gaitParam.footstepNodesList);
-  legCoordsGenerator.calcLegCoords(gaitParam, dt, mode.isSTRunning(),
-                                   gaitParam.refZmpTraj, gaitParam.genCoords, gaitParam.swingState);
+                                  gaitParam.footstepNodesList, gaitParam.isFootStepNodesListModified);
+  legCoordsGenerator.calcLegCoords(gaitParam, dt, mode.isSTRunning(), gaitParam.isPlanningCycle(),
+                                   gaitParam.refZmpTraj, gaitParam.refZmpTrajPreview, gaitParam.genCoords, gaitParam.swingState);
+  gaitParam.isFootStepNodesListModified = false; // calcLegCoordsでrefZmpTrajに反映済み
   legCoordsGenerator.calcCOMCoords(gaitParam, dt,
                                    gaitParam.genCog, gaitParam.genCogVel, gaitParam.genCogAcc);
   for(int i=0;i<gaitParam.eeName.size();i++){
     if(i<NUM_LEGS) gaitParam.abcEETargetPose[i] = gaitParam.genCoords[i].value();
     else gaitParam.abcEETargetPose[i] = gaitParam.icEETargetPose[i];
   }
+}
 
+// static function
+void AutoStabilizer::execExecutionStage(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const Stabilizer& stabilizer, const FullbodyIKSolver& fullbodyIKSolver) {
   // Stabilizer
   if(mode.isSyncToStopSTInit()){ // stopST直後の初回
     gaitParam.stOffsetRootRpy.setGoal(cnoid::Vector3::Zero(),mode.remainTime());
@@ -627,13 +1090,71 @@ bool AutoStabilizer::execAutoStabilizer(const AutoStabilizer::ControlMode& mode,
 
   // FullbodyIKSolver
   fullbodyIKSolver.solveFullbodyIK(dt, gaitParam,// input
+                                   gaitParam.debugData, //for log
                                    gaitParam.genRobot); // output
+}
 
-  return true;
+// static function
+void AutoStabilizer::copyGaitParamForPipeline(const GaitParam& gaitParam, bool isFullCopy, GaitParam& o_pipelineGaitParam){
+  // robotはo_pipelineGaitParam側のcloneを差し替えずに、状態のみコピーする. 後段はrefRobotRaw, actRobotRawを参照しないので、それらの状態はコピーしない
+  if(isFullCopy){
+    // パラメータ等の毎周期は変わらないものや、後段の状態(st*, genRobot)も含めて全てコピーする. 逐次実行する周期(startAutoBalancer直後の初回等)とsetAutoStabilizerParamの後に行う
+    cnoid::BodyPtr refRobotRaw = o_pipelineGaitParam.refRobotRaw;
+    cnoid::BodyPtr actRobotRaw = o_pipelineGaitParam.actRobotRaw;
+    cnoid::BodyPtr refRobot = o_pipelineGaitParam.refRobot;
+    cnoid::BodyPtr actRobot = o_pipelineGaitParam.actRobot;
+    cnoid::BodyPtr actRobotTqc = o_pipelineGaitParam.actRobotTqc;
+    cnoid::BodyPtr genRobot = o_pipelineGaitParam.genRobot;
+    o_pipelineGaitParam = gaitParam; // 要素数が変わらなければstd::vectorは確保済みの領域を再利用する
+    o_pipelineGaitParam.refRobotRaw = refRobotRaw;
+    o_pipelineGaitParam.actRobotRaw = actRobotRaw;
+    o_pipelineGaitParam.refRobot = refRobot;
+    o_pipelineGaitParam.actRobot = actRobot;
+    o_pipelineGaitParam.actRobotTqc = actRobotTqc; // actRobotTqcは後段のみが書き換えるので、状態もコピーしない
+    o_pipelineGaitParam.genRobot = genRobot;
+    cnoidbodyutil::copyRobotLinkStates(gaitParam.genRobot, o_pipelineGaitParam.genRobot); // startAutoBalancer直後の初回は前段がgenRobotを初期化する
+  }else{
+    // 前段やInPortが毎周期書き換え、後段(Stabilizer::execStabilizer, FullbodyIKSolver::solveFullbodyIK)が読むもののみ. 後段が読むものを増やしたらここにも加えること
+    o_pipelineGaitParam.selfCollision = gaitParam.selfCollision;
+    o_pipelineGaitParam.copOffset = gaitParam.copOffset;
+    o_pipelineGaitParam.isManualControlMode = gaitParam.isManualControlMode;
+    o_pipelineGaitParam.refEEWrench = gaitParam.refEEWrench;
+    o_pipelineGaitParam.footMidCoords = gaitParam.footMidCoords;
+    o_pipelineGaitParam.actCog = gaitParam.actCog;
+    o_pipelineGaitParam.actEEPose = gaitParam.actEEPose;
+    o_pipelineGaitParam.predActCog = gaitParam.predActCog;
+    o_pipelineGaitParam.predActCogVel = gaitParam.predActCogVel;
+    o_pipelineGaitParam.omega = gaitParam.omega;
+    o_pipelineGaitParam.l = gaitParam.l;
+    o_pipelineGaitParam.sbpOffset = gaitParam.sbpOffset;
+    o_pipelineGaitParam.footstepNodesList = gaitParam.footstepNodesList;
+    o_pipelineGaitParam.swingState = gaitParam.swingState;
+    o_pipelineGaitParam.genCog = gaitParam.genCog;
+    o_pipelineGaitParam.genCogVel = gaitParam.genCogVel;
+    o_pipelineGaitParam.refZmpTraj = gaitParam.refZmpTraj;
+    o_pipelineGaitParam.refZmpTrajPreview = gaitParam.refZmpTrajPreview;
+    o_pipelineGaitParam.abcEETargetPose = gaitParam.abcEETargetPose;
+  }
+  cnoidbodyutil::copyRobotLinkStates(gaitParam.refRobot, o_pipelineGaitParam.refRobot);
+  cnoidbodyutil::copyRobotLinkStates(gaitParam.actRobot, o_pipelineGaitParam.actRobot);
 }
 
 // static function
-bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoStabilizer::ControlMode& mode, cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, double dt, const GaitParam& gaitParam){
+void AutoStabilizer::mergePipelineOutput(const GaitParam& pipelineGaitParam, GaitParam& o_gaitParam){
+  // execExecutionStageが書き込むもの. robotはo_gaitParam側のcloneに状態のみコピーする. actRobotTqcは出力に使うトルクのみ
+  cnoidbodyutil::copyRobotLinkStates(pipelineGaitParam.genRobot, o_gaitParam.genRobot);
+  for(int i=0;i<o_gaitParam.actRobotTqc->numJoints();i++) o_gaitParam.actRobotTqc->joint(i)->u() = pipelineGaitParam.actRobotTqc->joint(i)->u();
+  o_gaitParam.stOffsetRootRpy = pipelineGaitParam.stOffsetRootRpy;
+  o_gaitParam.stTargetRootPose = pipelineGaitParam.stTargetRootPose;
+  o_gaitParam.stTargetZmp = pipelineGaitParam.stTargetZmp;
+  o_gaitParam.stEETargetWrench = pipelineGaitParam.stEETargetWrench;
+  o_gaitParam.stServoPGainPercentage = pipelineGaitParam.stServoPGainPercentage;
+  o_gaitParam.stServoDGainPercentage = pipelineGaitParam.stServoDGainPercentage;
+  o_gaitParam.debugData.ikStat = pipelineGaitParam.debugData.ikStat;
+}
+
+// static function
+void AutoStabilizer::updateIdleToAbcTransition(const AutoStabilizer::ControlMode& mode, double dt, cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator){
   if(mode.isSyncToABC()){
     if(mode.isSyncToABCInit()){
       idleToAbcTransitionInterpolator.reset(0.0);
@@ -647,28 +1168,47 @@ bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoSt
     idleToAbcTransitionInterpolator.setGoal(0.0,mode.remainTime());
     idleToAbcTransitionInterpolator.interpolate(dt);
   }
+}
+
+// static function
+double AutoStabilizer::calcOutputJointAngle(const AutoStabilizer::ControlMode& mode, const cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, const GaitParam& gaitParam, int i){
+  if(mode.now() == AutoStabilizer::ControlMode::MODE_IDLE || !gaitParam.jointControllable[i]){
+    return gaitParam.refRobotRaw->joint(i)->q();
+  }else if(mode.isSyncToABC() || mode.isSyncToIdle()){
+    double ratio = idleToAbcTransitionInterpolator.value();
+    return gaitParam.refRobotRaw->joint(i)->q() * (1.0 - ratio) + gaitParam.genRobot->joint(i)->q() * ratio;
+  }else{
+    return gaitParam.genRobot->joint(i)->q();
+  }
+}
+
+// static function
+double AutoStabilizer::calcOutputJointTorque(const AutoStabilizer::ControlMode& mode, const cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, const GaitParam& gaitParam, int i){
+  if(mode.now() == AutoStabilizer::ControlMode::MODE_IDLE || !gaitParam.jointControllable[i]){
+    return gaitParam.refRobotRaw->joint(i)->u();
+  }else if(mode.isSyncToABC() || mode.isSyncToIdle()){
+    double ratio = idleToAbcTransitionInterpolator.value();
+    return gaitParam.refRobotRaw->joint(i)->u() * (1.0 - ratio) + gaitParam.actRobotTqc->joint(i)->u() * ratio;
+  }else{
+    return gaitParam.actRobotTqc->joint(i)->u();
+  }
+}
+
+// static function
+bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoStabilizer::ControlMode& mode, cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, double dt, const GaitParam& gaitParam){
+  AutoStabilizer::updateIdleToAbcTransition(mode, dt, idleToAbcTransitionInterpolator);
 
   {
     // q
     ports.m_q_.tm = ports.m_qRef_.tm;
     ports.m_q_.data.length(gaitParam.genRobot->numJoints());
     for(int i=0;i<gaitParam.genRobot->numJoints();i++){
-      if(mode.now() == AutoStabilizer::ControlMode::MODE_IDLE || !gaitParam.jointControllable[i]){
-        double value = gaitParam.refRobotRaw->joint(i)->q();
-        if(std::isfinite(value)) ports.m_q_.data[i] = value;
-        else std::cerr << "m_q is not finite!" << std::endl;
-      }else if(mode.isSyncToABC() || mode.isSyncToIdle()){
-        double ratio = idleToAbcTransitionInterpolator.value();
-        double value = gaitParam.refRobotRaw->joint(i)->q() * (1.0 - ratio) + gaitParam.genRobot->joint(i)->q() * ratio;
-        if(std::isfinite(value)) ports.m_q_.data[i] = value;
-        else std::cerr << "m_q is not finite!" << std::endl;
-      }else{
-        double value = gaitParam.genRobot->joint(i)->q();
-        if(std::isfinite(value)) ports.m_q_.data[i] = value;
-        else std::cerr << "m_q is not finite!" << std::endl;
-      }
+      double value = AutoStabilizer::calcOutputJointAngle(mode, idleToAbcTransitionInterpolator, gaitParam, i);
+      if(std::isfinite(value)) ports.m_q_.data[i] = value;
+      else std::cerr << "m_q is not finite!" << std::endl;
     }
     ports.m_qOut_.write();
+    if(ports.m_qShm_.isOpened()) AutoStabilizer::writeJointShm(ports.m_qShm_, ports.m_q_);
   }
 
   {
@@ -676,22 +1216,12 @@ bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoSt
     ports.m_genTau_.tm = ports.m_qRef_.tm;
     ports.m_genTau_.data.length(gaitParam.actRobotTqc->numJoints());
     for(int i=0;i<gaitParam.actRobotTqc->numJoints();i++){
-      if(mode.now() == AutoStabilizer::ControlMode::MODE_IDLE || !gaitParam.jointControllable[i]){
-        double value = gaitParam.refRobotRaw->joint(i)->u();
-        if(std::isfinite(value)) ports.m_genTau_.data[i] = value;
-        else std::cerr << "m_genTau is not finite!" << std::endl;
-      }else if(mode.isSyncToABC() || mode.isSyncToIdle()){
-        double ratio = idleToAbcTransitionInterpolator.value();
-        double value = gaitParam.refRobotRaw->joint(i)->u() * (1.0 - ratio) + gaitParam.actRobotTqc->joint(i)->u() * ratio;
-        if(std::isfinite(value)) ports.m_genTau_.data[i] = value;
-        else std::cerr << "m_genTau is not finite!" << std::endl;
-      }else{
-        double value = gaitParam.actRobotTqc->joint(i)->u();
-        if(std::isfinite(value)) ports.m_genTau_.data[i] = value;
-        else std::cerr << "m_genTau is not finite!" << std::endl;
-      }
+      double value = AutoStabilizer::calcOutputJointTorque(mode, idleToAbcTransitionInterpolator, gaitParam, i);
+      if(std::isfinite(value)) ports.m_genTau_.data[i] = value;
+      else std::cerr << "m_genTau is not finite!" << std::endl;
     }
     ports.m_genTauOut_.write();
+    if(ports.m_genTauShm_.isOpened()) AutoStabilizer::writeJointShm(ports.m_genTauShm_, ports.m_genTau_);
   }
 
   {
@@ -838,62 +1368,83 @@ bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoSt
   }
 
   // only for logger. (IDLE時の出力や、モード遷移時の連続性はてきとうで良い)
+  //   書き込まないportはデータも作らない
   if(mode.isABCRunning()){
-    ports.m_genCog_.tm = ports.m_qRef_.tm;
-    ports.m_genCog_.data.x = gaitParam.genCog[0];
-    ports.m_genCog_.data.y = gaitParam.genCog[1];
-    ports.m_genCog_.data.z = gaitParam.genCog[2];
-    ports.m_genCogOut_.write();
-    cnoid::Vector3 genDcm = gaitParam.genCog + gaitParam.genCogVel / gaitParam.omega;
-    ports.m_genDcm_.tm = ports.m_qRef_.tm;
-    ports.m_genDcm_.data.x = genDcm[0];
-    ports.m_genDcm_.data.y = genDcm[1];
-    ports.m_genDcm_.data.z = genDcm[2];
-    ports.m_genDcmOut_.write();
-    ports.m_genZmp_.tm = ports.m_qRef_.tm;
-    ports.m_genZmp_.data.x = gaitParam.refZmpTraj[0].getStart()[0];
-    ports.m_genZmp_.data.y = gaitParam.refZmpTraj[0].getStart()[1];
-    ports.m_genZmp_.data.z = gaitParam.refZmpTraj[0].getStart()[2];
-    ports.m_genZmpOut_.write();
-    ports.m_tgtZmp_.tm = ports.m_qRef_.tm;
-    ports.m_tgtZmp_.data.x = gaitParam.stTargetZmp[0];
-    ports.m_tgtZmp_.data.y = gaitParam.stTargetZmp[1];
-    ports.m_tgtZmp_.data.z = gaitParam.stTargetZmp[2];
-    ports.m_tgtZmpOut_.write();
-    ports.m_actCog_.tm = ports.m_qRef_.tm;
-    ports.m_actCog_.data.x = gaitParam.actCog[0];
-    ports.m_actCog_.data.y = gaitParam.actCog[1];
-    ports.m_actCog_.data.z = gaitParam.actCog[2];
-    ports.m_actCogOut_.write();
-    cnoid::Vector3 actDcm = gaitParam.actCog + gaitParam.actCogVel.value() / gaitParam.omega;
-    ports.m_actDcm_.tm = ports.m_qRef_.tm;
-    ports.m_actDcm_.data.x = actDcm[0];
-    ports.m_actDcm_.data.y = actDcm[1];
-    ports.m_actDcm_.data.z = actDcm[2];
-    ports.m_actDcmOut_.write();
-    ports.m_dstLandingPos_.tm = ports.m_qRef_.tm;
-    ports.m_dstLandingPos_.data.length(6);
-    ports.m_dstLandingPos_.data[0] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[0];
-    ports.m_dstLandingPos_.data[1] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[1];
-    ports.m_dstLandingPos_.data[2] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[2];
-    ports.m_dstLandingPos_.data[3] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[0];
-    ports.m_dstLandingPos_.data[4] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[1];
-    ports.m_dstLandingPos_.data[5] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[2];
-    ports.m_dstLandingPosOut_.write();
-    ports.m_remainTime_.tm = ports.m_qRef_.tm;
-    ports.m_remainTime_.data.length(1);
-    ports.m_remainTime_.data[0] = gaitParam.footstepNodesList[0].remainTime;
-    ports.m_remainTimeOut_.write();
-    ports.m_genCoords_.tm = ports.m_qRef_.tm;
-    ports.m_genCoords_.data.length(12);
-    for (int i=0; i<3; i++) {
-      ports.m_genCoords_.data[0+i] = gaitParam.genCoords[RLEG].value().translation()[i];
-      ports.m_genCoords_.data[3+i] = gaitParam.genCoords[LLEG].value().translation()[i];
-      ports.m_genCoords_.data[6+i] = gaitParam.genCoords[RLEG].getGoal().translation()[i];
-      ports.m_genCoords_.data[9+i] = gaitParam.genCoords[LLEG].getGoal().translation()[i];
-    }
-    ports.m_genCoordsOut_.write();
-    {
+    ports.updateLogPorts();
+    const std::vector<AutoStabilizer::Ports::LogPort>& logPorts = ports.logPorts_;
+    if(logPorts[AutoStabilizer::Ports::GEN_COG_LOG].isActive){
+      ports.m_genCog_.tm = ports.m_qRef_.tm;
+      ports.m_genCog_.data.x = gaitParam.genCog[0];
+      ports.m_genCog_.data.y = gaitParam.genCog[1];
+      ports.m_genCog_.data.z = gaitParam.genCog[2];
+      ports.m_genCogOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::GEN_DCM_LOG].isActive){
+      cnoid::Vector3 genDcm = gaitParam.genCog + gaitParam.genCogVel / gaitParam.omega;
+      ports.m_genDcm_.tm = ports.m_qRef_.tm;
+      ports.m_genDcm_.data.x = genDcm[0];
+      ports.m_genDcm_.data.y = genDcm[1];
+      ports.m_genDcm_.data.z = genDcm[2];
+      ports.m_genDcmOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::GEN_ZMP_LOG].isActive){
+      ports.m_genZmp_.tm = ports.m_qRef_.tm;
+      ports.m_genZmp_.data.x = gaitParam.refZmpTraj[0].getStart()[0];
+      ports.m_genZmp_.data.y = gaitParam.refZmpTraj[0].getStart()[1];
+      ports.m_genZmp_.data.z = gaitParam.refZmpTraj[0].getStart()[2];
+      ports.m_genZmpOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::TGT_ZMP_LOG].isActive){
+      ports.m_tgtZmp_.tm = ports.m_qRef_.tm;
+      ports.m_tgtZmp_.data.x = gaitParam.stTargetZmp[0];
+      ports.m_tgtZmp_.data.y = gaitParam.stTargetZmp[1];
+      ports.m_tgtZmp_.data.z = gaitParam.stTargetZmp[2];
+      ports.m_tgtZmpOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::ACT_COG_LOG].isActive){
+      ports.m_actCog_.tm = ports.m_qRef_.tm;
+      ports.m_actCog_.data.x = gaitParam.actCog[0];
+      ports.m_actCog_.data.y = gaitParam.actCog[1];
+      ports.m_actCog_.data.z = gaitParam.actCog[2];
+      ports.m_actCogOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::ACT_DCM_LOG].isActive){
+      cnoid::Vector3 actDcm = gaitParam.actCog + gaitParam.actCogVel.value() / gaitParam.omega;
+      ports.m_actDcm_.tm = ports.m_qRef_.tm;
+      ports.m_actDcm_.data.x = actDcm[0];
+      ports.m_actDcm_.data.y = actDcm[1];
+      ports.m_actDcm_.data.z = actDcm[2];
+      ports.m_actDcmOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::DST_LANDING_POS_LOG].isActive){
+      ports.m_dstLandingPos_.tm = ports.m_qRef_.tm;
+      ports.m_dstLandingPos_.data.length(6);
+      ports.m_dstLandingPos_.data[0] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[0];
+      ports.m_dstLandingPos_.data[1] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[1];
+      ports.m_dstLandingPos_.data[2] = gaitParam.footstepNodesList[0].dstCoords[RLEG].translation()[2];
+      ports.m_dstLandingPos_.data[3] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[0];
+      ports.m_dstLandingPos_.data[4] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[1];
+      ports.m_dstLandingPos_.data[5] = gaitParam.footstepNodesList[0].dstCoords[LLEG].translation()[2];
+      ports.m_dstLandingPosOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::REMAIN_TIME_LOG].isActive){
+      ports.m_remainTime_.tm = ports.m_qRef_.tm;
+      ports.m_remainTime_.data.length(1);
+      ports.m_remainTime_.data[0] = gaitParam.footstepNodesList[0].remainTime;
+      ports.m_remainTimeOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::GEN_COORDS_LOG].isActive){
+      ports.m_genCoords_.tm = ports.m_qRef_.tm;
+      ports.m_genCoords_.data.length(12);
+      for (int i=0; i<3; i++) {
+        ports.m_genCoords_.data[0+i] = gaitParam.genCoords[RLEG].value().translation()[i];
+        ports.m_genCoords_.data[3+i] = gaitParam.genCoords[LLEG].value().translation()[i];
+        ports.m_genCoords_.data[6+i] = gaitParam.genCoords[RLEG].getGoal().translation()[i];
+        ports.m_genCoords_.data[9+i] = gaitParam.genCoords[LLEG].getGoal().translation()[i];
+      }
+      ports.m_genCoordsOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::CAPTURE_REGION_LOG].isActive){
       ports.m_captureRegion_.tm = ports.m_qRef_.tm;
       int sum = 0;
       for (int i=0; i<gaitParam.debugData.capturableHulls.size(); i++) sum+=gaitParam.debugData.capturableHulls[i].size();
@@ -908,13 +1459,11 @@ bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoSt
       }
       ports.m_captureRegionOut_.write();
     }
-    {
+    if(logPorts[AutoStabilizer::Ports::STEPPABLE_REGION_LOG].isActive){
       ports.m_steppableRegionLog_.tm = ports.m_qRef_.tm;
-      ports.m_steppableRegionNumLog_.tm = ports.m_qRef_.tm;
       int sum = 0;
       for (int i=0; i<gaitParam.steppableRegion.size(); i++) sum+=gaitParam.steppableRegion[i].size();
       ports.m_steppableRegionLog_.data.length(sum*2);
-      ports.m_steppableRegionNumLog_.data.length(gaitParam.steppableRegion.size());
       int index=0;
       for (int i=0; i<gaitParam.steppableRegion.size(); i++) {
         for (int j=0; j<gaitParam.steppableRegion[i].size(); j++) {
@@ -922,25 +1471,52 @@ bool AutoStabilizer::writeOutPortData(AutoStabilizer::Ports& ports, const AutoSt
           ports.m_steppableRegionLog_.data[index+1] = gaitParam.steppableRegion[i][j][1];
           index+=2;
         }
-        ports.m_steppableRegionNumLog_.data[i] = gaitParam.steppableRegion[i].size();
       }
       ports.m_steppableRegionLogOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::STEPPABLE_REGION_NUM_LOG].isActive){
+      ports.m_steppableRegionNumLog_.tm = ports.m_qRef_.tm;
+      ports.m_steppableRegionNumLog_.data.length(gaitParam.steppableRegion.size());
+      for (int i=0; i<gaitParam.steppableRegion.size(); i++) {
+        ports.m_steppableRegionNumLog_.data[i] = gaitParam.steppableRegion[i].size();
+      }
       ports.m_steppableRegionNumLogOut_.write();
     }
-    ports.m_strideLimitationHull_.tm = ports.m_qRef_.tm;
-    ports.m_strideLimitationHull_.data.length(gaitParam.debugData.strideLimitationHull.size()*2);
-    for (int i=0; i<gaitParam.debugData.strideLimitationHull.size(); i++) {
-      ports.m_strideLimitationHull_.data[i*2+0] = gaitParam.debugData.strideLimitationHull[i][0];
-      ports.m_strideLimitationHull_.data[i*2+1] = gaitParam.debugData.strideLimitationHull[i][1];
+    if(logPorts[AutoStabilizer::Ports::STRIDE_LIMITATION_HULL_LOG].isActive){
+      ports.m_strideLimitationHull_.tm = ports.m_qRef_.tm;
+      ports.m_strideLimitationHull_.data.length(gaitParam.debugData.strideLimitationHull.size()*2);
+      for (int i=0; i<gaitParam.debugData.strideLimitationHull.size(); i++) {
+        ports.m_strideLimitationHull_.data[i*2+0] = gaitParam.debugData.strideLimitationHull[i][0];
+        ports.m_strideLimitationHull_.data[i*2+1] = gaitParam.debugData.strideLimitationHull[i][1];
+      }
+      ports.m_strideLimitationHullOut_.write();
     }
-    ports.m_strideLimitationHullOut_.write();
-    ports.m_cpViewerLog_.tm = ports.m_qRef_.tm;
-    ports.m_cpViewerLog_.data.length(gaitParam.debugData.cpViewerLog.size());
-    for (int i=0; i<gaitParam.debugData.cpViewerLog.size(); i++) {
-      ports.m_cpViewerLog_.data[i] = gaitParam.debugData.cpViewerLog[i];
+    if(logPorts[AutoStabilizer::Ports::CP_VIEWER_LOG].isActive){
+      ports.m_cpViewerLog_.tm = ports.m_qRef_.tm;
+      ports.m_cpViewerLog_.data.length(gaitParam.debugData.cpViewerLog.size());
+      for (int i=0; i<gaitParam.debugData.cpViewerLog.size(); i++) {
+        ports.m_cpViewerLog_.data[i] = gaitParam.debugData.cpViewerLog[i];
+      }
+      ports.m_cpViewerLogOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::IK_STAT_LOG].isActive){
+      ports.m_ikStat_.tm = ports.m_qRef_.tm;
+      ports.m_ikStat_.data.length(gaitParam.debugData.ikStat.size());
+      for (int i=0; i<gaitParam.debugData.ikStat.size(); i++) {
+        ports.m_ikStat_.data[i] = gaitParam.debugData.ikStat[i];
+      }
+      ports.m_ikStatOut_.write();
+    }
+    if(logPorts[AutoStabilizer::Ports::PERF_STAT_LOG].isActive){
+      ports.m_perfStat_.tm = ports.m_qRef_.tm;
+      ports.m_perfStat_.data.length(gaitParam.debugData.perfStat.size());
+      for (int i=0; i<gaitParam.debugData.perfStat.size(); i++) {
+        ports.m_perfStat_.data[i] = gaitParam.debugData.perfStat[i];
+      }
+      ports.m_perfStatOut_.write();
     }
-    ports.m_cpViewerLogOut_.write();
     for(int i=0;i<gaitParam.eeName.size();i++){
+      if(!logPorts[AutoStabilizer::Ports::TGT_EE_WRENCH_LOG+i].isActive) continue;
       ports.m_tgtEEWrench_[i].tm = ports.m_qRef_.tm;
       ports.m_tgtEEWrench_[i].data.length(6);
       for(int j=0;j<6;j++) ports.m_tgtEEWrench_[i].data[j] = gaitParam.stEETargetWrench[i][j];
@@ -957,28 +1533,70 @@ RTC::ReturnCode_t AutoStabilizer::onExecute(RTC::UniqueId ec_id){
   std::string instance_name = std::string(this->m_profile.instance_name);
   this->loop_++;
 
-  if(!AutoStabilizer::readInPortData(this->dt_, this->gaitParam_, this->mode_, this->ports_, this->gaitParam_.refRobotRaw, this->gaitParam_.actRobotRaw, this->gaitParam_.refEEWrenchOrigin, this->gaitParam_.refEEPoseRaw, this->gaitParam_.selfCollision, this->gaitParam_.steppableRegion, this->gaitParam_.steppableHeight, this->gaitParam_.relLandingHeight, this->gaitParam_.relLandingNormal)) return RTC::RTC_OK;  // qRef が届かなければ何もしない
-
-  this->mode_.update(this->dt_);
-  this->gaitParam_.update(this->dt_);
-  this->refToGenFrameConverter_.update(this->dt_);
-  this->fullbodyIKSolver_.update(this->dt_);
-
-  if(this->mode_.isABCRunning()) {
-    if(this->mode_.isSyncToABCInit()){ // startAutoBalancer直後の初回. 内部パラメータのリセット
-      this->gaitParam_.reset();
-      this->refToGenFrameConverter_.reset();
-      this->actToGenFrameConverter_.reset();
-      this->externalForceHandler_.reset();
-      this->footStepGenerator_.reset();
-      this->impedanceController_.reset();
-      this->fullbodyIKSolver_.reset();
+  if(!this->isRtThreadConfigured_){ // activate後の初回. ExecutionContextのスレッドに対して設定する
+    if((this->rtCpus_.size() > 0 || this->rtPriority_ > 0) && !this->isRtThreadSettingSaved_ && realtimeutil::getThreadSetting(pthread_self(), this->rtThreadOrgSetting_)){ // 元に戻せない場合は変更しない
+      this->rtThread_ = pthread_self();
+      this->isRtThreadSettingSaved_ = true;
+      realtimeutil::setThreadAffinity(this->rtThread_, this->rtCpus_);
+      realtimeutil::setThreadPriority(this->rtThread_, this->rtPriority_);
+    }
+    if(this->rtLockMemory_) realtimeutil::prefaultStack(this->rtPrefaultStackSize_);
+    this->isRtThreadConfigured_ = true;
+  }
+  long minorPageFaults = 0, majorPageFaults = 0;
+  if(this->perfCounter_) realtimeutil::getPageFaults(minorPageFaults, majorPageFaults);
+
+  if(!AutoStabilizer::readInPortData(this->dt_, this->gaitParam_, this->mode_, this->ports_, this->gaitParam_.refRobotRaw, this->gaitParam_.actRobotRaw, this->gaitParam_.refEEWrenchOrigin, this->gaitParam_.refEEPoseRaw, this->gaitParam_.selfCollision, this->gaitParam_.steppableRegion, this->gaitParam_.steppableHeight, this->gaitParam_.relLandingHeight, this->gaitParam_.relLandingNormal, this->gaitParam_.actDelay)) return RTC::RTC_OK;  // qRef が届かなければ何もしない
+
+  AutoStabilizer::updatePlanningControllers(this->mode_, this->gaitParam_, this->dt_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->externalForceHandler_, this->footStepGenerator_, this->impedanceController_);
+
+  if(this->pipelineWorker_ && this->mode_.isABCRunning() && !this->mode_.isSyncToABCInit() && !this->mode_.isSyncToStopSTInit()){
+    // 前の周期の後段と並行に今周期の前段を行い、今周期の後段をpipelineWorker_に渡す. 出力するのは前の周期の後段の結果
+    if(this->perfCounter_) this->perfCounter_->begin();
+    AutoStabilizer::execPlanningStage(this->mode_, this->gaitParam_, this->dt_, this->footStepGenerator_, this->legCoordsGenerator_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_, this->externalForceHandler_, this->legManualController_, this->cmdVelGenerator_);
+    if(this->perfCounter_) this->perfCounter_->end(this->gaitParam_.debugData.perfStat); // 前段のみ
+    this->finishPipeline();
+    AutoStabilizer::copyGaitParamForPipeline(this->gaitParam_, !this->isPipelineGaitParamSynced_, this->pipelineGaitParam_);
+    this->isPipelineGaitParamSynced_ = true;
+    this->pipelineMode_ = this->mode_;
+    this->pipelineWorker_->submit(this->pipelineTask_);
+    this->isPipelineBusy_ = true;
+  }else if(this->pipelineWorker_ && this->mode_.isABCRunning()){
+    // 後段のrobotはpipelineGaitParam_が持っているので、逐次実行する周期もpipelineGaitParam_で後段を行う. ワーカーは待機中なので呼び出しスレッドで実行する
+    this->finishPipeline();
+    if(this->perfCounter_) this->perfCounter_->begin();
+    AutoStabilizer::execPlanningStage(this->mode_, this->gaitParam_, this->dt_, this->footStepGenerator_, this->legCoordsGenerator_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_, this->externalForceHandler_, this->legManualController_, this->cmdVelGenerator_);
+    AutoStabilizer::copyGaitParamForPipeline(this->gaitParam_, true, this->pipelineGaitParam_);
+    this->isPipelineGaitParamSynced_ = true;
+    this->pipelineMode_ = this->mode_;
+    this->pipelineTask_();
+    AutoStabilizer::mergePipelineOutput(this->pipelineGaitParam_, this->gaitParam_);
+    if(this->perfCounter_) this->perfCounter_->end(this->gaitParam_.debugData.perfStat);
+  }else{
+    this->finishPipeline();
+    AutoStabilizer::updateExecutionControllers(this->mode_, this->dt_, this->fullbodyIKSolver_);
+    if(this->mode_.isABCRunning()) {
+      if(this->perfCounter_) this->perfCounter_->begin();
+      AutoStabilizer::execPlanningStage(this->mode_, this->gaitParam_, this->dt_, this->footStepGenerator_, this->legCoordsGenerator_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_, this->externalForceHandler_, this->legManualController_, this->cmdVelGenerator_);
+      AutoStabilizer::execExecutionStage(this->mode_, this->gaitParam_, this->dt_, this->stabilizer_, this->fullbodyIKSolver_);
+      if(this->perfCounter_) this->perfCounter_->end(this->gaitParam_.debugData.perfStat);
     }
-    AutoStabilizer::execAutoStabilizer(this->mode_, this->gaitParam_, this->dt_, this->footStepGenerator_, this->legCoordsGenerator_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_,this->externalForceHandler_, this->fullbodyIKSolver_, this->legManualController_, this->cmdVelGenerator_);
   }
 
+  if(this->perfCounter_){
+    long minor, major;
+    realtimeutil::getPageFaults(minor, major);
+    this->gaitParam_.debugData.perfStat[PerfCounter::NUM_COUNTERS] = minor - minorPageFaults;
+    this->gaitParam_.debugData.perfStat[PerfCounter::NUM_COUNTERS+1] = major - majorPageFaults;
+  }
+  this->gaitParam_.debugData.perfStat[PerfCounter::NUM_COUNTERS+2] = this->gaitParam_.debugData.footstepNodesListOverflowCount;
+
   AutoStabilizer::writeOutPortData(this->ports_, this->mode_, this->idleToAbcTransitionInterpolator_, this->dt_, this->gaitParam_);
 
+  if(this->telemetryRecorder_ && this->mode_.isABCRunning()) this->telemetryRecorder_->record(this->ports_.m_qRef_.tm.sec, this->ports_.m_qRef_.tm.nsec, this->gaitParam_);
+
+  this->publishFootStepState();
+
   return RTC::RTC_OK;
 }
 
@@ -987,21 +1605,38 @@ RTC::ReturnCode_t AutoStabilizer::onActivated(RTC::UniqueId ec_id){
   std::cerr << "[" << m_profile.instance_name << "] "<< "onActivated(" << ec_id << ")" << std::endl;
   this->mode_.reset();
   this->idleToAbcTransitionInterpolator_.reset(0.0);
+  if(this->rtLockMemory_ && !this->isMemoryLocked_) this->isMemoryLocked_ = realtimeutil::lockMemory();
+  if(this->rtMallocTuning_ && !this->isMallocTuned_){
+    realtimeutil::tuneMalloc(this->rtPrefaultHeapSize_);
+    this->isMallocTuned_ = true;
+  }
+  this->isRtThreadConfigured_ = false; // onActivatedがExecutionContextのスレッドから呼ばれるとは限らないので、スレッドの設定は初回のonExecuteで行う
   return RTC::RTC_OK;
 }
 RTC::ReturnCode_t AutoStabilizer::onDeactivated(RTC::UniqueId ec_id){
   std::lock_guard<std::mutex> guard(this->mutex_);
   std::cerr << "[" << m_profile.instance_name << "] "<< "onDeactivated(" << ec_id << ")" << std::endl;
+  if(this->isRtThreadSettingSaved_){ // ExecutionContextのスレッドを、同じExecutionContextの他のRTCのために元の設定に戻す
+    realtimeutil::setThreadSetting(this->rtThread_, this->rtThreadOrgSetting_);
+    this->isRtThreadSettingSaved_ = false;
+  }
+  return RTC::RTC_OK;
+}
+RTC::ReturnCode_t AutoStabilizer::onFinalize(){
+  if(this->pipelineWorker_) this->pipelineWorker_->stop();
   return RTC::RTC_OK;
 }
-RTC::ReturnCode_t AutoStabilizer::onFinalize(){ return RTC::RTC_OK; }
 
 bool AutoStabilizer::goPos(const double& x, const double& y, const double& th){
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // gaitParam_を最新の状態にしてから変更・公開する
   if(this->mode_.isABCRunning()){
     if(std::isfinite(x) && std::isfinite(y) && std::isfinite(th)){
-      return this->footStepGenerator_.goPos(this->gaitParam_, x, y, th,
-                                            this->gaitParam_.footstepNodesList);
+      bool ret = this->footStepGenerator_.goPos(this->gaitParam_, x, y, th,
+                                                this->gaitParam_.footstepNodesList);
+      this->gaitParam_.isFootStepNodesListModified = true; // 次の周期に計画系の処理を行わなくてもrefZmpTrajを作り直す
+      this->publishFootStepState(); // goPos直後のwaitFootStepsが静止状態と判定しないように
+      return ret;
     }else{
       std::cerr << "goPos is not finite!" << std::endl;
       return false;
@@ -1029,12 +1664,15 @@ bool AutoStabilizer::goVelocity(const double& vx, const double& vy, const double
 }
 bool AutoStabilizer::goStop(){
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // gaitParam_を最新の状態にしてから変更・公開する
   if(this->mode_.isABCRunning() && this->footStepGenerator_.isGoVelocityMode){ // this->footStepGenerator_.isGoVelocityMode時のみ行う. goStopが呼ばれて、staticになる前にgoStopが再度呼ばれることが繰り返されると、止まらないので
     this->cmdVelGenerator_.refCmdVel.setZero();
     this->footStepGenerator_.isGoVelocityMode = false;
-    this->footStepGenerator_.goStop(this->gaitParam_,
-                                    this->gaitParam_.footstepNodesList);
-    return true;
+    bool ret = this->footStepGenerator_.goStop(this->gaitParam_,
+                                               this->gaitParam_.footstepNodesList);
+    this->gaitParam_.isFootStepNodesListModified = true; // 次の周期に計画系の処理を行わなくてもrefZmpTrajを作り直す
+    this->publishFootStepState();
+    return ret;
   }else{
     return false;
   }
@@ -1057,6 +1695,7 @@ bool AutoStabilizer::setFootSteps(const OpenHRP::AutoStabilizerService::Footstep
 
 bool AutoStabilizer::setFootStepsWithParam(const OpenHRP::AutoStabilizerService::FootstepSequence& fs, const OpenHRP::AutoStabilizerService::StepParamSequence& sps){
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // gaitParam_を最新の状態にしてから変更・公開する
   if(this->mode_.isABCRunning()){
     std::vector<FootStepGenerator::StepNode> footsteps;
     if(fs.length() != sps.length()){
@@ -1084,14 +1723,22 @@ bool AutoStabilizer::setFootStepsWithParam(const OpenHRP::AutoStabilizerService:
       stepNode.swingEnd = sps[i].swing_end;
       footsteps.push_back(stepNode);
     }
-    return this->footStepGenerator_.setFootSteps(this->gaitParam_, footsteps, // input
-                                                 this->gaitParam_.footstepNodesList); // output
+    bool ret = this->footStepGenerator_.setFootSteps(this->gaitParam_, footsteps, // input
+                                                     this->gaitParam_.footstepNodesList); // output
+    this->gaitParam_.isFootStepNodesListModified = true; // 次の周期に計画系の処理を行わなくてもrefZmpTrajを作り直す
+    this->publishFootStepState(); // setFootSteps直後のwaitFootStepsが静止状態と判定しないように
+    return ret;
   }else{
     return false;
   }
 }
 void AutoStabilizer::waitFootSteps(){
-  while (this->mode_.isABCRunning() && !this->gaitParam_.isStatic()) usleep(1000);
+  FootStepStateSnapshot snapshot;
+  while (true) {
+    this->footStepStateSnapshot_.read(snapshot);
+    if(!snapshot.isABCRunning || snapshot.isStatic) break;
+    usleep(1000);
+  }
   usleep(1000);
   return;
 }
@@ -1170,6 +1817,7 @@ bool AutoStabilizer::startImpedanceController(const std::string& i_name){
 
 bool AutoStabilizer::stopImpedanceController(const std::string& i_name){
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // gaitParam_を最新の状態にしてから変更する
   if(this->mode_.isABCRunning()){
     for(int i=0;i<this->gaitParam_.eeName.size();i++){
       if(this->gaitParam_.eeName[i] != i_name) continue;
@@ -1196,7 +1844,7 @@ bool AutoStabilizer::startWholeBodyMasterSlave(void){
       std::cerr << "[" << this->m_profile.instance_name << "] WholeBodyMasterSlave is already started" << std::endl;
       return false;
     }
-    if(std::abs(((long long)this->ports_.refEEPoseLastUpdateTime_.sec - (long long)this->ports_.m_qRef_.tm.sec) + 1e-9 * ((long long)this->ports_.refEEPoseLastUpdateTime_.nsec - (long long)this->ports_.m_qRef_.tm.nsec)) > 1.0) { // 最新のm_refEEPose_が1秒以上前. master sideが立ち上がっていないので、姿勢の急変を引き起こし危険. RTC::Timeはunsigned long型なので、符号付きの型に変換してから引き算
+    if(std::abs(((long long)this->ports_.inPortData_.refEEPoseLastUpdateTime.sec - (long long)this->ports_.m_qRef_.tm.sec) + 1e-9 * ((long long)this->ports_.inPortData_.refEEPoseLastUpdateTime.nsec - (long long)this->ports_.m_qRef_.tm.nsec)) > 1.0) { // 最新のm_refEEPose_が1秒以上前. master sideが立ち上がっていないので、姿勢の急変を引き起こし危険. RTC::Timeはunsigned long型なので、符号付きの型に変換してから引き算
       std::cerr << "[" << this->m_profile.instance_name << "] Please start master side" << std::endl;
       return false;
     }
@@ -1226,6 +1874,8 @@ bool AutoStabilizer::stopWholeBodyMasterSlave(void){
 
 bool AutoStabilizer::setAutoStabilizerParam(const OpenHRP::AutoStabilizerService::AutoStabilizerParam& i_param){
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // 後段が参照するStabilizer, FullbodyIKSolverのparameterを書き換えるため
+  this->isPipelineGaitParamSynced_ = false; // gaitParam_のパラメータを書き換えるため、次に後段に渡すときに全体をコピーする
 
   // ignore i_param.ee_name
   if(this->mode_.now() == ControlMode::MODE_IDLE){
@@ -1287,6 +1937,7 @@ bool AutoStabilizer::setAutoStabilizerParam(const OpenHRP::AutoStabilizerService
       }
     }
   }
+  this->gaitParam_.planningDecimation = std::max(i_param.planning_decimation, 1);
 
   if((this->refToGenFrameConverter_.handFixMode.getGoal() == 1.0) != i_param.is_hand_fix_mode) {
     if(this->mode_.isABCRunning()) this->refToGenFrameConverter_.handFixMode.setGoal(i_param.is_hand_fix_mode ? 1.0 : 0.0, 1.0); // 1.0[s]で補間
@@ -1304,6 +1955,10 @@ bool AutoStabilizer::setAutoStabilizerParam(const OpenHRP::AutoStabilizerService
       this->actToGenFrameConverter_.rpyOffset[i] = i_param.rpy_offset[i];
     }
   }
+  this->actToGenFrameConverter_.latencyCompensationTime = std::max(i_param.latency_compensation_time, 0.0);
+  this->actToGenFrameConverter_.useMeasuredActDelay = i_param.use_measured_act_delay;
+  this->actToGenFrameConverter_.cogVelFilterLagTime = std::max(i_param.cog_vel_filter_lag_time, 0.0);
+  this->actToGenFrameConverter_.latencyCompensationMaxTime = std::max(i_param.latency_compensation_max_time, 0.0);
 
   this->externalForceHandler_.useDisturbanceCompensation = i_param.use_disturbance_compensation;
   this->externalForceHandler_.disturbanceCompensationTimeConst = std::max(i_param.disturbance_compensation_time_const, 0.01);
@@ -1488,10 +2143,24 @@ bool AutoStabilizer::setAutoStabilizerParam(const OpenHRP::AutoStabilizerService
     }
   }
 
+  if(i_param.log_port_name.length() == i_param.log_port_decimation.length()){
+    for(int i=0;i<i_param.log_port_name.length();i++){
+      this->ports_.setLogPortDecimation(std::string(i_param.log_port_name[i]), i_param.log_port_decimation[i]);
+    }
+  }
+
+  if(i_param.inport_name.length() == i_param.inport_stale_threshold.length()){
+    for(int i=0;i<i_param.inport_name.length();i++){
+      this->ports_.inPortData_.monitor.setStaleThreshold(std::string(i_param.inport_name[i]), std::max(i_param.inport_stale_threshold[i], 0.0));
+    }
+  }
+
+
   return true;
 }
 bool AutoStabilizer::getAutoStabilizerParam(OpenHRP::AutoStabilizerService::AutoStabilizerParam& i_param) {
   std::lock_guard<std::mutex> guard(this->mutex_);
+  this->finishPipeline(); // gaitParam_を最新の状態にしてから読む
 
   i_param.ee_name.length(this->gaitParam_.eeName.size());
   for(int i=0;i<this->gaitParam_.eeName.size();i++) i_param.ee_name[i] = this->gaitParam_.eeName[i].c_str();
@@ -1525,6 +2194,7 @@ bool AutoStabilizer::getAutoStabilizerParam(OpenHRP::AutoStabilizerService::Auto
   for(int i=0;i<NUM_LEGS; i++) {
     i_param.is_manual_control_mode[i] = (this->gaitParam_.isManualControlMode[i].getGoal() == 1.0);
   }
+  i_param.planning_decimation = this->gaitParam_.planningDecimation;
 
   i_param.is_hand_fix_mode = (this->refToGenFrameConverter_.handFixMode.getGoal() == 1.0);
   i_param.reference_frame.length(NUM_LEGS);
@@ -1536,6 +2206,10 @@ bool AutoStabilizer::getAutoStabilizerParam(OpenHRP::AutoStabilizerService::Auto
   for(int i=0;i<3;i++) {
     i_param.rpy_offset[i] = this->actToGenFrameConverter_.rpyOffset[i];
   }
+  i_param.latency_compensation_time = this->actToGenFrameConverter_.latencyCompensationTime;
+  i_param.use_measured_act_delay = this->actToGenFrameConverter_.useMeasuredActDelay;
+  i_param.cog_vel_filter_lag_time = this->actToGenFrameConverter_.cogVelFilterLagTime;
+  i_param.latency_compensation_max_time = this->actToGenFrameConverter_.latencyCompensationMaxTime;
 
   i_param.use_disturbance_compensation = this->externalForceHandler_.useDisturbanceCompensation;
   i_param.disturbance_compensation_time_const = this->externalForceHandler_.disturbanceCompensationTimeConst;
@@ -1695,30 +2369,45 @@ bool AutoStabilizer::getAutoStabilizerParam(OpenHRP::AutoStabilizerService::Auto
     i_param.dq_weight[i] = this->fullbodyIKSolver_.dqWeight[i].getGoal();
   }
 
+  i_param.log_port_name.length(this->ports_.logPorts_.size());
+  i_param.log_port_decimation.length(this->ports_.logPorts_.size());
+  for(int i=0;i<this->ports_.logPorts_.size();i++){
+    i_param.log_port_name[i] = this->ports_.logPorts_[i].name.c_str();
+    i_param.log_port_decimation[i] = this->ports_.logPorts_[i].decimation;
+  }
+  const std::vector<InPortMonitor::Port>& monitorPorts = this->ports_.inPortData_.monitor.ports();
+  i_param.inport_name.length(monitorPorts.size());
+  i_param.inport_stale_threshold.length(monitorPorts.size());
+  for(int i=0;i<monitorPorts.size();i++){
+    i_param.inport_name[i] = monitorPorts[i].name.c_str();
+    i_param.inport_stale_threshold[i] = monitorPorts[i].staleThreshold;
+  }
+
   return true;
 }
 
 bool AutoStabilizer::getFootStepState(OpenHRP::AutoStabilizerService::FootStepState& i_param) {
-  std::lock_guard<std::mutex> guard(this->mutex_);
+  // mutex_をとらずに、最後に公開された状態を読む
+  FootStepStateSnapshot snapshot;
+  this->footStepStateSnapshot_.read(snapshot);
 
   i_param.leg_coords.length(NUM_LEGS);
   i_param.support_leg.length(NUM_LEGS);
   i_param.leg_src_coords.length(NUM_LEGS);
   i_param.leg_dst_coords.length(NUM_LEGS);
   for(int i=0;i<NUM_LEGS;i++){
-    i_param.leg_coords[i].leg = this->gaitParam_.eeName[i].c_str();
-    AutoStabilizer::copyEigenCoords2FootStep(this->gaitParam_.genCoords[i].value(), i_param.leg_coords[i]);
-    i_param.support_leg[i] = this->gaitParam_.footstepNodesList[0].isSupportPhase[i];
+    i_param.leg_coords[i].leg = this->gaitParam_.eeName[i].c_str(); // eeNameはconstant
+    AutoStabilizer::copyEigenCoords2FootStep(snapshot.genCoords[i], i_param.leg_coords[i]);
+    i_param.support_leg[i] = snapshot.isSupportPhase[i];
     i_param.leg_src_coords[i].leg = this->gaitParam_.eeName[i].c_str();
-    AutoStabilizer::copyEigenCoords2FootStep(this->gaitParam_.srcCoords[i], i_param.leg_src_coords[i]);
+    AutoStabilizer::copyEigenCoords2FootStep(snapshot.srcCoords[i], i_param.leg_src_coords[i]);
     i_param.leg_dst_coords[i].leg = this->gaitParam_.eeName[i].c_str();
-    AutoStabilizer::copyEigenCoords2FootStep(this->gaitParam_.footstepNodesList[0].dstCoords[i], i_param.leg_dst_coords[i]);
+    AutoStabilizer::copyEigenCoords2FootStep(snapshot.dstCoords[i], i_param.leg_dst_coords[i]);
   }
   // 現在支持脚、または現在遊脚で次支持脚になる脚の、dstCoordsの中間. 水平
   std::vector<double> weights(NUM_LEGS, 0.0);
   for(int i=0;i<NUM_LEGS; i++){
-    if(this->gaitParam_.footstepNodesList[0].isSupportPhase[i] ||
-       (this->gaitParam_.footstepNodesList.size() > 1 && this->gaitParam_.footstepNodesList[1].isSupportPhase[i]))
+    if(snapshot.isSupportPhase[i] || snapshot.isNextSupportPhase[i])
       weights[i] = 1.0;
   }
   if(weights[RLEG] == 0.0 && weights[LLEG] == 0.0) {
@@ -1727,18 +2416,84 @@ bool AutoStabilizer::getFootStepState(OpenHRP::AutoStabilizerService::FootStepSt
   if(weights[RLEG] == 1.0 && weights[LLEG] == 1.0) i_param.dst_foot_midcoords.leg = "both";
   else if(weights[RLEG] == 1.0) i_param.dst_foot_midcoords.leg = "rleg";
   else if(weights[LLEG] == 1.0) i_param.dst_foot_midcoords.leg = "lleg";
-  AutoStabilizer::copyEigenCoords2FootStep(mathutil::orientCoordToAxis(mathutil::calcMidCoords(this->gaitParam_.footstepNodesList[0].dstCoords, weights), cnoid::Vector3::UnitZ()), i_param.dst_foot_midcoords);
+  AutoStabilizer::copyEigenCoords2FootStep(mathutil::orientCoordToAxis(mathutil::calcMidCoords(std::vector<cnoid::Position>(snapshot.dstCoords.begin(), snapshot.dstCoords.end()), weights), cnoid::Vector3::UnitZ()), i_param.dst_foot_midcoords);
   i_param.is_manual_control_mode.length(NUM_LEGS);
   for(int i=0;i<NUM_LEGS; i++) {
-    i_param.is_manual_control_mode[i] = (this->gaitParam_.isManualControlMode[i].getGoal() == 1.0);
+    i_param.is_manual_control_mode[i] = snapshot.isManualControlMode[i];
   }
-  i_param.joint_angle.length(this->gaitParam_.genRobot->numJoints());
-  for(int i=0;i<this->gaitParam_.genRobot->numJoints();i++){
-    i_param.joint_angle[i] = this->gaitParam_.genRobot->joint(i)->q();
+  i_param.joint_angle.length(snapshot.genJointAngle.size());
+  for(int i=0;i<snapshot.genJointAngle.size();i++){
+    i_param.joint_angle[i] = snapshot.genJointAngle[i];
   }
   return true;
 }
 
+bool AutoStabilizer::getInPortStatus(OpenHRP::AutoStabilizerService::InPortStatusSequence& i_param) {
+  std::lock_guard<std::mutex> guard(this->mutex_);
+  const InPortMonitor& monitor = this->ports_.inPortData_.monitor;
+  const std::vector<InPortMonitor::Port>& ports = monitor.ports();
+  i_param.length(ports.size());
+  for(int i=0;i<ports.size();i++){
+    const InPortMonitor::Port& port = ports[i];
+    OpenHRP::AutoStabilizerService::InPortStatus& status = i_param[i];
+    status.name = port.name.c_str();
+    status.count = port.count;
+    status.age = port.age;
+    status.mean_age = (port.count > 0) ? port.sumAge / port.count : 0.0;
+    status.max_age = port.maxAge;
+    status.max_interval = port.maxInterval;
+    status.since_last_arrival = monitor.now() - ((port.count > 0) ? std::max(port.lastArrival, monitor.startTime()) : monitor.startTime());
+    status.stale_threshold = port.staleThreshold;
+    status.is_stale = port.isStale;
+    status.stale_count = port.staleCount;
+    status.histogram_edges.length(InPortMonitor::BIN_EDGES.size());
+    for(int j=0;j<InPortMonitor::BIN_EDGES.size();j++) status.histogram_edges[j] = InPortMonitor::BIN_EDGES[j];
+    status.age_histogram.length(InPortMonitor::NUM_BINS);
+    status.interval_histogram.length(InPortMonitor::NUM_BINS);
+    for(int j=0;j<InPortMonitor::NUM_BINS;j++){
+      status.age_histogram[j] = port.ageHistogram[j];
+      status.interval_histogram[j] = port.intervalHistogram[j];
+    }
+  }
+  return true;
+}
+
+bool AutoStabilizer::resetInPortStatus() {
+  std::lock_guard<std::mutex> guard(this->mutex_);
+  this->ports_.inPortData_.monitor.resetStatistics();
+  return true;
+}
+
+// static function
+void AutoStabilizer::copyFootStepStateSnapshot(const AutoStabilizer::ControlMode& mode, const GaitParam& gaitParam, AutoStabilizer::FootStepStateSnapshot& o_snapshot){
+  // o_snapshotは他スレッドから読まれている可能性があるので、genJointAngleの要素数を変えないこと
+  o_snapshot.isABCRunning = mode.isABCRunning();
+  o_snapshot.isStatic = gaitParam.isStatic();
+  for(int i=0;i<NUM_LEGS;i++){
+    o_snapshot.genCoords[i] = gaitParam.genCoords[i].value();
+    o_snapshot.srcCoords[i] = gaitParam.srcCoords[i];
+    o_snapshot.dstCoords[i] = gaitParam.footstepNodesList[0].dstCoords[i];
+    o_snapshot.isSupportPhase[i] = gaitParam.footstepNodesList[0].isSupportPhase[i];
+    o_snapshot.isNextSupportPhase[i] = gaitParam.footstepNodesList.size() > 1 && gaitParam.footstepNodesList[1].isSupportPhase[i];
+    o_snapshot.isManualControlMode[i] = (gaitParam.isManualControlMode[i].getGoal() == 1.0);
+  }
+  for(int i=0;i<o_snapshot.genJointAngle.size() && i<gaitParam.genRobot->numJoints();i++){
+    o_snapshot.genJointAngle[i] = gaitParam.genRobot->joint(i)->q();
+  }
+}
+
+void AutoStabilizer::publishFootStepState(){
+  AutoStabilizer::copyFootStepStateSnapshot(this->mode_, this->gaitParam_, this->footStepStateSnapshot_.writeBuffer());
+  this->footStepStateSnapshot_.publish();
+}
+
+void AutoStabilizer::finishPipeline(){
+  if(!this->isPipelineBusy_) return;
+  this->pipelineWorker_->wait();
+  AutoStabilizer::mergePipelineOutput(this->pipelineGaitParam_, this->gaitParam_);
+  this->isPipelineBusy_ = false;
+}
+
 bool AutoStabilizer::getProperty(const std::string& key, std::string& ret) {
   if (this->getProperties().hasKey(key.c_str())) {
     ret = std::string(this->getProperties()[key.c_str()]);
@@ -1751,6 +2506,52 @@ bool AutoStabilizer::getProperty(const std::string& key, std::string& ret) {
   return true;
 }
 
+bool AutoStabilizer::getProperty(const std::string& key, long& ret) {
+  std::string buf;
+  if(!this->getProperty(key, buf)) return false;
+  if(!AutoStabilizer::parseNumber(buf, ret)){
+    std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << key << " is not an integer. default value " << ret << " is used" << "\x1b[39m" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool AutoStabilizer::getProperty(const std::string& key, double& ret) {
+  std::string buf;
+  if(!this->getProperty(key, buf)) return false;
+  if(!AutoStabilizer::parseNumber(buf, ret)){
+    std::cerr << "\x1b[31m[" << this->m_profile.instance_name << "] " << key << " is not a number. default value " << ret << " is used" << "\x1b[39m" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// static function
+bool AutoStabilizer::parseNumber(const std::string& str, long& o_value){
+  const char* begin = str.c_str();
+  char* end = nullptr;
+  errno = 0;
+  long value = std::strtol(begin, &end, 10);
+  if(end == begin || errno == ERANGE) return false;
+  while(std::isspace(static_cast<unsigned char>(*end))) end++;
+  if(*end != '\0') return false;
+  o_value = value;
+  return true;
+}
+
+// static function
+bool AutoStabilizer::parseNumber(const std::string& str, double& o_value){
+  const char* begin = str.c_str();
+  char* end = nullptr;
+  errno = 0;
+  double value = std::strtod(begin, &end);
+  if(end == begin || errno == ERANGE) return false;
+  while(std::isspace(static_cast<unsigned char>(*end))) end++;
+  if(*end != '\0') return false;
+  o_value = value;
+  return true;
+}
+
 // static function
 void AutoStabilizer::copyEigenCoords2FootStep(const cnoid::Position& in_fs, OpenHRP::AutoStabilizerService::Footstep& out_fs){
   out_fs.pos.length(3);
@@ -5,6 +5,7 @@
 #include <map>
 #include <time.h>
 #include <mutex>
+#include <functional>
 
 #include <rtm/idl/BasicDataType.hh>
 #include <rtm/idl/ExtendedDataTypes.hh>
@@ -18,6 +19,9 @@
 #include <rtm/CorbaNaming.h>
 
 #include <cnoid/Body>
+#include <cnoid/ForceSensor>
+#include <cnoid/RateGyroSensor>
+#include <cnoid/JointPath>
 
 #include <cpp_filters/TwoPointInterpolator.h>
 
@@ -40,8 +44,16 @@
 #include "ExternalForceHandler.h"
 #include "FullbodyIKSolver.h"
 #include "CmdVelGenerator.h"
+#include "PipelineWorker.h"
+#include "PerfCounter.h"
+#include "SnapshotBuffer.h"
+#include "TelemetryRecorder.h"
+#include "JointShmChannel.h"
+#include "InPortMonitor.h"
+#include "RealtimeUtil.h"
 
 class AutoStabilizer : public RTC::DataFlowComponentBase{
+  friend class OfflineAutoStabilizer; // OpenRTMを介さずにログの再生やシミュレーションを行うため、static関数と制御用のクラスを使う
 public:
   AutoStabilizer(RTC::Manager* manager);
   virtual RTC::ReturnCode_t onInitialize();
@@ -62,6 +74,8 @@ public:
   bool setAutoStabilizerParam(const OpenHRP::AutoStabilizerService::AutoStabilizerParam& i_param);
   bool getAutoStabilizerParam(OpenHRP::AutoStabilizerService::AutoStabilizerParam& i_param);
   bool getFootStepState(OpenHRP::AutoStabilizerService::FootStepState& i_param);
+  bool getInPortStatus(OpenHRP::AutoStabilizerService::InPortStatusSequence& i_param);
+  bool resetInPortStatus();
   bool releaseEmergencyStop();
   bool startStabilizer(void);
   bool stopStabilizer(void);
@@ -77,6 +91,47 @@ protected:
   unsigned long long loop_;
   double dt_;
 
+  // 今周期に各InPortに届いたデータ. 届いていないものはnullptr. 通常はreadInPortDataがPortsから与え、replay時はAutoStabilizerReplayがログから与える
+  class InPortData {
+  public:
+    RTC::Time tm; // 最新のqRefの時刻
+    const RTC::TimedDoubleSeq* qRef = nullptr;
+    const RTC::TimedDoubleSeq* refTau = nullptr;
+    const RTC::TimedPoint3D* refBasePos = nullptr;
+    const RTC::TimedOrientation3D* refBaseRpy = nullptr;
+    std::vector<const RTC::TimedDoubleSeq*> refEEWrench; // 要素数及び順番はgaitParam_.eeNameと同じ
+    std::vector<const RTC::TimedPose3D*> refEEPose; // 要素数及び順番はgaitParam_.eeNameと同じ
+    const RTC::TimedDoubleSeq* qAct = nullptr;
+    const RTC::TimedDoubleSeq* dqAct = nullptr;
+    const RTC::TimedOrientation3D* actImu = nullptr;
+    std::vector<const RTC::TimedDoubleSeq*> actWrench; // 要素数及び順番はrobot->forceSensorsと同じ
+    const collision_checker_msgs::TimedCollisionSeq* selfCollision = nullptr;
+    const auto_stabilizer_msgs::TimedSteppableRegion* steppableRegion = nullptr;
+    const auto_stabilizer_msgs::TimedLandingPosition* landingHeight = nullptr;
+    RTC::Time refEEPoseLastUpdateTime; // refEEPoseのどれかに最後にdataが届いたときの、tmの時刻
+    RTC::Time steppableRegionLastUpdateTime; // 支持脚が一致したsteppableRegionを最後に反映したときの、tmの時刻. 支持脚が異なるものが届き続けても更新しない
+
+    // 各InPortの遅延とstaleの判定. portの並びはmonitor_enumの後に、refEEWrench(eeNameの順), refEEPose(eeNameの順), actWrench(robot->forceSensorsの順)
+    //   staleになったときの扱い(fallback)はsteppableRegion, landingHeightはCLEAR, それ以外はHOLD. staleThresholdのdefaultはsteppableRegionのみ2.0[s], それ以外は0(判定しない)
+    //   steppableRegionはこれとは別に、steppableRegionLastUpdateTimeから2秒経ったら捨てる
+    enum monitor_enum{MONITOR_QREF=0, MONITOR_REFTAU, MONITOR_REFBASEPOS, MONITOR_REFBASERPY, MONITOR_QACT, MONITOR_DQACT, MONITOR_ACTIMU, MONITOR_SELFCOLLISION, MONITOR_STEPPABLEREGION, MONITOR_LANDINGHEIGHT, NUM_MONITOR_FIXED};
+    InPortMonitor monitor;
+    int refEEWrenchMonitorIdx(int i) const { return NUM_MONITOR_FIXED + i; }
+    int refEEPoseMonitorIdx(int i) const { return NUM_MONITOR_FIXED + this->refEEWrench.size() + i; }
+    int actWrenchMonitorIdx(int i) const { return NUM_MONITOR_FIXED + 2 * this->refEEWrench.size() + i; }
+
+    // applyInPortDataで毎周期探索やメモリ確保をしないように、init時に解決しておくもの
+    std::vector<cnoid::ForceSensorPtr> actForceSensor; // 要素数及び順番はactWrenchと同じ. actRobotRawのもの
+    cnoid::RateGyroSensorPtr actImuSensor; // actRobotRawのgyrometer
+    std::shared_ptr<cnoid::JointPath> actImuPath; // actRobotRawのrootLinkからactImuSensorのlinkまで. actImuSensorがnullptrならnullptr
+    // selfCollisionのlink名とlink indexの対応. 衝突ペアの並びは通常毎回同じなので、前回と同じlink名ならlinkの探索とstd::stringの生成を省略する. 要素数はselfCollisionの要素数の2倍以上. [2*i]: link1, [2*i+1]: link2
+    std::vector<std::pair<std::string, int> > selfCollisionLinkCache;
+    std::vector<cnoid::Vector3> steppableRegionVertices; // steppableRegionの各polygonを変換するときの作業領域. 確保済みの領域を再利用する
+
+    // 初期化時に一回呼ばれる. gaitParamのロボットモデルとEndEffectorの情報に合わせて要素数を確保する
+    void init(const GaitParam& gaitParam);
+  };
+
   class Ports {
   public:
     Ports();
@@ -101,19 +156,26 @@ protected:
     std::vector<std::unique_ptr<RTC::InPort<RTC::TimedDoubleSeq> > > m_actWrenchIn_;
     std::vector<RTC::TimedPose3D> m_refEEPose_; // Reference World frame. 要素数及び順番はgaitParam_.eeNameと同じ
     std::vector<std::unique_ptr<RTC::InPort<RTC::TimedPose3D> > > m_refEEPoseIn_;
-    RTC::Time refEEPoseLastUpdateTime_; // m_refEEPoseIn_のどれかに最後にdataが届いたときの、m_qRef_.tmの時刻
     collision_checker_msgs::TimedCollisionSeq m_selfCollision_; // generate frame. genRobotの自己干渉の最近傍点
     RTC::InPort<collision_checker_msgs::TimedCollisionSeq> m_selfCollisionIn_;
     auto_stabilizer_msgs::TimedSteppableRegion m_steppableRegion_; // 着地可能領域. 支持脚を水平にした座標系
     RTC::InPort<auto_stabilizer_msgs::TimedSteppableRegion> m_steppableRegionIn_;
-    RTC::Time steppableRegionLastUpdateTime_; // m_steppableRegionIn_に最後にdataが届いたときの、m_qRef_.tmの時刻
     auto_stabilizer_msgs::TimedLandingPosition m_landingHeight_; // 着地姿勢. 支持脚を水平にした座標系
     RTC::InPort<auto_stabilizer_msgs::TimedLandingPosition> m_landingHeightIn_;
+    InPortData inPortData_; // readInPortDataで毎周期更新される
 
     RTC::TimedDoubleSeq m_q_;
     RTC::OutPort<RTC::TimedDoubleSeq> m_qOut_;
     RTC::TimedDoubleSeq m_genTau_;
     RTC::OutPort<RTC::TimedDoubleSeq> m_genTauOut_;
+
+    // joint_shm_portsで指定されたportに対応するもののみcreateされる. InPortはcreateされていればInPortの代わりにこちらを読む. OutPortはOutPortとこちらの両方に書き込む
+    JointShmChannel m_qRefShm_;
+    JointShmChannel m_refTauShm_;
+    JointShmChannel m_qActShm_;
+    JointShmChannel m_dqActShm_;
+    JointShmChannel m_qShm_;
+    JointShmChannel m_genTauShm_;
     RTC::TimedPose3D m_genBasePose_; // Generate World frame
     RTC::OutPort<RTC::TimedPose3D> m_genBasePoseOut_;
     RTC::TimedDoubleSeq m_genBaseTform_;  // Generate World frame
@@ -167,8 +229,29 @@ protected:
     RTC::OutPort<RTC::TimedDoubleSeq> m_strideLimitationHullOut_; // for log
     RTC::TimedDoubleSeq m_cpViewerLog_;
     RTC::OutPort<RTC::TimedDoubleSeq> m_cpViewerLogOut_; // for log
+    RTC::TimedDoubleSeq m_ikStat_;
+    RTC::OutPort<RTC::TimedDoubleSeq> m_ikStatOut_; // for log
+    RTC::TimedDoubleSeq m_perfStat_;
+    RTC::OutPort<RTC::TimedDoubleSeq> m_perfStatOut_; // for log
     std::vector<RTC::TimedDoubleSeq> m_tgtEEWrench_; // Generate World frame. EndEffector origin. 要素数及び順番はgaitParam_.eeNameと同じ. ロボットが受ける力
     std::vector<std::unique_ptr<RTC::OutPort<RTC::TimedDoubleSeq> > > m_tgtEEWrenchOut_;
+
+    // only for logのOutPortの出力設定. 実機では使うportだけに書き込み、その他のportのデータは作らない
+    enum logPort_enum{GEN_COG_LOG, GEN_DCM_LOG, GEN_ZMP_LOG, TGT_ZMP_LOG, ACT_COG_LOG, ACT_DCM_LOG, DST_LANDING_POS_LOG, REMAIN_TIME_LOG, GEN_COORDS_LOG, CAPTURE_REGION_LOG, STEPPABLE_REGION_LOG, STEPPABLE_REGION_NUM_LOG, STRIDE_LIMITATION_HULL_LOG, CP_VIEWER_LOG, IK_STAT_LOG, PERF_STAT_LOG, TGT_EE_WRENCH_LOG/*以降EndEffectorの数だけ並ぶ*/};
+    class LogPort {
+    public:
+      std::string name; // OutPortの名前
+      RTC::OutPortBase* port = nullptr;
+      int decimation = 1; // 0ならこのportには書き込まない. n(>=1)ならn周期に1回書き込む
+      bool isActive = false; // 今周期に書き込むかどうか. updateLogPortsで計算される
+    };
+    std::vector<LogPort> logPorts_; // 要素数及び順番はlogPort_enumと同じ
+    unsigned long long logLoop_ = 0;
+    void addLogPort(const std::string& name, RTC::OutPortBase* port);
+    // nameのportのdecimationを設定する. nameが"*"なら全てのport. 該当するportが無ければfalse
+    bool setLogPortDecimation(const std::string& name, int decimation);
+    // 毎周期書き込み前に呼ぶ. decimationに該当する周期で、かつ接続先があるportのみisActiveになる
+    void updateLogPorts();
   };
   Ports ports_;
 
@@ -266,14 +349,78 @@ protected:
   Stabilizer stabilizer_;
   FullbodyIKSolver fullbodyIKSolver_;
 
+  std::vector<int> rtCpus_; // ExecutionContextのスレッドを固定するCPU. 空なら固定しない
+  int rtPriority_ = 0; // ExecutionContextのスレッドのSCHED_FIFOの優先度. 0なら変更しない
+  int rtWorkerPriority_ = 0; // PipelineWorkerのスレッドのSCHED_FIFOの優先度. 0なら変更しない
+  bool rtLockMemory_ = false; // activate時にmlockallする
+  bool rtMallocTuning_ = false; // activate時にmalloptでfreeした領域をOSに返さないようにする. プロセス全体に影響する
+  size_t rtPrefaultHeapSize_ = 16*1024*1024; // [byte]. rtMallocTuning_の場合にactivate時に確保して書き込んでおくheapの大きさ
+  size_t rtPrefaultStackSize_ = 512*1024; // [byte]. rtLockMemory_の場合に初回のonExecuteで書き込んでおくstackの大きさ
+  bool isMemoryLocked_ = false;
+  bool isMallocTuned_ = false;
+  bool isRtThreadConfigured_ = false; // ExecutionContextのスレッドにrtCpus_, rtPriority_等を設定したか. onActivatedでfalseに戻す
+  bool isRtThreadSettingSaved_ = false; // rtThread_の元の設定をrtThreadOrgSetting_に保存し、rtCpus_, rtPriority_に変更したか. onDeactivatedで元に戻してfalseにする
+  pthread_t rtThread_; // rtCpus_, rtPriority_を設定したExecutionContextのスレッド. 同じExecutionContextの他のRTCと共有している
+  realtimeutil::ThreadSetting rtThreadOrgSetting_;
+  std::shared_ptr<PipelineWorker> pipelineWorker_ = nullptr; // 後段(Stabilizer, IK)を前段と並行に実行する. pipeline_modeが与えられなければnullptr(逐次実行)
+  GaitParam pipelineGaitParam_; // 後段が読み書きするgaitParam_のコピー. 後段の実行中は後段のみが触る. Stabilizer, FullbodyIKSolverがlinkを保持しているgenRobot, actRobotTqcはこちらが持ち、gaitParam_は別のcloneを持つ
+  bool isPipelineGaitParamSynced_ = false; // pipelineGaitParam_が、毎周期は変わらないパラメータ等も含めてgaitParam_と一致しているか. falseなら次に後段に渡すときに全体をコピーする. trueなら前段が毎周期書き換えるもののみコピーする
+  ControlMode pipelineMode_; // 後段が参照するmode_のコピー
+  std::function<void()> pipelineTask_; // pipelineWorker_で実行する後段の処理
+  bool isPipelineBusy_ = false; // pipelineWorker_に後段をsubmitし、まだ結果をgaitParam_に反映していない
+  std::shared_ptr<PerfCounter> perfCounter_ = nullptr; // 1周期あたりのcache miss等の計測用. perf_countersが与えられなければnullptr(計測しない)
+  std::shared_ptr<TelemetryRecorder> telemetryRecorder_ = nullptr; // 毎周期の主要な値をファイルに記録する. telemetry_fileが与えられなければnullptr(記録しない)
+
+  // getFootStepState, waitFootSteps用. gaitParam_のうち外部から参照される部分のコピー. mutex_をとらずに読める
+  class FootStepStateSnapshot {
+  public:
+    bool isABCRunning = false;
+    bool isStatic = true;
+    std::array<cnoid::Position, NUM_LEGS> genCoords = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // generate frame
+    std::array<cnoid::Position, NUM_LEGS> srcCoords = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // generate frame
+    std::array<cnoid::Position, NUM_LEGS> dstCoords = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // generate frame. footstepNodesList[0]のdstCoords
+    std::array<bool, NUM_LEGS> isSupportPhase = {{true, true}}; // footstepNodesList[0]のisSupportPhase
+    std::array<bool, NUM_LEGS> isNextSupportPhase = {{false, false}}; // footstepNodesList[1]のisSupportPhase. footstepNodesListの要素数が1ならfalse
+    std::array<bool, NUM_LEGS> isManualControlMode = {{false, false}}; // isManualControlModeのgoalが1かどうか
+    std::vector<double> genJointAngle; // 要素数と順序はgenRobot->numJoints()と同じ. init後に要素数を変えない
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  SnapshotBuffer<FootStepStateSnapshot> footStepStateSnapshot_; // 毎周期の終わりと、footstepNodesListを変更するservice呼び出しの後に、mutex_をとった状態で更新される
+
 protected:
   // utility functions
   bool getProperty(const std::string& key, std::string& ret);
+  bool getProperty(const std::string& key, long& ret); // 数値として読めなければ警告してfalseを返し、retを変えない
+  bool getProperty(const std::string& key, double& ret); // 数値として読めなければ警告してfalseを返し、retを変えない
+  static bool parseNumber(const std::string& str, long& o_value); // 全体が数値として読めればtrue. std::stoi等と異なり例外を投げない
+  static bool parseNumber(const std::string& str, double& o_value);
   static void copyEigenCoords2FootStep(const cnoid::Position& in_fs, OpenHRP::AutoStabilizerService::Footstep& out_fs);
 
-  static bool readInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::Ports& ports, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal);
+  static bool initGaitParam(const std::function<bool(const std::string&, std::string&)>& getProperty, const std::string& instanceName, double& o_dt, GaitParam& o_gaitParam);
+  static void initControllers(const GaitParam& gaitParam, ActToGenFrameConverter& actToGenFrameConverter, ImpedanceController& impedanceController, Stabilizer& stabilizer, FullbodyIKSolver& fullbodyIKSolver);
+  static bool readInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::Ports& ports, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal, double& actDelay);
+  static void updateInPortMonitor(AutoStabilizer::InPortData& inPortData);
+  static bool applyInPortData(const double& dt, const GaitParam& gaitParam, const AutoStabilizer::ControlMode& mode, AutoStabilizer::InPortData& inPortData, cnoid::BodyPtr refRobotRaw, cnoid::BodyPtr actRobotRaw, std::vector<cnoid::Vector6>& refEEWrenchOrigin, std::vector<cpp_filters::TwoPointInterpolatorSE3>& refEEPoseRaw, std::vector<GaitParam::Collision>& selfCollision, std::vector<std::vector<cnoid::Vector3> >& steppableRegion, std::vector<double>& steppableHeight, double& relLandingHeight, cnoid::Vector3& relLandingNormal, double& actDelay);
+  static bool readJointShm(JointShmChannel& channel, RTC::TimedDoubleSeq& o_data); // 新しいdataがあればo_dataに読み込んでtrueを返す
+  static void writeJointShm(JointShmChannel& channel, const RTC::TimedDoubleSeq& data);
+  static int resolveLinkIndex(const cnoid::BodyPtr& robot, const char* name, std::pair<std::string, int>& cache); // nameのlinkのindexを返す. 無ければ-1. cacheに前回の結果を持つ
+  static void updateControllers(AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, RefToGenFrameConverter& refToGenFrameConverter, ActToGenFrameConverter& actToGenFrameConverter, ExternalForceHandler& externalForceHandler, FootStepGenerator& footStepGenerator, ImpedanceController& impedanceController, FullbodyIKSolver& fullbodyIKSolver);
   static bool execAutoStabilizer(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const FootStepGenerator& footStepGenerator, const LegCoordsGenerator& legCoordsGenerator, const RefToGenFrameConverter& refToGenFrameConverter, const ActToGenFrameConverter& actToGenFrameConverter, const ImpedanceController& impedanceController, const Stabilizer& stabilizer, const ExternalForceHandler& externalForceHandler, const FullbodyIKSolver& fullbodyIKSolver, const LegManualController& legManualController, const CmdVelGenerator& cmdVelGenerator);
+  // 1周期の処理を、前段(planning. 座標変換, 歩容生成)と後段(execution. Stabilizer, IK)に分けたもの. 前段->後段の順に呼べば、updateControllers, execAutoStabilizerと同じ
+  static void updatePlanningControllers(AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, RefToGenFrameConverter& refToGenFrameConverter, ActToGenFrameConverter& actToGenFrameConverter, ExternalForceHandler& externalForceHandler, FootStepGenerator& footStepGenerator, ImpedanceController& impedanceController);
+  static void updateExecutionControllers(const AutoStabilizer::ControlMode& mode, double dt, FullbodyIKSolver& fullbodyIKSolver);
+  static void execPlanningStage(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const FootStepGenerator& footStepGenerator, const LegCoordsGenerator& legCoordsGenerator, const RefToGenFrameConverter& refToGenFrameConverter, const ActToGenFrameConverter& actToGenFrameConverter, const ImpedanceController& impedanceController, const Stabilizer& stabilizer, const ExternalForceHandler& externalForceHandler, const LegManualController& legManualController, const CmdVelGenerator& cmdVelGenerator);
+  static void execExecutionStage(const AutoStabilizer::ControlMode& mode, GaitParam& gaitParam, double dt, const Stabilizer& stabilizer, const FullbodyIKSolver& fullbodyIKSolver);
+  static void copyGaitParamForPipeline(const GaitParam& gaitParam, bool isFullCopy, GaitParam& o_pipelineGaitParam); // o_pipelineGaitParamのrobotは差し替えずに状態のみコピーする. isFullCopyがfalseなら後段が読むもののうち前段が毎周期書き換えるもののみコピーする
+  static void mergePipelineOutput(const GaitParam& pipelineGaitParam, GaitParam& o_gaitParam); // 後段の出力(genRobot, actRobotTqcのトルク, st*, ikStat)をo_gaitParamに反映する
   static bool writeOutPortData(AutoStabilizer::Ports& ports, const AutoStabilizer::ControlMode& mode, cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, double dt, const GaitParam& gaitParam);
+  static void updateIdleToAbcTransition(const AutoStabilizer::ControlMode& mode, double dt, cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator);
+  static double calcOutputJointAngle(const AutoStabilizer::ControlMode& mode, const cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, const GaitParam& gaitParam, int i);
+  static double calcOutputJointTorque(const AutoStabilizer::ControlMode& mode, const cpp_filters::TwoPointInterpolator<double>& idleToAbcTransitionInterpolator, const GaitParam& gaitParam, int i);
+  static void copyFootStepStateSnapshot(const AutoStabilizer::ControlMode& mode, const GaitParam& gaitParam, AutoStabilizer::FootStepStateSnapshot& o_snapshot);
+  void publishFootStepState(); // mutex_をとった状態で呼ぶこと
+  void finishPipeline(); // 実行中の後段があれば終わるのを待ち、結果をgaitParam_に反映する. mutex_をとった状態で呼ぶこと
 };
 
 
@@ -0,0 +1,140 @@
+/*
+  footguidedcontroller::calcFootGuidedControlの計算時間を、メモリ確保を行わない現在の実装と、ur_をコピーしてexp(-w*Tj)を要素ごとに計算する以前の実装とで比較する. 両者の結果の差も出力する
+  使い方: AutoStabilizerFootGuidedBench [key=value ...]
+  key=valueで与えるもの. 括弧内はdefault
+    segments(8) : ur_の要素数. 1以上
+    trajectories(2000) : ランダムに生成するur_の数
+    repeat(100) : 各ur_に対して計算を繰り返す回数
+    omega(3.13) : w[1/s]. sqrt(g/h)相当
+    seed(0) : 乱数のseed
+  T = cnoid::Vector3で計算する. LegCoordsGenerator::calcCOMCoords, Stabilizer::calcZMPと同じ型である
+*/
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iterator>
+#include <algorithm>
+#include <cnoid/EigenTypes>
+#include "FootGuidedController.h"
+
+namespace {
+  // 以前のcalcFootGuidedControl. 比較用
+  template <typename T> T calcFootGuidedControlReference(const double& w, const T& l, const T& x0, const std::vector<footguidedcontroller::LinearTrajectory<T> >& ur_) {
+    const int n = ur_.size();
+
+    std::vector<footguidedcontroller::LinearTrajectory<T> > ur;
+    ur.reserve(n + 2);
+    ur.push_back(footguidedcontroller::LinearTrajectory<T>(x0-l, x0-l, 0.0)); // j=0
+    std::copy(ur_.begin(), ur_.end(), std::back_inserter(ur)); // j=1 ~ j=n
+    ur.push_back(footguidedcontroller::LinearTrajectory<T>(ur_.back().getGoal(),ur_.back().getGoal(), 0.0)); // j=n+1
+
+    T u = x0*0.0;
+    double Tj = 0.0;
+    for(int j=0;j<=n;j++){
+      Tj += ur.at(j).getTime();
+      u += exp(- w * Tj) * (ur.at(j).getGoal() - ur.at(j+1).getStart() + (ur.at(j).getSlope() - ur.at(j+1).getSlope()) / w);
+    }
+
+    if((1 - exp(-2 * w * Tj)) == 0.0) { // ゼロ除算チェック
+      std::cerr << "[calcFootGuidedControl] (1 - exp(-2 * w * Tj))==0 !" << std::endl;
+      return ur[1].getStart();
+    }
+
+    return ur[1].getStart() + 2 / (1 - exp(-2 * w * Tj)) * u;
+  };
+
+  class Sample {
+  public:
+    cnoid::Vector3 l;
+    cnoid::Vector3 x0;
+    std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> > ur;
+  };
+}
+
+int main(int argc, char** argv){
+  int segments = 8;
+  int trajectories = 2000;
+  int repeat = 100;
+  double omega = 3.13;
+  unsigned int seed = 0;
+  for(int i=1;i<argc;i++){
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos){
+      std::cerr << "invalid argument " << arg << ". key=value is expected" << std::endl;
+      return 1;
+    }
+    std::string key = arg.substr(0, eq);
+    std::string value = arg.substr(eq+1);
+    if(key == "segments") segments = std::max(std::stoi(value), 1);
+    else if(key == "trajectories") trajectories = std::max(std::stoi(value), 1);
+    else if(key == "repeat") repeat = std::max(std::stoi(value), 1);
+    else if(key == "omega") omega = std::stod(value);
+    else if(key == "seed") seed = std::stoul(value);
+    else {
+      std::cerr << "unknown key " << key << std::endl;
+      return 1;
+    }
+  }
+
+  // 歩行中のrefZmpTrajに近いもの. 各要素は0~1[s]で、0.1[m]程度ずつ移動する. 時間0の要素はstartとgoalを同じにする
+  std::mt19937 engine(seed);
+  std::uniform_real_distribution<double> pos(-0.1, 0.1);
+  std::uniform_real_distribution<double> time(0.0, 1.0);
+  std::bernoulli_distribution isZeroTime(0.1);
+  std::vector<Sample> samples(trajectories);
+  for(int i=0;i<trajectories;i++){
+    Sample& sample = samples[i];
+    sample.l = cnoid::Vector3(0.0, 0.0, 1.0);
+    sample.x0 = cnoid::Vector3(pos(engine), pos(engine), 0.0);
+    cnoid::Vector3 start = cnoid::Vector3(pos(engine), pos(engine), 0.0);
+    for(int j=0;j<segments;j++){
+      bool zero = (j != 0) && isZeroTime(engine);
+      cnoid::Vector3 goal = zero ? start : cnoid::Vector3(start + cnoid::Vector3(pos(engine), pos(engine), 0.0));
+      sample.ur.emplace_back(start, goal, zero ? 0.0 : time(engine) + 0.05);
+      start = goal;
+    }
+  }
+
+  // 結果の差
+  double maxError = 0.0;
+  double maxRelError = 0.0;
+  for(int i=0;i<trajectories;i++){
+    const Sample& sample = samples[i];
+    cnoid::Vector3 ref = calcFootGuidedControlReference(omega, sample.l, sample.x0, sample.ur);
+    cnoid::Vector3 cur = footguidedcontroller::calcFootGuidedControl(omega, sample.l, sample.x0, sample.ur);
+    double error = (cur - ref).cwiseAbs().maxCoeff();
+    maxError = std::max(maxError, error);
+    maxRelError = std::max(maxRelError, error / std::max(ref.cwiseAbs().maxCoeff(), 1e-12));
+  }
+
+  // 計算時間. 結果を足し合わせて出力し、計算が省略されないようにする
+  cnoid::Vector3 sumRef = cnoid::Vector3::Zero();
+  std::chrono::steady_clock::time_point refBegin = std::chrono::steady_clock::now();
+  for(int r=0;r<repeat;r++){
+    for(int i=0;i<trajectories;i++){
+      sumRef += calcFootGuidedControlReference(omega, samples[i].l, samples[i].x0, samples[i].ur);
+    }
+  }
+  double refTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - refBegin).count();
+
+  cnoid::Vector3 sumCur = cnoid::Vector3::Zero();
+  std::chrono::steady_clock::time_point curBegin = std::chrono::steady_clock::now();
+  for(int r=0;r<repeat;r++){
+    for(int i=0;i<trajectories;i++){
+      sumCur += footguidedcontroller::calcFootGuidedControl(omega, samples[i].l, samples[i].x0, samples[i].ur);
+    }
+  }
+  double curTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - curBegin).count();
+
+  const double calls = (double)repeat * trajectories;
+  std::cerr << "[AutoStabilizerFootGuidedBench] segments " << segments << ", " << calls << " calls" << std::endl;
+  std::cerr << "  reference [ns/call]: " << refTime / calls * 1e9 << std::endl;
+  std::cerr << "  current [ns/call]: " << curTime / calls * 1e9 << std::endl;
+  std::cerr << "  max error: " << maxError << ", max relative error: " << maxRelError << std::endl;
+  std::cerr << "  checksum: " << sumRef.transpose() << " / " << sumCur.transpose() << std::endl;
+  return 0;
+}
@@ -0,0 +1,373 @@
+/*
+  LipmPlantとOfflineAutoStabilizerで閉ループを組み、ランダムな押し動作からの回復試験を全速力で繰り返して、成功率と1周期あたりの計算時間を出力する
+  使い方: AutoStabilizerPushTest <conf file> [key=value ...]
+    conf file: AutoStabilizerに与えているconf file. model, end_effectors, dt等を読む. "key: value"形式
+  key=valueで与えるもの. 括弧内はdefault. conf fileの同名のkeyよりも優先する
+    reference_q() : qRefに与える関節角度[rad]. ','または空白区切りで、要素数はnumJoints. 空なら全て0
+    trials(100) : 1つのparameterの組あたりの試行回数
+    seed(0) : 乱数のseed
+    threads(CPUの数) : 並列に試行を行うスレッドの数. 試行ごとに独立したOfflineAutoStabilizerとLipmPlantを使う
+    start_st_time(3.0) : startAutoBalancerしてからstartStabilizerするまでの時間[s]
+    push_time(4.0) push_time_range(1.0) : 押す時刻[s]. startAutoBalancerからの経過時間. [push_time, push_time + push_time_range)の一様乱数
+    push_force_min(50.0) push_force_max(300.0) : 押す力の大きさ[N]. 一様乱数
+    push_direction_min(-180.0) push_direction_max(180.0) : 押す向き[deg]. generate frameのX軸から反時計回り. 一様乱数
+    push_duration(0.1) : 押す時間[s]
+    observe_time(4.0) : 押し終わってから観察する時間[s]. この間に転倒しなければ成功
+    fall_distance(0.2) : LipmPlant::fallDistance[m]
+    verbose(0) : 1なら各試行の結果を出力する
+  以下はFootStepGeneratorのparameterで、','区切りで複数の値を与えると全ての組み合わせについて試行を行う. 括弧内はdefault. 空ならFootStepGeneratorのdefault
+    default_step_time() : FootStepGenerator::defaultStepTime[s]. emergency stepの一歩の時間にも使われる
+    is_emergency_step_mode() : FootStepGenerator::isEmergencyStepMode. 0 or 1
+    emergency_step_cp_check_margin() : FootStepGenerator::emergencyStepCpCheckMargin[m]
+    emergency_step_num() : FootStepGenerator::emergencyStepNum
+  押し動作は試行の番号ごとに一度だけ生成し、全てのparameterの組で共通にする. 結果はthreadsによらない
+  threadsが2以上の場合、1周期あたりの計算時間は他のスレッドとのキャッシュやメモリ帯域の競合を含む. 実機相当の値を見るならthreads=1とすること
+  上記以外のparameterはservice callによる変更を行わないので、defaultのparameterで動く
+*/
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "OfflineAutoStabilizer.h"
+#include "LipmPlant.h"
+#include "PipelineWorker.h"
+
+namespace {
+  // parameterの組. 負の値は「FootStepGeneratorのdefaultのまま」を表す
+  class SweepParam {
+  public:
+    double defaultStepTime = -1.0;
+    int isEmergencyStepMode = -1;
+    double emergencyStepCpCheckMargin = -1.0;
+    int emergencyStepNum = -1;
+  };
+
+  class Option {
+  public:
+    std::vector<double> referenceQ;
+    int trials = 100;
+    unsigned int seed = 0;
+    int threads = 1;
+    double startStTime = 3.0;
+    double pushTime = 4.0;
+    double pushTimeRange = 1.0;
+    double pushForceMin = 50.0;
+    double pushForceMax = 300.0;
+    double pushDirectionMin = -180.0; // [deg]
+    double pushDirectionMax = 180.0; // [deg]
+    double pushDuration = 0.1;
+    double observeTime = 4.0;
+    double fallDistance = 0.2;
+    bool verbose = false;
+    std::vector<SweepParam> sweepParams; // 全ての組み合わせ
+  };
+
+  class TrialResult {
+  public:
+    double pushTime = 0.0;
+    cnoid::Vector3 pushForce = cnoid::Vector3::Zero();
+    bool isSuccess = false;
+    double fallTime = 0.0;
+    unsigned long ticks = 0;
+    double initTime = 0.0; // [s]. OfflineAutoStabilizerとLipmPlantの初期化にかかった時間
+    std::vector<double> execTime; // [s]. 1周期ごとのOfflineAutoStabilizer::execute()の計算時間
+  };
+
+  std::vector<double> parseList(std::string buf){
+    std::replace(buf.begin(), buf.end(), ',', ' ');
+    std::stringstream ss(buf);
+    std::vector<double> ret;
+    double value;
+    while(ss >> value) ret.push_back(value);
+    return ret;
+  }
+
+  void applySweepParam(const SweepParam& param, FootStepGenerator& footStepGenerator){
+    if(param.defaultStepTime > 0.0) footStepGenerator.defaultStepTime = param.defaultStepTime;
+    if(param.isEmergencyStepMode >= 0) footStepGenerator.isEmergencyStepMode = (param.isEmergencyStepMode != 0);
+    if(param.emergencyStepCpCheckMargin >= 0.0) footStepGenerator.emergencyStepCpCheckMargin = param.emergencyStepCpCheckMargin;
+    if(param.emergencyStepNum >= 1) footStepGenerator.emergencyStepNum = param.emergencyStepNum;
+  }
+
+  std::string toString(const SweepParam& param){
+    std::stringstream ss;
+    ss << "default_step_time=" << (param.defaultStepTime > 0.0 ? std::to_string(param.defaultStepTime) : "default")
+       << " is_emergency_step_mode=" << (param.isEmergencyStepMode >= 0 ? std::to_string(param.isEmergencyStepMode) : "default")
+       << " emergency_step_cp_check_margin=" << (param.emergencyStepCpCheckMargin >= 0.0 ? std::to_string(param.emergencyStepCpCheckMargin) : "default")
+       << " emergency_step_num=" << (param.emergencyStepNum >= 1 ? std::to_string(param.emergencyStepNum) : "default");
+    return ss.str();
+  }
+
+  // 1試行. astとplantは初期化済みのものを与える
+  void runTrial(const Option& option, OfflineAutoStabilizer& ast, LipmPlant& plant, TrialResult& o_result){
+    double dt = ast.dt();
+    plant.fallDistance = option.fallDistance;
+    plant.pushes.resize(1);
+    plant.pushes[0].startTime = o_result.pushTime;
+    plant.pushes[0].duration = option.pushDuration;
+    plant.pushes[0].force = o_result.pushForce;
+    plant.reset();
+
+    RTC::TimedDoubleSeq qRef;
+    qRef.data.length(ast.gaitParam().refRobotRaw->numJoints());
+    for(int i=0;i<qRef.data.length();i++) qRef.data[i] = (i < option.referenceQ.size()) ? option.referenceQ[i] : 0.0;
+
+    OfflineAutoStabilizer::InPortData& inPortData = ast.inPortData();
+    double endTime = o_result.pushTime + option.pushDuration + option.observeTime;
+    unsigned long endTick = std::ceil(endTime / dt);
+    unsigned long startStTick = std::round(option.startStTime / dt);
+    o_result.execTime.clear();
+    o_result.execTime.reserve(endTick);
+    for(unsigned long tick=0;tick<endTick;tick++){
+      if(tick == 0) ast.startAutoBalancer();
+      if(tick == startStTick) ast.startStabilizer();
+
+      qRef.tm.sec = std::floor(plant.time());
+      qRef.tm.nsec = (plant.time() - qRef.tm.sec) * 1e9;
+      inPortData.tm = qRef.tm;
+      inPortData.qRef = &qRef; // 最初の周期以外は変化しないが、RobotHardwareの周期で届き続けるので毎周期与える
+      plant.setInPortData(inPortData);
+
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      ast.execute();
+      o_result.execTime.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+
+      plant.update(ast);
+      if(plant.isFallen()) break;
+    }
+    o_result.ticks = o_result.execTime.size();
+    o_result.isSuccess = !plant.isFallen();
+    o_result.fallTime = plant.fallTime();
+  }
+
+  double percentile(const std::vector<double>& sorted, double ratio){
+    if(sorted.size() == 0) return 0.0;
+    return sorted[std::min((size_t)(ratio * sorted.size()), sorted.size() - 1)];
+  }
+
+  // 成功率(押す力の大きさごと, 向きごと)と1周期あたりの計算時間を出力する
+  void printResults(const Option& option, const std::vector<TrialResult>& results, double dt){
+    int successNum = 0;
+    for(int i=0;i<results.size();i++) if(results[i].isSuccess) successNum++;
+    std::cerr << "  " << successNum << " / " << results.size() << " trials succeeded" << std::endl;
+    const int forceBinNum = 5;
+    double forceBinWidth = (option.pushForceMax - option.pushForceMin) / forceBinNum;
+    for(int b=0;b<forceBinNum && forceBinWidth > 0.0;b++){
+      int num = 0, success = 0;
+      for(int i=0;i<results.size();i++){
+        int bin = std::min((int)((results[i].pushForce.norm() - option.pushForceMin) / forceBinWidth), forceBinNum - 1);
+        if(bin != b) continue;
+        num++;
+        if(results[i].isSuccess) success++;
+      }
+      std::cerr << "    push " << std::setw(6) << option.pushForceMin + forceBinWidth * b << " - " << std::setw(6) << option.pushForceMin + forceBinWidth * (b+1) << " [N]: " << success << " / " << num << std::endl;
+    }
+    const int dirBinNum = 4;
+    const char* dirBinName[dirBinNum] = {"front", "left", "back", "right"};
+    for(int b=0;b<dirBinNum;b++){
+      int num = 0, success = 0;
+      for(int i=0;i<results.size();i++){
+        double dir = std::atan2(results[i].pushForce[1], results[i].pushForce[0]); // -pi ~ pi
+        int bin = ((int)std::floor((dir + M_PI / dirBinNum) / (2 * M_PI / dirBinNum)) + dirBinNum) % dirBinNum;
+        if(bin != b) continue;
+        num++;
+        if(results[i].isSuccess) success++;
+      }
+      if(num > 0) std::cerr << "    push to " << std::setw(5) << dirBinName[b] << ": " << success << " / " << num << std::endl;
+    }
+
+    std::vector<double> execTime;
+    for(int i=0;i<results.size();i++) execTime.insert(execTime.end(), results[i].execTime.begin(), results[i].execTime.end());
+    std::sort(execTime.begin(), execTime.end());
+    double totalExecTime = 0.0;
+    for(int i=0;i<execTime.size();i++) totalExecTime += execTime[i];
+    if(execTime.size() > 0){
+      std::cerr << "    time per tick [ms]: mean " << totalExecTime / execTime.size() * 1e3 << ", p50 " << percentile(execTime, 0.5) * 1e3 << ", p99 " << percentile(execTime, 0.99) * 1e3 << ", p99.9 " << percentile(execTime, 0.999) * 1e3 << ", max " << execTime.back() * 1e3 << std::endl;
+    }
+    std::cerr << "    " << execTime.size() << " ticks (" << execTime.size() * dt << " [s])" << std::endl;
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 2){
+    std::cerr << "usage: " << argv[0] << " <conf file> [key=value ...]" << std::endl;
+    return 1;
+  }
+  std::map<std::string, std::string> properties;
+  if(!OfflineAutoStabilizer::readConfFile(argv[1], properties)){
+    std::cerr << "failed to open " << argv[1] << std::endl;
+    return 1;
+  }
+  for(int i=2;i<argc;i++){
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos){
+      std::cerr << "invalid argument " << arg << ". key=value is expected" << std::endl;
+      return 1;
+    }
+    properties[arg.substr(0, eq)] = arg.substr(eq+1);
+  }
+  // 各スレッドから同時に呼ばれるが、propertiesは読むだけなので安全
+  std::function<bool(const std::string&, std::string&)> getProperty = [&properties](const std::string& key, std::string& ret){
+    std::map<std::string, std::string>::const_iterator it = properties.find(key);
+    if(it == properties.end()) return false;
+    ret = it->second;
+    return true;
+  };
+
+  Option option;
+  option.threads = std::max((int)std::thread::hardware_concurrency(), 1);
+  {
+    std::string buf;
+    if(getProperty("reference_q", buf)) option.referenceQ = parseList(buf);
+    if(getProperty("trials", buf)) option.trials = std::stoi(buf);
+    if(getProperty("seed", buf)) option.seed = std::stoul(buf);
+    if(getProperty("threads", buf)) option.threads = std::max(std::stoi(buf), 1);
+    if(getProperty("start_st_time", buf)) option.startStTime = std::stod(buf);
+    if(getProperty("push_time", buf)) option.pushTime = std::stod(buf);
+    if(getProperty("push_time_range", buf)) option.pushTimeRange = std::stod(buf);
+    if(getProperty("push_force_min", buf)) option.pushForceMin = std::stod(buf);
+    if(getProperty("push_force_max", buf)) option.pushForceMax = std::stod(buf);
+    if(getProperty("push_direction_min", buf)) option.pushDirectionMin = std::stod(buf);
+    if(getProperty("push_direction_max", buf)) option.pushDirectionMax = std::stod(buf);
+    if(getProperty("push_duration", buf)) option.pushDuration = std::stod(buf);
+    if(getProperty("observe_time", buf)) option.observeTime = std::stod(buf);
+    if(getProperty("fall_distance", buf)) option.fallDistance = std::stod(buf);
+    if(getProperty("verbose", buf)) option.verbose = std::stoi(buf) != 0;
+
+    std::vector<double> defaultStepTime, isEmergencyStepMode, emergencyStepCpCheckMargin, emergencyStepNum;
+    if(getProperty("default_step_time", buf)) defaultStepTime = parseList(buf);
+    if(getProperty("is_emergency_step_mode", buf)) isEmergencyStepMode = parseList(buf);
+    if(getProperty("emergency_step_cp_check_margin", buf)) emergencyStepCpCheckMargin = parseList(buf);
+    if(getProperty("emergency_step_num", buf)) emergencyStepNum = parseList(buf);
+    if(defaultStepTime.size() == 0) defaultStepTime.push_back(-1.0);
+    if(isEmergencyStepMode.size() == 0) isEmergencyStepMode.push_back(-1);
+    if(emergencyStepCpCheckMargin.size() == 0) emergencyStepCpCheckMargin.push_back(-1.0);
+    if(emergencyStepNum.size() == 0) emergencyStepNum.push_back(-1);
+    for(int a=0;a<defaultStepTime.size();a++){
+      for(int b=0;b<isEmergencyStepMode.size();b++){
+        for(int c=0;c<emergencyStepCpCheckMargin.size();c++){
+          for(int d=0;d<emergencyStepNum.size();d++){
+            SweepParam param;
+            param.defaultStepTime = defaultStepTime[a];
+            param.isEmergencyStepMode = (int)isEmergencyStepMode[b];
+            param.emergencyStepCpCheckMargin = emergencyStepCpCheckMargin[c];
+            param.emergencyStepNum = (int)emergencyStepNum[d];
+            option.sweepParams.push_back(param);
+          }
+        }
+      }
+    }
+  }
+
+  // 押し動作は試行の番号ごとに生成し、全てのparameterの組で共通にする
+  std::vector<TrialResult> pushes(option.trials);
+  {
+    std::mt19937 engine(option.seed);
+    std::uniform_real_distribution<double> pushTimeDist(option.pushTime, option.pushTime + option.pushTimeRange);
+    std::uniform_real_distribution<double> pushForceDist(option.pushForceMin, option.pushForceMax);
+    std::uniform_real_distribution<double> pushDirDist(option.pushDirectionMin * M_PI / 180.0, option.pushDirectionMax * M_PI / 180.0);
+    for(int i=0;i<option.trials;i++){
+      double dir = pushDirDist(engine);
+      double force = pushForceDist(engine);
+      pushes[i].pushTime = pushTimeDist(engine);
+      pushes[i].pushForce = cnoid::Vector3(force * std::cos(dir), force * std::sin(dir), 0.0);
+    }
+  }
+
+  // 各試行は独立なOfflineAutoStabilizerとLipmPlantを持つので並列に実行できる. ただしmodelの読み込み(cnoid::BodyLoader)と破棄はスレッド安全とは限らないので排他する
+  std::vector<std::vector<TrialResult> > results(option.sweepParams.size(), pushes);
+  std::mutex initMutex;
+  double dt = 0.0;
+  int numJoints = 0;
+  bool isInitFailed = false;
+  std::function<void(int)> job = [&](int jobIdx){
+    int paramIdx = jobIdx / option.trials;
+    int trialIdx = jobIdx % option.trials;
+    TrialResult& result = results[paramIdx][trialIdx];
+
+    // 試行ごとに内部状態を完全に初期化するため、毎回作り直す
+    std::chrono::steady_clock::time_point initBegin = std::chrono::steady_clock::now();
+    std::unique_ptr<OfflineAutoStabilizer> ast = std::make_unique<OfflineAutoStabilizer>();
+    std::unique_ptr<LipmPlant> plant = std::make_unique<LipmPlant>();
+    {
+      std::lock_guard<std::mutex> guard(initMutex);
+      if(isInitFailed) return;
+      if(!ast->init(getProperty, "AutoStabilizerPushTest") || !plant->init(*ast)){
+        isInitFailed = true;
+        return;
+      }
+      dt = ast->dt();
+      numJoints = ast->gaitParam().refRobotRaw->numJoints();
+    }
+    applySweepParam(option.sweepParams[paramIdx], ast->footStepGenerator());
+    result.initTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - initBegin).count();
+
+    runTrial(option, *ast, *plant, result);
+
+    // modelの破棄も読み込みと同様に排他する
+    std::lock_guard<std::mutex> guard(initMutex);
+    plant.reset();
+    ast.reset();
+  };
+
+  std::chrono::steady_clock::time_point wallBegin = std::chrono::steady_clock::now();
+  {
+    // 各スレッドは未処理の試行が無くなるまで1つずつ取り出して実行する. 呼び出しスレッドも計算に参加する
+    const int jobNum = option.sweepParams.size() * option.trials;
+    std::atomic<int> nextJob{0};
+    std::function<void()> consume = [&](){
+      while(true){
+        int jobIdx = nextJob.fetch_add(1);
+        if(jobIdx >= jobNum) return;
+        job(jobIdx);
+      }
+    };
+    std::vector<std::unique_ptr<PipelineWorker> > workers(option.threads - 1);
+    for(int i=0;i<workers.size();i++){
+      workers[i] = std::make_unique<PipelineWorker>();
+      workers[i]->start();
+      workers[i]->submit(consume);
+    }
+    consume();
+    for(int i=0;i<workers.size();i++) workers[i]->wait();
+  }
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallBegin).count();
+  if(isInitFailed) return 1;
+
+  if(option.referenceQ.size() != numJoints){
+    std::cerr << "[AutoStabilizerPushTest] size of reference_q (" << option.referenceQ.size() << ") is not numJoints (" << numJoints << "). missing joints are 0" << std::endl;
+  }
+  unsigned long totalTicks = 0;
+  double initTime = 0.0;
+  for(int p=0;p<results.size();p++){
+    std::cerr << "[AutoStabilizerPushTest] " << toString(option.sweepParams[p]) << std::endl;
+    if(option.verbose){
+      for(int i=0;i<results[p].size();i++){
+        const TrialResult& result = results[p][i];
+        std::cerr << "  trial " << i << ": push " << result.pushForce.norm() << " [N] dir " << std::atan2(result.pushForce[1], result.pushForce[0]) * 180.0 / M_PI << " [deg] at " << result.pushTime << " [s] -> ";
+        if(result.isSuccess) std::cerr << "success" << std::endl;
+        else std::cerr << "fall at " << result.fallTime << " [s]" << std::endl;
+      }
+    }
+    printResults(option, results[p], dt);
+    for(int i=0;i<results[p].size();i++){
+      totalTicks += results[p][i].ticks;
+      initTime += results[p][i].initTime;
+    }
+  }
+  int trialNum = option.sweepParams.size() * option.trials;
+  std::cerr << "[AutoStabilizerPushTest] " << trialNum << " trials (" << option.sweepParams.size() << " parameter sets) with " << option.threads << " threads. " << totalTicks << " ticks (" << totalTicks * dt << " [s]) in " << wallTime << " [s] (init " << initTime << " [s] in total), real time factor " << totalTicks * dt / wallTime << ", " << trialNum / wallTime * 60.0 << " trials per minute" << std::endl;
+  return 0;
+}
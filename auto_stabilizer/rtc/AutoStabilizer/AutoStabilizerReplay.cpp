@@ -0,0 +1,407 @@
+/*
+  datalogger(hrpsys DataLogger)で記録したAutoStabilizerの入力を、OpenRTMのmanager/ExecutionContextを介さずにAutoStabilizerの制御処理に与えて全速力で再生し、記録された出力(q, genTau)と比較する. 回帰テストや、制御処理のみのprofileに使う
+  使い方: AutoStabilizerReplay <conf file> <log prefix> [key=value ...]
+    conf file: AutoStabilizerに与えているconf file. model, end_effectors, dt, joint_limit_table等を読む. "key: value"形式
+    log prefix: dataloggerの出力のprefix. 例: /tmp/test_JAXON_JVRC_20221106041023.
+  key=valueで与えるもの. 括弧内はdefault. conf fileの同名のkeyよりも優先する
+    qRef(sh_qOut) refTau() refBasePos(sh_basePosOut) refBaseRpy(sh_baseRpyOut) ref<EndEffector名>Wrench() ref<EndEffector名>Pose()
+    qAct(rh_q) dqAct(rh_dq) actImu(kf_rpy) act<ForceSensor名>(rh_<ForceSensor名>) selfCollision() steppableRegion() landingHeight()
+      : 各InPortに与えるログのport名. 空の場合やファイルが無い場合は、そのInPortにはdataが一度も届かなかったものとする
+    q(ast_q) genTau(ast_genTauOut) : 比較対象のログのport名. 空の場合やファイルが無い場合は比較しない
+    tolerance(1e-6) : 比較の許容誤差
+    start_abc() stop_abc() start_st() stop_st() : 最初のqRefの時刻からの経過時間[s]. その時刻にstartAutoBalancer等が呼ばれたものとする
+  qRefの各行が1周期にあたる. 他のログは、その周期の時刻以前の行のうち未読のものがあれば、最新の行がその周期に届いたものとする
+  selfCollision, steppableRegion, landingHeightはdataloggerで記録できない型なので、以下の形式のテキストファイルを別途用意する
+    selfCollision: "時刻 (link1 x1 y1 z1 link2 x2 y2 z2 dx21 dy21 dz21 distance)*衝突ペア数"
+    steppableRegion: "時刻 l_r 領域数 (頂点数 (x y z)*頂点数)*領域数"
+    landingHeight: "時刻 x y z nx ny nz l_r"
+  記録された出力と許容誤差内で一致すれば終了コード0, 一致しなければ2を返す
+  service callによるparameterの変更や歩行指令は再生しないので、全てdefaultのparameterで動く. pipeline_mode等の並列実行も使わない
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cnoid/ForceSensor>
+#include "OfflineAutoStabilizer.h"
+
+namespace {
+  // dataloggerの出力のテキストファイルを1行ずつ読む. 1行が "時刻 値 値 ..."
+  class LogReader {
+  public:
+    bool open(const std::string& fileName){
+      this->ifs_.open(fileName.c_str());
+      if(!this->ifs_) return false;
+      this->readLine();
+      return true;
+    }
+    bool isOpen() const { return this->ifs_.is_open(); }
+    // 1行読み進める
+    bool next(){
+      if(!this->hasNext_) return false;
+      this->time = this->nextTime_;
+      this->tokens.swap(this->nextTokens_);
+      this->readLine();
+      return true;
+    }
+    // timeの時刻以前の未読の行を、最新のものまで読み進める. 読み進めたらtrue
+    bool readUntil(double time){
+      bool updated = false;
+      while(this->hasNext_ && this->nextTime_ <= time + 1e-6){
+        this->next();
+        updated = true;
+      }
+      return updated;
+    }
+
+    double time = 0.0;
+    std::vector<std::string> tokens; // 時刻を除いた値
+  protected:
+    void readLine(){
+      std::string line;
+      while(std::getline(this->ifs_, line)){
+        std::stringstream ss(line);
+        std::string token;
+        if(!(ss >> token)) continue; // 空行
+        this->nextTime_ = std::stod(token);
+        this->nextTokens_.clear();
+        while(ss >> token) this->nextTokens_.push_back(token);
+        this->hasNext_ = true;
+        return;
+      }
+      this->hasNext_ = false;
+    }
+    std::ifstream ifs_;
+    bool hasNext_ = false;
+    double nextTime_ = 0.0;
+    std::vector<std::string> nextTokens_;
+  };
+
+  RTC::Time toTime(double time){
+    RTC::Time tm;
+    tm.sec = std::floor(time);
+    tm.nsec = std::round((time - tm.sec) * 1e9);
+    if(tm.nsec >= 1000000000) { tm.sec += 1; tm.nsec -= 1000000000; }
+    return tm;
+  }
+
+  bool toTimedDoubleSeq(const LogReader& log, RTC::TimedDoubleSeq& o_data){
+    o_data.tm = toTime(log.time);
+    o_data.data.length(log.tokens.size());
+    for(int i=0;i<log.tokens.size();i++) o_data.data[i] = std::stod(log.tokens[i]);
+    return true;
+  }
+  bool toTimedPoint3D(const LogReader& log, RTC::TimedPoint3D& o_data){
+    if(log.tokens.size() < 3) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.x = std::stod(log.tokens[0]); o_data.data.y = std::stod(log.tokens[1]); o_data.data.z = std::stod(log.tokens[2]);
+    return true;
+  }
+  bool toTimedOrientation3D(const LogReader& log, RTC::TimedOrientation3D& o_data){
+    if(log.tokens.size() < 3) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.r = std::stod(log.tokens[0]); o_data.data.p = std::stod(log.tokens[1]); o_data.data.y = std::stod(log.tokens[2]);
+    return true;
+  }
+  bool toTimedPose3D(const LogReader& log, RTC::TimedPose3D& o_data){
+    if(log.tokens.size() < 6) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.position.x = std::stod(log.tokens[0]); o_data.data.position.y = std::stod(log.tokens[1]); o_data.data.position.z = std::stod(log.tokens[2]);
+    o_data.data.orientation.r = std::stod(log.tokens[3]); o_data.data.orientation.p = std::stod(log.tokens[4]); o_data.data.orientation.y = std::stod(log.tokens[5]);
+    return true;
+  }
+  bool toTimedCollisionSeq(const LogReader& log, collision_checker_msgs::TimedCollisionSeq& o_data){
+    if(log.tokens.size() % 12 != 0) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.length(log.tokens.size() / 12);
+    for(int i=0;i<o_data.data.length();i++){
+      const std::string* t = &log.tokens[12*i];
+      o_data.data[i].link1 = t[0].c_str();
+      o_data.data[i].point1.x = std::stod(t[1]); o_data.data[i].point1.y = std::stod(t[2]); o_data.data[i].point1.z = std::stod(t[3]);
+      o_data.data[i].link2 = t[4].c_str();
+      o_data.data[i].point2.x = std::stod(t[5]); o_data.data[i].point2.y = std::stod(t[6]); o_data.data[i].point2.z = std::stod(t[7]);
+      o_data.data[i].direction21.x = std::stod(t[8]); o_data.data[i].direction21.y = std::stod(t[9]); o_data.data[i].direction21.z = std::stod(t[10]);
+      o_data.data[i].distance = std::stod(t[11]);
+    }
+    return true;
+  }
+  bool toTimedSteppableRegion(const LogReader& log, auto_stabilizer_msgs::TimedSteppableRegion& o_data){
+    if(log.tokens.size() < 2) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.l_r = std::stoi(log.tokens[0]);
+    int regionNum = std::stoi(log.tokens[1]);
+    o_data.data.region.length(regionNum);
+    int idx = 2;
+    for(int i=0;i<regionNum;i++){
+      if(idx >= log.tokens.size()) return false;
+      int vertexNum = std::stoi(log.tokens[idx++]);
+      if(idx + 3*vertexNum > log.tokens.size()) return false;
+      o_data.data.region[i].length(3*vertexNum);
+      for(int j=0;j<3*vertexNum;j++) o_data.data.region[i][j] = std::stod(log.tokens[idx++]);
+    }
+    return true;
+  }
+  bool toTimedLandingPosition(const LogReader& log, auto_stabilizer_msgs::TimedLandingPosition& o_data){
+    if(log.tokens.size() < 7) return false;
+    o_data.tm = toTime(log.time);
+    o_data.data.x = std::stod(log.tokens[0]); o_data.data.y = std::stod(log.tokens[1]); o_data.data.z = std::stod(log.tokens[2]);
+    o_data.data.nx = std::stod(log.tokens[3]); o_data.data.ny = std::stod(log.tokens[4]); o_data.data.nz = std::stod(log.tokens[5]);
+    o_data.data.l_r = std::stoi(log.tokens[6]);
+    return true;
+  }
+
+  // ログのtime以前の行を読み進め、新しい行があればo_dataに変換してそのアドレスを返す. 無ければnullptr
+  template<typename T>
+  const T* readPortData(LogReader& log, double time, bool (*convert)(const LogReader&, T&), T& o_data, const std::string& name){
+    if(!log.isOpen() || !log.readUntil(time)) return nullptr;
+    if(!convert(log, o_data)){
+      std::cerr << "[AutoStabilizerReplay] invalid line in " << name << " at " << log.time << std::endl;
+      return nullptr;
+    }
+    return &o_data;
+  }
+
+  // 1つの出力portについて、記録された値との誤差を集計する
+  class Comparison {
+  public:
+    void compare(const LogReader& log, const std::vector<double>& value, unsigned long tick, double tolerance){
+      if(log.tokens.size() != value.size()){
+        if(this->sizeMismatch == 0) std::cerr << "[AutoStabilizerReplay] size of " << this->name << " does not match (" << log.tokens.size() << " != " << value.size() << ") at " << log.time << std::endl;
+        this->sizeMismatch++;
+        return;
+      }
+      this->compared++;
+      for(int i=0;i<value.size();i++){
+        double error = std::abs(std::stod(log.tokens[i]) - value[i]);
+        if(!(error <= tolerance)){ // nanも不一致とする
+          this->mismatch++;
+          if(this->mismatch == 1){
+            this->firstMismatchTick = tick;
+            this->firstMismatchTime = log.time;
+            this->firstMismatchJoint = i;
+          }
+        }
+        if(!(error <= this->maxError)){
+          this->maxError = error;
+          this->maxErrorTime = log.time;
+          this->maxErrorJoint = i;
+        }
+      }
+    }
+    void print(std::ostream& os) const {
+      os << this->name << ": compared " << this->compared << " ticks";
+      if(this->compared == 0) { os << std::endl; return; }
+      os << ", max error " << this->maxError << " (joint " << this->maxErrorJoint << " at " << this->maxErrorTime << ")";
+      if(this->mismatch > 0) os << ", " << this->mismatch << " mismatched values. first mismatch at tick " << this->firstMismatchTick << " (time " << this->firstMismatchTime << ", joint " << this->firstMismatchJoint << ")";
+      if(this->sizeMismatch > 0) os << ", " << this->sizeMismatch << " ticks with size mismatch";
+      os << std::endl;
+    }
+    bool ok() const { return this->mismatch == 0 && this->sizeMismatch == 0; }
+
+    std::string name;
+    unsigned long compared = 0, mismatch = 0, sizeMismatch = 0;
+    double maxError = 0.0, maxErrorTime = 0.0;
+    int maxErrorJoint = -1;
+    unsigned long firstMismatchTick = 0;
+    double firstMismatchTime = 0.0;
+    int firstMismatchJoint = -1;
+  };
+}
+
+class AutoStabilizerReplay {
+public:
+  bool init(const std::map<std::string, std::string>& properties, const std::string& logPrefix){
+    this->properties_ = properties;
+    this->logPrefix_ = logPrefix;
+    if(!this->ast_.init([this](const std::string& key, std::string& ret){ return this->getProperty(key, ret); }, "AutoStabilizerReplay")) return false;
+    const GaitParam& gaitParam = this->ast_.gaitParam();
+
+    // open logs
+    if(!this->openLog("qRef", "sh_qOut", this->qRefLog_) ){
+      std::cerr << "[AutoStabilizerReplay] failed to open qRef log" << std::endl;
+      return false;
+    }
+    this->openLog("refTau", "", this->refTauLog_);
+    this->openLog("refBasePos", "sh_basePosOut", this->refBasePosLog_);
+    this->openLog("refBaseRpy", "sh_baseRpyOut", this->refBaseRpyLog_);
+    this->refEEWrenchLog_.resize(gaitParam.eeName.size());
+    this->refEEWrench_.resize(gaitParam.eeName.size());
+    this->refEEPoseLog_.resize(gaitParam.eeName.size());
+    this->refEEPose_.resize(gaitParam.eeName.size());
+    for(int i=0;i<gaitParam.eeName.size();i++){
+      this->openLog("ref"+gaitParam.eeName[i]+"Wrench", "", this->refEEWrenchLog_[i]);
+      this->openLog("ref"+gaitParam.eeName[i]+"Pose", "", this->refEEPoseLog_[i]);
+    }
+    this->openLog("qAct", "rh_q", this->qActLog_);
+    this->openLog("dqAct", "rh_dq", this->dqActLog_);
+    this->openLog("actImu", "kf_rpy", this->actImuLog_);
+    cnoid::DeviceList<cnoid::ForceSensor> forceSensors(gaitParam.actRobotRaw->devices());
+    this->actWrenchLog_.resize(forceSensors.size());
+    this->actWrench_.resize(forceSensors.size());
+    for(int i=0;i<forceSensors.size();i++){
+      this->openLog("act"+forceSensors[i]->name(), "rh_"+forceSensors[i]->name(), this->actWrenchLog_[i]);
+    }
+    this->openLog("selfCollision", "", this->selfCollisionLog_);
+    this->openLog("steppableRegion", "", this->steppableRegionLog_);
+    this->openLog("landingHeight", "", this->landingHeightLog_);
+    this->openLog("q", "ast_q", this->qLog_);
+    this->openLog("genTau", "ast_genTauOut", this->genTauLog_);
+
+    std::string buf;
+    if(this->getProperty("tolerance", buf)) this->tolerance_ = std::stod(buf);
+    const std::vector<std::pair<std::string, bool (OfflineAutoStabilizer::*)()> > transitions{
+      {"start_abc", &OfflineAutoStabilizer::startAutoBalancer}, {"stop_abc", &OfflineAutoStabilizer::stopAutoBalancer},
+      {"start_st", &OfflineAutoStabilizer::startStabilizer}, {"stop_st", &OfflineAutoStabilizer::stopStabilizer}};
+    for(int i=0;i<transitions.size();i++){
+      if(this->getProperty(transitions[i].first, buf) && !buf.empty()) this->transitions_.push_back(Transition{std::stod(buf), transitions[i].second, transitions[i].first});
+    }
+    std::sort(this->transitions_.begin(), this->transitions_.end(), [](const Transition& a, const Transition& b){ return a.time < b.time; });
+    return true;
+  }
+
+  // 記録された出力と一致すればtrue
+  bool run(){
+    Comparison qComparison, genTauComparison;
+    qComparison.name = "q";
+    genTauComparison.name = "genTau";
+    OfflineAutoStabilizer::InPortData& inPortData = this->ast_.inPortData();
+    unsigned long tick = 0;
+    int nextTransition = 0;
+    double startTime = 0.0;
+    double totalTime = 0.0, maxTime = 0.0; // [s]
+    unsigned long maxTimeTick = 0;
+
+    while(this->qRefLog_.next()){
+      double time = this->qRefLog_.time;
+      if(tick == 0) startTime = time;
+
+      // 今周期に届いたdataを与える
+      toTimedDoubleSeq(this->qRefLog_, this->qRef_);
+      inPortData.tm = this->qRef_.tm;
+      inPortData.qRef = &this->qRef_;
+      inPortData.refTau = readPortData(this->refTauLog_, time, toTimedDoubleSeq, this->refTau_, "refTau");
+      inPortData.refBasePos = readPortData(this->refBasePosLog_, time, toTimedPoint3D, this->refBasePos_, "refBasePos");
+      inPortData.refBaseRpy = readPortData(this->refBaseRpyLog_, time, toTimedOrientation3D, this->refBaseRpy_, "refBaseRpy");
+      for(int i=0;i<this->refEEWrenchLog_.size();i++) inPortData.refEEWrench[i] = readPortData(this->refEEWrenchLog_[i], time, toTimedDoubleSeq, this->refEEWrench_[i], "refEEWrench");
+      for(int i=0;i<this->refEEPoseLog_.size();i++) inPortData.refEEPose[i] = readPortData(this->refEEPoseLog_[i], time, toTimedPose3D, this->refEEPose_[i], "refEEPose");
+      inPortData.qAct = readPortData(this->qActLog_, time, toTimedDoubleSeq, this->qAct_, "qAct");
+      inPortData.dqAct = readPortData(this->dqActLog_, time, toTimedDoubleSeq, this->dqAct_, "dqAct");
+      inPortData.actImu = readPortData(this->actImuLog_, time, toTimedOrientation3D, this->actImu_, "actImu");
+      for(int i=0;i<this->actWrenchLog_.size();i++) inPortData.actWrench[i] = readPortData(this->actWrenchLog_[i], time, toTimedDoubleSeq, this->actWrench_[i], "actWrench");
+      inPortData.selfCollision = readPortData(this->selfCollisionLog_, time, toTimedCollisionSeq, this->selfCollision_, "selfCollision");
+      inPortData.steppableRegion = readPortData(this->steppableRegionLog_, time, toTimedSteppableRegion, this->steppableRegion_, "steppableRegion");
+      inPortData.landingHeight = readPortData(this->landingHeightLog_, time, toTimedLandingPosition, this->landingHeight_, "landingHeight");
+
+      // startAutoBalancer等. 実機ではservice callのスレッドでsetNextTransitionした後の周期のonExecuteで遷移が始まる
+      while(nextTransition < this->transitions_.size() && time - startTime >= this->transitions_[nextTransition].time - 1e-6){
+        if(!(this->ast_.*(this->transitions_[nextTransition].transition))()){
+          std::cerr << "[AutoStabilizerReplay] " << this->transitions_[nextTransition].name << " is ignored at " << time << " (mode " << this->ast_.mode() << ")" << std::endl;
+        }
+        nextTransition++;
+      }
+
+      // onExecuteのうち、portの読み書き以外の部分
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      if(!this->ast_.execute()){ // qRefの要素数が合わない. onExecuteでは何も出力しない
+        std::cerr << "[AutoStabilizerReplay] qRef is invalid at " << time << std::endl;
+        tick++;
+        continue;
+      }
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      totalTime += elapsed;
+      if(elapsed > maxTime) { maxTime = elapsed; maxTimeTick = tick; }
+
+      // 記録された出力と比較する. 出力のtmは入力のqRefのtmと同じ
+      if(this->qLog_.isOpen() && this->qLog_.readUntil(time) && std::abs(this->qLog_.time - time) < 1e-6) qComparison.compare(this->qLog_, this->ast_.q(), tick, this->tolerance_);
+      if(this->genTauLog_.isOpen() && this->genTauLog_.readUntil(time) && std::abs(this->genTauLog_.time - time) < 1e-6) genTauComparison.compare(this->genTauLog_, this->ast_.genTau(), tick, this->tolerance_);
+
+      tick++;
+    }
+
+    std::cerr << "[AutoStabilizerReplay] replayed " << tick << " ticks (" << tick * this->ast_.dt() << " [s])" << std::endl;
+    if(tick > 0){
+      std::cerr << "  time per tick: mean " << totalTime / tick * 1e3 << " [ms], max " << maxTime * 1e3 << " [ms] (tick " << maxTimeTick << "), real time factor " << tick * this->ast_.dt() / totalTime << std::endl;
+    }
+    std::cerr << "  "; qComparison.print(std::cerr);
+    std::cerr << "  "; genTauComparison.print(std::cerr);
+    return qComparison.ok() && genTauComparison.ok();
+  }
+
+protected:
+  bool getProperty(const std::string& key, std::string& ret){
+    std::map<std::string, std::string>::const_iterator it = this->properties_.find(key);
+    if(it == this->properties_.end()) return false;
+    ret = it->second;
+    return true;
+  }
+  bool openLog(const std::string& key, const std::string& defaultPort, LogReader& log){
+    std::string port = defaultPort;
+    this->getProperty(key, port);
+    if(port.empty()) return false;
+    if(!log.open(this->logPrefix_ + port)){
+      std::cerr << "[AutoStabilizerReplay] " << key << ": " << this->logPrefix_ + port << " is not found" << std::endl;
+      return false;
+    }
+    std::cerr << "[AutoStabilizerReplay] " << key << ": " << this->logPrefix_ + port << std::endl;
+    return true;
+  }
+
+  class Transition {
+  public:
+    double time;
+    bool (OfflineAutoStabilizer::*transition)();
+    std::string name;
+  };
+
+  std::map<std::string, std::string> properties_;
+  std::string logPrefix_;
+  double tolerance_ = 1e-6;
+  std::vector<Transition> transitions_;
+
+  OfflineAutoStabilizer ast_;
+  LogReader qRefLog_, refTauLog_, refBasePosLog_, refBaseRpyLog_, qActLog_, dqActLog_, actImuLog_, selfCollisionLog_, steppableRegionLog_, landingHeightLog_, qLog_, genTauLog_;
+  std::vector<LogReader> refEEWrenchLog_, refEEPoseLog_, actWrenchLog_;
+  RTC::TimedDoubleSeq qRef_, refTau_, qAct_, dqAct_;
+  RTC::TimedPoint3D refBasePos_;
+  RTC::TimedOrientation3D refBaseRpy_, actImu_;
+  std::vector<RTC::TimedDoubleSeq> refEEWrench_, actWrench_;
+  std::vector<RTC::TimedPose3D> refEEPose_;
+  collision_checker_msgs::TimedCollisionSeq selfCollision_;
+  auto_stabilizer_msgs::TimedSteppableRegion steppableRegion_;
+  auto_stabilizer_msgs::TimedLandingPosition landingHeight_;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+int main(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: " << argv[0] << " <conf file> <log prefix> [key=value ...]" << std::endl;
+    return 1;
+  }
+  std::map<std::string, std::string> properties;
+  if(!OfflineAutoStabilizer::readConfFile(argv[1], properties)){
+    std::cerr << "failed to open " << argv[1] << std::endl;
+    return 1;
+  }
+  for(int i=3;i<argc;i++){
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos){
+      std::cerr << "invalid argument " << arg << ". key=value is expected" << std::endl;
+      return 1;
+    }
+    properties[arg.substr(0, eq)] = arg.substr(eq+1);
+  }
+
+  std::unique_ptr<AutoStabilizerReplay> replay = std::make_unique<AutoStabilizerReplay>();
+  if(!replay->init(properties, argv[2])) return 1;
+  return replay->run() ? 0 : 2;
+}
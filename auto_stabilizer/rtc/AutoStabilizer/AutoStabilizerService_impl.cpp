@@ -81,6 +81,17 @@ CORBA::Boolean AutoStabilizerService_impl::getFootStepState(OpenHRP::AutoStabili
   return this->comp_->getFootStepState(*i_param);
 };
 
+CORBA::Boolean AutoStabilizerService_impl::getInPortStatus(OpenHRP::AutoStabilizerService::InPortStatusSequence_out i_param)
+{
+  i_param = new OpenHRP::AutoStabilizerService::InPortStatusSequence();
+  return this->comp_->getInPortStatus(*i_param);
+};
+
+CORBA::Boolean AutoStabilizerService_impl::resetInPortStatus()
+{
+  return this->comp_->resetInPortStatus();
+};
+
 CORBA::Boolean AutoStabilizerService_impl::releaseEmergencyStop()
 {
     return this->comp_->releaseEmergencyStop();
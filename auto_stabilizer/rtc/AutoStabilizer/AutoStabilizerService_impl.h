@@ -27,6 +27,8 @@ public:
   CORBA::Boolean setAutoStabilizerParam(const OpenHRP::AutoStabilizerService::AutoStabilizerParam& i_param);
   CORBA::Boolean getAutoStabilizerParam(OpenHRP::AutoStabilizerService::AutoStabilizerParam_out i_param);
   CORBA::Boolean getFootStepState(OpenHRP::AutoStabilizerService::FootStepState_out i_param);
+  CORBA::Boolean getInPortStatus(OpenHRP::AutoStabilizerService::InPortStatusSequence_out i_param);
+  CORBA::Boolean resetInPortStatus();
   CORBA::Boolean releaseEmergencyStop();
   CORBA::Boolean startImpedanceController(const char *i_name_);
   CORBA::Boolean stopImpedanceController(const char *i_name_);
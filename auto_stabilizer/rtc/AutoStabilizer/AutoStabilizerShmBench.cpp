@@ -0,0 +1,200 @@
+/*
+  JointShmChannelを介してqRef, qActを受け取りqを返すまでの往復の遅延を計測する. 1プロセス内の2スレッドで、RobotHardware側とAutoStabilizer側を模擬する
+  使い方: AutoStabilizerShmBench <conf file> [key=value ...]
+    conf file: AutoStabilizerに与えているconf file. model, end_effectors, dt等を読む. "key: value"形式
+  key=valueで与えるもの. 括弧内はdefault. conf fileの同名のkeyよりも優先する
+    ticks(5000) : 計測する周期の数
+    period(conf fileのdt) : RobotHardware側がqRef, qActを書き込む周期[s]. 0なら前の周期のqを受け取った直後に次を書き込む
+    execute(1) : 1ならAutoStabilizer側はOfflineAutoStabilizer::execute()(startAutoBalancer済み)を行ってからqを書き込む. 0なら受け取ったqActをそのままqとして書き込み、通信のみの遅延を見る
+    reference_q() : qRefに与える関節角度[rad]. ','または空白区切りで、要素数はnumJoints. 空なら全て0
+    joint_shm_prefix(/dev/shm/AutoStabilizerShmBench) joint_shm_capacity(4) : AutoStabilizerのproperty joint_shm_prefix, joint_shm_capacityと同じ
+  AutoStabilizerと同様に、AutoStabilizer側がファイルをcreateし、RobotHardware側はそれをopenする
+  往復の遅延(RobotHardware側がqActを書き込んでから、同じ時刻のqを読むまで)と、そのうちAutoStabilizer側がqActを読んでからqを書き込むまでの時間を出力する. 両者の差が共有メモリによる通信の遅延である
+  両スレッドとも読み込みはbusy waitで行うので、CPUが2つ以上空いている環境で使うこと
+*/
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include "OfflineAutoStabilizer.h"
+#include "JointShmChannel.h"
+
+namespace {
+  std::vector<double> parseList(std::string buf){
+    std::replace(buf.begin(), buf.end(), ',', ' ');
+    std::stringstream ss(buf);
+    std::vector<double> ret;
+    double value;
+    while(ss >> value) ret.push_back(value);
+    return ret;
+  }
+
+  double percentile(const std::vector<double>& sorted, double ratio){
+    if(sorted.size() == 0) return 0.0;
+    return sorted[std::min((size_t)(ratio * sorted.size()), sorted.size() - 1)];
+  }
+
+  void printLatency(const std::string& name, std::vector<double> latency){
+    if(latency.size() == 0) return;
+    std::sort(latency.begin(), latency.end());
+    double total = 0.0;
+    for(int i=0;i<latency.size();i++) total += latency[i];
+    std::cerr << "  " << name << " [us]: mean " << total / latency.size() * 1e6 << ", p50 " << percentile(latency, 0.5) * 1e6 << ", p99 " << percentile(latency, 0.99) * 1e6 << ", p99.9 " << percentile(latency, 0.999) * 1e6 << ", max " << latency.back() * 1e6 << std::endl;
+  }
+
+  double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 2){
+    std::cerr << "usage: " << argv[0] << " <conf file> [key=value ...]" << std::endl;
+    return 1;
+  }
+  std::map<std::string, std::string> properties;
+  if(!OfflineAutoStabilizer::readConfFile(argv[1], properties)){
+    std::cerr << "failed to open " << argv[1] << std::endl;
+    return 1;
+  }
+  for(int i=2;i<argc;i++){
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos){
+      std::cerr << "invalid argument " << arg << ". key=value is expected" << std::endl;
+      return 1;
+    }
+    properties[arg.substr(0, eq)] = arg.substr(eq+1);
+  }
+  std::function<bool(const std::string&, std::string&)> getProperty = [&properties](const std::string& key, std::string& ret){
+    std::map<std::string, std::string>::const_iterator it = properties.find(key);
+    if(it == properties.end()) return false;
+    ret = it->second;
+    return true;
+  };
+
+  OfflineAutoStabilizer ast;
+  if(!ast.init(getProperty, "AutoStabilizerShmBench")) return 1;
+  const int numJoints = ast.gaitParam().refRobotRaw->numJoints();
+
+  int ticks = 5000;
+  double period = ast.dt();
+  bool execute = true;
+  std::vector<double> referenceQ;
+  std::string prefix = "/dev/shm/AutoStabilizerShmBench";
+  int capacity = 4;
+  {
+    std::string buf;
+    if(getProperty("ticks", buf)) ticks = std::max(std::stoi(buf), 1);
+    if(getProperty("period", buf)) period = std::max(std::stod(buf), 0.0);
+    if(getProperty("execute", buf)) execute = std::stoi(buf) != 0;
+    if(getProperty("reference_q", buf)) referenceQ = parseList(buf);
+    if(getProperty("joint_shm_prefix", buf) && buf != "") prefix = buf;
+    if(getProperty("joint_shm_capacity", buf)) capacity = std::max(std::stoi(buf), 2);
+  }
+  if(referenceQ.size() != numJoints){
+    std::cerr << "[AutoStabilizerShmBench] size of reference_q (" << referenceQ.size() << ") is not numJoints (" << numJoints << "). missing joints are 0" << std::endl;
+  }
+  referenceQ.resize(numJoints, 0.0);
+
+  // AutoStabilizer側. AutoStabilizerと同じくcreateする
+  JointShmChannel astQRef, astQAct, astQ;
+  if(!astQRef.create(prefix + "_qRef", numJoints, capacity) ||
+     !astQAct.create(prefix + "_qAct", numJoints, capacity) ||
+     !astQ.create(prefix + "_q", numJoints, capacity)) return 1;
+  // RobotHardware側
+  JointShmChannel rhQRef, rhQAct, rhQ;
+  if(!rhQRef.open(prefix + "_qRef") ||
+     !rhQAct.open(prefix + "_qAct") ||
+     !rhQ.open(prefix + "_q")) return 1;
+
+  if(execute) ast.startAutoBalancer();
+
+  std::atomic<bool> isRunning(true);
+  std::vector<double> ctrlTime; // [s]. AutoStabilizer側がqActを読んでからqを書き込むまで
+  ctrlTime.reserve(ticks);
+  std::thread astThread([&](){
+    RTC::TimedDoubleSeq qRef, qAct;
+    qRef.data.length(numJoints);
+    qAct.data.length(numJoints);
+    std::vector<double> q(numJoints, 0.0);
+    bool isQRefReceived = false;
+    OfflineAutoStabilizer::InPortData& inPortData = ast.inPortData();
+    while(isRunning.load(std::memory_order_relaxed)){
+      int64_t sec, nsec;
+      // RobotHardware側はqRef, qActの順に書き込むので、qActを読めたならその周期のqRefも既に届いている
+      if(astQRef.read(sec, nsec, qRef.data.get_buffer())){
+        qRef.tm.sec = sec;
+        qRef.tm.nsec = nsec;
+        isQRefReceived = true;
+      }
+      if(!astQAct.read(sec, nsec, qAct.data.get_buffer())) continue;
+      double begin = now();
+      qAct.tm.sec = sec;
+      qAct.tm.nsec = nsec;
+      if(execute && isQRefReceived){
+        inPortData.tm = qRef.tm;
+        inPortData.qRef = &qRef;
+        inPortData.qAct = &qAct;
+        ast.execute();
+        astQ.write(sec, nsec, ast.q().data());
+      }else{
+        for(int i=0;i<numJoints;i++) q[i] = qAct.data[i];
+        astQ.write(sec, nsec, q.data());
+      }
+      ctrlTime.push_back(now() - begin);
+    }
+  });
+
+  std::vector<double> roundTrip; // [s]. RobotHardware側がqActを書き込んでから同じ時刻のqを読むまで
+  roundTrip.reserve(ticks);
+  int lost = 0;
+  {
+    std::vector<double> qAct = referenceQ;
+    std::vector<double> q(numJoints, 0.0);
+    double next = now();
+    for(int tick=0;tick<ticks;tick++){
+      if(period > 0.0){
+        next += period;
+        while(now() < next) {} // sleepの遅延を含めないようにbusy waitする
+      }
+      // tmで周期を識別する
+      int64_t sec = tick / 1000000000LL;
+      int64_t nsec = tick % 1000000000LL;
+      double begin = now();
+      rhQRef.write(sec, nsec, referenceQ.data());
+      rhQAct.write(sec, nsec, qAct.data());
+      int64_t qSec = -1, qNsec = -1;
+      while(qSec != sec || qNsec != nsec){
+        if(now() - begin > 1.0) break;
+        rhQ.read(qSec, qNsec, q.data());
+      }
+      if(qSec != sec || qNsec != nsec){
+        lost++;
+        continue;
+      }
+      roundTrip.push_back(now() - begin);
+      qAct = q; // 指令値通りに関節が動いたものとする
+    }
+  }
+  isRunning = false;
+  astThread.join();
+
+  std::cerr << "[AutoStabilizerShmBench] " << ticks << " ticks, " << numJoints << " joints, period " << period << " [s], execute " << execute << std::endl;
+  printLatency("round trip", roundTrip);
+  printLatency("AutoStabilizer side", ctrlTime);
+  std::cerr << "  lost " << lost << ", skipped qRef " << astQRef.skipped() << " qAct " << astQAct.skipped() << " q " << rhQ.skipped() << std::endl;
+
+  ::unlink((prefix + "_qRef").c_str());
+  ::unlink((prefix + "_qAct").c_str());
+  ::unlink((prefix + "_q").c_str());
+  return lost == 0 ? 0 : 2;
+}
@@ -0,0 +1,111 @@
+/*
+  SnapshotBufferのwriterとreaderを並行に全速力で動かし、readerが破れたスナップショット(書き込み途中のスロット)や古いスナップショットを読まないことを確認する
+  使い方: AutoStabilizerSnapshotStress [key=value ...]
+  key=valueで与えるもの. 括弧内はdefault
+    duration(5.0) : 試験時間[s]
+    readers(3) : readerのスレッドの数. 1以上
+    size(64) : スナップショットの要素数. FootStepStateSnapshotのgenJointAngleと同様に、init後に要素数を変えないstd::vector<double>とする. 1以上
+    writer_sleep(0) : writerが公開するたびにsleepする時間[us]. 0ならsleepしない
+  writerはi回目の公開で、全要素と通し番号をiにする. readerは、読んだスナップショットの全要素が通し番号と一致すること、通し番号が前回読んだもの以上であることを確認する
+  いずれかが破られたら、その内容を出力して1を返す. 破られなければ、公開回数と読み込み回数を出力して0を返す
+  弱いメモリモデルのCPU(ARM等)で実行しないと、fenceの欠落による問題は現れにくい
+*/
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "SnapshotBuffer.h"
+
+namespace {
+  class Snapshot {
+  public:
+    unsigned long long seq = 0;
+    std::vector<double> values;
+  };
+}
+
+int main(int argc, char** argv){
+  double duration = 5.0;
+  int numReaders = 3;
+  int size = 64;
+  int writerSleep = 0;
+  for(int i=1;i<argc;i++){
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos){
+      std::cerr << "invalid argument " << arg << ". key=value is expected" << std::endl;
+      return 1;
+    }
+    std::string key = arg.substr(0, eq);
+    std::string value = arg.substr(eq+1);
+    if(key == "duration") duration = std::max(std::stod(value), 0.0);
+    else if(key == "readers") numReaders = std::max(std::stoi(value), 1);
+    else if(key == "size") size = std::max(std::stoi(value), 1);
+    else if(key == "writer_sleep") writerSleep = std::max(std::stoi(value), 0);
+    else {
+      std::cerr << "unknown key " << key << std::endl;
+      return 1;
+    }
+  }
+
+  SnapshotBuffer<Snapshot> buffer;
+  {
+    Snapshot snapshot;
+    snapshot.values.resize(size, 0.0);
+    buffer.init(snapshot);
+  }
+
+  std::atomic<bool> quit{false};
+  std::atomic<bool> isFailed{false};
+  std::atomic<unsigned long long> numReads{0};
+
+  std::vector<std::thread> readers;
+  for(int r=0;r<numReaders;r++){
+    readers.emplace_back([&, r](){
+      Snapshot snapshot;
+      snapshot.values.resize(size, 0.0);
+      unsigned long long prevSeq = 0;
+      unsigned long long reads = 0;
+      while(!quit.load(std::memory_order_relaxed)){
+        buffer.read(snapshot);
+        reads++;
+        for(int i=0;i<snapshot.values.size();i++){
+          if(snapshot.values[i] != (double)snapshot.seq){
+            std::cerr << "[AutoStabilizerSnapshotStress] reader " << r << " read a torn snapshot. seq " << snapshot.seq << ", values[" << i << "] " << snapshot.values[i] << std::endl;
+            isFailed.store(true);
+            quit.store(true);
+            return;
+          }
+        }
+        if(snapshot.seq < prevSeq){
+          std::cerr << "[AutoStabilizerSnapshotStress] reader " << r << " read an older snapshot. seq " << snapshot.seq << " after " << prevSeq << std::endl;
+          isFailed.store(true);
+          quit.store(true);
+          return;
+        }
+        prevSeq = snapshot.seq;
+      }
+      numReads.fetch_add(reads);
+    });
+  }
+
+  unsigned long long numPublished = 0;
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  while(!quit.load(std::memory_order_relaxed)){
+    numPublished++;
+    Snapshot& snapshot = buffer.writeBuffer();
+    snapshot.seq = numPublished;
+    for(int i=0;i<snapshot.values.size();i++) snapshot.values[i] = (double)numPublished;
+    buffer.publish();
+    if(writerSleep > 0) std::this_thread::sleep_for(std::chrono::microseconds(writerSleep));
+    if((numPublished & 0xff) == 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() > duration) quit.store(true);
+  }
+  for(int r=0;r<readers.size();r++) readers[r].join();
+
+  if(isFailed.load()) return 1;
+  std::cerr << "[AutoStabilizerSnapshotStress] ok. published " << numPublished << ", read " << numReads.load() << " by " << numReaders << " readers" << std::endl;
+  return 0;
+}
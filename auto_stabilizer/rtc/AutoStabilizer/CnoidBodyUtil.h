@@ -9,7 +9,14 @@ namespace cnoidbodyutil {
     cnoid::Position transform = target * at.inverse();
     robot->rootLink()->T() = transform * robot->rootLink()->T();
   }
-  inline void copyRobotState(cnoid::BodyPtr inRobot, cnoid::BodyPtr outRobot) {
+  inline void moveCoordsAllLinks(cnoid::BodyPtr robot, const cnoid::Position& target, const cnoid::Position& at){
+    // moveCoordsの後にFKをやり直したのと同じ結果を、FKをせずに全linkを剛体変換して得る. 重心は変換されないのでcalcCenterOfMassは呼ぶこと
+    cnoid::Position transform = target * at.inverse();
+    for(int i=0;i<robot->numLinks();i++){
+      robot->link(i)->T() = transform * robot->link(i)->T();
+    }
+  }
+  inline void copyRobotStateWithoutFK(cnoid::BodyPtr inRobot, cnoid::BodyPtr outRobot) {
     outRobot->rootLink()->T() = inRobot->rootLink()->T();
     outRobot->rootLink()->v() = inRobot->rootLink()->v();
     outRobot->rootLink()->w() = inRobot->rootLink()->w();
@@ -21,9 +28,29 @@ namespace cnoidbodyutil {
       outRobot->joint(i)->ddq() = inRobot->joint(i)->ddq();
       outRobot->joint(i)->u() = inRobot->joint(i)->u();
     }
+  }
+  inline void copyRobotState(cnoid::BodyPtr inRobot, cnoid::BodyPtr outRobot) {
+    copyRobotStateWithoutFK(inRobot, outRobot);
     outRobot->calcForwardKinematics();
     outRobot->calcCenterOfMass();
   }
+  inline void copyRobotLinkStates(cnoid::BodyPtr inRobot, cnoid::BodyPtr outRobot) {
+    // FKをせずに、全linkの位置姿勢・速度・加速度と関節の状態をそのままコピーする. inRobotの各linkの位置姿勢がFK済みであること
+    for(int i=0;i<outRobot->numLinks();i++){
+      cnoid::LinkPtr inLink = inRobot->link(i);
+      cnoid::LinkPtr outLink = outRobot->link(i);
+      outLink->T() = inLink->T();
+      outLink->v() = inLink->v();
+      outLink->w() = inLink->w();
+      outLink->dv() = inLink->dv();
+      outLink->dw() = inLink->dw();
+      outLink->q() = inLink->q();
+      outLink->dq() = inLink->dq();
+      outLink->ddq() = inLink->ddq();
+      outLink->u() = inLink->u();
+    }
+    outRobot->calcCenterOfMass();
+  }
 
 };
 
@@ -40,7 +40,7 @@ bool ExternalForceHandler::initExternalForceHandlerOutput(const GaitParam& gaitP
   return true;
 }
 
-bool ExternalForceHandler::handleExternalForce(const GaitParam& gaitParam, bool useActState, double dt,
+bool ExternalForceHandler::handleExternalForce(const GaitParam& gaitParam, bool useActState, double dt, bool isPlanningCycle,
                                                double& o_omega, cnoid::Vector3& o_l, cnoid::Vector3& o_sbpOffset, cnoid::Vector3& o_actCog) const{
 
   double omega;
@@ -49,7 +49,7 @@ bool ExternalForceHandler::handleExternalForce(const GaitParam& gaitParam, bool
   this->handleFeedForwardExternalForce(gaitParam,
                                        omega, l, feedForwardSbpOffset);
   cnoid::Vector3 feedBackSbpOffset;
-  this->handleFeedBackExternalForce(gaitParam, useActState, dt, omega, feedForwardSbpOffset,
+  this->handleFeedBackExternalForce(gaitParam, useActState, dt, isPlanningCycle, omega, feedForwardSbpOffset,
                                     feedBackSbpOffset);
 
   o_omega = omega;
@@ -99,51 +99,60 @@ bool ExternalForceHandler::handleFeedForwardExternalForce(const GaitParam& gaitP
 
   return true;
 }
-bool ExternalForceHandler::handleFeedBackExternalForce(const GaitParam& gaitParam, bool useActState, double dt, double omega, const cnoid::Vector3& feedForwardSbpOffset,
+bool ExternalForceHandler::handleFeedBackExternalForce(const GaitParam& gaitParam, bool useActState, double dt, bool isPlanningCycle, double omega, const cnoid::Vector3& feedForwardSbpOffset,
                                                        cnoid::Vector3& o_feedBackSbpOffset) const{
 
-  cnoid::Vector3 actCP = gaitParam.actRobot->centerOfMass() + gaitParam.actCogVel.value() / omega; // generate frame. ここではsbpOffsetやlは考えない, 生の重心位置を用いる
-  cnoid::Vector3 actCPVel;
-  if(this->isInitial) actCPVel = cnoid::Vector3::Zero();
-  else actCPVel = (actCP - this->actCPPrev) / dt;
-  this->actCPPrev = actCP;
-
-  cnoid::Vector3 targetOffset = cnoid::Vector3::Zero();
-  double timeConst = this->disturbanceCompensationTimeConst;
-  if(this->useDisturbanceCompensation && useActState){
-    if(!gaitParam.isStatic()) {// 非静止状態. (着地の衝撃が大きかったり、右脚と左脚とで誤差ののり方が反対向きになったりするので、一歩ごとに積算する) (逆に静止状態時に、適当に1[s]などで区切って一歩分の誤差として積算すると、BangBang的な挙動をしてしまう)
-      cnoid::Vector3 tmpOffset = cnoid::Vector3::Zero(); // 今の外乱の大きさ
-      tmpOffset.head<2>() = (actCP - actCPVel / omega - gaitParam.stTargetZmp).head<2>();
-      this->disturbance = (this->disturbance * this->disturbanceTime + tmpOffset * dt) / (this->disturbanceTime + dt);
-      this->disturbanceTime += dt;
-      if(this->disturbanceTime > 0.0 &&
-         (gaitParam.prevSupportPhase[RLEG] != gaitParam.footstepNodesList[0].isSupportPhase[RLEG] || gaitParam.prevSupportPhase[LLEG] != gaitParam.footstepNodesList[0].isSupportPhase[LLEG])){ // footStepNodesListの変わり目
-        this->disturbanceQueue.emplace_back(this->disturbance, this->disturbanceTime);
-        this->disturbance = cnoid::Vector3::Zero();
-        this->disturbanceTime = 0.0;
-        while(this->disturbanceQueue.size() > this->disturbanceCompensationStepNum) this->disturbanceQueue.pop_front();
+  // 外乱の推定はisPlanningCycleの周期のみ行う. ただし、外乱はfootStepNodesListの1stepごとに積算するので、footStepNodesListの変わり目では必ず行う
+  this->feedBackElapsedTime += dt;
+  bool isStepChanged = (gaitParam.prevSupportPhase[RLEG] != gaitParam.footstepNodesList[0].isSupportPhase[RLEG] || gaitParam.prevSupportPhase[LLEG] != gaitParam.footstepNodesList[0].isSupportPhase[LLEG]); // footStepNodesListの変わり目
+  if(isPlanningCycle || isStepChanged || this->isInitial){
+    double estimationDt = this->feedBackElapsedTime; // 前回外乱を推定してからの時間
+    this->feedBackElapsedTime = 0.0;
+
+    cnoid::Vector3 actCP = gaitParam.actRobot->centerOfMass() + gaitParam.actCogVel.value() / omega; // generate frame. ここではsbpOffsetやlは考えない, 生の重心位置を用いる
+    cnoid::Vector3 actCPVel;
+    if(this->isInitial) actCPVel = cnoid::Vector3::Zero();
+    else actCPVel = (actCP - this->actCPPrev) / estimationDt;
+    this->actCPPrev = actCP;
+
+    cnoid::Vector3 targetOffset = cnoid::Vector3::Zero();
+    if(this->useDisturbanceCompensation && useActState){
+      if(!gaitParam.isStatic()) {// 非静止状態. (着地の衝撃が大きかったり、右脚と左脚とで誤差ののり方が反対向きになったりするので、一歩ごとに積算する) (逆に静止状態時に、適当に1[s]などで区切って一歩分の誤差として積算すると、BangBang的な挙動をしてしまう)
+        cnoid::Vector3 tmpOffset = cnoid::Vector3::Zero(); // 今の外乱の大きさ
+        tmpOffset.head<2>() = (actCP - actCPVel / omega - gaitParam.stTargetZmp).head<2>();
+        this->disturbance = (this->disturbance * this->disturbanceTime + tmpOffset * estimationDt) / (this->disturbanceTime + estimationDt);
+        this->disturbanceTime += estimationDt;
+        if(this->disturbanceTime > 0.0 && isStepChanged){ // footStepNodesListの変わり目
+          this->disturbanceQueue.emplace_back(this->disturbance, this->disturbanceTime);
+          this->disturbance = cnoid::Vector3::Zero();
+          this->disturbanceTime = 0.0;
+          while(this->disturbanceQueue.size() > this->disturbanceCompensationStepNum) this->disturbanceQueue.pop_front();
+        }
+      } else { // 静止状態
+        cnoid::Vector3 tmpOffset = cnoid::Vector3::Zero(); // 安易に現在の誤差を積分すると不安定になるので、現状は何もしない
+        disturbanceQueue = {std::pair<cnoid::Vector3, double>{tmpOffset,1.0}};
+        disturbance = cnoid::Vector3::Zero();
+        disturbanceTime = 0.0;
       }
-    } else { // 静止状態
-      cnoid::Vector3 tmpOffset = cnoid::Vector3::Zero(); // 安易に現在の誤差を積分すると不安定になるので、現状は何もしない
-      disturbanceQueue = {std::pair<cnoid::Vector3, double>{tmpOffset,1.0}};
+
+      double tm = 0;
+      for(std::list<std::pair<cnoid::Vector3, double> >::iterator it = this->disturbanceQueue.begin(); it != this->disturbanceQueue.end(); it++){
+        targetOffset += it->first * it->second;
+        tm += it->second;
+      }
+      targetOffset /= tm;
+      targetOffset -= feedForwardSbpOffset; // フィードフォワード外乱補償では足りない分のみを扱う
+
+    }else{ // if(this->useDisturbanceCompensation && useActState)
+      disturbanceQueue = {std::pair<cnoid::Vector3, double>{cnoid::Vector3::Zero(),1.0}};
       disturbance = cnoid::Vector3::Zero();
       disturbanceTime = 0.0;
     }
-
-    double tm = 0;
-    for(std::list<std::pair<cnoid::Vector3, double> >::iterator it = this->disturbanceQueue.begin(); it != this->disturbanceQueue.end(); it++){
-      targetOffset += it->first * it->second;
-      tm += it->second;
-    }
-    targetOffset /= tm;
-    targetOffset -= feedForwardSbpOffset; // フィードフォワード外乱補償では足りない分のみを扱う
-
-  }else{ // if(this->useDisturbanceCompensation && useActState)
-    disturbanceQueue = {std::pair<cnoid::Vector3, double>{cnoid::Vector3::Zero(),1.0}};
-    disturbance = cnoid::Vector3::Zero();
-    disturbanceTime = 0.0;
+    this->feedBackTargetOffset = targetOffset;
   }
 
+  // 目標値への追従は毎周期行う
+  const cnoid::Vector3& targetOffset = this->feedBackTargetOffset;
   cnoid::Vector3 feedBackSbpOffset = this->feedBackSbpOffsetPrev;
   for(int i=0;i<2;i++){
     double timeConst = this->disturbanceCompensationTimeConst;
@@ -20,6 +20,8 @@ protected:
   mutable cnoid::Vector3 disturbance = cnoid::Vector3::Zero(); // generate frame. 現在のfootstepNodesListのステップの外乱
   mutable double disturbanceTime = 0.0; // 現在のfootstepNodesListのステップの時間
   mutable cnoid::Vector3 feedBackSbpOffsetPrev = cnoid::Vector3::Zero(); // generate frame. 前回の周期の長期的外乱補償の大きさ
+  mutable cnoid::Vector3 feedBackTargetOffset = cnoid::Vector3::Zero(); // generate frame. 最後に外乱を推定したときの長期的外乱補償の目標値. 外乱の推定を行わない周期も、feedBackSbpOffsetはこの値に向けて毎周期滑らかに変化する
+  mutable double feedBackElapsedTime = 0.0; // 前回外乱を推定してからの時間[s]
 public:
   // startAutoBalancer時に呼ばれる
   void reset() {
@@ -29,18 +31,21 @@ public:
     disturbance = cnoid::Vector3::Zero();
     disturbanceTime = 0.0;
     feedBackSbpOffsetPrev = cnoid::Vector3::Zero();
+    feedBackTargetOffset = cnoid::Vector3::Zero();
+    feedBackElapsedTime = 0.0;
   }
 
   bool initExternalForceHandlerOutput(const GaitParam& gaitParam,
                                       double& o_omega, cnoid::Vector3& o_l, cnoid::Vector3& o_sbpOffset, cnoid::Vector3& o_genCog) const;
 
-  bool handleExternalForce(const GaitParam& gaitParam, bool useActState, double dt,
+  // isPlanningCycleがfalseの周期は、長期的外乱補償の外乱の推定を省略する(footstepNodesListの変わり目を除く). 推定した目標値への追従は毎周期行う
+  bool handleExternalForce(const GaitParam& gaitParam, bool useActState, double dt, bool isPlanningCycle,
                            double& o_omega, cnoid::Vector3& o_l, cnoid::Vector3& o_sbpOffset, cnoid::Vector3& o_actCog) const;
 
 protected:
   bool handleFeedForwardExternalForce(const GaitParam& gaitParam,
                                       double& o_omega, cnoid::Vector3& o_l, cnoid::Vector3& o_feedForwardSbpOffset) const;
-  bool handleFeedBackExternalForce(const GaitParam& gaitParam, bool useActState, double dt, double omega, const cnoid::Vector3& feedForwardSbpOffset,
+  bool handleFeedBackExternalForce(const GaitParam& gaitParam, bool useActState, double dt, bool isPlanningCycle, double omega, const cnoid::Vector3& feedForwardSbpOffset,
                                    cnoid::Vector3& o_feedBackSbpOffset) const;
 };
 
@@ -3,6 +3,8 @@
 #ifndef FOOTGILDEDCONTROLLER_H_
 #define FOOTGILDEDCONTROLLER_H_
 #include <iostream>
+#include <vector>
+#include <cmath>
 #include <Eigen/Eigen>
 
 namespace footguidedcontroller{
@@ -32,29 +34,65 @@ namespace footguidedcontroller{
     x(T) = u^r(T) + l
     u^r = std::vector<LinearTrajectory>
   */
-  // ur_のサイズは1以上でなければならない. ur_にtime=0の要素があっても、その要素のstartとgoalが同じなら破綻しない. ただし、ur_のtimeの和が0だと破綻する
-  template <typename T> T calcFootGuidedControl(const double& w, const T& l, const T& x0, const std::vector<LinearTrajectory<T> >& ur_) {
-    const int n = ur_.size();
+  /*
+    calcFootGuidedControlのうち、x0に依存しない部分(各要素のexp(-w*Tj)による重み付き和)を事前に計算したもの.
+    w, l, ur_が同じなら、calcFootGuidedControl(w, l, x0, ur_) = offset + gain * x0 となる.
+    同じw, l, ur_に対して異なるx0(genDCMとactDCM等)で何度も評価する場合に、重み付き和の計算を一回で済ませるために使う
+  */
+  template <typename T>
+  class FootGuidedPreview
+  {
+  private:
+    T offset;
+    double gain;
+  public:
+    FootGuidedPreview(const T& _offset, const double _gain)
+      : offset(_offset), gain(_gain) {};
+    const T& getOffset() const { return offset; };
+    double getGain() const { return gain; };
+    T calcFootGuidedControl(const T& x0) const { return offset + gain * x0; };
+  };
 
-    std::vector<LinearTrajectory<T> > ur;
-    ur.reserve(n + 2);
-    ur.push_back(LinearTrajectory<T>(x0-l, x0-l, 0.0)); // j=0
-    std::copy(ur_.begin(), ur_.end(), std::back_inserter(ur)); // j=1 ~ j=n
-    ur.push_back(LinearTrajectory<T>(ur_.back().getGoal(),ur_.back().getGoal(), 0.0)); // j=n+1
+  // ur_のサイズは1以上でなければならない. ur_にtime=0の要素があっても、その要素のstartとgoalが同じなら破綻しない. ただし、ur_のtimeの和が0だと破綻する
+  // ur_をポインタと要素数nで与える. 先頭(j=0)と末尾(j=n+1)の仮想的な要素を作ってコピーすることはせず、メモリ確保を行わない. exp(-w*Tj)は各要素のexp(-w*time)の積として順に求める
+  // Tがcnoid::Vector3等の固定サイズのEigenの型なら、ループ内の演算は全て展開される
+  template <typename T> FootGuidedPreview<T> calcFootGuidedPreview(const double& w, const T& l, const LinearTrajectory<T>* ur_, int n) {
+    const double invW = 1.0 / w;
 
-    T u = x0*0.0;
-    double Tj = 0.0;
-    for(int j=0;j<=n;j++){
-      Tj += ur.at(j).getTime();
-      u += exp(- w * Tj) * (ur.at(j).getGoal() - ur.at(j+1).getStart() + (ur.at(j).getSlope() - ur.at(j+1).getSlope()) / w);
+    // j=0. 仮想的な要素(start=goal=x0-l, slope=0, time=0)とur_[0]の間. exp(-w*T0)=1. x0の項はgainとしてまとめるので、ここでは含めない
+    T u = - l - ur_[0].getStart() - ur_[0].getSlope() * invW;
+    double expWTj = 1.0; // exp(-w*Tj)
+    for(int j=1;j<n;j++){ // ur_[j-1]とur_[j]の間
+      expWTj *= std::exp(- w * ur_[j-1].getTime());
+      u += expWTj * (ur_[j-1].getGoal() - ur_[j].getStart() + (ur_[j-1].getSlope() - ur_[j].getSlope()) * invW);
     }
+    // j=n. ur_[n-1]と仮想的な要素(start=goal=ur_[n-1].goal, slope=0, time=0)の間
+    expWTj *= std::exp(- w * ur_[n-1].getTime());
+    u += expWTj * ur_[n-1].getSlope() * invW;
 
-    if((1 - exp(-2 * w * Tj)) == 0.0) { // ゼロ除算チェック
+    const double denom = 1 - expWTj * expWTj; // 1 - exp(-2 * w * Tj)
+    if(denom == 0.0) { // ゼロ除算チェック
       std::cerr << "[calcFootGuidedControl] (1 - exp(-2 * w * Tj))==0 !" << std::endl;
-      return ur[1].getStart();
+      return FootGuidedPreview<T>(ur_[0].getStart(), 0.0);
     }
 
-    return ur[1].getStart() + 2 / (1 - exp(-2 * w * Tj)) * u;
+    const double gain = 2 / denom;
+    return FootGuidedPreview<T>(ur_[0].getStart() + gain * u, gain);
+  };
+
+  // ur_のサイズは1以上でなければならない.
+  template <typename T> FootGuidedPreview<T> calcFootGuidedPreview(const double& w, const T& l, const std::vector<LinearTrajectory<T> >& ur_) {
+    return calcFootGuidedPreview(w, l, ur_.data(), ur_.size());
+  };
+
+  // ur_のサイズは1以上でなければならない.
+  template <typename T> T calcFootGuidedControl(const double& w, const T& l, const T& x0, const LinearTrajectory<T>* ur_, int n) {
+    return calcFootGuidedPreview(w, l, ur_, n).calcFootGuidedControl(x0);
+  };
+
+  // ur_のサイズは1以上でなければならない.
+  template <typename T> T calcFootGuidedControl(const double& w, const T& l, const T& x0, const std::vector<LinearTrajectory<T> >& ur_) {
+    return calcFootGuidedControl(w, l, x0, ur_.data(), ur_.size());
   };
 
   template <typename T> void updateState(const double& w, const T& l, const T& c, const T& dc, const T& u, double m, double dt,
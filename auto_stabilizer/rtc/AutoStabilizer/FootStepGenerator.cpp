@@ -3,9 +3,11 @@
 #include <cnoid/EigenUtil>
 
 bool FootStepGenerator::initFootStepNodesList(const GaitParam& gaitParam,
-                                              std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cnoid::Position>& o_srcCoords, std::vector<cnoid::Position>& o_dstCoordsOrg, double& o_remainTimeOrg, std::vector<GaitParam::SwingState_enum>& o_swingState, double& o_elapsedTime, std::vector<bool>& o_prevSupportPhase) const{
+                                              GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& o_srcCoords, std::array<cnoid::Position, NUM_LEGS>& o_dstCoordsOrg, double& o_remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& o_swingState, double& o_elapsedTime, std::array<bool, NUM_LEGS>& o_prevSupportPhase) const{
   // footStepNodesListを初期化する
-  std::vector<GaitParam::FootStepNodes> footstepNodesList(1);
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList.clear();
+  footstepNodesList.resize(1);
   cnoid::Position rlegCoords = gaitParam.genRobot->link(gaitParam.eeParentLink[RLEG])->T()*gaitParam.eeLocalT[RLEG];
   cnoid::Position llegCoords = gaitParam.genRobot->link(gaitParam.eeParentLink[LLEG])->T()*gaitParam.eeLocalT[LLEG];
   footstepNodesList[0].dstCoords = {rlegCoords, llegCoords};
@@ -14,17 +16,17 @@ bool FootStepGenerator::initFootStepNodesList(const GaitParam& gaitParam,
   if(footstepNodesList[0].isSupportPhase[RLEG] && !footstepNodesList[0].isSupportPhase[LLEG]) footstepNodesList[0].endRefZmpState = GaitParam::FootStepNodes::refZmpState_enum::RLEG;
   else if(!footstepNodesList[0].isSupportPhase[RLEG] && footstepNodesList[0].isSupportPhase[LLEG]) footstepNodesList[0].endRefZmpState = GaitParam::FootStepNodes::refZmpState_enum::LLEG;
   else footstepNodesList[0].endRefZmpState = GaitParam::FootStepNodes::refZmpState_enum::MIDDLE;
-  std::vector<cnoid::Position> srcCoords = footstepNodesList[0].dstCoords;
-  std::vector<cnoid::Position> dstCoordsOrg = footstepNodesList[0].dstCoords;
+  std::array<cnoid::Position, NUM_LEGS> srcCoords = footstepNodesList[0].dstCoords;
+  std::array<cnoid::Position, NUM_LEGS> dstCoordsOrg = footstepNodesList[0].dstCoords;
   double remainTimeOrg = footstepNodesList[0].remainTime;
-  std::vector<GaitParam::SwingState_enum> swingState(NUM_LEGS);
+  std::array<GaitParam::SwingState_enum, NUM_LEGS> swingState;
   for(int i=0;i<NUM_LEGS;i++) swingState[i] = GaitParam::LIFT_PHASE;
-  std::vector<bool> prevSupportPhase(NUM_LEGS);
+  std::array<bool, NUM_LEGS> prevSupportPhase;
   for(int i=0;i<NUM_LEGS;i++) prevSupportPhase[i] = footstepNodesList[0].isSupportPhase[i];
   double elapsedTime = 0.0;
 
   o_prevSupportPhase = prevSupportPhase;
-  o_footstepNodesList = footstepNodesList;
+  o_footstepNodesList.swap(footstepNodesList);
   o_srcCoords = srcCoords;
   o_dstCoordsOrg = dstCoordsOrg;
   o_remainTimeOrg = remainTimeOrg;
@@ -35,7 +37,7 @@ bool FootStepGenerator::initFootStepNodesList(const GaitParam& gaitParam,
 }
 
 bool FootStepGenerator::setFootSteps(const GaitParam& gaitParam, const std::vector<StepNode>& footsteps,
-                                     std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const{
+                                     GaitParam::FootStepNodesList& o_footstepNodesList) const{
   if(!gaitParam.isStatic()){ // 静止中でないと無効
     o_footstepNodesList = gaitParam.footstepNodesList;
     return false;
@@ -57,6 +59,12 @@ bool FootStepGenerator::setFootSteps(const GaitParam& gaitParam, const std::vect
     return false;
   }
 
+  if(1 + 2 * footsteps.size() + 3 > GaitParam::MAX_FOOTSTEP_NODES){ // footstepNodesListに入りきらない. 無効
+    std::cerr << "[FootStepGenerator] too many footsteps. the number of footsteps must be at most " << (GaitParam::MAX_FOOTSTEP_NODES - 4) / 2 << std::endl;
+    o_footstepNodesList = gaitParam.footstepNodesList;
+    return false;
+  }
+
   for(int i=1;i<footsteps.size();i++){
     if((footsteps[i-1].l_r == RLEG && footsteps[i-1].swingEnd == true && footsteps[i].l_r == LLEG) ||
        (footsteps[i-1].l_r == LLEG && footsteps[i-1].swingEnd == true && footsteps[i].l_r == RLEG)){ // 空中の足を支持脚にしようとしている. 無効
@@ -65,7 +73,8 @@ bool FootStepGenerator::setFootSteps(const GaitParam& gaitParam, const std::vect
     }
   }
 
-  std::vector<GaitParam::FootStepNodes> footstepNodesList;
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList.clear();
   footstepNodesList.push_back(gaitParam.footstepNodesList[0]);
 
   if(footstepNodesList.back().isSupportPhase[RLEG] && footstepNodesList.back().isSupportPhase[LLEG]){ // 両足支持期を延長
@@ -124,18 +133,25 @@ bool FootStepGenerator::setFootSteps(const GaitParam& gaitParam, const std::vect
     footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * (1.0 - this->defaultDoubleSupportRatio), GaitParam::FootStepNodes::refZmpState_enum::MIDDLE)); // 末尾の両足支持期を延長. これがないと重心が目標位置に収束する前に返ってしまい, emergencyStepが無限に誘発する footGudedBalanceTimeを0.4程度に小さくすると収束が速くなるのでこの処理が不要になるのだが、今度はZ方向に振動しやすい
   }
 
-  o_footstepNodesList = footstepNodesList;
+  if(footstepNodesList.overflowed()){ // footstepNodesListに入りきらなかった. 途中までの歩行をさせるのは危険なので無効
+    std::cerr << "\x1b[31m[FootStepGenerator] setFootSteps is rejected. footstepNodesList exceeded " << GaitParam::MAX_FOOTSTEP_NODES << " nodes" << "\x1b[39m" << std::endl;
+    o_footstepNodesList = gaitParam.footstepNodesList;
+    return false;
+  }
+
+  o_footstepNodesList.swap(footstepNodesList);
   return true;
 }
 
 bool FootStepGenerator::goPos(const GaitParam& gaitParam, double x/*m*/, double y/*m*/, double th/*deg*/,
-                              std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const{
+                              GaitParam::FootStepNodesList& o_footstepNodesList) const{
   if(!gaitParam.isStatic()){ // 静止中でないと無効
     o_footstepNodesList = gaitParam.footstepNodesList;
     return false;
   }
 
-  std::vector<GaitParam::FootStepNodes> footstepNodesList;
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList.clear();
   footstepNodesList.push_back(gaitParam.footstepNodesList[0]);
 
   cnoid::Position currentPose;
@@ -185,19 +201,26 @@ bool FootStepGenerator::goPos(const GaitParam& gaitParam, double x/*m*/, double
   footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * this->defaultDoubleSupportRatio, GaitParam::FootStepNodes::refZmpState_enum::MIDDLE));
   footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * (1.0 - this->defaultDoubleSupportRatio), GaitParam::FootStepNodes::refZmpState_enum::MIDDLE)); // 末尾の両足支持期を延長. これがないと重心が目標位置に収束する前に返ってしまい, emergencyStepが無限に誘発する footGudedBalanceTimeを0.4程度に小さくすると収束が速くなるのでこの処理が不要になるのだが、今度はZ方向に振動しやすい
 
-  o_footstepNodesList = footstepNodesList;
+  if(footstepNodesList.overflowed()){ // footstepNodesListに入りきらなかった. 途中までの歩行をさせるのは危険なので無効
+    std::cerr << "\x1b[31m[FootStepGenerator] goPos is rejected. footstepNodesList exceeded " << GaitParam::MAX_FOOTSTEP_NODES << " nodes" << "\x1b[39m" << std::endl;
+    o_footstepNodesList = gaitParam.footstepNodesList;
+    return false;
+  }
+
+  o_footstepNodesList.swap(footstepNodesList);
   return true;
 }
 
 
 bool FootStepGenerator::goStop(const GaitParam& gaitParam,
-            std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const {
+            GaitParam::FootStepNodesList& o_footstepNodesList) const {
   if(gaitParam.isStatic()){
     o_footstepNodesList = gaitParam.footstepNodesList;
     return true;
   }
 
-  std::vector<GaitParam::FootStepNodes> footstepNodesList = gaitParam.footstepNodesList;
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList = gaitParam.footstepNodesList;
 
   // footstepNodesList[0]と[1]は変えない. footstepNodesList[1]以降で次に両足支持期になるときを探し、それ以降のstepを上書きする. 片足支持期の状態が末尾の要素になると、片足立ちで止まるという状態を意味することに注意
   for(int i=1;i<footstepNodesList.size();i++){
@@ -217,21 +240,28 @@ bool FootStepGenerator::goStop(const GaitParam& gaitParam,
   footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * this->defaultDoubleSupportRatio, GaitParam::FootStepNodes::refZmpState_enum::MIDDLE));
   footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * (1.0 - this->defaultDoubleSupportRatio), GaitParam::FootStepNodes::refZmpState_enum::MIDDLE)); // 末尾の両足支持期を延長. これがないと重心が目標位置に収束する前に返ってしまい, emergencyStepが無限に誘発する footGudedBalanceTimeを0.4程度に小さくすると収束が速くなるのでこの処理が不要になるのだが、今度はZ方向に振動しやすい
 
-  o_footstepNodesList = footstepNodesList;
+  if(footstepNodesList.overflowed()){ // footstepNodesListに入りきらなかった. 途中までの歩行をさせるのは危険なので無効
+    std::cerr << "\x1b[31m[FootStepGenerator] goStop is rejected. footstepNodesList exceeded " << GaitParam::MAX_FOOTSTEP_NODES << " nodes" << "\x1b[39m" << std::endl;
+    o_footstepNodesList = gaitParam.footstepNodesList;
+    return false;
+  }
+
+  o_footstepNodesList.swap(footstepNodesList);
   return true;
 
 }
 
 // FootStepNodesListをdtすすめる
 bool FootStepGenerator::procFootStepNodesList(const GaitParam& gaitParam, const double& dt, bool useActState,
-                                              std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cnoid::Position>& o_srcCoords, std::vector<cnoid::Position>& o_dstCoordsOrg, double& o_remainTimeOrg, std::vector<GaitParam::SwingState_enum>& o_swingState, double& o_elapsedTime, std::vector<bool>& o_prevSupportPhase, double& relLandingHeight) const{
-  std::vector<GaitParam::FootStepNodes> footstepNodesList = gaitParam.footstepNodesList;
-  std::vector<bool> prevSupportPhase = gaitParam.prevSupportPhase;
+                                              GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& o_srcCoords, std::array<cnoid::Position, NUM_LEGS>& o_dstCoordsOrg, double& o_remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& o_swingState, double& o_elapsedTime, std::array<bool, NUM_LEGS>& o_prevSupportPhase, double& relLandingHeight) const{
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList = gaitParam.footstepNodesList;
+  std::array<bool, NUM_LEGS> prevSupportPhase = gaitParam.prevSupportPhase;
   double elapsedTime = gaitParam.elapsedTime;
-  std::vector<cnoid::Position> srcCoords = gaitParam.srcCoords;
-  std::vector<cnoid::Position> dstCoordsOrg = gaitParam.dstCoordsOrg;
+  std::array<cnoid::Position, NUM_LEGS> srcCoords = gaitParam.srcCoords;
+  std::array<cnoid::Position, NUM_LEGS> dstCoordsOrg = gaitParam.dstCoordsOrg;
   double remainTimeOrg = gaitParam.remainTimeOrg;
-  std::vector<GaitParam::SwingState_enum> swingState = gaitParam.swingState;
+  std::array<GaitParam::SwingState_enum, NUM_LEGS> swingState = gaitParam.swingState;
 
   if(useActState){
     // 早づきしたらremainTimeにかかわらずすぐに次のnodeへ移る(remainTimeをdtにする). この機能が無いと少しでもロボットが傾いて早づきするとジャンプするような挙動になる.
@@ -254,7 +284,7 @@ bool FootStepGenerator::procFootStepNodesList(const GaitParam& gaitParam, const
                                   footstepNodesList, srcCoords, dstCoordsOrg, remainTimeOrg, swingState, elapsedTime, relLandingHeight);
   }
 
-  o_footstepNodesList = footstepNodesList;
+  o_footstepNodesList.swap(footstepNodesList);
   o_prevSupportPhase = prevSupportPhase;
   o_elapsedTime = elapsedTime;
   o_srcCoords = srcCoords;
@@ -265,13 +295,15 @@ bool FootStepGenerator::procFootStepNodesList(const GaitParam& gaitParam, const
   return true;
 }
 
-bool FootStepGenerator::calcFootSteps(const GaitParam& gaitParam, const double& dt, bool useActState,
+bool FootStepGenerator::calcFootSteps(const GaitParam& gaitParam, const double& dt, bool useActState, bool isPlanningCycle,
                                       GaitParam::DebugData& debugData, //for Log
-                                      std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const{
-  std::vector<GaitParam::FootStepNodes> footstepNodesList = gaitParam.footstepNodesList;
+                                      GaitParam::FootStepNodesList& o_footstepNodesList, bool& o_isFootStepNodesListModified) const{
+  GaitParam::FootStepNodesList& footstepNodesList = this->footstepNodesListBuffer;
+  footstepNodesList = gaitParam.footstepNodesList;
+  bool isModified = isPlanningCycle; // 計画系の処理を行う周期は、footstepNodesListが変わりうる
 
   // goVelocityModeなら、進行方向に向けてfootStepNodesList[2] ~ footStepNodesList[goVelocityStepNum]の要素を機械的に計算してどんどん末尾appendしていく. cmdVelに応じてきまる
-  if(this->isGoVelocityMode){
+  if(isPlanningCycle && this->isGoVelocityMode){
     // footstepNodesList[0]と[1]は変えない. footstepNodesList[1]以降で次に両足支持期になるときを探し、それ以降のstepを上書きする. 片足支持期の状態が末尾の要素になると、片足立ちで止まるという状態を意味することに注意
     for(int i=1;i<footstepNodesList.size();i++){
       if(footstepNodesList[i].isSupportPhase[RLEG] && footstepNodesList[i].isSupportPhase[LLEG]){
@@ -285,22 +317,29 @@ bool FootStepGenerator::calcFootSteps(const GaitParam& gaitParam, const double&
   }
 
   if(useActState){
-    if(this->isModifyFootSteps && this->isEmergencyStepMode){
-      this->checkEmergencyStep(footstepNodesList, gaitParam);
+    if(this->isModifyFootSteps && this->isEmergencyStepMode){ // 転倒回避のため、isPlanningCycleによらず毎周期判断する
+      if(this->checkEmergencyStep(footstepNodesList, gaitParam)) isModified = true;
     }
 
-    if(this->isModifyFootSteps){
+    if(isPlanningCycle && this->isModifyFootSteps){
       this->modifyFootSteps(footstepNodesList, debugData, gaitParam);
     }
   }
 
-  o_footstepNodesList = footstepNodesList;
+  if(footstepNodesList.overflowed()){ // footstepNodesListに入りきらなかった. 末尾が欠けたnodeを使うのは危険なので、この周期の変更は反映しない. 制御周期なので出力は行わず、perfStatOutで報告する
+    debugData.footstepNodesListOverflowCount++; // for log
+    o_footstepNodesList = gaitParam.footstepNodesList;
+    return false;
+  }
+
+  o_footstepNodesList.swap(footstepNodesList);
+  if(isModified) o_isFootStepNodesListModified = true;
 
   return true;
 }
 
 bool FootStepGenerator::goNextFootStepNodesList(const GaitParam& gaitParam, double dt,
-                                                std::vector<GaitParam::FootStepNodes>& footstepNodesList, std::vector<cnoid::Position>& srcCoords, std::vector<cnoid::Position>& dstCoordsOrg, double& remainTimeOrg, std::vector<GaitParam::SwingState_enum>& swingState, double& elapsedTime, double& relLandingHeight) const{
+                                                GaitParam::FootStepNodesList& footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& srcCoords, std::array<cnoid::Position, NUM_LEGS>& dstCoordsOrg, double& remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& swingState, double& elapsedTime, double& relLandingHeight) const{
   // 今のgenCoordsとdstCoordsが異なるなら、将来のstepの位置姿勢をそれに合わせてずらす.
   // early touch downまたはlate touch downが発生していると、今のgenCoordsとdstCoordsが異なる.
   //   今のgenCoordsが正しい地形を表していることが期待されるので、将来のstepの位置姿勢をgenCoordsにあわせてずらしたくなる
@@ -354,7 +393,7 @@ bool FootStepGenerator::goNextFootStepNodesList(const GaitParam& gaitParam, doub
   }
 
   // footstepNodesListをpop front
-  footstepNodesList.erase(footstepNodesList.begin()); // vectorではなくlistにするべきかもしれないが、要素数がそんなに大きくないのでよしとする
+  footstepNodesList.pop_front(); // リングバッファなので他の要素は移動しない
   for(int i=0;i<NUM_LEGS;i++) {
     srcCoords[i] = gaitParam.genCoords[i].value();
     dstCoordsOrg[i] = footstepNodesList[0].dstCoords[i];
@@ -367,7 +406,7 @@ bool FootStepGenerator::goNextFootStepNodesList(const GaitParam& gaitParam, doub
   return true;
 }
 
-void FootStepGenerator::transformFutureSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const{
+void FootStepGenerator::transformFutureSteps(GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const{
   for(int l=0;l<NUM_LEGS;l++){
     bool swinged = false;
     for(int i=index;i<footstepNodesList.size();i++){
@@ -377,7 +416,7 @@ void FootStepGenerator::transformFutureSteps(std::vector<GaitParam::FootStepNode
   }
 }
 
-void FootStepGenerator::transformFutureSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Vector3& transform/*generate frame*/) const{
+void FootStepGenerator::transformFutureSteps(GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Vector3& transform/*generate frame*/) const{
   for(int l=0;l<NUM_LEGS;l++){
     bool swinged = false;
     for(int i=index;i<footstepNodesList.size();i++){
@@ -388,7 +427,7 @@ void FootStepGenerator::transformFutureSteps(std::vector<GaitParam::FootStepNode
 }
 
 // indexのsupportLegが次にswingするまでの間の位置を、generate frameでtransformだけ動かす
-void FootStepGenerator::transformCurrentSupportSteps(int leg, std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const{
+void FootStepGenerator::transformCurrentSupportSteps(int leg, GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const{
   assert(0<=leg && leg < NUM_LEGS);
   for(int i=index;i<footstepNodesList.size();i++){
     if(!footstepNodesList[i].isSupportPhase[leg]) return;
@@ -396,7 +435,7 @@ void FootStepGenerator::transformCurrentSupportSteps(int leg, std::vector<GaitPa
   }
 }
 
-void FootStepGenerator::calcDefaultNextStep(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam, const cnoid::Vector3& offset /*leg frame*/, bool stableStart) const{
+void FootStepGenerator::calcDefaultNextStep(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam, const cnoid::Vector3& offset /*leg frame*/, bool stableStart) const{
   if(footstepNodesList.back().isSupportPhase[RLEG] && footstepNodesList.back().isSupportPhase[LLEG]){
     if(footstepNodesList.back().endRefZmpState == GaitParam::FootStepNodes::refZmpState_enum::MIDDLE){
       // offsetを、両足の中間からの距離と解釈する(これ以外のケースでは支持脚からの距離と解釈する)
@@ -506,7 +545,7 @@ inline std::ostream &operator<<(std::ostream &os, const std::vector<std::pair<st
   return os;
 }
 
-void FootStepGenerator::modifyFootSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, // input & output
+void FootStepGenerator::modifyFootSteps(GaitParam::FootStepNodesList& footstepNodesList, // input & output
                                         GaitParam::DebugData& debugData, //for Log
                                         const GaitParam& gaitParam) const{
   // 現在片足支持期で、次が両足支持期であるときのみ、行う
@@ -535,7 +574,7 @@ void FootStepGenerator::modifyFootSteps(std::vector<GaitParam::FootStepNodes>& f
   if(footstepNodesList[0].stopCurrentPosition[swingLeg]) return;
 
   // dx = w ( x - z - l)
-  cnoid::Vector3 actDCM = gaitParam.actCog + gaitParam.actCogVel.value() / gaitParam.omega;
+  cnoid::Vector3 actDCM = gaitParam.predActCog + gaitParam.predActCogVel / gaitParam.omega; // 遅延補償したもの
 
   /*
     capturable: ある時刻t(overwritableMinTime<=t<=overwritableMaxTime)が存在し、時刻tに着地すれば転倒しないような着地位置.
@@ -809,7 +848,7 @@ void FootStepGenerator::modifyFootSteps(std::vector<GaitParam::FootStepNodes>& f
 // remainTimeが0になっても地面についていなかったら、remainTimeを少しずつ延長し着地位置を下方に少しずつオフセットさせる
 //   - remainTimeが0のときには本来の着地位置に行くようにしないと、着地タイミングがrefZmpよりも常に早すぎ・遅すぎになるので良くない
 //   - ただし、この方法だと、遅づきしたときに着地時刻が遅くなるのでDCMが移動しずぎてしまっているので、転びやすい.
-void FootStepGenerator::checkEarlyTouchDown(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam, double dt) const{
+void FootStepGenerator::checkEarlyTouchDown(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam, double dt) const{
   for(int i=0;i<NUM_LEGS;i++){
     actLegWrenchFilter[i].passFilter(gaitParam.actEEWrench[i], dt);
   }
@@ -834,9 +873,9 @@ void FootStepGenerator::checkEarlyTouchDown(std::vector<GaitParam::FootStepNodes
 }
 
 // emergengy step.
-void FootStepGenerator::checkEmergencyStep(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam) const{
+bool FootStepGenerator::checkEmergencyStep(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam) const{
   // 現在静止状態で、CapturePointがsafeLegHullの外にあるなら、footstepNodesListがemergencyStepNumのサイズになるまで歩くnodeが末尾に入る.
-  if(!(footstepNodesList.size() == 1 && footstepNodesList[0].remainTime == 0)) return; // static 状態でないなら何もしない
+  if(!(footstepNodesList.size() == 1 && footstepNodesList[0].remainTime == 0)) return false; // static 状態でないなら何もしない
 
   std::vector<cnoid::Vector3> supportVertices; // generate frame
   for(int i=0;i<NUM_LEGS;i++){
@@ -849,7 +888,7 @@ void FootStepGenerator::checkEmergencyStep(std::vector<GaitParam::FootStepNodes>
   std::vector<cnoid::Vector3> supportHull = mathutil::calcConvexHull(supportVertices); // generate frame. Z成分はてきとう
 
   // dx = w ( x - z - l)
-  cnoid::Vector3 actDCM = gaitParam.actCog + gaitParam.actCogVel.value() / gaitParam.omega; // generate frame
+  cnoid::Vector3 actDCM = gaitParam.predActCog + gaitParam.predActCogVel / gaitParam.omega; // generate frame. 遅延補償したもの
   cnoid::Vector3 actCMP = actDCM - gaitParam.l; // generate frame
 
   if(!mathutil::isInsideHull(actCMP, supportHull) || // supportHullに入っていない
@@ -865,11 +904,13 @@ void FootStepGenerator::checkEmergencyStep(std::vector<GaitParam::FootStepNodes>
     footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * (1.0 - this->defaultDoubleSupportRatio), footstepNodesList.back().endRefZmpState));
     footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * this->defaultDoubleSupportRatio, GaitParam::FootStepNodes::refZmpState_enum::MIDDLE));
     footstepNodesList.push_back(calcDefaultDoubleSupportStep(footstepNodesList.back(), this->defaultStepTime * (1.0 - this->defaultDoubleSupportRatio), GaitParam::FootStepNodes::refZmpState_enum::MIDDLE)); // 末尾の両足支持期を延長. これがないと重心が目標位置に収束する前に返ってしまい, emergencyStepが無限に誘発する footGudedBalanceTimeを0.4程度に小さくすると収束が速くなるのでこの処理が不要になるのだが、今度はZ方向に振動しやすい
+    return true;
   }
+  return false;
 }
 
 // Stable Go Stop
-void FootStepGenerator::checkStableGoStop(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam) const{
+void FootStepGenerator::checkStableGoStop(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam) const{
   // 着地位置修正を行ったなら、footstepNodesListがemergencyStepNumのサイズになるまで歩くnodeが末尾に入る.
   for(int i=0;i<NUM_LEGS; i++){
     if((footstepNodesList[0].dstCoords[i].translation().head<2>() - gaitParam.dstCoordsOrg[i].translation().head<2>()).norm() > 0.01){ // 1cm以上着地位置修正を行ったなら
@@ -892,7 +933,7 @@ void FootStepGenerator::checkStableGoStop(std::vector<GaitParam::FootStepNodes>&
   }
 }
 
-std::vector<cnoid::Vector3> FootStepGenerator::calcRealStrideLimitationHull(const int& swingLeg, const double& theta, const std::vector<std::vector<cnoid::Vector3> >& legHull, const std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> >& defaultTranslatePos, const std::vector<std::vector<cnoid::Vector3> >& strideLimitationHull) const{
+std::vector<cnoid::Vector3> FootStepGenerator::calcRealStrideLimitationHull(const int& swingLeg, const double& theta, const std::vector<std::vector<cnoid::Vector3> >& legHull, const std::array<cpp_filters::TwoPointInterpolator<cnoid::Vector3>, NUM_LEGS>& defaultTranslatePos, const std::vector<std::vector<cnoid::Vector3> >& strideLimitationHull) const{
   std::vector<cnoid::Vector3> realStrideLimitationHull = strideLimitationHull[swingLeg]; // 支持脚(水平)座標系. strideLimitationHullの要素数は1以上あることが保証されているという仮定
 
   int supportLeg = swingLeg == RLEG ? LLEG : RLEG;
@@ -43,6 +43,8 @@ public:
 
 protected:
   mutable std::vector<cpp_filters::FirstOrderLowPassFilter<cnoid::Vector6> > actLegWrenchFilter = std::vector<cpp_filters::FirstOrderLowPassFilter<cnoid::Vector6> >(2, cpp_filters::FirstOrderLowPassFilter<cnoid::Vector6>(50.0, cnoid::Vector6::Zero()));  // 要素数2. rleg: 0. lleg: 1. generate frame. endeffector origin. cutoff 50hz. contactDecisionThresholdを用いた接触判定に用いる
+  // 新しいfootstepNodesListを作るための作業領域. 呼ばれるたびにFootStepNodesListを確保しないように使い回し、完成したらo_footstepNodesListとswapする. クリアしなくても副作用はない
+  mutable GaitParam::FootStepNodesList footstepNodesListBuffer;
 public:
   // startAutoBalancer時に呼ばれる
   void reset(){
@@ -68,7 +70,7 @@ public:
 public:
   // startAutoBalancer直後の初回で呼ばれる
   bool initFootStepNodesList(const GaitParam& gaitParam,
-                             std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cnoid::Position>& o_srcCoords, std::vector<cnoid::Position>& o_dstCoordsOrg, double& o_remainTimeOrg, std::vector<GaitParam::SwingState_enum>& o_swingState, double& o_elapsedTime, std::vector<bool>& o_prevSupportPhase) const;
+                             GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& o_srcCoords, std::array<cnoid::Position, NUM_LEGS>& o_dstCoordsOrg, double& o_remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& o_swingState, double& o_elapsedTime, std::array<bool, NUM_LEGS>& o_prevSupportPhase) const;
 
   class StepNode {
   public:
@@ -98,57 +100,59 @@ public:
     footstepsの0番目の要素は、実際には歩かず、基準座標としてのみ使われる. footstepNodesList[0].dstCoordsのZ軸を鉛直に直した座標系と、footstepsの0番目の要素のZ軸を鉛直に直した座標系が一致するように座標変換する.
    */
   bool setFootSteps(const GaitParam& gaitParam, const std::vector<StepNode>& footsteps,
-                    std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const;
+                    GaitParam::FootStepNodesList& o_footstepNodesList) const;
   bool goPos(const GaitParam& gaitParam, double x, double y, double th,
-             std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const;
+             GaitParam::FootStepNodesList& o_footstepNodesList) const;
 
   // footstepNodesListの末尾に両脚が横に並ぶ位置に2歩歩くnodeが入る. 外部からgoVelocityModeをfalseにすること
   bool goStop(const GaitParam& gaitParam,
-                    std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const;
+                    GaitParam::FootStepNodesList& o_footstepNodesList) const;
 
   // FootStepNodesListをdtすすめる
   bool procFootStepNodesList(const GaitParam& gaitParam, const double& dt, bool useActState,
-                             std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cnoid::Position>& o_srcCoords, std::vector<cnoid::Position>& o_dstCoordsOrg, double& o_remainTimeOrg, std::vector<GaitParam::SwingState_enum>& o_swingState, double& o_elapsedTime, std::vector<bool>& o_prevSupportPhase, double& relLandingHeight) const;
+                             GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& o_srcCoords, std::array<cnoid::Position, NUM_LEGS>& o_dstCoordsOrg, double& o_remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& o_swingState, double& o_elapsedTime, std::array<bool, NUM_LEGS>& o_prevSupportPhase, double& relLandingHeight) const;
 
   /*
     footstepNodesList[1]開始時のsupport/swingの状態を上書きによって変更する場合は、footstepNodesList[0]の終了時の状態が両脚支持でかつその期間の時間がdefaultDoubleSupportTimeよりも短いなら延長する
 
-    goVelocityModeなら、進行方向に向けてfootStepNodesList[1] ~ footStepNodesList[goVelocityStepNum]の要素を機械的に計算してどんどん末尾appendしていく. cmdVelに応じてきまる
+    goVelocityModeなら、進行方向に向けてfootStepNodesList[1] ~ footStepNodesList[goVelocityStepNum]の要素を機械的に計算してどんどん末尾appendしていく. cmdVelに応じてきまる. isPlanningCycleの周期のみ行う
 
     跳躍中でなければ、
     emergencyStepModeなら、footstepNodesList[0]が末尾の要素でかつ現在のdstCoordsのままだとバランスが取れないなら、footstepNodesList[1]に両脚が横に並ぶ位置に一歩歩くnodeが末尾に入る. (modifyFootStepsと併用せよ)
-    modifyFootStepsなら、footstepNodesList[0]の現在のdstCoordsのままだとバランスが取れないか、今swing期でfootstepNodesList[0]終了時に着地する予定の要素のdstCoordsが着地可能領域上にないなら、footstepNodesList[0]の、今swing期でfootstepNodesList[0]終了時に着地する予定の要素を修正する. また、それ以降一回でもswingする要素の位置を平行移動する
+    modifyFootStepsなら、footstepNodesList[0]の現在のdstCoordsのままだとバランスが取れないか、今swing期でfootstepNodesList[0]終了時に着地する予定の要素のdstCoordsが着地可能領域上にないなら、footstepNodesList[0]の、今swing期でfootstepNodesList[0]終了時に着地する予定の要素を修正する. また、それ以降一回でもswingする要素の位置を平行移動する. isPlanningCycleの周期のみ行う
+    emergencyStepModeの判断は転倒回避のため遅らせず、毎周期行う
 
+    footstepNodesListを変更しうる処理を行ったらo_isFootStepNodesListModifiedをtrueにする(falseにはしない)
   */
-  bool calcFootSteps(const GaitParam& gaitParam, const double& dt, bool useActState,
+  bool calcFootSteps(const GaitParam& gaitParam, const double& dt, bool useActState, bool isPlanningCycle,
                      GaitParam::DebugData& debugData, //for Log
-                     std::vector<GaitParam::FootStepNodes>& o_footstepNodesList) const;
+                     GaitParam::FootStepNodesList& o_footstepNodesList, bool& o_isFootStepNodesListModified) const;
 
 protected:
   // 早づきしたらremainTimeをdtに減らしてすぐに次のnodeへ移る. この機能が無いと少しでもロボットが傾いて早づきするとジャンプするような挙動になる.
-  void checkEarlyTouchDown(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam, double dt) const;
+  void checkEarlyTouchDown(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam, double dt) const;
   // stableGoStop.
-  void checkStableGoStop(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam) const;
+  void checkStableGoStop(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam) const;
   // footstepNodesListをdtだけ進める
   bool goNextFootStepNodesList(const GaitParam& gaitParam, double dt,
-                               std::vector<GaitParam::FootStepNodes>& footstepNodesList, std::vector<cnoid::Position>& srcCoords, std::vector<cnoid::Position>& dstCoordsOrg, double& remainTimeOrg, std::vector<GaitParam::SwingState_enum>& swingState, double& elapsedTime, double& relLandingHeight) const;
-  // emergengy step.
-  void checkEmergencyStep(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam) const;
+                               GaitParam::FootStepNodesList& footstepNodesList, std::array<cnoid::Position, NUM_LEGS>& srcCoords, std::array<cnoid::Position, NUM_LEGS>& dstCoordsOrg, double& remainTimeOrg, std::array<GaitParam::SwingState_enum, NUM_LEGS>& swingState, double& elapsedTime, double& relLandingHeight) const;
+  // emergengy step. nodeを追加したらtrueを返す
+  bool checkEmergencyStep(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam) const;
   // 着地位置・タイミング修正
-  void modifyFootSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, // input & output
+  void modifyFootSteps(GaitParam::FootStepNodesList& footstepNodesList, // input & output
                        GaitParam::DebugData& debugData, //for Log
                        const GaitParam& gaitParam) const;
 
   // thetaとlegHullとstrideLimitationHullから、実際のstrideLimitationhullを求める. 支持脚(水平)座標系. strideLimitationHullの要素数が1以上なら、返り値も必ず1以上
-  std::vector<cnoid::Vector3> calcRealStrideLimitationHull(const int& swingLeg, const double& theta, const std::vector<std::vector<cnoid::Vector3> >& legHull, const std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> >& defaultTranslatePos, const std::vector<std::vector<cnoid::Vector3> >& strideLimitationHull) const;
+  std::vector<cnoid::Vector3> calcRealStrideLimitationHull(const int& swingLeg, const double& theta, const std::vector<std::vector<cnoid::Vector3> >& legHull, const std::array<cpp_filters::TwoPointInterpolator<cnoid::Vector3>, NUM_LEGS>& defaultTranslatePos, const std::vector<std::vector<cnoid::Vector3> >& strideLimitationHull) const;
   // footstepNodesList[idx:] idxより先のstepの位置をgenerate frameで(左から)transformだけ動かす
-  void transformFutureSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const;
+  void transformFutureSteps(GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const;
   // footstepNodesList[idx:] idxより先のstepの位置をgenerate frameでtransformだけ動かす
-  void transformFutureSteps(std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Vector3& transform/*generate frame*/) const;
+  void transformFutureSteps(GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Vector3& transform/*generate frame*/) const;
   // indexのsupportLegが次にswingするまでの間の位置を、generate frameで(左から)transformだけ動かす
-  void transformCurrentSupportSteps(int leg, std::vector<GaitParam::FootStepNodes>& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const;
+  void transformCurrentSupportSteps(int leg, GaitParam::FootStepNodesList& footstepNodesList, int index, const cnoid::Position& transform/*generate frame*/) const;
   // footstepNodesの次の一歩を作る. RLEGとLLEGどちらをswingすべきかも決める
-  void calcDefaultNextStep(std::vector<GaitParam::FootStepNodes>& footstepNodesList, const GaitParam& gaitParam, const cnoid::Vector3& offset = cnoid::Vector3::Zero() /*leg frame*/, bool stableStart = true) const;
+  void calcDefaultNextStep(GaitParam::FootStepNodesList& footstepNodesList, const GaitParam& gaitParam, const cnoid::Vector3& offset = cnoid::Vector3::Zero() /*leg frame*/, bool stableStart = true) const;
   // footstepNodesの次の一歩を作る.
   GaitParam::FootStepNodes calcDefaultSwingStep(const int& swingLeg, const GaitParam::FootStepNodes& footstepNodes, const GaitParam& gaitParam, const cnoid::Vector3& offset = cnoid::Vector3::Zero(), bool startWithSingleSupport = false) const;
   GaitParam::FootStepNodes calcDefaultDoubleSupportStep(const GaitParam::FootStepNodes& footstepNodes, double doubleSupportTime, GaitParam::FootStepNodes::refZmpState_enum endRefZmpState) const;
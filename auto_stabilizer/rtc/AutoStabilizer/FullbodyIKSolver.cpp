@@ -2,12 +2,21 @@
 #include <prioritized_inverse_kinematics_solver/PrioritizedInverseKinematicsSolver.h>
 
 bool FullbodyIKSolver::solveFullbodyIK(double dt, const GaitParam& gaitParam,
+                                       GaitParam::DebugData& debugData, //for Log
                                        cnoid::BodyPtr& genRobot) const{
+  struct timeval startTime; gettimeofday(&startTime, NULL); // for log
+
   // !jointControllableの関節は指令値をそのまま入れる
   for(size_t i=0;i<genRobot->numJoints();i++){
     if(!gaitParam.jointControllable[i]) genRobot->joint(i)->q() = gaitParam.refRobot->joint(i)->q();
   }
 
+  // 静止中で、IKの目標が前回IKを解いたときから変化しておらず、前回の解が収束していたなら、IKを解いても結果は変わらないので解かない. 立っている時間が長いロボットでCPUを節約する
+  if(this->isIKSkippable(gaitParam)){
+    for(int i=0;i<debugData.ikStat.size();i++) debugData.ikStat[i] = 0.0; // for log
+    return true;
+  }
+
   // jointControllableの関節のみ、探索変数にする
   std::vector<cnoid::LinkPtr> variables; variables.reserve(1+genRobot->numJoints());
   std::vector<double> dqWeight; dqWeight.reserve(6+genRobot->numJoints());
@@ -35,8 +44,14 @@ bool FullbodyIKSolver::solveFullbodyIK(double dt, const GaitParam& gaitParam,
   // joint angle
   for(size_t i=0;i<genRobot->numJoints();i++){
     if(!gaitParam.jointControllable[i]) continue;
-    this->jointLimitConstraint[i]->joint() = genRobot->joint(i);
-    this->jointLimitConstraint[i]->jointLimitTables() = gaitParam.jointLimitTables[i];
+    // 関節角度上下限を評価する. IKの前のテーブルの評価はここで一回だけ行い、IKを解く間だけgenRobotの関節の可動範囲としてjointLimitConstraintに与える
+    double u = this->jointUpperLimit[i];
+    double l = this->jointLowerLimit[i];
+    for(int j=this->jointLimitTableBegin[i];j<this->jointLimitTableBegin[i+1];j++){
+      u = std::min(u,this->jointLimitTableList[j]->getUlimit());
+      l = std::max(l,this->jointLimitTableList[j]->getLlimit());
+    }
+    genRobot->joint(i)->setJointRange(l, u);
     this->jointLimitConstraint[i]->maxError() = 1.0 * dt;
     this->jointLimitConstraint[i]->weight() = 1.0;
     ikConstraint0.push_back(this->jointLimitConstraint[i]);
@@ -57,7 +72,7 @@ bool FullbodyIKSolver::solveFullbodyIK(double dt, const GaitParam& gaitParam,
     this->selfCollisionConstraint[i]->direction() = gaitParam.selfCollision[i].direction21;
 
     // 全自己干渉情報を与えると計算コストが膨大になるため、距離が近いもののみ与える
-    if(gaitParam.selfCollision[i].distance < 0.05){
+    if(gaitParam.selfCollision[i].distance < this->selfCollisionDistanceThreshold){
       ikConstraint1.push_back(this->selfCollisionConstraint[i]);
     }
   }
@@ -142,6 +157,11 @@ bool FullbodyIKSolver::solveFullbodyIK(double dt, const GaitParam& gaitParam,
       constraints[i][j]->debuglevel() = 0;//debuglevel
     }
   }
+  // 次周期のIK省略判定用
+  this->rootPosBeforeSolve = genRobot->rootLink()->p();
+  this->rootRBeforeSolve = genRobot->rootLink()->R();
+  for(size_t i=0;i<genRobot->numJoints();i++) this->qBeforeSolve[i] = genRobot->joint(i)->q();
+
   prioritized_inverse_kinematics_solver::IKParam param;
   param.maxIteration = 1;
   param.dqWeight = dqWeight;
@@ -156,18 +176,82 @@ bool FullbodyIKSolver::solveFullbodyIK(double dt, const GaitParam& gaitParam,
                                                      );
 
 
-  // 念の為limit check
-  for(int i=0;i<gaitParam.refRobot->numJoints();i++){
+  // genRobotの関節の可動範囲をモデルの値に戻す. 他にq_upper(), q_lower()を読むところがテーブルの上下限を読まないようにする
+  for(int i=0;i<genRobot->numJoints();i++){
+    if(!gaitParam.jointControllable[i]) continue;
+    genRobot->joint(i)->setJointRange(this->jointLowerLimit[i], this->jointUpperLimit[i]);
+  }
+
+  // 念の為limit check. テーブルを持つ関節は、IKで動いた後の相手の関節の角度でテーブルを評価し直す
+  for(int i=0;i<genRobot->numJoints();i++){
     if(!gaitParam.jointControllable[i]) continue;
     cnoid::LinkPtr joint = genRobot->joint(i);
-    double u = gaitParam.refRobot->joint(i)->q_upper();
-    double l = gaitParam.refRobot->joint(i)->q_lower();
-    for(int j=0;j<gaitParam.jointLimitTables[i].size();j++){
-      u = std::min(u,gaitParam.jointLimitTables[i][j]->getUlimit());
-      l = std::max(l,gaitParam.jointLimitTables[i][j]->getLlimit());
+    double u = this->jointUpperLimit[i];
+    double l = this->jointLowerLimit[i];
+    for(int j=this->jointLimitTableBegin[i];j<this->jointLimitTableBegin[i+1];j++){
+      u = std::min(u,this->jointLimitTableList[j]->getUlimit());
+      l = std::max(l,this->jointLimitTableList[j]->getLlimit());
     }
     joint->q() = std::min(u, std::max(l, joint->q()));
   }
 
+  // 次周期のIK省略判定用
+  {
+    bool converged = ((genRobot->rootLink()->p() - this->rootPosBeforeSolve).cwiseAbs().maxCoeff() <= this->ikSkipTolerance) &&
+      ((genRobot->rootLink()->R() - this->rootRBeforeSolve).cwiseAbs().maxCoeff() <= this->ikSkipTolerance);
+    for(size_t i=0;i<genRobot->numJoints() && converged;i++){
+      if(std::abs(genRobot->joint(i)->q() - this->qBeforeSolve[i]) > this->ikSkipTolerance) converged = false;
+    }
+    this->isConverged = converged;
+    for(int i=0;i<gaitParam.eeName.size();i++) this->prevEETargetPose[i] = gaitParam.abcEETargetPose[i];
+    this->prevCogTarget = gaitParam.genCog + gaitParam.sbpOffset;
+    this->prevRootTargetPos = gaitParam.stTargetRootPose.translation();
+    this->prevRootTargetR = gaitParam.stTargetRootPose.linear();
+    for(size_t i=0;i<genRobot->numJoints();i++) this->prevRefq[i] = gaitParam.refRobot->joint(i)->q();
+  }
+
+  // for log
+  {
+    for(size_t i=0;i<constraints.size();i++){
+      debugData.ikStat[3*i+0] = constraints[i].size();
+      debugData.ikStat[3*i+1] = 0.0;
+      debugData.ikStat[3*i+2] = 0.0;
+    }
+    // tasksはsolveIKLoopが優先度ごとに1つずつ作る. 前周期のOSQPの作業領域を保持しているので、今周期のiterationの数と終了状態がわかる
+    for(size_t i=0;i<constraints.size() && i<this->tasks.size();i++){
+      std::shared_ptr<prioritized_qp_osqp::Task> task = std::dynamic_pointer_cast<prioritized_qp_osqp::Task>(this->tasks[i]);
+      if(!task || !task->solver().isInitialized() || !task->solver().workspace() || !task->solver().workspace()->info) continue;
+      debugData.ikStat[3*i+1] = task->solver().workspace()->info->iter;
+      debugData.ikStat[3*i+2] = task->solver().workspace()->info->status_val;
+    }
+    struct timeval endTime; gettimeofday(&endTime, NULL);
+    debugData.ikStat[9] = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_usec - startTime.tv_usec) * 1e-6;
+  }
+
+  return true;
+}
+
+bool FullbodyIKSolver::isIKSkippable(const GaitParam& gaitParam) const{
+  if(!this->isConverged) return false;
+  if(!gaitParam.isStatic()) return false;
+  for(int i=0;i<NUM_LEGS;i++){
+    if(gaitParam.isManualControlMode[i].value() != 0.0) return false;
+  }
+  for(int i=0;i<gaitParam.selfCollision.size();i++){
+    if(gaitParam.selfCollision[i].distance < this->selfCollisionDistanceThreshold) return false; // 自己干渉回避の制約が与えられる場合は、自己干渉の情報が毎周期変わるので省略しない
+  }
+
+  // IKの目標が前回IKを解いたときから変化していないか. impedanceControlやmanualControlによる動きもabcEETargetPoseに含まれる
+  for(int i=0;i<gaitParam.eeName.size();i++){
+    if((gaitParam.abcEETargetPose[i].translation() - this->prevEETargetPose[i].translation()).cwiseAbs().maxCoeff() > this->ikSkipTolerance) return false;
+    if((gaitParam.abcEETargetPose[i].linear() - this->prevEETargetPose[i].linear()).cwiseAbs().maxCoeff() > this->ikSkipTolerance) return false;
+  }
+  if((gaitParam.genCog + gaitParam.sbpOffset - this->prevCogTarget).cwiseAbs().maxCoeff() > this->ikSkipTolerance) return false;
+  if((gaitParam.stTargetRootPose.translation() - this->prevRootTargetPos).cwiseAbs().maxCoeff() > this->ikSkipTolerance) return false;
+  if((gaitParam.stTargetRootPose.linear() - this->prevRootTargetR).cwiseAbs().maxCoeff() > this->ikSkipTolerance) return false;
+  for(size_t i=0;i<gaitParam.refRobot->numJoints();i++){
+    if(std::abs(gaitParam.refRobot->joint(i)->q() - this->prevRefq[i]) > this->ikSkipTolerance) return false;
+  }
+
   return true;
 }
@@ -10,14 +10,22 @@
 #include <ik_constraint/JointVelocityConstraint.h>
 #include <ik_constraint/ClientCollisionConstraint.h>
 #include <prioritized_inverse_kinematics_solver/PrioritizedInverseKinematicsSolver.h>
+#include <prioritized_qp_osqp/prioritized_qp_osqp.h>
 
 class FullbodyIKSolver{
 public:
   // FullbodyIKSolverでのみ使うパラメータ
   std::vector<cpp_filters::TwoPointInterpolator<double> > dqWeight; // 要素数と順序はrobot->numJoints()と同じ. 0より大きい. 各関節の変位に対する重みの比. default 1. 動かしたくない関節は大きくする. 全く動かしたくないなら、controllable_jointsを使うこと
+  double selfCollisionDistanceThreshold = 0.05; // [m]. 0以上. 距離がこれ未満の自己干渉のペアのみ、IKに自己干渉回避の制約として与える. 与える制約がある間はIKを省略しない
+
+  FullbodyIKSolver() {}
+  // 以下のIK::Constraint等をshared_ptrで持つので、コピーすると2つのインスタンスが同じ作業領域を共有してしまう
+  FullbodyIKSolver(const FullbodyIKSolver&) = delete;
+  FullbodyIKSolver& operator=(const FullbodyIKSolver&) = delete;
 
   // FullbodyIKSolverでのみ使うパラメータ
   // 内部にヤコビアンの情報をキャッシュするが、クリアしなくても副作用はあまりない
+  // solveFullbodyIKはconstだがこれらを書き換えるので、1つのインスタンスのsolveFullbodyIKを複数のスレッドから同時に呼んではいけない
   mutable std::vector<std::shared_ptr<IK::PositionConstraint> > ikEEPositionConstraint; // 要素数と順序はeeNameと同じ.
   mutable std::vector<std::shared_ptr<IK::JointAngleConstraint> > refJointAngleConstraint; // 要素数と順序はrobot->numJoints()と同じ
   mutable std::shared_ptr<IK::PositionConstraint> rootPositionConstraint = std::make_shared<IK::PositionConstraint>();
@@ -30,6 +38,25 @@ protected:
   // クリアしなくても副作用はあまりない
   mutable cnoid::VectorX jlim_avoid_weight;
   mutable std::vector<std::shared_ptr<prioritized_qp_base::Task> > tasks;
+
+  // gaitParam.jointLimitTablesを毎周期辿らなくて良いように、init時に平坦な配列にしたもの. gaitParam.jointLimitTablesが所有しているので生ポインタで持つ
+  std::vector<double> jointLowerLimit; // 要素数と順序はrobot->numJoints()と同じ. テーブルを考慮しない関節角度下限. init時のgenRobotの関節の可動範囲. IKを解いた後にgenRobotの関節の可動範囲をこれに戻す
+  std::vector<double> jointUpperLimit; // 要素数と順序はrobot->numJoints()と同じ. テーブルを考慮しない関節角度上限
+  std::vector<int> jointLimitTableBegin; // 要素数はrobot->numJoints()+1. i番目の関節のテーブルはjointLimitTableList[jointLimitTableBegin[i]] ~ jointLimitTableList[jointLimitTableBegin[i+1]-1]
+  std::vector<joint_limit_table::JointLimitTable*> jointLimitTableList;
+
+  // 静止中にIKを省略するためのキャッシュ.
+  //   前回IKを解いたときのIKの目標と、そのときの解の変化量を覚えておく. 静止中で、IKの目標が前回IKを解いたときから変化しておらず、前回の解が変化していなかった(収束していた)なら、IKを解かずに前周期のgenRobotをそのまま使う
+  const double ikSkipTolerance = 1e-5; // [m], [rad]
+  mutable bool isConverged = false; // 前回IKを解いたときに、解がikSkipTolerance以上変化しなかったかどうか
+  mutable std::vector<cnoid::Position> prevEETargetPose; // 要素数と順序はeeNameと同じ. 前回IKを解いたときのabcEETargetPose
+  mutable cnoid::Vector3 prevCogTarget = cnoid::Vector3::Zero(); // 前回IKを解いたときのgenCog + sbpOffset
+  mutable cnoid::Vector3 prevRootTargetPos = cnoid::Vector3::Zero(); // 前回IKを解いたときのstTargetRootPose
+  mutable cnoid::Matrix3 prevRootTargetR = cnoid::Matrix3::Identity();
+  mutable cnoid::VectorX prevRefq; // 要素数と順序はrobot->numJoints()と同じ. 前回IKを解いたときのrefRobotの関節角度
+  mutable cnoid::Vector3 rootPosBeforeSolve = cnoid::Vector3::Zero();
+  mutable cnoid::Matrix3 rootRBeforeSolve = cnoid::Matrix3::Identity();
+  mutable cnoid::VectorX qBeforeSolve; // 要素数と順序はrobot->numJoints()と同じ
 public:
   // 初期化時に一回呼ばれる
   void init(const cnoid::BodyPtr& genRobot, const GaitParam& gaitParam){
@@ -41,14 +68,33 @@ public:
     jointVelocityConstraint.clear();
     for(int i=0;i<genRobot->numJoints();i++) jointVelocityConstraint.push_back(std::make_shared<IK::JointVelocityConstraint>());
     jointLimitConstraint.clear();
-    for(int i=0;i<genRobot->numJoints();i++) jointLimitConstraint.push_back(std::make_shared<ik_constraint_joint_limit_table::JointLimitMinMaxTableConstraint>());
+    for(int i=0;i<genRobot->numJoints();i++) {
+      jointLimitConstraint.push_back(std::make_shared<ik_constraint_joint_limit_table::JointLimitMinMaxTableConstraint>());
+      jointLimitConstraint.back()->joint() = genRobot->joint(i); // テーブルは与えない. solveFullbodyIKで評価済みの上下限を、IKを解く間だけgenRobotの関節の可動範囲として与える
+    }
+    jointLowerLimit.resize(genRobot->numJoints());
+    jointUpperLimit.resize(genRobot->numJoints());
+    jointLimitTableBegin.resize(genRobot->numJoints()+1);
+    jointLimitTableList.clear();
+    for(int i=0;i<genRobot->numJoints();i++){
+      jointLowerLimit[i] = genRobot->joint(i)->q_lower();
+      jointUpperLimit[i] = genRobot->joint(i)->q_upper();
+      jointLimitTableBegin[i] = jointLimitTableList.size();
+      for(int j=0;j<gaitParam.jointLimitTables[i].size();j++) jointLimitTableList.push_back(gaitParam.jointLimitTables[i][j].get());
+    }
+    jointLimitTableBegin[genRobot->numJoints()] = jointLimitTableList.size();
     selfCollisionConstraint.clear();
     for(int i=0;i<gaitParam.selfCollision.size();i++) selfCollisionConstraint.push_back(std::make_shared<IK::ClientCollisionConstraint>());
+    prevEETargetPose.resize(gaitParam.eeName.size(), cnoid::Position::Identity());
+    prevRefq = cnoid::VectorX::Zero(genRobot->numJoints());
+    qBeforeSolve = cnoid::VectorX::Zero(genRobot->numJoints());
+    isConverged = false;
   }
 
   // startAutoBalancer時に一回呼ばれる
   void reset(){
     for(int i=0;i<dqWeight.size();i++) dqWeight[i].reset(dqWeight[i].getGoal());
+    isConverged = false;
   }
 
   // 毎周期呼ばれる
@@ -57,7 +103,12 @@ public:
   }
 
   bool solveFullbodyIK(double dt, const GaitParam& gaitParam,
+                       GaitParam::DebugData& debugData, //for Log
                        cnoid::BodyPtr& genRobot) const;
+
+protected:
+  // IKを解かずに前周期のgenRobotをそのまま使ってよいか
+  bool isIKSkippable(const GaitParam& gaitParam) const;
 };
 
 #endif
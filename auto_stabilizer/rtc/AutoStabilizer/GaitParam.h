@@ -4,11 +4,13 @@
 #include <sys/time.h>
 #include <cnoid/EigenTypes>
 #include <vector>
+#include <array>
 #include <limits>
 #include <cpp_filters/TwoPointInterpolator.h>
 #include <cpp_filters/FirstOrderLowPassFilter.h>
 #include <joint_limit_table/JointLimitTable.h>
 #include "FootGuidedController.h"
+#include "RingBuffer.h"
 
 enum leg_enum{RLEG=0, LLEG=1, NUM_LEGS=2};
 
@@ -29,24 +31,26 @@ public:
 
 public:
   // parameter
-  std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> > copOffset = std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> >{cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3(0.0,0.02,0.0),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB),cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3(0.0,-0.02,0.0),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB)}; // 要素数2. rleg: 0. lleg: 1. endeffector frame. 足裏COPの目標位置. 幾何的な位置はcopOffset.value()無しで考えるが、目標COPを考えるときはcopOffset.value()を考慮する. クロスできたりジャンプできたりする脚でないと左右方向(外側向き)の着地位置修正は難しいので、その方向に転びそうになることが極力ないように内側にcopをオフセットさせておくとよい.  単位[m]. 滑らかに変化する.
+  std::array<cpp_filters::TwoPointInterpolator<cnoid::Vector3>, NUM_LEGS> copOffset = {{cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3(0.0,0.02,0.0),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB),cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3(0.0,-0.02,0.0),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB)}}; // 要素数2. rleg: 0. lleg: 1. endeffector frame. 足裏COPの目標位置. 幾何的な位置はcopOffset.value()無しで考えるが、目標COPを考えるときはcopOffset.value()を考慮する. クロスできたりジャンプできたりする脚でないと左右方向(外側向き)の着地位置修正は難しいので、その方向に転びそうになることが極力ないように内側にcopをオフセットさせておくとよい.  単位[m]. 滑らかに変化する.
   std::vector<std::vector<cnoid::Vector3> > legHull = std::vector<std::vector<cnoid::Vector3> >(2, std::vector<cnoid::Vector3>{cnoid::Vector3(0.115,0.065,0.0),cnoid::Vector3(-0.095,0.065,0.0),cnoid::Vector3(-0.095,-0.065,0.0),cnoid::Vector3(0.115,-0.065,0.0)}); // 要素数2. rleg: 0. lleg: 1. endeffector frame.  凸形状で,上から見て半時計回り. Z成分はあったほうが計算上扱いやすいからありにしているが、0でなければならない. 単位[m]. JAXONでは、COPがY -0.1近くにくるとギア飛びしやすいので、少しYの下限を少なくしている
-  std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> > defaultTranslatePos = std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector3> >(2,cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB)); // goPos, goVelocity, setFootSteps等するときの右脚と左脚の中心からの相対位置. また、reference frameとgenerate frameの対応付けに用いられる. (Z軸は鉛直). Z成分はあったほうが計算上扱いやすいからありにしているが、0でなければならない. RefToGenFrameConverter(handFixMode)が「左右」という概念を使うので、X成分も0でなければならない. 単位[m] 滑らかに変化する.
-  std::vector<cpp_filters::TwoPointInterpolator<double> > isManualControlMode = std::vector<cpp_filters::TwoPointInterpolator<double> >(2, cpp_filters::TwoPointInterpolator<double>(0.0, 0.0, 0.0, cpp_filters::LINEAR)); // 要素数2. 0: rleg. 1: lleg. 0~1. 連続的に変化する. 1ならicEETargetPoseに従い、refEEWrenchに応じて重心をオフセットする. 0ならImpedanceControlをせず、refEEWrenchを無視し、DampingControlを行わない. 静止状態で無い場合や、支持脚の場合は、勝手に0になる. 両足が同時に1になることはない. 1にするなら、RefToGenFrameConverter.refFootOriginWeightを0にしたほうが良い. 1の状態でStartAutoStabilizerすると、遊脚で始まる
+  std::array<cpp_filters::TwoPointInterpolator<cnoid::Vector3>, NUM_LEGS> defaultTranslatePos = {{cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB),cpp_filters::TwoPointInterpolator<cnoid::Vector3>(cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),cpp_filters::HOFFARBIB)}}; // goPos, goVelocity, setFootSteps等するときの右脚と左脚の中心からの相対位置. また、reference frameとgenerate frameの対応付けに用いられる. (Z軸は鉛直). Z成分はあったほうが計算上扱いやすいからありにしているが、0でなければならない. RefToGenFrameConverter(handFixMode)が「左右」という概念を使うので、X成分も0でなければならない. 単位[m] 滑らかに変化する.
+  std::array<cpp_filters::TwoPointInterpolator<double>, NUM_LEGS> isManualControlMode = {{cpp_filters::TwoPointInterpolator<double>(0.0, 0.0, 0.0, cpp_filters::LINEAR),cpp_filters::TwoPointInterpolator<double>(0.0, 0.0, 0.0, cpp_filters::LINEAR)}}; // 要素数2. 0: rleg. 1: lleg. 0~1. 連続的に変化する. 1ならicEETargetPoseに従い、refEEWrenchに応じて重心をオフセットする. 0ならImpedanceControlをせず、refEEWrenchを無視し、DampingControlを行わない. 静止状態で無い場合や、支持脚の場合は、勝手に0になる. 両足が同時に1になることはない. 1にするなら、RefToGenFrameConverter.refFootOriginWeightを0にしたほうが良い. 1の状態でStartAutoStabilizerすると、遊脚で始まる
 
   std::vector<bool> jointControllable; // 要素数と順序はnumJoints()と同じ. falseの場合、qやtauはrefの値をそのまま出力する(writeOutputPort時にref値で上書き). IKでは動かさない(ref値をそのまま). トルク計算では目標トルクを通常通り計算する. このパラメータはMODE_IDLEのときにしか変更されない
 
+  int planningDecimation = 1; // 1以上. 変化の遅い計画系の処理(FootStepGeneratorの着地位置修正とgoVelocityModeのnodeの追加, LegCoordsGeneratorのrefZmpTrajの作り直し, ExternalForceHandlerの長期的外乱補償の外乱の推定)を、この周期数に1回だけ行う. emergency stepの判断, Stabilizer, IK等は毎周期行う. 制御周期が短いときに計算時間を減らすためのもの. 着地位置修正がこの周期数ぶん遅れうるので、planningDecimation * dtが数[ms]以内になるようにする
+
 public:
   // from data port
-  cnoid::BodyPtr refRobotRaw; // reference. reference world frame
+  cnoid::BodyPtr refRobotRaw; // reference. reference world frame. applyInPortDataで各linkの位置姿勢と重心まで計算される
   std::vector<cnoid::Vector6> refEEWrenchOrigin; // 要素数と順序はeeNameと同じ.FootOrigin frame. EndEffector origin. ロボットが受ける力
   std::vector<cpp_filters::TwoPointInterpolatorSE3> refEEPoseRaw; // 要素数と順序はeeNameと同じ. reference world frame. EEPoseはjoint angleなどと比べて遅い周期で届くことが多いので、interpolaterで補間する.
-  cnoid::BodyPtr actRobotRaw; // actual. actual imu world frame
+  cnoid::BodyPtr actRobotRaw; // actual. actual imu world frame. rootLinkの位置姿勢と関節角度・角速度, 力センサの値のみ更新される. 各linkの位置姿勢と重心は更新されない
   class Collision {
   public:
-    std::string link1 = "";
+    int link1 = -1; // robot->link(link1). link名ではなくindex. refRobotRaw, genRobot等で共通
     cnoid::Vector3 point1 = cnoid::Vector3::Zero(); // link1 frame
-    std::string link2 = "";
+    int link2 = -1; // robot->link(link2)
     cnoid::Vector3 point2 = cnoid::Vector3::Zero(); // link2 frame
     cnoid::Vector3 direction21 = cnoid::Vector3::UnitX(); // generate frame
     double distance = 0.0;
@@ -58,6 +62,7 @@ public:
   std::vector<double> steppableHeight; // generate frame. 要素数と順序はsteppableRegionと同じ。steppableRegionの各要素の重心Z.
   double relLandingHeight = -1e15; // generate frame. 現在の遊脚のfootstepNodesList[0]のdstCoordsのZ. -1e10未満なら、relLandingHeightとrelLandingNormalは無視される. footStepNodesListsの次のnodeに移るたびにFootStepGeneratorによって-1e15に上書きされる.
   cnoid::Vector3 relLandingNormal = cnoid::Vector3::UnitZ(); // generate frame. 現在の遊脚のfootstepNodesList[0]のdstCoordsのZ軸の方向. ノルムは常に1
+  double actDelay = 0.0; // [s]. 最後にqAct, actImuが届いたときの、qRefの時刻 - それらの時刻(大きい方). センサRTCからAutoStabilizerまでの遅延. 送り手が時刻を設定していない場合は意味を持たない
 public:
   // AutoStabilizerの中で計算更新される.
 
@@ -80,6 +85,10 @@ public:
   cnoid::Vector3 sbpOffset = cnoid::Vector3::Zero(); // generate frame. 外力考慮重心と重心のオフセット. genCog = genRobot->centerOfMass() - sbpOffset. actCog = actRobot->centerOfMass() - sbpOffset.
   cnoid::Vector3 actCog; // generate frame. 現在のCOMにsbpOffsetを施したもの actCog = actRobot->centerOfMass() - sbpOffset
 
+  // ActToGenFrameConverter::predictActState
+  cnoid::Vector3 predActCog = cnoid::Vector3::Zero(); // generate frame. actCogを遅延の分だけ倒立振子モデルで先に進めたもの. 遅延補償を行わない場合はactCogと同じ
+  cnoid::Vector3 predActCogVel = cnoid::Vector3::Zero(); // generate frame. actCogVel.value()を同様に先に進めたもの
+
   // ImpedanceController
   std::vector<cpp_filters::TwoPointInterpolator<cnoid::Vector6> > icEEOffset; // 要素数と順序はeeNameと同じ.generate frame. endEffector origin. icで計算されるオフセット
   std::vector<cnoid::Position> icEETargetPose; // 要素数と順序はeeNameと同じ.generate frame. icで計算された目標位置姿勢. icEETargetPose = icEEOffset + refEEPose
@@ -109,32 +118,38 @@ public:
       footstepNodesList[0]のendRefZmpStateは変更されない.
       footstepNodesList[0]のendRefZmpStateは、isStatic()である場合を除いて変更されない.
     */
-    std::vector<cnoid::Position> dstCoords = std::vector<cnoid::Position>(NUM_LEGS,cnoid::Position::Identity()); // 要素数2. rleg: 0. lleg: 1. generate frame.
-    std::vector<bool> isSupportPhase = std::vector<bool>(NUM_LEGS, true); // 要素数2. rleg: 0. lleg: 1. footstepNodesListの末尾の要素が両方falseであることは無い
+    std::array<cnoid::Position, NUM_LEGS> dstCoords = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // 要素数2. rleg: 0. lleg: 1. generate frame.
+    std::array<bool, NUM_LEGS> isSupportPhase = {{true, true}}; // 要素数2. rleg: 0. lleg: 1. footstepNodesListの末尾の要素が両方falseであることは無い
     double remainTime = 0.0;
     enum class refZmpState_enum{RLEG, LLEG, MIDDLE};
     refZmpState_enum endRefZmpState = refZmpState_enum::MIDDLE; // このnode終了時のrefZmpの位置.
 
     // 遊脚軌道用パラメータ
-    std::vector<std::vector<double> > stepHeight = std::vector<std::vector<double> >(NUM_LEGS,std::vector<double>(2,0)); // 要素数2. rleg: 0. lleg: 1. swing期には、srcCoordsの高さ+[0]とdstCoordsの高さ+[1]の高い方に上げるような軌道を生成する
-    std::vector<bool> stopCurrentPosition = std::vector<bool>(NUM_LEGS, false); // 現在の位置で強制的に止めるかどうか
-    std::vector<double> goalOffset = std::vector<double>(NUM_LEGS,0.0); // [m]. 遊脚軌道生成時に、遅づきの場合、generate frameで鉛直方向に, 目標着地位置に対して加えるオフセットの最大値. 0以下.
-    std::vector<double> touchVel = std::vector<double>(NUM_LEGS,0.3); // 0より大きい. 単位[m/s]. 足を下ろすときの速さ
+    std::array<std::array<double, 2>, NUM_LEGS> stepHeight = {{{0.0,0.0},{0.0,0.0}}}; // 要素数2. rleg: 0. lleg: 1. swing期には、srcCoordsの高さ+[0]とdstCoordsの高さ+[1]の高い方に上げるような軌道を生成する
+    std::array<bool, NUM_LEGS> stopCurrentPosition = {{false, false}}; // 現在の位置で強制的に止めるかどうか
+    std::array<double, NUM_LEGS> goalOffset = {{0.0, 0.0}}; // [m]. 遊脚軌道生成時に、遅づきの場合、generate frameで鉛直方向に, 目標着地位置に対して加えるオフセットの最大値. 0以下.
+    std::array<double, NUM_LEGS> touchVel = {{0.3, 0.3}}; // 0より大きい. 単位[m/s]. 足を下ろすときの速さ
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
-  std::vector<FootStepNodes> footstepNodesList = std::vector<FootStepNodes>(1); // 要素数1以上. 0番目が現在の状態. 末尾の要素以降は、末尾の状態がずっと続くとして扱われる.
-  std::vector<cnoid::Position> srcCoords = std::vector<cnoid::Position>(NUM_LEGS,cnoid::Position::Identity()); // 要素数2. rleg: 0. lleg: 1. generate frame. 現在のfootstep開始時のgenCoords
-  std::vector<cnoid::Position> dstCoordsOrg = std::vector<cnoid::Position>(NUM_LEGS,cnoid::Position::Identity()); // 要素数2. rleg: 0. lleg: 1. generate frame. 現在のfootstep開始時のdstCoords
+  // footstepNodesListの要素数の上限. goPosの最大歩数(100歩)の全nodeが入る大きさ. 領域は構築時に一度だけヒープに確保する. FootStepNodesはヒープを使わないので、footstepNodesListのコピー代入やswap, pop frontでメモリ確保は起こらない
+  static const int MAX_FOOTSTEP_NODES = 256;
+  typedef RingBuffer<FootStepNodes, MAX_FOOTSTEP_NODES> FootStepNodesList;
+  FootStepNodesList footstepNodesList = FootStepNodesList(1); // 要素数1以上. 0番目が現在の状態. 末尾の要素以降は、末尾の状態がずっと続くとして扱われる.
+  std::array<cnoid::Position, NUM_LEGS> srcCoords = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // 要素数2. rleg: 0. lleg: 1. generate frame. 現在のfootstep開始時のgenCoords
+  std::array<cnoid::Position, NUM_LEGS> dstCoordsOrg = {{cnoid::Position::Identity(),cnoid::Position::Identity()}}; // 要素数2. rleg: 0. lleg: 1. generate frame. 現在のfootstep開始時のdstCoords
   double remainTimeOrg = 0.0; // 現在のfootstep開始時のremainTime
   enum SwingState_enum{LIFT_PHASE, SWING_PHASE, DOWN_PHASE};
-  std::vector<SwingState_enum> swingState = std::vector<SwingState_enum>(NUM_LEGS,LIFT_PHASE); // 要素数2. rleg: 0. lleg: 0. isSupportPhase = falseの脚は、footstep開始時はLIFT_PHASEで、LIFT_PHASE->SWING_PHASE->DOWN_PHASEと遷移する. 一度DOWN_PHASEになったら次のfootstepが始まるまで別のPHASEになることはない. DOWN_PHASEのときはfootstepNodesList[0]のdstCoordsはgenCoordsよりも高い位置に変更されることはない. isSupportPhase = trueの脚は、swingStateは参照されない(常にLIFT_PHASEとなる).
+  std::array<SwingState_enum, NUM_LEGS> swingState = {{LIFT_PHASE,LIFT_PHASE}}; // 要素数2. rleg: 0. lleg: 0. isSupportPhase = falseの脚は、footstep開始時はLIFT_PHASEで、LIFT_PHASE->SWING_PHASE->DOWN_PHASEと遷移する. 一度DOWN_PHASEになったら次のfootstepが始まるまで別のPHASEになることはない. DOWN_PHASEのときはfootstepNodesList[0]のdstCoordsはgenCoordsよりも高い位置に変更されることはない. isSupportPhase = trueの脚は、swingStateは参照されない(常にLIFT_PHASEとなる).
   double elapsedTime = 0.0; // 現在のfootstep開始時からの経過時間
-  std::vector<bool> prevSupportPhase = std::vector<bool>{true, true}; // 要素数2. rleg: 0. lleg: 1. 一つ前の周期でSupportPhaseだったかどうか
+  std::array<bool, NUM_LEGS> prevSupportPhase = {{true, true}}; // 要素数2. rleg: 0. lleg: 1. 一つ前の周期でSupportPhaseだったかどうか
+  int planningCount = 0; // 前回計画系の処理を行った周期からの周期数. 0なら今周期に計画系の処理を行う. planningDecimationを参照
+  bool isFootStepNodesListModified = false; // footstepNodesListがprocFootStepNodesList以外(goPos, setFootSteps, goStop, calcFootSteps)によって変更されたらtrueになる. trueなら計画系の処理を行わない周期でもrefZmpTrajを作り直し、falseに戻す
 
   // LegCoordsGenerator
-  std::vector<cpp_filters::TwoPointInterpolatorSE3> genCoords = std::vector<cpp_filters::TwoPointInterpolatorSE3>(NUM_LEGS, cpp_filters::TwoPointInterpolatorSE3(cnoid::Position::Identity(),cnoid::Vector6::Zero(),cnoid::Vector6::Zero(),cpp_filters::HOFFARBIB)); // 要素数2. rleg: 0. lleg: 1. generate frame. 現在の位置
+  std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS> genCoords = {{cpp_filters::TwoPointInterpolatorSE3(cnoid::Position::Identity(),cnoid::Vector6::Zero(),cnoid::Vector6::Zero(),cpp_filters::HOFFARBIB),cpp_filters::TwoPointInterpolatorSE3(cnoid::Position::Identity(),cnoid::Vector6::Zero(),cnoid::Vector6::Zero(),cpp_filters::HOFFARBIB)}}; // 要素数2. rleg: 0. lleg: 1. generate frame. 現在の位置
   std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> > refZmpTraj = {footguidedcontroller::LinearTrajectory<cnoid::Vector3>(cnoid::Vector3::Zero(),cnoid::Vector3::Zero(),0.0)}; // 要素数1以上. generate frame. footstepNodesListを単純に線形補間して計算される現在の目標zmp軌道
+  footguidedcontroller::FootGuidedPreview<cnoid::Vector3> refZmpTrajPreview = footguidedcontroller::FootGuidedPreview<cnoid::Vector3>(cnoid::Vector3::Zero(), 0.0); // refZmpTraj, omega, lから毎周期一回計算される. calcFootGuidedControl(omega, l, DCM, refZmpTraj) = refZmpTrajPreview.calcFootGuidedControl(DCM)
 
   cnoid::Vector3 genCog; // generate frame. abcで計算された目標COM
   cnoid::Vector3 genCogVel;  // generate frame.  abcで計算された目標COM速度
@@ -159,6 +174,9 @@ public:
     std::vector<cnoid::Vector3> strideLimitationHull = std::vector<cnoid::Vector3>(); // generate frame. overwritableStrideLimitationHullの範囲内の着地位置(自己干渉・IKの考慮が含まれる). Z成分には0を入れる
     std::vector<std::vector<cnoid::Vector3> > capturableHulls = std::vector<std::vector<cnoid::Vector3> >(); // generate frame. 要素数と順番はcandidatesに対応
     std::vector<double> cpViewerLog = std::vector<double>(37, 0.0);
+    std::vector<double> ikStat = std::vector<double>(3*3+1, 0.0); // FullbodyIKSolverの統計. 優先度ごとに[与えた制約の数, OSQPのiterationの数, OSQPの終了状態(status_val. 1なら解けた)]. 最後の要素は計算時間[s]
+    std::vector<double> perfStat = std::vector<double>(7, 0.0); // 1周期あたりのハードウェアカウンタとpage faultの回数. [cycles, instructions, cache-references, cache-misses, minor page faults, major page faults]. perf_countersが有効な場合のみ. 最後の要素はfootstepNodesListOverflowCount
+    unsigned long footstepNodesListOverflowCount = 0; // calcFootStepsでfootstepNodesListが容量を超えたため、その周期の変更を破棄した回数の累計
   };
   DebugData debugData; // デバッグ用のOutPortから出力するためのデータ. AutoStabilizer内の制御処理では使われることは無い. そのため、モード遷移や初期化等の処理にはあまり注意を払わなくて良い
 
@@ -166,6 +184,9 @@ public:
   bool isStatic() const{ // 現在static状態かどうか
     return this->footstepNodesList.size() == 1 && this->footstepNodesList[0].remainTime == 0.0;
   }
+  bool isPlanningCycle() const{ // 今周期に計画系の処理を行うかどうか. planningDecimationを参照
+    return this->planningCount == 0;
+  }
 
 public:
   void init(const cnoid::BodyPtr& robot){
@@ -217,6 +238,9 @@ public:
     steppableHeight.clear();
     relLandingHeight = -1e15;
     relLandingNormal = cnoid::Vector3::UnitZ();
+
+    planningCount = 0; // startAutoBalancer直後の初回は計画系の処理を行う
+    isFootStepNodesListModified = false;
   }
 
   // 毎周期呼ばれる. 内部の補間器をdtだけ進める
@@ -226,24 +250,17 @@ public:
       defaultTranslatePos[i].interpolate(dt);
       isManualControlMode[i].interpolate(dt);
     }
+    planningCount++;
+    if(planningCount >= planningDecimation) planningCount = 0;
   }
 
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-  // for debug
-  mutable struct timeval prevTime;
-  void resetTime() const { gettimeofday(&prevTime, NULL);}
-  void printTime(const std::string& message="") const {
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-    std::cerr << message << (currentTime.tv_sec - prevTime.tv_sec) + (currentTime.tv_usec - prevTime.tv_usec) * 1e-6 << std::endl;
-  }
 };
 
 // for debug
 
-inline std::ostream &operator<<(std::ostream &os, const std::vector<GaitParam::FootStepNodes>& footstepNodesList) {
+inline std::ostream &operator<<(std::ostream &os, const GaitParam::FootStepNodesList& footstepNodesList) {
   for(int i=0;i<footstepNodesList.size();i++){
     os << "footstep" << i << std::endl;
     os << " RLEG: " << std::endl;
@@ -0,0 +1,81 @@
+#include "InPortMonitor.h"
+#include <algorithm>
+
+const std::array<double, InPortMonitor::NUM_BINS-1> InPortMonitor::BIN_EDGES{0.0015, 0.003, 0.006, 0.012, 0.025, 0.06, 0.12}; // 典型的な周期(1, 2, 5, 10, 20, 50, 100[ms])がbinの境界に来ないようにする
+
+void InPortMonitor::clear(){
+  this->ports_.clear();
+  this->isStarted_ = false;
+}
+
+int InPortMonitor::addPort(const std::string& name, double staleThreshold, Fallback_enum fallback){
+  Port port;
+  port.name = name;
+  port.staleThreshold = staleThreshold;
+  port.fallback = fallback;
+  this->ports_.push_back(port);
+  return this->ports_.size() - 1;
+}
+
+bool InPortMonitor::setStaleThreshold(const std::string& name, double staleThreshold){
+  bool found = false;
+  for(int i=0;i<this->ports_.size();i++){
+    if(name == "*" || this->ports_[i].name == name){
+      this->ports_[i].staleThreshold = staleThreshold;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void InPortMonitor::resetStatistics(){
+  for(int i=0;i<this->ports_.size();i++){
+    Port& port = this->ports_[i];
+    port.count = 0;
+    port.sumAge = 0.0;
+    port.maxAge = 0.0;
+    port.maxInterval = 0.0;
+    port.ageHistogram.fill(0);
+    port.intervalHistogram.fill(0);
+    port.staleCount = 0;
+  }
+}
+
+void InPortMonitor::arrive(int idx, double now, double stamp){
+  Port& port = this->ports_[idx];
+  double age = now - stamp;
+  port.age = age;
+  port.sumAge += age;
+  if(port.count == 0 || age > port.maxAge) port.maxAge = age;
+  port.ageHistogram[InPortMonitor::findBin(age)]++;
+  if(port.count > 0){
+    double interval = stamp - port.lastStamp;
+    if(interval > port.maxInterval) port.maxInterval = interval;
+    port.intervalHistogram[InPortMonitor::findBin(interval)]++;
+  }
+  port.lastArrival = now;
+  port.lastStamp = stamp;
+  port.count++;
+}
+
+void InPortMonitor::update(double now){
+  if(!this->isStarted_ || now < this->now_){ // 初回, または時刻が巻き戻った(replayのやり直し等)
+    this->isStarted_ = true;
+    this->startTime_ = now;
+    for(int i=0;i<this->ports_.size();i++) this->ports_[i].lastArrival = std::min(this->ports_[i].lastArrival, now);
+  }
+  this->now_ = now;
+  for(int i=0;i<this->ports_.size();i++){
+    Port& port = this->ports_[i];
+    double since = now - ((port.count > 0) ? std::max(port.lastArrival, this->startTime_) : this->startTime_);
+    bool isStale = port.staleThreshold > 0.0 && since > port.staleThreshold;
+    port.isNewlyStale = isStale && !port.isStale;
+    if(port.isNewlyStale) port.staleCount++;
+    port.isStale = isStale;
+  }
+}
+
+// static function
+int InPortMonitor::findBin(double value){
+  return std::upper_bound(InPortMonitor::BIN_EDGES.begin(), InPortMonitor::BIN_EDGES.end(), value) - InPortMonitor::BIN_EDGES.begin();
+}
@@ -0,0 +1,73 @@
+#ifndef AutoStabilizer_InPortMonitor_H
+#define AutoStabilizer_InPortMonitor_H
+
+#include <string>
+#include <vector>
+#include <array>
+
+/*
+  各InPortについて、dataが届いた時刻とdataの時刻を記録し、遅延とstale(一定時間届いていない)を判定する. センサ等のRTCからAutoStabilizerまでの経路の遅延の診断に使う
+  - 時刻は全てqRefの時刻(inPortData.tm)を基準とする. qRefが届かない間は時間が進まない
+  - age: dataが届いたときの、qRefの時刻 - dataの時刻(tm). 送り手がtmを設定していない(0のまま)場合は意味を持たない
+  - interval: dataの時刻の前回との差. 送り手の周期の揺らぎを見る
+  - staleThresholdより長く届いていないportはstaleとし、fallbackに従って扱う. staleThresholdが0以下なら判定しない
+  - 毎周期呼ばれるarrive, updateはメモリ確保を行わない
+*/
+class InPortMonitor {
+public:
+  enum Fallback_enum{
+    HOLD, // 最後に届いた値を使い続ける
+    CLEAR // 最後に届いた値を捨てる. 捨て方はport側で定める
+  };
+  static const int NUM_BINS = 8;
+  static const std::array<double, NUM_BINS-1> BIN_EDGES; // [s]. ヒストグラムのi番目のbinは[BIN_EDGES[i-1], BIN_EDGES[i]). 最初のbinは負の値を含み、最後のbinは上限が無い
+
+  class Port {
+  public:
+    std::string name;
+    double staleThreshold = 0.0; // [s]. 0以下ならstaleの判定をしない
+    Fallback_enum fallback = HOLD;
+
+    unsigned long long count = 0; // 届いた回数
+    double lastArrival = 0.0; // 最後に届いたときのqRefの時刻[s]
+    double lastStamp = 0.0; // 最後に届いたdataの時刻[s]
+    double age = 0.0; // [s]. 最後に届いたもの
+    double sumAge = 0.0; // [s]
+    double maxAge = 0.0; // [s]
+    double maxInterval = 0.0; // [s]
+    std::array<unsigned long long, NUM_BINS> ageHistogram{};
+    std::array<unsigned long long, NUM_BINS> intervalHistogram{};
+    bool isStale = false;
+    bool isNewlyStale = false; // 今周期のupdateでstaleになった
+    unsigned long long staleCount = 0; // staleになった回数
+  };
+
+  // port一覧を作り直す前に呼ぶ
+  void clear();
+  // 追加したportのindexを返す
+  int addPort(const std::string& name, double staleThreshold = 0.0, Fallback_enum fallback = HOLD);
+  // nameのportのstaleThresholdを変更する. nameが*なら全てのport. 該当するportが無ければfalse
+  bool setStaleThreshold(const std::string& name, double staleThreshold);
+  // 統計(count, age, interval, ヒストグラム, staleCount)を0に戻す
+  void resetStatistics();
+
+  // idx番目のportに今周期dataが届いたときに呼ぶ. now: qRefの時刻[s]. stamp: dataの時刻[s]
+  void arrive(int idx, double now, double stamp);
+  // 毎周期、arriveの後に呼ぶ. 各portのisStale, isNewlyStaleを更新する
+  void update(double now);
+
+  bool isStale(int idx) const { return this->ports_[idx].isStale; }
+  const std::vector<Port>& ports() const { return this->ports_; }
+  double now() const { return this->now_; } // 最後にupdateに与えられた時刻[s]
+  double startTime() const { return this->startTime_; } // 最初にupdateに与えられた時刻[s]. 一度も届いていないportは、この時刻から届いていないものとする
+
+protected:
+  static int findBin(double value);
+
+  std::vector<Port> ports_;
+  bool isStarted_ = false;
+  double startTime_ = 0.0;
+  double now_ = 0.0;
+};
+
+#endif
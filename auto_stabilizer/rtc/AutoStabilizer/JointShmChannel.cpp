@@ -0,0 +1,131 @@
+#include "JointShmChannel.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+const char JointShmChannel::MAGIC[8] = {'A','S','T','J','S','H','M','\0'};
+
+bool JointShmChannel::create(const std::string& fileName, int numJoints, int capacity){
+  this->close();
+  if(numJoints <= 0 || capacity < 2) return false;
+
+  size_t slotSize = (sizeof(Slot) + sizeof(double) * numJoints + 63) / 64 * 64; // slotごとに別のcache lineにする
+  size_t slotOffset = (sizeof(Header) + 63) / 64 * 64;
+  size_t mapSize = slotOffset + slotSize * capacity;
+
+  ::unlink(fileName.c_str()); // 古いファイルをopenしている相手側が、初期化途中の領域を読まないように作り直す
+  int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  if(fd < 0){
+    std::cerr << "[JointShmChannel] failed to create " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if(ftruncate(fd, mapSize) != 0){
+    std::cerr << "[JointShmChannel] failed to resize " << fileName << ": " << std::strerror(errno) << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd); // mmapした領域はfdを閉じても有効
+  if(map == MAP_FAILED){
+    std::cerr << "[JointShmChannel] failed to mmap " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  std::memset(map, 0, mapSize); // 全ページに一度書き込んでおく
+
+  this->map_ = map;
+  this->mapSize_ = mapSize;
+  this->header_ = static_cast<Header*>(map);
+  this->header_->version = VERSION;
+  this->header_->numJoints = numJoints;
+  this->header_->capacity = capacity;
+  this->header_->slotSize = slotSize;
+  this->header_->slotOffset = slotOffset;
+  __atomic_store_n(&this->header_->writeCount, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  std::memcpy(this->header_->magic, MAGIC, sizeof(MAGIC)); // magicは最後に書く
+  this->readCount_ = 0;
+  this->skipped_ = 0;
+  return true;
+}
+
+bool JointShmChannel::open(const std::string& fileName){
+  this->close();
+
+  int fd = ::open(fileName.c_str(), O_RDWR);
+  if(fd < 0){
+    std::cerr << "[JointShmChannel] failed to open " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)){
+    std::cerr << "[JointShmChannel] " << fileName << " is not initialized" << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if(map == MAP_FAILED){
+    std::cerr << "[JointShmChannel] failed to mmap " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  Header* header = static_cast<Header*>(map);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION ||
+     header->slotOffset + (uint64_t)header->slotSize * header->capacity > (uint64_t)st.st_size){
+    std::cerr << "[JointShmChannel] " << fileName << " is not a valid channel" << std::endl;
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  this->map_ = map;
+  this->mapSize_ = st.st_size;
+  this->header_ = header;
+  this->readCount_ = __atomic_load_n(&this->header_->writeCount, __ATOMIC_ACQUIRE); // open以前に書き込まれたものは読まない
+  this->skipped_ = 0;
+  return true;
+}
+
+void JointShmChannel::close(){
+  if(this->map_ != nullptr) munmap(this->map_, this->mapSize_);
+  this->map_ = nullptr;
+  this->mapSize_ = 0;
+  this->header_ = nullptr;
+}
+
+void JointShmChannel::write(int64_t sec, int64_t nsec, const double* data){
+  if(!this->isOpened()) return;
+  uint64_t count = __atomic_load_n(&this->header_->writeCount, __ATOMIC_RELAXED); // 書き込み側しか書かない
+  Slot* s = this->slot(count);
+  __atomic_store_n(&s->seq, 2 * count + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // seqが奇数になってからdataを書き換える
+  s->sec = sec;
+  s->nsec = nsec;
+  std::memcpy(s->data(), data, sizeof(double) * this->header_->numJoints);
+  __atomic_store_n(&s->seq, 2 * count + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&this->header_->writeCount, count + 1, __ATOMIC_RELEASE);
+}
+
+bool JointShmChannel::read(int64_t& o_sec, int64_t& o_nsec, double* o_data){
+  if(!this->isOpened()) return false;
+  while(true){
+    uint64_t count = __atomic_load_n(&this->header_->writeCount, __ATOMIC_ACQUIRE);
+    if(count == this->readCount_) return false;
+    Slot* s = this->slot(count - 1);
+    uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if(seq != 2 * (count - 1) + 2) continue; // 既に次の書き込みが始まっている. より新しいslotを読み直す
+    int64_t sec = s->sec;
+    int64_t nsec = s->nsec;
+    std::memcpy(o_data, s->data(), sizeof(double) * this->header_->numJoints);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // dataを読み終えてからseqを読み直す
+    if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq) continue; // 読み込み中に上書きされた
+    o_sec = sec;
+    o_nsec = nsec;
+    this->skipped_ += count - this->readCount_ - 1;
+    this->readCount_ = count;
+    return true;
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef AutoStabilizer_JointShmChannel_H
+#define AutoStabilizer_JointShmChannel_H
+
+#include <string>
+#include <cstdint>
+
+/*
+  同じホスト上のプロセス間で、関節数ぶんのdouble配列(関節角度, トルク等)を毎周期受け渡すための共有メモリ. qRef, qAct等のportのCORBAのmarshallingを省くために使う.
+  - 書き込み側1つ、読み込み側1つ(single-producer/single-consumer). mmapしたファイル(/dev/shm/以下を想定)上の、関節数で決まる固定長のslotのリングバッファ
+  - writeもreadもロックを取らず、システムコールもメモリ確保も行わない. 書き込み側は読み込み側を待たずに古いslotを上書きする
+  - readは最新のslotのみを読む. 読み込み側が読む前に上書きされたslotの数はskipped()で分かる. 各slotは書き込み中か、いつ書き込まれたかの番号(seqlock)を持ち、読み込み中に上書きされた場合は読み直す
+  - createした側がファイルを作り直すので、相手側はcreateの後にopenし直すこと
+  - OpenRTMやchoreonoidに依存しないので、RobotHardware等の相手側のプロセスでもこのクラスをそのまま使える
+*/
+class JointShmChannel{
+public:
+  JointShmChannel() {}
+  ~JointShmChannel() { this->close(); }
+  JointShmChannel(const JointShmChannel&) = delete;
+  JointShmChannel& operator=(const JointShmChannel&) = delete;
+
+  // fileNameを作り直して初期化する. capacityはslotの数. 2以上
+  bool create(const std::string& fileName, int numJoints, int capacity = 4);
+  // createされたfileNameを開く
+  bool open(const std::string& fileName);
+  void close();
+  bool isOpened() const { return this->header_ != nullptr; }
+  int numJoints() const { return this->header_ ? this->header_->numJoints : 0; }
+
+  // dataの要素数はnumJoints()
+  void write(int64_t sec, int64_t nsec, const double* data);
+  // 前回のread以降に書き込まれたslotがあれば、最新のものをo_dataにコピーしてtrueを返す. o_dataの要素数はnumJoints()
+  bool read(int64_t& o_sec, int64_t& o_nsec, double* o_data);
+  uint64_t skipped() const { return this->skipped_; }
+
+protected:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t numJoints;
+    uint32_t capacity;
+    uint32_t slotSize; // [byte]. 64の倍数
+    uint64_t slotOffset; // [byte]. ファイル先頭からslot[0]まで
+    alignas(64) uint64_t writeCount; // 書き込みが完了したslotの数. 書き込み側のみが書く
+  };
+  struct Slot {
+    uint64_t seq; // i番目の書き込み中は2i+1, 完了後は2i+2
+    int64_t sec;
+    int64_t nsec;
+    double* data() { return reinterpret_cast<double*>(this + 1); }
+  };
+  static const char MAGIC[8];
+  static const uint32_t VERSION = 1;
+
+  Slot* slot(uint64_t count) { return reinterpret_cast<Slot*>(static_cast<char*>(this->map_) + this->header_->slotOffset + this->header_->slotSize * (count % this->header_->capacity)); }
+
+  void* map_ = nullptr;
+  size_t mapSize_ = 0;
+  Header* header_ = nullptr;
+  uint64_t readCount_ = 0; // 前回readしたときのwriteCount
+  uint64_t skipped_ = 0;
+};
+
+#endif
@@ -4,15 +4,14 @@
 #define DEBUG true
 
 void LegCoordsGenerator::initLegCoords(const GaitParam& gaitParam,
-                                       std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> >& o_refZmpTraj, std::vector<cpp_filters::TwoPointInterpolatorSE3>& o_genCoords) const{
+                                       std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> >& o_refZmpTraj, std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS>& o_genCoords) const{
   std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> > refZmpTraj;
-  std::vector<cpp_filters::TwoPointInterpolatorSE3> genCoords;
 
   cnoid::Position rlegCoords = gaitParam.footstepNodesList[0].dstCoords[RLEG];
   cnoid::Position llegCoords = gaitParam.footstepNodesList[0].dstCoords[LLEG];
 
-  genCoords.emplace_back(rlegCoords, cnoid::Vector6::Zero(), cnoid::Vector6::Zero(), cpp_filters::HOFFARBIB);
-  genCoords.emplace_back(llegCoords, cnoid::Vector6::Zero(), cnoid::Vector6::Zero(), cpp_filters::HOFFARBIB);
+  std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS> genCoords = {{cpp_filters::TwoPointInterpolatorSE3(rlegCoords, cnoid::Vector6::Zero(), cnoid::Vector6::Zero(), cpp_filters::HOFFARBIB),
+                                                                          cpp_filters::TwoPointInterpolatorSE3(llegCoords, cnoid::Vector6::Zero(), cnoid::Vector6::Zero(), cpp_filters::HOFFARBIB)}};
   cnoid::Vector3 zmp;
   if(gaitParam.footstepNodesList[0].isSupportPhase[RLEG] && gaitParam.footstepNodesList[0].isSupportPhase[LLEG]){
     zmp = 0.5 * (rlegCoords.translation() + rlegCoords.linear()*gaitParam.copOffset[RLEG].value()) + 0.5 * (llegCoords.translation() + llegCoords.linear()*gaitParam.copOffset[LLEG].value());
@@ -27,8 +26,8 @@ void LegCoordsGenerator::initLegCoords(const GaitParam& gaitParam,
   o_genCoords = genCoords;
 }
 
-void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bool useActStates,
-                                       std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> >& o_refZmpTraj, std::vector<cpp_filters::TwoPointInterpolatorSE3>& o_genCoords, std::vector<GaitParam::SwingState_enum>& o_swingState) const{
+void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bool useActStates, bool isPlanningCycle,
+                                       std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> >& o_refZmpTraj, footguidedcontroller::FootGuidedPreview<cnoid::Vector3>& o_refZmpTrajPreview, std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS>& o_genCoords, std::array<GaitParam::SwingState_enum, NUM_LEGS>& o_swingState) const{
   // swing期は、remainTime - supportTime - delayTimeOffset後にdstCoordsに到達するようなantececdent軌道を生成し(genCoords.getGoal()の値)、その軌道にdelayTimeOffset遅れで滑らかに追従するような軌道(genCoords.value()の値)を生成する.
   //   rectangle以外の軌道タイプや跳躍についてはひとまず考えない TODO
   //   srcCoordsとdstCoordsを結ぶ軌道を生成する. srcCoordsの高さ+[0]とdstCoordsの高さ+[1]の高い方(heightとおく)に上げるようなrectangle軌道を生成する
@@ -36,7 +35,8 @@ void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bo
 
   // refZmpTrajを更新し進める
   std::vector<footguidedcontroller::LinearTrajectory<cnoid::Vector3> > refZmpTraj = gaitParam.refZmpTraj;
-  {
+  // footstepNodesListから作り直すのはisPlanningCycleの周期と、footstepNodesListのnodeが切り替わった周期(early touch downを含む. 切り替わるとelapsedTimeが0になる)と、goPos等やemergency stepでfootstepNodesListが変更された周期(isFootStepNodesListModified)のみ. それ以外の周期は前回のrefZmpTrajをdtだけ進めたものを使う. 作り直しても、refZmpTraj[0]の始点は変わらないので連続である
+  if(isPlanningCycle || gaitParam.elapsedTime == 0.0 || gaitParam.isFootStepNodesListModified){
     cnoid::Vector3 refZmp = refZmpTraj[0].getStart(); // for文中の現在のrefzmp
     refZmpTraj.clear();
     // footstepNodesListのサイズが1, footstepNodesList[0].remainTimeが0のときに、copOffsetのパラメータが滑らかに変更になる場合がある. それに対応できるように
@@ -73,7 +73,8 @@ void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bo
     if(totalTime < this->footGuidedBalanceTime){
       refZmpTraj.push_back(footguidedcontroller::LinearTrajectory<cnoid::Vector3>(refZmp,refZmp, std::max(this->footGuidedBalanceTime - totalTime, dt)));
     }
-
+  }
+  {
     // dtだけ進める
     if(refZmpTraj[0].getTime() <= dt){
       if(refZmpTraj.size() > 1) refZmpTraj.erase(refZmpTraj.begin());
@@ -84,8 +85,8 @@ void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bo
   }
 
   // genCoordsを進める
-  std::vector<cpp_filters::TwoPointInterpolatorSE3> genCoords = gaitParam.genCoords;
-  std::vector<GaitParam::SwingState_enum> swingState = gaitParam.swingState;
+  std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS> genCoords = gaitParam.genCoords;
+  std::array<GaitParam::SwingState_enum, NUM_LEGS> swingState = gaitParam.swingState;
   for(int i=0;i<NUM_LEGS;i++){
     if(gaitParam.footstepNodesList[0].stopCurrentPosition[i]){ // for early touch down. 今の位置に止める
       genCoords[i].reset(genCoords[i].value());
@@ -180,6 +181,7 @@ void LegCoordsGenerator::calcLegCoords(const GaitParam& gaitParam, double dt, bo
   }
 
   o_refZmpTraj = refZmpTraj;
+  o_refZmpTrajPreview = footguidedcontroller::calcFootGuidedPreview(gaitParam.omega,gaitParam.l,refZmpTraj); // calcCOMCoordsとStabilizerで共有する
   o_genCoords = genCoords;
   o_swingState = swingState;
 }
@@ -188,7 +190,7 @@ void LegCoordsGenerator::calcCOMCoords(const GaitParam& gaitParam, double dt, cn
   cnoid::Vector3 genZmp;
   if(gaitParam.footstepNodesList[0].isSupportPhase[RLEG] || gaitParam.footstepNodesList[0].isSupportPhase[LLEG]){
     cnoid::Vector3 genDCM = gaitParam.genCog + gaitParam.genCogVel / gaitParam.omega;
-    genZmp = footguidedcontroller::calcFootGuidedControl(gaitParam.omega,gaitParam.l,genDCM,gaitParam.refZmpTraj);
+    genZmp = gaitParam.refZmpTrajPreview.calcFootGuidedControl(genDCM); // = footguidedcontroller::calcFootGuidedControl(gaitParam.omega,gaitParam.l,genDCM,gaitParam.refZmpTraj)
     if(genZmp[2] >= gaitParam.genCog[2]) genZmp = gaitParam.genCog; // 下向きの力は受けられないので
     else{
       cnoid::Vector3 genZmpOrg = genZmp;
@@ -2,7 +2,7 @@
 #include "MathUtil.h"
 
 bool LegManualController::legManualControl(const GaitParam& gaitParam, double dt,
-                                           std::vector<cpp_filters::TwoPointInterpolatorSE3>& o_genCoords, std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_isManualControlMode) const{
+                                           std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS>& o_genCoords, GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cpp_filters::TwoPointInterpolator<double>, NUM_LEGS>& o_isManualControlMode) const{
   for(int i=0;i<NUM_LEGS;i++){
     if(!gaitParam.isStatic() || gaitParam.footstepNodesList[0].isSupportPhase[i]){ // 静止状態で無い場合や、支持脚の場合は、勝手にManualControlはオフになる
       if(o_isManualControlMode[i].getGoal() != 0.0) o_isManualControlMode[i].setGoal(0.0, 2.0); // 2.0[s]で遷移
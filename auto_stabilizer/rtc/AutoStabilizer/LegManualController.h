@@ -9,7 +9,7 @@ public:
 
 public:
   bool legManualControl(const GaitParam& gaitParam, double dt,
-                        std::vector<cpp_filters::TwoPointInterpolatorSE3>& o_genCoords, std::vector<GaitParam::FootStepNodes>& o_footstepNodesList, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_isManualControlMode) const;
+                        std::array<cpp_filters::TwoPointInterpolatorSE3, NUM_LEGS>& o_genCoords, GaitParam::FootStepNodesList& o_footstepNodesList, std::array<cpp_filters::TwoPointInterpolator<double>, NUM_LEGS>& o_isManualControlMode) const;
 };
 
 #endif
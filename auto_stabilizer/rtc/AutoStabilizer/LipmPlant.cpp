@@ -0,0 +1,182 @@
+#include "LipmPlant.h"
+#include "MathUtil.h"
+#include <cnoid/ForceSensor>
+#include <cnoid/RateGyroSensor>
+#include <cnoid/EigenUtil>
+#include <cmath>
+
+namespace {
+  RTC::Time toTime(double time){
+    RTC::Time tm;
+    tm.sec = std::floor(time);
+    tm.nsec = std::round((time - tm.sec) * 1e9);
+    if(tm.nsec >= 1000000000) { tm.sec += 1; tm.nsec -= 1000000000; }
+    return tm;
+  }
+}
+
+bool LipmPlant::init(const OfflineAutoStabilizer& ast){
+  const GaitParam& gaitParam = ast.gaitParam();
+  cnoid::DeviceList<cnoid::ForceSensor> forceSensors(gaitParam.actRobotRaw->devices());
+  this->eeForceSensorIdx_.resize(gaitParam.eeName.size(), -1);
+  for(int i=0;i<gaitParam.eeName.size();i++){
+    for(int j=0;j<forceSensors.size();j++){
+      if(forceSensors[j]->name() == ast.eeForceSensor()[i]) this->eeForceSensorIdx_[i] = j;
+    }
+  }
+  if(this->eeForceSensorIdx_[RLEG] < 0 || this->eeForceSensorIdx_[LLEG] < 0){
+    std::cerr << "[LipmPlant] force sensors of legs are not found" << std::endl;
+    return false;
+  }
+  if(!gaitParam.actRobotRaw->findDevice<cnoid::RateGyroSensor>("gyrometer")){
+    std::cerr << "[LipmPlant] gyrometer is not found" << std::endl;
+    return false;
+  }
+  this->actWrench_.resize(forceSensors.size());
+  this->reset();
+  return true;
+}
+
+void LipmPlant::reset(){
+  this->time_ = 0.0;
+  this->isFallen_ = false;
+  this->fallTime_ = 0.0;
+  this->qPrev_.clear();
+  this->qAct_.data.length(0);
+  this->dqAct_.data.length(0);
+  for(int i=0;i<this->actWrench_.size();i++) this->actWrench_[i].data.length(0);
+}
+
+void LipmPlant::update(const OfflineAutoStabilizer& ast){
+  const GaitParam& gaitParam = ast.gaitParam();
+  double dt = ast.dt();
+  this->time_ += dt;
+
+  // 傾きを除いてactualと一致しているロボット. ABC起動中はgenerate frame, ABC停止中はreference frame
+  cnoid::BodyPtr robot = ast.isABCRunning() ? gaitParam.genRobot : gaitParam.refRobotRaw;
+  double mass = robot->mass();
+
+  // 接地している足の支持領域
+  std::array<bool, NUM_LEGS> isContact = ast.isABCRunning() ? gaitParam.footstepNodesList[0].isSupportPhase : std::array<bool, NUM_LEGS>{{true, true}};
+  std::array<cnoid::Position, NUM_LEGS> legPose;
+  std::vector<cnoid::Vector3> vertices;
+  double groundHeight = 0.0;
+  int contactNum = 0;
+  for(int i=0;i<NUM_LEGS;i++){
+    legPose[i] = ast.isABCRunning() ? gaitParam.genCoords[i].value() : cnoid::Position(robot->link(gaitParam.eeParentLink[i])->T() * gaitParam.eeLocalT[i]);
+    if(!isContact[i]) continue;
+    for(int j=0;j<gaitParam.legHull[i].size();j++) vertices.push_back(legPose[i] * gaitParam.legHull[i][j]);
+    groundHeight += legPose[i].translation()[2];
+    contactNum++;
+  }
+  if(contactNum > 0) groundHeight /= contactNum;
+  std::vector<cnoid::Vector3> hull = mathutil::calcConvexHull(vertices);
+
+  cnoid::Vector3 pushForce = cnoid::Vector3::Zero();
+  for(int i=0;i<this->pushes.size();i++){
+    if(this->pushes[i].startTime <= this->time_ && this->time_ < this->pushes[i].startTime + this->pushes[i].duration) pushForce.head<2>() += this->pushes[i].force.head<2>();
+  }
+
+  // 重心の運動
+  cnoid::Vector3 kinematicCog = robot->centerOfMass();
+  cnoid::Vector3 cogAcc = cnoid::Vector3::Zero();
+  bool isActive = ast.isABCRunning() && !ast.isSyncToABC();
+  if(!isActive){
+    this->cog_ = kinematicCog;
+    this->cogVel_ = ast.isABCRunning() ? gaitParam.genCogVel : cnoid::Vector3::Zero();
+    this->zmp_ = mathutil::calcNearestPointOfHull(ast.isABCRunning() ? gaitParam.stTargetZmp : kinematicCog, hull);
+    this->zmp_[2] = groundHeight;
+  }else{
+    if(contactNum > 0){
+      this->zmp_ = mathutil::calcNearestPointOfHull(gaitParam.stTargetZmp, hull);
+      this->zmp_[2] = groundHeight;
+      double height = std::max(this->cog_[2] - this->zmp_[2], 0.1);
+      cogAcc.head<2>() = gaitParam.g / height * (this->cog_ - this->zmp_).head<2>();
+    }
+    cogAcc.head<2>() += pushForce.head<2>() / mass;
+    this->cogVel_ += cogAcc * dt;
+    this->cog_ += this->cogVel_ * dt;
+    this->cog_[2] = kinematicCog[2];
+    this->cogVel_[2] = 0.0;
+
+    if(!this->isFallen_ && contactNum > 0){
+      cnoid::Vector3 nearest = mathutil::calcNearestPointOfHull(this->cog_, hull);
+      if((this->cog_ - nearest).head<2>().norm() > this->fallDistance){
+        this->isFallen_ = true;
+        this->fallTime_ = this->time_;
+      }
+    }
+  }
+
+  // 重心のずれを、ZMPまわりのロボット全体の傾きとする
+  cnoid::Matrix3 tiltR = cnoid::Matrix3::Identity();
+  if(isActive){
+    tiltR = Eigen::Quaterniond::FromTwoVectors(kinematicCog - this->zmp_, this->cog_ - this->zmp_).toRotationMatrix();
+  }
+
+  RTC::Time tm = toTime(this->time_);
+
+  // qAct, dqAct. 関節は指令値に完全に追従する
+  const std::vector<double>& q = ast.q();
+  this->qAct_.tm = tm;
+  this->qAct_.data.length(q.size());
+  this->dqAct_.tm = tm;
+  this->dqAct_.data.length(q.size());
+  for(int i=0;i<q.size();i++){
+    this->qAct_.data[i] = q[i];
+    this->dqAct_.data[i] = (this->qPrev_.size() == q.size()) ? (q[i] - this->qPrev_[i]) / dt : 0.0;
+  }
+  this->qPrev_ = q;
+
+  // actImu
+  cnoid::RateGyroSensorPtr imu = robot->findDevice<cnoid::RateGyroSensor>("gyrometer");
+  cnoid::Vector3 rpy = cnoid::rpyFromRot(tiltR * imu->link()->R() * imu->R_local());
+  this->actImu_.tm = tm;
+  this->actImu_.data.r = rpy[0];
+  this->actImu_.data.p = rpy[1];
+  this->actImu_.data.y = rpy[2];
+
+  // 床反力. 合力はZMPに作用し、接地している脚の間でZMPの位置に応じて分配する
+  cnoid::Vector3 totalForce = mass * (cogAcc + cnoid::Vector3(0.0, 0.0, gaitParam.g)) - pushForce; // ロボットが受ける力
+  std::array<double, NUM_LEGS> ratio = {{0.0, 0.0}};
+  if(isContact[RLEG] && isContact[LLEG]){
+    cnoid::Vector3 rToL = legPose[LLEG].translation() - legPose[RLEG].translation();
+    double alpha = (rToL.head<2>().squaredNorm() > 1e-6) ? mathutil::clamp((this->zmp_ - legPose[RLEG].translation()).head<2>().dot(rToL.head<2>()) / rToL.head<2>().squaredNorm(), 0.0, 1.0) : 0.5;
+    ratio[RLEG] = 1.0 - alpha;
+    ratio[LLEG] = alpha;
+  }else if(isContact[RLEG]){
+    ratio[RLEG] = 1.0;
+  }else if(isContact[LLEG]){
+    ratio[LLEG] = 1.0;
+  }
+  for(int i=0;i<this->actWrench_.size();i++){
+    this->actWrench_[i].tm = tm;
+    this->actWrench_[i].data.length(6);
+    for(int j=0;j<6;j++) this->actWrench_[i].data[j] = 0.0;
+  }
+  cnoid::DeviceList<cnoid::ForceSensor> forceSensors(robot->devices());
+  for(int i=0;i<NUM_LEGS;i++){
+    if(ratio[i] == 0.0) continue;
+    cnoid::ForceSensorPtr sensor = forceSensors[this->eeForceSensorIdx_[i]];
+    cnoid::Position senPose = sensor->link()->T() * sensor->T_local();
+    cnoid::Vector3 senPos = this->zmp_ + tiltR * (senPose.translation() - this->zmp_);
+    cnoid::Matrix3 senR = tiltR * senPose.linear();
+    cnoid::Vector3 force = ratio[i] * totalForce;
+    cnoid::Vector3 moment = (this->zmp_ - senPos).cross(force);
+    cnoid::Vector3 localForce = senR.transpose() * force;
+    cnoid::Vector3 localMoment = senR.transpose() * moment;
+    for(int j=0;j<3;j++){
+      this->actWrench_[this->eeForceSensorIdx_[i]].data[j] = localForce[j];
+      this->actWrench_[this->eeForceSensorIdx_[i]].data[3+j] = localMoment[j];
+    }
+  }
+}
+
+void LipmPlant::setInPortData(OfflineAutoStabilizer::InPortData& o_inPortData) const{
+  // 一度もupdateしていなければ、何も届かなかったものとする
+  bool isUpdated = this->qAct_.data.length() > 0;
+  o_inPortData.qAct = isUpdated ? &this->qAct_ : nullptr;
+  o_inPortData.dqAct = isUpdated ? &this->dqAct_ : nullptr;
+  o_inPortData.actImu = isUpdated ? &this->actImu_ : nullptr;
+  for(int i=0;i<o_inPortData.actWrench.size() && i<this->actWrench_.size();i++) o_inPortData.actWrench[i] = isUpdated ? &this->actWrench_[i] : nullptr;
+}
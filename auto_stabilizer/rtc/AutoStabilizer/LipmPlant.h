@@ -0,0 +1,62 @@
+#ifndef AutoStabilizer_LipmPlant_H
+#define AutoStabilizer_LipmPlant_H
+
+#include <vector>
+#include <cnoid/EigenTypes>
+#include "OfflineAutoStabilizer.h"
+
+/*
+  AutoStabilizerの閉ループの動作確認用に、ロボットを線形倒立振子(LIPM)で近似した軽量なシミュレータ. Choreonoidを使うよりも十分速く、押し動作からの回復試験を多数回行うために使う
+  - 関節は指令値(OfflineAutoStabilizer::q())に完全に追従し、接地している足は滑らないとする. 重心の水平方向の運動のみを
+      c'' = omega^2 (c - p) + f / m (c: 重心, p: ZMP, f: 外乱)
+    で計算し、genRobotの重心との差を、ZMPまわりのロボット全体の傾きとしてIMUの値に反映する. この傾きによる遊脚の位置のずれは無視する
+  - ZMPはstTargetZmp(Stabilizerの目標ZMP. ST停止中はrefZmp)を、接地している足の支持領域内に制限したものとする. トルク制御で目標ZMPが実現されることを仮定している
+  - 接地状態はfootstepNodesList[0].isSupportPhaseに従う. 床反力は、ZMPに作用する合力を接地している脚の間でZMPの位置に応じて分配し、各脚の力センサの値とする
+  - ABCが起動してからMODE_SYNC_TO_ABCが終わるまでと、ABCの停止中は、重心はgenRobot(ABC停止中はrefRobotRaw)に一致したまま動かない
+  - 出力はqAct, dqAct, actImu, act<ForceSensor名>のInPortに届くdataと同じ形式なので、setInPortDataでOfflineAutoStabilizerに与えると、実機と同じ経路でactual値として使われる
+*/
+class LipmPlant {
+public:
+  class Push {
+  public:
+    double startTime = 0.0; // [s]. reset()からの経過時間
+    double duration = 0.1; // [s]
+    cnoid::Vector3 force = cnoid::Vector3::Zero(); // [N]. generate frame. 重心に加わる外力. Z成分は無視する
+  };
+  std::vector<Push> pushes;
+  double fallDistance = 0.2; // [m]. 重心の水平位置が、接地している足の支持領域からこれ以上離れたら転倒とみなす
+
+  bool init(const OfflineAutoStabilizer& ast);
+  void reset(); // 時刻と転倒状態を初期化する. pushesは変更しない
+  // OfflineAutoStabilizer::execute()の後に毎周期呼ぶ. dtだけ時間を進め、次の周期にOfflineAutoStabilizerに与えるactual値を計算する
+  void update(const OfflineAutoStabilizer& ast);
+  void setInPortData(OfflineAutoStabilizer::InPortData& o_inPortData) const;
+
+  double time() const { return this->time_; }
+  bool isFallen() const { return this->isFallen_; }
+  double fallTime() const { return this->fallTime_; } // 転倒したと判定された時刻
+  const cnoid::Vector3& cog() const { return this->cog_; } // generate frame
+  const cnoid::Vector3& cogVel() const { return this->cogVel_; } // generate frame
+  const cnoid::Vector3& zmp() const { return this->zmp_; } // generate frame
+
+protected:
+  double time_ = 0.0;
+  bool isFallen_ = false;
+  double fallTime_ = 0.0;
+  cnoid::Vector3 cog_ = cnoid::Vector3::Zero();
+  cnoid::Vector3 cogVel_ = cnoid::Vector3::Zero();
+  cnoid::Vector3 zmp_ = cnoid::Vector3::Zero();
+
+  std::vector<int> eeForceSensorIdx_; // 要素数と順序はeeNameと同じ. DeviceList<ForceSensor>の中のindex. 対応するForceSensorが無ければ-1
+  std::vector<double> qPrev_;
+
+  RTC::TimedDoubleSeq qAct_;
+  RTC::TimedDoubleSeq dqAct_;
+  RTC::TimedOrientation3D actImu_;
+  std::vector<RTC::TimedDoubleSeq> actWrench_; // 要素数と順序はrobot->forceSensorsと同じ
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
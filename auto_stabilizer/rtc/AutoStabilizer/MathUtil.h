@@ -2,6 +2,8 @@
 #define AutoStabilizer_MathUtil_H
 
 #include <Eigen/Eigen>
+#include <cstdint>
+#include <cstring>
 
 namespace mathutil {
   // axisとlocalaxisはノルムが1, mは回転行列でなければならない.
@@ -36,6 +38,18 @@ namespace mathutil {
     return value.array().max(llimit_value.array()).min(ulimit_value.array());
   }
 
+  // data[0] ~ data[size-1]が全て有限か. 指数部のビットのみを見て要素ごとに分岐しないので、ループがベクトル化される
+  inline bool isAllFinite(const double* data, int size) {
+    const uint64_t expMask = 0x7FF0000000000000ULL; // 指数部が全て1ならinfかnan
+    uint64_t nonFinite = 0;
+    for(int i=0;i<size;i++){
+      uint64_t bits;
+      std::memcpy(&bits, &data[i], sizeof(double));
+      nonFinite |= ((bits & expMask) == expMask);
+    }
+    return nonFinite == 0;
+  }
+
   Eigen::Matrix3d cross(const Eigen::Vector3d& m);
 
   // Z成分は無視する
@@ -0,0 +1,58 @@
+#include "OfflineAutoStabilizer.h"
+#include <fstream>
+
+// static function
+bool OfflineAutoStabilizer::readConfFile(const std::string& fileName, std::map<std::string, std::string>& o_properties){
+  std::ifstream ifs(fileName.c_str());
+  if(!ifs) return false;
+  std::string line, buf;
+  while(std::getline(ifs, buf)){
+    if(!buf.empty() && buf.back() == '\\'){ // 行末の\は次の行に続く
+      line += buf.substr(0, buf.size()-1);
+      continue;
+    }
+    line += buf;
+    size_t comment = line.find('#');
+    if(comment != std::string::npos) line.erase(comment);
+    size_t colon = line.find(':');
+    if(colon != std::string::npos){
+      std::string key = line.substr(0, colon), value = line.substr(colon+1);
+      key.erase(0, key.find_first_not_of(" \t")); key.erase(key.find_last_not_of(" \t\r")+1);
+      value.erase(0, value.find_first_not_of(" \t")); value.erase(value.find_last_not_of(" \t\r")+1);
+      if(!key.empty()) o_properties[key] = value;
+    }
+    line.clear();
+  }
+  return true;
+}
+
+bool OfflineAutoStabilizer::init(const std::function<bool(const std::string&, std::string&)>& getProperty, const std::string& instanceName){
+  // dtとexec_cxt.periodic.rateはAutoStabilizerではmanagerが必ず与えるので、無い場合は0とする
+  std::function<bool(const std::string&, std::string&)> getPropertyWithDefault = [&getProperty](const std::string& key, std::string& ret){
+    if(getProperty(key, ret)) return true;
+    if(key == "dt" || key == "exec_cxt.periodic.rate") ret = "0.0";
+    return false;
+  };
+  if(!AutoStabilizer::initGaitParam(getPropertyWithDefault, instanceName, this->dt_, this->gaitParam_)) return false;
+  AutoStabilizer::initControllers(this->gaitParam_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_, this->fullbodyIKSolver_);
+
+  this->inPortData_.init(this->gaitParam_);
+  this->q_.resize(this->gaitParam_.genRobot->numJoints(), 0.0);
+  this->genTau_.resize(this->gaitParam_.genRobot->numJoints(), 0.0);
+  return true;
+}
+
+bool OfflineAutoStabilizer::execute(){
+  if(!AutoStabilizer::applyInPortData(this->dt_, this->gaitParam_, this->mode_, this->inPortData_, this->gaitParam_.refRobotRaw, this->gaitParam_.actRobotRaw, this->gaitParam_.refEEWrenchOrigin, this->gaitParam_.refEEPoseRaw, this->gaitParam_.selfCollision, this->gaitParam_.steppableRegion, this->gaitParam_.steppableHeight, this->gaitParam_.relLandingHeight, this->gaitParam_.relLandingNormal, this->gaitParam_.actDelay)) return false;
+
+  AutoStabilizer::updateControllers(this->mode_, this->gaitParam_, this->dt_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->externalForceHandler_, this->footStepGenerator_, this->impedanceController_, this->fullbodyIKSolver_);
+
+  if(this->mode_.isABCRunning()) {
+    AutoStabilizer::execAutoStabilizer(this->mode_, this->gaitParam_, this->dt_, this->footStepGenerator_, this->legCoordsGenerator_, this->refToGenFrameConverter_, this->actToGenFrameConverter_, this->impedanceController_, this->stabilizer_,this->externalForceHandler_, this->fullbodyIKSolver_, this->legManualController_, this->cmdVelGenerator_);
+  }
+
+  AutoStabilizer::updateIdleToAbcTransition(this->mode_, this->dt_, this->idleToAbcTransitionInterpolator_);
+  for(int i=0;i<this->q_.size();i++) this->q_[i] = AutoStabilizer::calcOutputJointAngle(this->mode_, this->idleToAbcTransitionInterpolator_, this->gaitParam_, i);
+  for(int i=0;i<this->genTau_.size();i++) this->genTau_[i] = AutoStabilizer::calcOutputJointTorque(this->mode_, this->idleToAbcTransitionInterpolator_, this->gaitParam_, i);
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef AutoStabilizer_OfflineAutoStabilizer_H
+#define AutoStabilizer_OfflineAutoStabilizer_H
+
+#include <functional>
+#include <map>
+#include "AutoStabilizer.h"
+
+/*
+  AutoStabilizerのonExecuteのうち、portの読み書き以外の部分をOpenRTMを介さずに実行する. ログの再生(AutoStabilizerReplay)やシミュレーション(AutoStabilizerPushTest)で使う
+  - 1インスタンスが1台のロボットに対応し、AutoStabilizerと同じGaitParamと制御用のクラスを持つ
+  - inPortData()にその周期に届いたdataを入れてからexecute()を呼ぶと、AutoStabilizerの1周期と同じ処理を行い、q(), genTau()が更新される
+  - startAutoBalancer等はAutoStabilizerと異なり遷移の完了を待たない. 次のexecute()から遷移が始まる
+  - service callによるparameterの変更や歩行指令は、gaitParam()等を直接書き換えて行う
+*/
+class OfflineAutoStabilizer {
+public:
+  typedef AutoStabilizer::InPortData InPortData;
+
+  // "key: value"形式のconf file(AutoStabilizerに与えるものと同じ)を読む
+  static bool readConfFile(const std::string& fileName, std::map<std::string, std::string>& o_properties);
+
+  // getPropertyはAutoStabilizerのconf fileの"model", "end_effectors", "dt"等を返す
+  bool init(const std::function<bool(const std::string&, std::string&)>& getProperty, const std::string& instanceName);
+
+  InPortData& inPortData() { return this->inPortData_; }
+  // qRefが届いていないか不正なら何もせずにfalseを返す
+  bool execute();
+  const std::vector<double>& q() const { return this->q_; } // 要素数と順序はgenRobot->numJoints()と同じ
+  const std::vector<double>& genTau() const { return this->genTau_; } // 要素数と順序はgenRobot->numJoints()と同じ
+
+  bool startAutoBalancer() { return this->mode_.setNextTransition(AutoStabilizer::ControlMode::START_ABC); }
+  bool stopAutoBalancer() { return this->mode_.setNextTransition(AutoStabilizer::ControlMode::STOP_ABC); }
+  bool startStabilizer() { return this->mode_.setNextTransition(AutoStabilizer::ControlMode::START_ST); }
+  bool stopStabilizer() { return this->mode_.setNextTransition(AutoStabilizer::ControlMode::STOP_ST); }
+  bool isABCRunning() const { return this->mode_.isABCRunning(); }
+  bool isSTRunning() const { return this->mode_.isSTRunning(); }
+  bool isSyncToABC() const { return this->mode_.isSyncToABC(); }
+  int mode() const { return this->mode_.now(); }
+
+  double dt() const { return this->dt_; }
+  GaitParam& gaitParam() { return this->gaitParam_; }
+  const GaitParam& gaitParam() const { return this->gaitParam_; }
+  const std::vector<std::string>& eeForceSensor() const { return this->actToGenFrameConverter_.eeForceSensor; } // 要素数と順序はeeNameと同じ. 対応するForceSensorが無ければ""
+  FootStepGenerator& footStepGenerator() { return this->footStepGenerator_; }
+  Stabilizer& stabilizer() { return this->stabilizer_; }
+
+protected:
+  double dt_ = 0.002;
+  AutoStabilizer::ControlMode mode_;
+  cpp_filters::TwoPointInterpolator<double> idleToAbcTransitionInterpolator_ = cpp_filters::TwoPointInterpolator<double>(0.0, 0.0, 0.0, cpp_filters::LINEAR);
+  GaitParam gaitParam_;
+  RefToGenFrameConverter refToGenFrameConverter_;
+  ActToGenFrameConverter actToGenFrameConverter_;
+  ExternalForceHandler externalForceHandler_;
+  ImpedanceController impedanceController_;
+  LegManualController legManualController_;
+  CmdVelGenerator cmdVelGenerator_;
+  FootStepGenerator footStepGenerator_;
+  LegCoordsGenerator legCoordsGenerator_;
+  Stabilizer stabilizer_;
+  FullbodyIKSolver fullbodyIKSolver_;
+
+  InPortData inPortData_;
+  std::vector<double> q_;
+  std::vector<double> genTau_;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif
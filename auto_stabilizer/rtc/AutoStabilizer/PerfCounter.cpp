@@ -0,0 +1,70 @@
+#include "PerfCounter.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+
+namespace {
+  int perfEventOpen(uint64_t config, int groupFd){
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = (groupFd < 0) ? 1 : 0; // group leaderのenable/disableで全カウンタをまとめて制御する
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0/*calling thread*/, -1/*any cpu*/, groupFd, 0);
+  }
+}
+
+bool PerfCounter::open(){
+  this->close();
+  const uint64_t configs[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+  for(int i=0;i<NUM_COUNTERS;i++){
+    this->fd_[i] = perfEventOpen(configs[i], this->fd_[0]);
+    if(this->fd_[i] < 0){
+      std::cerr << "[PerfCounter] perf_event_open failed for counter " << i << ": " << std::strerror(errno) << std::endl;
+      if(i == 0) return false;
+    }
+  }
+  return true;
+}
+
+void PerfCounter::close(){
+  for(int i=NUM_COUNTERS-1;i>=0;i--){
+    if(this->fd_[i] >= 0) ::close(this->fd_[i]);
+    this->fd_[i] = -1;
+  }
+}
+
+void PerfCounter::begin(){
+  if(!this->isOpenTried_){
+    this->isOpenTried_ = true;
+    this->open();
+  }
+  if(!this->isOpened()) return;
+  ioctl(this->fd_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(this->fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounter::end(std::vector<double>& o_counts){
+  for(int i=0;i<NUM_COUNTERS && i<o_counts.size();i++) o_counts[i] = 0.0; // NUM_COUNTERS番目以降は呼び出し側が使う
+  if(!this->isOpened()) return;
+  ioctl(this->fd_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  // PERF_FORMAT_GROUP: nr, values[nr]. 値はopenに成功したカウンタの順に並ぶ
+  uint64_t buf[1 + NUM_COUNTERS];
+  if(read(this->fd_[0], buf, sizeof(buf)) <= 0) return;
+  int idx = 0;
+  for(int i=0;i<NUM_COUNTERS && idx<buf[0];i++){
+    if(this->fd_[i] < 0) continue;
+    if(i < o_counts.size()) o_counts[i] = buf[1+idx];
+    idx++;
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef AutoStabilizer_PerfCounter_H
+#define AutoStabilizer_PerfCounter_H
+
+#include <vector>
+
+/*
+  制御周期ごとのハードウェアカウンタ(cycles, instructions, cache-references, cache-misses)をperf_event_openで計測する.
+  - 呼び出しスレッドのuser空間のみを計測する. 最初にbeginを呼んだスレッドでカウンタを開くので、beginとendは常に制御周期のスレッドから呼ぶこと
+  - 1周期あたりioctl 2回とread 1回のシステムコールが増えるので、計測時のみ有効にすること
+  - カーネルがperf_eventを許可していない(kernel.perf_event_paranoid等)場合はopenが失敗し、以後何もしない
+*/
+class PerfCounter{
+public:
+  enum counter_enum{CYCLES=0, INSTRUCTIONS=1, CACHE_REFERENCES=2, CACHE_MISSES=3, NUM_COUNTERS=4};
+
+  PerfCounter() {}
+  ~PerfCounter() { this->close(); }
+  PerfCounter(const PerfCounter&) = delete;
+  PerfCounter& operator=(const PerfCounter&) = delete;
+
+  bool open(); // 呼び出しスレッドについてカウンタを開く
+  void close();
+  bool isOpened() const { return this->fd_[0] >= 0; }
+
+  // begin()からend()までの間のカウント値をo_countsに入れる. o_countsの要素数はNUM_COUNTERS. 開けていないカウンタは0
+  void begin();
+  void end(std::vector<double>& o_counts);
+
+protected:
+  int fd_[NUM_COUNTERS] = {-1, -1, -1, -1}; // fd_[0]がgroup leader
+  bool isOpenTried_ = false; // openに失敗した場合に毎周期openし直さないため
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "PipelineWorker.h"
+#include "RealtimeUtil.h"
+#include <iostream>
+
+void PipelineWorker::start(int cpu, int priority){
+  this->stop();
+
+  this->quit_.store(false);
+  this->done_.store(this->submitted_.load());
+  this->thread_ = std::thread(&PipelineWorker::workerLoop, this);
+  if(cpu >= 0){
+    if(!realtimeutil::setThreadAffinity(this->thread_.native_handle(), std::vector<int>{cpu})){
+      std::cerr << "[PipelineWorker] failed to set affinity to cpu " << cpu << std::endl;
+    }
+  }
+  realtimeutil::setThreadPriority(this->thread_.native_handle(), priority);
+}
+
+void PipelineWorker::stop(){
+  if(!this->thread_.joinable()) return;
+  this->wait();
+  {
+    std::lock_guard<std::mutex> guard(this->mutex_); // ワーカーがquit_を確認してからwaitするまでの間に通知が来て取りこぼすことを防ぐ
+    this->quit_.store(true);
+  }
+  this->startCond_.notify_one();
+  this->thread_.join();
+}
+
+void PipelineWorker::run(void (*func)(void*), void* arg){
+  if(!this->thread_.joinable()){
+    func(arg);
+    return;
+  }
+
+  this->func_ = func;
+  this->arg_ = arg;
+  {
+    std::lock_guard<std::mutex> guard(this->mutex_); // ワーカーがsubmitted_を確認してからwaitするまでの間に通知が来て取りこぼすことを防ぐ
+    this->submitted_.fetch_add(1, std::memory_order_release); // ここでfunc_, arg_と、呼び出しスレッドがそれまでに書き込んだ内容がワーカーに公開される
+  }
+  this->startCond_.notify_one();
+}
+
+void PipelineWorker::wait(){
+  unsigned int submitted = this->submitted_.load(std::memory_order_relaxed);
+  for(int spin=0;spin<SPIN_COUNT;spin++){
+    if(this->done_.load(std::memory_order_acquire) == submitted) return;
+  }
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->doneCond_.wait(lock, [&]{ return this->done_.load(std::memory_order_acquire) == submitted; });
+}
+
+void PipelineWorker::workerLoop(){
+  unsigned int done = this->done_.load(std::memory_order_relaxed);
+  while(true){
+    bool isSubmitted = false;
+    for(int spin=0;spin<SPIN_COUNT && !isSubmitted;spin++){
+      isSubmitted = (this->submitted_.load(std::memory_order_acquire) != done);
+    }
+    if(!isSubmitted){
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->startCond_.wait(lock, [&]{ return this->quit_.load(std::memory_order_relaxed) || this->submitted_.load(std::memory_order_acquire) != done; });
+    }
+    if(this->submitted_.load(std::memory_order_acquire) == done) return; // quit. stopはwaitで処理の終了を待ってからquit_を立てるので、未処理のsubmitは無い
+    this->func_(this->arg_);
+    done++;
+    {
+      std::lock_guard<std::mutex> guard(this->mutex_); // 呼び出しスレッドがdone_を確認してからwaitするまでの間に通知が来て取りこぼすことを防ぐ
+      this->done_.store(done, std::memory_order_release); // ここでfuncが書き込んだ内容が呼び出しスレッドに公開される
+    }
+    this->doneCond_.notify_one();
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef AutoStabilizer_PipelineWorker_H
+#define AutoStabilizer_PipelineWorker_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/*
+  1つの専用スレッドに処理を渡し、呼び出しスレッドと並行に実行する.
+  制御周期の処理を2段のパイプラインにするために使う. 呼び出しスレッドが次の周期の前段の処理を行っている間に、今周期の後段の処理を行う.
+  AutoStabilizerPushTestでは、スレッドの数だけ用意して試行を並列に実行するために使う
+  - スレッドはstart時に生成し、以後生成・破棄しない
+  - ワーカーの待機とwaitは、短い時間だけspin-waitし、その後はcondition_variableでブロックする. sched_yieldはSCHED_FIFOでは同じ優先度のスレッドにしか譲らないので使わない. そのためSCHED_FIFOのワーカーが待機中に同じCPUの低優先度のスレッドを止め続けることはない
+  - submitは待たずに戻る. submitからwaitが戻るまでの間、funcが読み書きする領域に呼び出しスレッドが触れてはならない
+  - submit, waitは1つのスレッドからのみ呼ぶこと. submitの前には必ずwaitで前回の処理の終了を待つこと
+  - submit, waitはメモリ確保を行わない. 受け渡しはatomicなカウンタで行い、mutexは相手がブロックしている場合の通知の取りこぼしを防ぐためだけにとる
+*/
+class PipelineWorker{
+public:
+  PipelineWorker() {}
+  ~PipelineWorker() { this->stop(); }
+  PipelineWorker(const PipelineWorker&) = delete;
+  PipelineWorker& operator=(const PipelineWorker&) = delete;
+
+  // 初期化時に一回呼ばれる. cpuが0以上なら、スレッドをcpu番のCPUに固定する. priorityが1以上なら、スレッドをその優先度のSCHED_FIFOにする
+  void start(int cpu = -1, int priority = 0);
+  void stop();
+  bool isStarted() const { return this->thread_.joinable(); }
+
+  // func()の実行を開始し、終了を待たずに戻る. funcはwaitが戻るまで破棄してはならない. startされていなければ呼び出しスレッドで実行する
+  template<typename Func>
+  void submit(Func& func){
+    this->run(&PipelineWorker::invoke<Func>, static_cast<void*>(&func));
+  }
+  // submitしたfuncが終わるまで待つ. 実行中のものが無ければすぐに戻る
+  void wait();
+
+protected:
+  template<typename Func>
+  static void invoke(void* func) { (*static_cast<Func*>(func))(); }
+
+  void run(void (*func)(void*), void* arg);
+  void workerLoop();
+
+  static const int SPIN_COUNT = 1000; // ブロックする前にspin-waitする回数
+
+  std::thread thread_;
+  std::atomic<bool> quit_{false};
+  std::atomic<unsigned int> submitted_{0}; // submitされた回数. 呼び出しスレッドのみが書く
+  std::atomic<unsigned int> done_{0}; // 処理を終えた回数. ワーカーのみが書く
+  std::mutex mutex_;
+  std::condition_variable startCond_; // submitted_の変化とquit_をワーカーに通知する
+  std::condition_variable doneCond_; // done_の変化を呼び出しスレッドに通知する
+  void (*func_)(void*) = nullptr;
+  void* arg_ = nullptr;
+};
+
+#endif
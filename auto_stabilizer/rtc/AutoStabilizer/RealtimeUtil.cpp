@@ -0,0 +1,118 @@
+#include "RealtimeUtil.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <iostream>
+#include <alloca.h>
+
+namespace realtimeutil {
+  std::vector<int> parseCpuList(const std::string& str){
+    std::vector<int> cpus;
+    std::stringstream ss(str);
+    std::string buf;
+    while(std::getline(ss, buf, ',')){
+      if(buf.find_first_not_of(" \t") == std::string::npos) continue;
+      char* end = nullptr;
+      errno = 0;
+      long cpu = std::strtol(buf.c_str(), &end, 10);
+      if(end == buf.c_str() || errno == ERANGE || cpu < 0 || cpu >= CPU_SETSIZE || buf.find_first_not_of(" \t", end - buf.c_str()) != std::string::npos){
+        std::cerr << "[RealtimeUtil] invalid cpu number " << buf << " is ignored" << std::endl;
+        continue;
+      }
+      cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  bool setThreadAffinity(pthread_t thread, const std::vector<int>& cpus){
+    if(cpus.size() == 0) return true;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for(int i=0;i<cpus.size();i++) CPU_SET(cpus[i], &cpuset);
+    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+    if(ret != 0){
+      std::cerr << "[RealtimeUtil] failed to set affinity: " << std::strerror(ret) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool setThreadPriority(pthread_t thread, int priority){
+    if(priority <= 0) return true;
+    struct sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int ret = pthread_setschedparam(thread, SCHED_FIFO, &param);
+    if(ret != 0){
+      std::cerr << "[RealtimeUtil] failed to set SCHED_FIFO priority " << priority << ": " << std::strerror(ret) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool getThreadSetting(pthread_t thread, ThreadSetting& o_setting){
+    CPU_ZERO(&o_setting.cpuset);
+    int ret = pthread_getaffinity_np(thread, sizeof(cpu_set_t), &o_setting.cpuset);
+    if(ret == 0) ret = pthread_getschedparam(thread, &o_setting.policy, &o_setting.param);
+    if(ret != 0){
+      std::cerr << "[RealtimeUtil] failed to get thread setting: " << std::strerror(ret) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool setThreadSetting(pthread_t thread, const ThreadSetting& setting){
+    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &setting.cpuset);
+    if(ret == 0) ret = pthread_setschedparam(thread, setting.policy, &setting.param);
+    if(ret != 0){
+      std::cerr << "[RealtimeUtil] failed to restore thread setting: " << std::strerror(ret) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool lockMemory(){
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+      std::cerr << "[RealtimeUtil] mlockall failed: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void tuneMalloc(size_t prefaultHeapSize){
+    mallopt(M_TRIM_THRESHOLD, -1); // freeした領域をOSに返さない
+    mallopt(M_MMAP_MAX, 0); // 大きな領域もmmapせずheapから確保する. munmapで返されてしまうため
+    if(prefaultHeapSize > 0){
+      char* buf = static_cast<char*>(std::malloc(prefaultHeapSize));
+      if(buf != nullptr){
+        long pageSize = sysconf(_SC_PAGESIZE);
+        for(size_t i=0;i<prefaultHeapSize;i+=pageSize) buf[i] = 0;
+        std::free(buf); // M_TRIM_THRESHOLDにより、解放後もheapに残る. lockMemory済みならmlockされたまま
+      }
+    }
+  }
+
+  void prefaultStack(size_t prefaultStackSize){
+    if(prefaultStackSize == 0) return;
+    volatile char* buf = static_cast<volatile char*>(alloca(prefaultStackSize));
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for(size_t i=0;i<prefaultStackSize;i+=pageSize) buf[i] = 0;
+  }
+
+  void getPageFaults(long& o_minor, long& o_major){
+    struct rusage usage;
+    if(getrusage(RUSAGE_THREAD, &usage) != 0){
+      o_minor = 0;
+      o_major = 0;
+      return;
+    }
+    o_minor = usage.ru_minflt;
+    o_major = usage.ru_majflt;
+  }
+};
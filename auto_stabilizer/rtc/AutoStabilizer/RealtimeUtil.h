@@ -0,0 +1,44 @@
+#ifndef AutoStabilizer_RealtimeUtil_H
+#define AutoStabilizer_RealtimeUtil_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <pthread.h>
+#include <sched.h>
+
+/*
+  制御周期のスレッドの遅延を予測可能にするための設定. OpenRTMのExecutionContextやPipelineWorker等のスレッドに対して使う
+  - SCHED_FIFOの設定とmlockallにはCAP_SYS_NICE, CAP_IPC_LOCK(またはrlimitのrtprio, memlock)が必要. 失敗した場合はメッセージを出してfalseを返すだけで、処理は続ける
+*/
+namespace realtimeutil {
+  // スレッドのaffinityとスケジューリングポリシー. 他のRTCと共有するスレッドの設定を変更する前に保存し、後で元に戻すために使う
+  class ThreadSetting {
+  public:
+    cpu_set_t cpuset;
+    int policy = SCHED_OTHER;
+    struct sched_param param;
+  };
+
+  // ','区切りのCPU番号の列を読む. 例: "2,3". 数値として読めない要素はメッセージを出して無視する
+  std::vector<int> parseCpuList(const std::string& str);
+  // cpusの要素数が0なら何もしない
+  bool setThreadAffinity(pthread_t thread, const std::vector<int>& cpus);
+  // priorityが1以上ならSCHED_FIFOのその優先度にする. 0以下なら何もしない
+  bool setThreadPriority(pthread_t thread, int priority);
+  // threadの現在のaffinityとスケジューリングポリシーをo_settingに保存する
+  bool getThreadSetting(pthread_t thread, ThreadSetting& o_setting);
+  // getThreadSettingで保存したsettingに戻す
+  bool setThreadSetting(pthread_t thread, const ThreadSetting& setting);
+  // 現在と今後確保する全てのページをmlockallする
+  bool lockMemory();
+  // mallocが確保済みの領域をOSに返さず、大きな領域もmmapせずheapから確保するようにしたうえで、heapをprefaultHeapSize[byte]確保して全ページに書き込んでから解放する.
+  // malloptはプロセス全体の設定である. 同じプロセスの他のRTCやライブラリのmallocにも影響し、以後heapは縮まなくなる. 元に戻さない
+  void tuneMalloc(size_t prefaultHeapSize);
+  // 呼び出しスレッドのstackをprefaultStackSize[byte]ぶん書き込んでおく. lockMemoryの後に、制御周期のスレッドから呼ぶこと
+  void prefaultStack(size_t prefaultStackSize);
+  // 呼び出しスレッドのこれまでのpage faultの回数
+  void getPageFaults(long& o_minor, long& o_major);
+};
+
+#endif
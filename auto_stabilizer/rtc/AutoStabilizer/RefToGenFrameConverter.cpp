@@ -158,15 +158,47 @@ void RefToGenFrameConverter::calcFootMidCoords(const GaitParam& gaitParam, doubl
 
 // refRobotRawをrefRobotに変換する.
 void RefToGenFrameConverter::convertRefRobotRaw(const GaitParam& gaitParam, const cnoid::Position& genFootMidCoords, cnoid::BodyPtr& refRobot, std::vector<cnoid::Position>& refEEPoseFK, double& refdz) const{
-  cnoidbodyutil::copyRobotState(gaitParam.refRobotRaw, refRobot);
-  cnoid::Position rleg = refRobot->link(gaitParam.eeParentLink[RLEG])->T()*gaitParam.eeLocalT[RLEG];
-  cnoid::Position lleg = refRobot->link(gaitParam.eeParentLink[LLEG])->T()*gaitParam.eeLocalT[LLEG];
+  // refRobotRawの各linkの位置姿勢と重心はapplyInPortDataで計算済みなので、FKをやり直さずに使う
+  const cnoid::BodyPtr& refRobotRaw = gaitParam.refRobotRaw;
+  cnoid::Position rleg = refRobotRaw->link(gaitParam.eeParentLink[RLEG])->T()*gaitParam.eeLocalT[RLEG];
+  cnoid::Position lleg = refRobotRaw->link(gaitParam.eeParentLink[LLEG])->T()*gaitParam.eeLocalT[LLEG];
   cnoid::Position refFootMidCoords = this->calcRefFootMidCoords(rleg, lleg, gaitParam);
-  refdz = (refFootMidCoords.inverse() * refRobot->centerOfMass())[2]; // ref重心高さ
+  refdz = (refFootMidCoords.inverse() * refRobotRaw->centerOfMass())[2]; // ref重心高さ
 
-  cnoidbodyutil::moveCoords(refRobot, genFootMidCoords, refFootMidCoords);
-  refRobot->calcForwardKinematics();
-  refRobot->calcCenterOfMass();
+  cnoid::Position transform = genFootMidCoords * refFootMidCoords.inverse();
+
+  // refRobotRawの位置姿勢と、generate frameへの変換が前回から変化したか. 変化していなければrefRobotの各linkの位置姿勢と重心は前回のままで良い
+  bool isChanged = !this->isRefRobotValid ||
+    transform.matrix() != this->prevRefRobotTransform.matrix() ||
+    refRobotRaw->rootLink()->T().matrix() != this->prevRefRobotRawRootT.matrix() ||
+    this->prevRefRobotRawq.size() != refRobotRaw->numJoints();
+  for(int i=0;i<refRobotRaw->numJoints() && !isChanged;i++){
+    if(refRobotRaw->joint(i)->q() != this->prevRefRobotRawq[i]) isChanged = true;
+  }
+
+  if(isChanged){
+    // moveCoordsの後にFKをやり直したのと同じ結果を、refRobotRawの各linkを剛体変換して得る
+    cnoidbodyutil::copyRobotStateWithoutFK(refRobotRaw, refRobot);
+    for(int i=0;i<refRobot->numLinks();i++){
+      refRobot->link(i)->T() = transform * refRobotRaw->link(i)->T();
+    }
+    refRobot->calcCenterOfMass();
+
+    this->isRefRobotValid = true;
+    this->prevRefRobotTransform = transform;
+    this->prevRefRobotRawRootT = refRobotRaw->rootLink()->T();
+    if(this->prevRefRobotRawq.size() != refRobotRaw->numJoints()) this->prevRefRobotRawq.resize(refRobotRaw->numJoints());
+    for(int i=0;i<refRobotRaw->numJoints();i++) this->prevRefRobotRawq[i] = refRobotRaw->joint(i)->q();
+  }else{
+    // 位置姿勢に関係しないものだけコピーする
+    refRobot->rootLink()->v() = refRobotRaw->rootLink()->v();
+    refRobot->rootLink()->w() = refRobotRaw->rootLink()->w();
+    for(int i=0;i<refRobot->numJoints();i++){
+      refRobot->joint(i)->dq() = refRobotRaw->joint(i)->dq();
+      refRobot->joint(i)->ddq() = refRobotRaw->joint(i)->ddq();
+      refRobot->joint(i)->u() = refRobotRaw->joint(i)->u();
+    }
+  }
 
   for(int i=0;i<gaitParam.eeName.size();i++){
     refEEPoseFK[i] = refRobot->link(gaitParam.eeParentLink[i])->T() * gaitParam.eeLocalT[i];
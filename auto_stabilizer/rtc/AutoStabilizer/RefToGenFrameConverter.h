@@ -11,12 +11,21 @@ public:
   std::vector<cpp_filters::TwoPointInterpolator<double> > refFootOriginWeight = std::vector<cpp_filters::TwoPointInterpolator<double> >(NUM_LEGS,cpp_filters::TwoPointInterpolator<double>(1.0,0.0,0.0,cpp_filters::HOFFARBIB)); // 要素数2. 0: rleg. 1: lleg. 0~1. Reference座標系のfootOriginを計算するときに用いるweight. このfootOriginからの相対位置で、GaitGeneratorに管理されていないEndEffectorのReference位置が解釈される. interpolatorによって連続的に変化する. 全てのLegのrefFootOriginWeightが同時に0になることはない.
   cpp_filters::TwoPointInterpolator<double> solveFKMode = cpp_filters::TwoPointInterpolator<double>(1.0,0.0,0.0,cpp_filters::HOFFARBIB); // 0~1. 1ならエンドエフェクタ位置姿勢をrefRobotRawのFKから求める. 0なら、refEEPoseRawから求める. startAutoBalancerした直後は必ず1
 
+protected:
+  // 内部で変更されるパラメータ. startAutoBalancer時にリセットされる
+  //   refRobotの各linkの位置姿勢と重心は、refRobotRawの位置姿勢か、generate frameへの投影の変換が前回計算したときから変化した場合のみ計算し直す. 上位のsequencerの周期がAutoStabilizerより長い場合や静止時は、毎周期同じ値になる
+  mutable bool isRefRobotValid = false; // falseなら次のconvertFrameで必ず計算し直す
+  mutable cnoid::Position prevRefRobotRawRootT = cnoid::Position::Identity(); // reference frame. 前回refRobotを計算したときのrefRobotRawのrootLinkの位置姿勢
+  mutable cnoid::VectorX prevRefRobotRawq; // 要素数と順序はrobot->numJoints()と同じ. 前回refRobotを計算したときのrefRobotRawの関節角度
+  mutable cnoid::Position prevRefRobotTransform = cnoid::Position::Identity(); // 前回refRobotを計算したときの、reference frameからgenerate frameへの変換
+
 public:
   // startAutoBalancer時に呼ばれる
   void reset() {
     handFixMode.reset(handFixMode.getGoal());
     for(int i=0;i<refFootOriginWeight.size();i++) refFootOriginWeight[i].reset(refFootOriginWeight[i].getGoal());
     solveFKMode.reset(1.0);
+    isRefRobotValid = false;
   }
   // 内部の補間器をdtだけ進める
   void update(double dt){
@@ -43,7 +52,7 @@ public:
 protected:
   // 現在のFootStepNodesListから、genRobotのfootMidCoordsを求める (gaitParam.footMidCoords)
   void calcFootMidCoords(const GaitParam& gaitParam, double dt, cpp_filters::TwoPointInterpolatorSE3& footMidCoords) const;
-  // refRobotRawをrefRobotに変換する.
+  // refRobotRawをrefRobotに変換する. refRobotRawの各linkの位置姿勢と重心は計算済みであること(applyInPortDataで計算される)
   void convertRefRobotRaw(const GaitParam& gaitParam, const cnoid::Position& genFootMidCoords, cnoid::BodyPtr& refRobot, std::vector<cnoid::Position>& refEEPoseFK, double& refdz) const;
   // refEEPoseRawを変換する.
   void convertRefEEPoseRaw(const GaitParam& gaitParam, const cnoid::Position& genFootMidCoords, std::vector<cnoid::Position>& refEEPoseWithOutFK) const;
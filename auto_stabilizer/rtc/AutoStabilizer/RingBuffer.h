@@ -0,0 +1,108 @@
+#ifndef AutoStabilizer_RingBuffer_H
+#define AutoStabilizer_RingBuffer_H
+
+#include <new>
+#include <utility>
+#include <cstdlib>
+
+/*
+  要素数の上限がCapacityで固定されたリングバッファ.
+  - Capacity個ぶんの領域は構築時に一度だけヒープに確保し、以後確保し直さない. オブジェクト自体は小さいので、関数内のローカル変数にしてもstackを圧迫しない
+  - std::vectorと同様に、operator[]でfrontからの順番でアクセスする
+  - pop_frontは先頭の位置をずらすだけなので、要素数によらず定数時間で、他の要素を移動しない
+  - コピー代入は自身の領域を使い回し、存在する要素のみをコピーする. メモリ確保を行わない. コピー構築は領域を新たに確保する
+  - swapは領域ごと交換するので、要素をコピーせず、メモリ確保も行わない
+  - 要素数がCapacityのときにpush_backしても追加されない(falseを返し、overflowed()がtrueになる). overflowed()はclearかコピー代入でfalseに戻る. 一連の追加の後にoverflowed()を確認し、要素が欠けた結果を使わないこと
+  - 制御周期から呼ばれるので、overflowしても出力は行わない. 報告は呼び出し側が行う
+*/
+template<typename T, int Capacity>
+class RingBuffer{
+public:
+  RingBuffer() { this->allocate(); }
+  explicit RingBuffer(int n) { this->allocate(); this->resize(n); }
+  RingBuffer(const RingBuffer& other) { this->allocate(); this->copyFrom(other); }
+  RingBuffer& operator=(const RingBuffer& other) {
+    if(this != &other) {
+      this->clear();
+      this->copyFrom(other);
+    }
+    return *this;
+  }
+  ~RingBuffer() {
+    this->clear();
+    std::free(this->storage_);
+  }
+
+  static constexpr int capacity() { return Capacity; }
+  int size() const { return this->size_; }
+  bool empty() const { return this->size_ == 0; }
+  bool full() const { return this->size_ == Capacity; }
+  bool overflowed() const { return this->overflowed_; }
+
+  T& operator[](int i) { return *this->ptr(i); }
+  const T& operator[](int i) const { return *this->ptr(i); }
+  T& front() { return *this->ptr(0); }
+  const T& front() const { return *this->ptr(0); }
+  T& back() { return *this->ptr(this->size_-1); }
+  const T& back() const { return *this->ptr(this->size_-1); }
+
+  bool push_back(const T& value) {
+    if(this->full()) {
+      this->overflowed_ = true;
+      return false;
+    }
+    new (this->ptr(this->size_)) T(value);
+    this->size_++;
+    return true;
+  }
+  void pop_front() {
+    this->ptr(0)->~T();
+    this->head_ = (this->head_ + 1) % Capacity;
+    this->size_--;
+  }
+  void pop_back() {
+    this->ptr(this->size_-1)->~T();
+    this->size_--;
+  }
+  // 要素数をnにする. 増える場合はデフォルト値の要素を末尾に追加する
+  void resize(int n) {
+    if(n > Capacity) n = Capacity;
+    while(this->size_ > n) this->pop_back();
+    while(this->size_ < n) {
+      new (this->ptr(this->size_)) T();
+      this->size_++;
+    }
+  }
+  void clear() {
+    while(this->size_ > 0) this->pop_back();
+    this->head_ = 0;
+    this->overflowed_ = false;
+  }
+  void swap(RingBuffer& other) {
+    std::swap(this->storage_, other.storage_);
+    std::swap(this->head_, other.head_);
+    std::swap(this->size_, other.size_);
+    std::swap(this->overflowed_, other.overflowed_);
+  }
+
+protected:
+  T* ptr(int i) { return reinterpret_cast<T*>(this->storage_) + (this->head_ + i) % Capacity; }
+  const T* ptr(int i) const { return reinterpret_cast<const T*>(this->storage_) + (this->head_ + i) % Capacity; }
+  void allocate() {
+    void* storage = nullptr;
+    if(posix_memalign(&storage, alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*), sizeof(T) * Capacity) != 0) throw std::bad_alloc();
+    this->storage_ = static_cast<unsigned char*>(storage);
+  }
+  void copyFrom(const RingBuffer& other) { // 空であること
+    this->head_ = 0;
+    for(int i=0;i<other.size_;i++) new (this->ptr(i)) T(other[i]);
+    this->size_ = other.size_;
+  }
+
+  unsigned char* storage_ = nullptr; // Capacity個ぶんの領域. alignof(T)にalignされている
+  int head_ = 0; // storage_上でのfrontのindex
+  int size_ = 0;
+  bool overflowed_ = false; // clear以降にpush_backで要素を追加できなかったことがあるか
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef AutoStabilizer_SnapshotBuffer_H
+#define AutoStabilizer_SnapshotBuffer_H
+
+#include <atomic>
+#include <thread>
+
+/*
+  制御周期のスレッド(writer 1つ)が毎周期書き込む状態を、他のスレッド(readerは複数でもよい)がロック無しで読むためのトリプルバッファ.
+  - writerは、最新のスロットとその一つ前のスロット以外のスロットに書き込んでから公開する. readerを待つことは無い
+  - readerは、最新のスロットをコピーした後にseqlockと同様にシーケンス番号を確認し、コピー中にそのスロットが上書きされた可能性があればやり直す.
+    スロットが上書きされるのは2回公開された後なので、readerのコピーが2周期以内に終われば、やり直しは起こらない
+  - AutoStabilizerSnapshotStressで、writerとreaderを並行に動かして破れたスナップショットが読まれないことを確認できる
+  - Tのコピーはメモリ確保を行わないこと(std::vectorなら、init後に要素数を変えないこと). writerとreaderのコピーが重なっても、Tの内部のポインタや要素数が変化しないようにするため
+*/
+template<typename T>
+class SnapshotBuffer{
+public:
+  // 初期化時に一回呼ばれる. 全スロットをvalueにする
+  void init(const T& value) {
+    for(int i=0;i<3;i++) this->buf_[i] = value;
+    this->seq_.store(0, std::memory_order_release);
+  }
+
+  // writer用. 書き込むスロットを返す. 書き込み後にpublishを呼ぶこと
+  T& writeBuffer() { return this->buf_[(this->seq_.load(std::memory_order_relaxed) + 1) % 3]; }
+  void publish() {
+    this->seq_.fetch_add(1, std::memory_order_release); // ここまでにwriteBufferに書き込んだ内容がreaderに公開される
+    std::atomic_thread_fence(std::memory_order_release); // releaseは以降の書き込みを前に移動させないので、次のwriteBufferへの書き込みがseq_の更新より先にreaderに見えないようにする(seqlockのwriter側のfence)
+  }
+
+  // reader用. 最後に公開された状態をo_valueにコピーする
+  void read(T& o_value) const {
+    while(true){
+      unsigned long long seq = this->seq_.load(std::memory_order_acquire);
+      o_value = this->buf_[seq % 3];
+      std::atomic_thread_fence(std::memory_order_acquire); // コピーの読み込みが、下のseq_の読み込みより後に移動しないようにする(seqlockのreader側のfence)
+      if(this->seq_.load(std::memory_order_relaxed) - seq < 2) return; // コピー中にこのスロットへの書き込みは始まっていない
+      std::this_thread::yield();
+    }
+  }
+
+protected:
+  T buf_[3];
+  std::atomic<unsigned long long> seq_{0}; // 公開した回数. buf_[seq_%3]が最新
+};
+
+#endif
@@ -83,14 +83,14 @@ bool Stabilizer::moveBasePosRotForBodyRPYControl(double dt, const GaitParam& gai
 
 bool Stabilizer::calcZMP(const GaitParam& gaitParam, double dt, bool useActState,
                          cnoid::Vector3& o_tgtZmp, cnoid::Vector3& o_tgtForce) const{
-  cnoid::Vector3 cog = useActState ? gaitParam.actCog : gaitParam.genCog;
-  cnoid::Vector3 cogVel = useActState ? gaitParam.actCogVel.value() : gaitParam.genCogVel;
+  cnoid::Vector3 cog = useActState ? gaitParam.predActCog : gaitParam.genCog; // actualは遅延補償したもの
+  cnoid::Vector3 cogVel = useActState ? gaitParam.predActCogVel : gaitParam.genCogVel;
   cnoid::Vector3 DCM = cog + cogVel / gaitParam.omega;
   const std::vector<cnoid::Position>& EEPose = useActState ? gaitParam.actEEPose : gaitParam.abcEETargetPose;
 
   cnoid::Vector3 tgtZmp;
   if(gaitParam.footstepNodesList[0].isSupportPhase[RLEG] || gaitParam.footstepNodesList[0].isSupportPhase[LLEG]){
-    tgtZmp = footguidedcontroller::calcFootGuidedControl(gaitParam.omega,gaitParam.l,DCM,gaitParam.refZmpTraj);
+    tgtZmp = gaitParam.refZmpTrajPreview.calcFootGuidedControl(DCM); // = footguidedcontroller::calcFootGuidedControl(gaitParam.omega,gaitParam.l,DCM,gaitParam.refZmpTraj)
     if(tgtZmp[2] >= gaitParam.actCog[2]) tgtZmp = gaitParam.actCog - cnoid::Vector3(gaitParam.l[0],gaitParam.l[1], 0.0); // 下向きの力は受けられないので
     else{
       // truncate zmp inside polygon. actual robotの関節角度を用いて計算する
@@ -287,34 +287,38 @@ bool Stabilizer::calcWrench(const GaitParam& gaitParam, const cnoid::Vector3& tg
 bool Stabilizer::calcTorque(double dt, const GaitParam& gaitParam, const std::vector<cnoid::Vector6>& tgtEEWrench /* 要素数EndEffector数. generate座標系. EndEffector origin*/,
                             cnoid::BodyPtr& actRobotTqc, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_stServoPGainPercentage, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_stServoDGainPercentage) const{
   // 速度・加速度を考慮しない重力補償
-  actRobotTqc->rootLink()->T() = gaitParam.actRobot->rootLink()->T();
-  actRobotTqc->rootLink()->v() = cnoid::Vector3::Zero();
-  actRobotTqc->rootLink()->w() = cnoid::Vector3::Zero();
-  actRobotTqc->rootLink()->dv() = cnoid::Vector3(0.0,0.0,gaitParam.g);
-  actRobotTqc->rootLink()->dw() = cnoid::Vector3::Zero();
+  //   関節角度はactRobotと同じなので、各linkの位置姿勢はActToGenFrameConverterが計算したactRobotのものをコピーし、FKをやり直さない
+  //   dq = ddq = 0, rootLinkの加速度が重力加速度のみなので、calcForwardKinematics(true, true)の結果は全linkで v = w = dw = 0, dv = (0, 0, g)となる. これも直接与える
+  const cnoid::Vector3 gravityAcc(0.0,0.0,gaitParam.g);
+  for(int i=0;i<actRobotTqc->numLinks();i++){
+    cnoid::Link* link = actRobotTqc->link(i);
+    link->T() = gaitParam.actRobot->link(i)->T();
+    link->v().setZero();
+    link->w().setZero();
+    link->dv() = gravityAcc;
+    link->dw().setZero();
+  }
   for(int i=0;i<actRobotTqc->numJoints();i++){
     actRobotTqc->joint(i)->q() = gaitParam.actRobot->joint(i)->q();
     actRobotTqc->joint(i)->dq() = 0.0;
     actRobotTqc->joint(i)->ddq() = 0.0;
   }
-  actRobotTqc->calcForwardKinematics(true, true);
   cnoid::calcInverseDynamics(actRobotTqc->rootLink()); // actRobotTqc->joint()->u()に書き込まれる
 
   // tgtEEWrench
   for(int i=0;i<gaitParam.eeName.size();i++){
-    cnoid::JointPath jointPath(actRobotTqc->rootLink(), actRobotTqc->link(gaitParam.eeParentLink[i]));
-    cnoid::MatrixXd J = cnoid::MatrixXd::Zero(6,jointPath.numJoints()); // generate frame. endeffector origin
-    cnoid::setJacobian<0x3f,0,0,true>(jointPath,actRobotTqc->link(gaitParam.eeParentLink[i]),gaitParam.eeLocalT[i].translation(), // input
-                                      J); // output
-    cnoid::VectorX tau = - J.transpose() * tgtEEWrench[i];
+    cnoid::JointPath& jointPath = *(this->eeJointPath_[i]);
+    cnoid::setJacobian<0x3f,0,0,true>(jointPath,jointPath.endLink(),gaitParam.eeLocalT[i].translation(), // input
+                                      this->eeJ_[i]); // output
+    this->eeTau_[i].noalias() = - this->eeJ_[i].transpose() * tgtEEWrench[i];
     for(int j=0;j<jointPath.numJoints();j++){
-      jointPath.joint(j)->u() += tau[j];
+      jointPath.joint(j)->u() += this->eeTau_[i][j];
     }
   }
 
   // Gain
   for(int i=0;i<NUM_LEGS;i++){
-    cnoid::JointPath jointPath(actRobotTqc->rootLink(), actRobotTqc->link(gaitParam.eeParentLink[i]));
+    const cnoid::JointPath& jointPath = *(this->eeJointPath_[i]);
     if(gaitParam.isManualControlMode[i].getGoal() == 0.0) { // Manual Control off
       if(gaitParam.footstepNodesList[0].isSupportPhase[i]){
         double transitionTime = std::max(this->landing2SupportTransitionTime, dt*2); // 現状, setGoal(*,dt)以下の時間でgoal指定するとwriteOutPortDataが破綻するのでテンポラリ
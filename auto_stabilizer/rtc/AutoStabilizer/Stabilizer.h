@@ -22,7 +22,20 @@ public:
   double landing2SupportTransitionTime = 0.1; // [s]. 0より大きい
   double support2SwingTransitionTime = 0.2; // [s]. 0より大きい
 
+  Stabilizer() {}
+  // constraintTask_等をshared_ptrで持つので、コピーすると2つのインスタンスが同じ作業領域を共有してしまう
+  Stabilizer(const Stabilizer&) = delete;
+  Stabilizer& operator=(const Stabilizer&) = delete;
+
   void init(const GaitParam& gaitParam, cnoid::BodyPtr& actRobotTqc){
+    eeJointPath_.clear();
+    eeJ_.clear();
+    eeTau_.clear();
+    for(int i=0;i<gaitParam.eeName.size();i++){
+      eeJointPath_.push_back(std::make_shared<cnoid::JointPath>(actRobotTqc->rootLink(), actRobotTqc->link(gaitParam.eeParentLink[i])));
+      eeJ_.push_back(cnoid::MatrixXd::Zero(6,eeJointPath_.back()->numJoints()));
+      eeTau_.push_back(cnoid::VectorX::Zero(eeJointPath_.back()->numJoints()));
+    }
     for(int i=0;i<NUM_LEGS;i++){
       cnoid::JointPath jointPath(actRobotTqc->rootLink(), actRobotTqc->link(gaitParam.eeParentLink[i]));
       if(jointPath.numJoints() == 6){
@@ -50,10 +63,14 @@ public:
     }
   }
 protected:
-  // 計算高速化のためのキャッシュ. クリアしなくても別に副作用はない.
+  // 計算高速化のためのキャッシュ. クリアしなくても別に副作用はない. constな関数から書き換えるので、1つのインスタンスのexecStabilizerを複数のスレッドから同時に呼んではいけない
   mutable std::shared_ptr<prioritized_qp_osqp::Task> constraintTask_ = std::make_shared<prioritized_qp_osqp::Task>();
   mutable std::shared_ptr<prioritized_qp_osqp::Task> tgtZmpTask_ = std::make_shared<prioritized_qp_osqp::Task>();;
   mutable std::shared_ptr<prioritized_qp_osqp::Task> copTask_ = std::make_shared<prioritized_qp_osqp::Task>();;
+  // calcTorque用. 要素数と順番はEndEffectorと同じ. 毎周期メモリ確保しないようにinit時に確保しておく. EndEffectorごとに別の領域なので並列に書き込める
+  std::vector<std::shared_ptr<cnoid::JointPath> > eeJointPath_; // actRobotTqcのrootLinkから各EndEffectorの親リンクまで
+  mutable std::vector<cnoid::MatrixXd> eeJ_; // generate frame. endeffector origin
+  mutable std::vector<cnoid::VectorX> eeTau_;
 public:
   void initStabilizerOutput(const GaitParam& gaitParam,
                             cpp_filters::TwoPointInterpolator<cnoid::Vector3>& o_stOffsetRootRpy, cnoid::Vector3& o_stTargetZmp, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_stServoPGainPercentage, std::vector<cpp_filters::TwoPointInterpolator<double> >& o_stServoDGainPercentage) const;
@@ -0,0 +1,80 @@
+#ifndef AutoStabilizer_TelemetryRecord_H
+#define AutoStabilizer_TelemetryRecord_H
+
+#include <cstdint>
+
+/*
+  TelemetryRecorderが書き込むリングファイルのレイアウト. TelemetryToLogと共有するため、OpenRTMやchoreonoidに依存しないこと.
+  ファイル構成: TelemetryHeader | TelemetryRecord[capacity] | TelemetryVertex[vertexCapacity]
+  - TelemetryRecordは固定長. 頂点数が大きく変わるregion類(captureRegion, steppableRegion, strideLimitationHull)は、レコードには頂点数と先頭の通し番号だけを書き、頂点自体はTelemetryVertexのリングに詰めて書く.
+    region類を固定長の最大数ぶん確保すると1レコードが約8KBになり、その大半が空きのまま確保・mlockされるため
+  - その他の可変長のデータは最大数を決めて、要素数と一緒に記録する. 最大数を超えたぶんは記録しない
+  - レイアウトを変更したらTELEMETRY_VERSIONを上げること
+*/
+namespace telemetry {
+  static const char TELEMETRY_MAGIC[8] = {'A','S','T','T','L','M','\0','\0'};
+  static const uint32_t TELEMETRY_VERSION = 4;
+
+  static const int MAX_EE = 8;
+  static const int MAX_EE_NAME = 32;
+  static const int MAX_CAPTURE_REGION_VERTICES = 128;
+  static const int MAX_STEPPABLE_REGIONS = 32;
+  static const int MAX_STEPPABLE_REGION_VERTICES = 256; // 全regionの合計
+  static const int MAX_STRIDE_LIMITATION_HULL_VERTICES = 32;
+  static const int MAX_VERTICES_PER_RECORD = MAX_CAPTURE_REGION_VERTICES + MAX_STEPPABLE_REGION_VERTICES + MAX_STRIDE_LIMITATION_HULL_VERTICES; // vertexCapacityはこれ以上にすること
+  static const int MAX_CP_VIEWER_LOG = 64;
+  static const int MAX_IK_STAT = 16;
+  static const int MAX_PERF_STAT = 7;
+
+  class TelemetryHeader {
+  public:
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize; // sizeof(TelemetryRecord)
+    uint64_t recordOffset; // ファイル先頭からTelemetryRecord[0]までのbyte数. ページ境界に揃える
+    uint64_t capacity; // TelemetryRecordの数
+    uint32_t eeNum;
+    uint32_t reserved;
+    char eeName[MAX_EE][MAX_EE_NAME]; // 要素数と順番はgaitParam.eeNameと同じ
+    uint64_t count; // これまでに書き込んだレコードの総数. レコードを書き終えてから更新される. 最新のレコードは(count-1)%capacity
+    uint64_t vertexOffset; // ファイル先頭からTelemetryVertex[0]までのbyte数. ページ境界に揃える
+    uint64_t vertexCapacity; // TelemetryVertexの数
+    uint64_t vertexCount; // これまでに書き込んだ(書き込み中のものを含む)頂点の総数. 頂点を書き始める前に更新される. 通し番号vの頂点はv%vertexCapacityにあり、vertexCount > v+vertexCapacityなら上書きされている
+  };
+
+  class TelemetryVertex {
+  public:
+    double x;
+    double y;
+  };
+
+  // 各要素はAutoStabilizerのlog用OutPortと同じ内容. 座標系等はAutoStabilizer::writeOutPortDataを参照
+  class TelemetryRecord {
+  public:
+    int64_t sec; // m_qRef_.tm
+    int64_t nsec;
+    double genCog[3];
+    double genDcm[3];
+    double genZmp[3];
+    double tgtZmp[3];
+    double actCog[3];
+    double actDcm[3];
+    double dstLandingPos[6];
+    double remainTime;
+    double genCoords[12];
+    uint64_t vertexBegin; // このレコードの先頭の頂点の通し番号. captureRegion, steppableRegion, strideLimitationHullの順に連続して書く
+    uint32_t captureRegionNum; // 頂点数
+    uint32_t steppableRegionNum; // region数
+    uint32_t strideLimitationHullNum; // 頂点数
+    uint32_t cpViewerLogNum;
+    uint32_t ikStatNum;
+    uint32_t perfStatNum;
+    uint32_t steppableRegionVertexNum[MAX_STEPPABLE_REGIONS]; // 各regionの頂点数
+    double cpViewerLog[MAX_CP_VIEWER_LOG];
+    double ikStat[MAX_IK_STAT];
+    double perfStat[MAX_PERF_STAT];
+    double tgtEEWrench[MAX_EE][6];
+  };
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "TelemetryRecorder.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+
+bool TelemetryRecorder::open(const std::string& fileName, unsigned long capacity, unsigned long vertexCapacity, const std::vector<std::string>& eeName){
+  this->close();
+  if(capacity == 0) return false;
+  if(vertexCapacity < telemetry::MAX_VERTICES_PER_RECORD){
+    std::cerr << "[TelemetryRecorder] vertex capacity " << vertexCapacity << " is smaller than " << telemetry::MAX_VERTICES_PER_RECORD << std::endl;
+    return false;
+  }
+
+  long pageSize = sysconf(_SC_PAGESIZE);
+  size_t recordOffset = (sizeof(telemetry::TelemetryHeader) + pageSize - 1) / pageSize * pageSize;
+  size_t vertexOffset = (recordOffset + sizeof(telemetry::TelemetryRecord) * capacity + pageSize - 1) / pageSize * pageSize;
+  size_t mapSize = vertexOffset + sizeof(telemetry::TelemetryVertex) * vertexCapacity;
+
+  int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0){
+    std::cerr << "[TelemetryRecorder] failed to open " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  struct statfs fs;
+  if(fstatfs(fd, &fs) == 0 && fs.f_type != TMPFS_MAGIC){
+    std::cerr << "\x1b[31m[TelemetryRecorder] " << fileName << " is not on tmpfs. writeback of the file may cause page faults while recording. put it under /dev/shm" << "\x1b[39m" << std::endl;
+  }
+  int err = posix_fallocate(fd, 0, mapSize); // 記録中にディスクのブロック確保が起きないようにする
+  if(err != 0){
+    std::cerr << "[TelemetryRecorder] failed to allocate " << mapSize << " bytes for " << fileName << ": " << std::strerror(err) << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  ::close(fd); // mmapした領域はfdを閉じても有効
+  if(map == MAP_FAILED){
+    std::cerr << "[TelemetryRecorder] failed to mmap " << fileName << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  std::memset(map, 0, mapSize); // 全ページに一度書き込んでおく
+
+  this->map_ = map;
+  this->mapSize_ = mapSize;
+  this->header_ = static_cast<telemetry::TelemetryHeader*>(map);
+  this->records_ = reinterpret_cast<telemetry::TelemetryRecord*>(static_cast<char*>(map) + recordOffset);
+  this->vertices_ = reinterpret_cast<telemetry::TelemetryVertex*>(static_cast<char*>(map) + vertexOffset);
+  this->count_ = 0;
+  this->vertexCount_ = 0;
+
+  std::memcpy(this->header_->magic, telemetry::TELEMETRY_MAGIC, sizeof(this->header_->magic));
+  this->header_->version = telemetry::TELEMETRY_VERSION;
+  this->header_->recordSize = sizeof(telemetry::TelemetryRecord);
+  this->header_->recordOffset = recordOffset;
+  this->header_->capacity = capacity;
+  this->header_->eeNum = std::min((int)eeName.size(), telemetry::MAX_EE);
+  for(int i=0;i<this->header_->eeNum;i++) std::strncpy(this->header_->eeName[i], eeName[i].c_str(), telemetry::MAX_EE_NAME-1);
+  this->header_->vertexOffset = vertexOffset;
+  this->header_->vertexCapacity = vertexCapacity;
+  __atomic_store_n(&this->header_->vertexCount, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&this->header_->count, 0, __ATOMIC_RELEASE);
+  return true;
+}
+
+void TelemetryRecorder::close(){
+  if(this->map_ != nullptr) munmap(this->map_, this->mapSize_);
+  this->map_ = nullptr;
+  this->mapSize_ = 0;
+  this->header_ = nullptr;
+  this->records_ = nullptr;
+  this->vertices_ = nullptr;
+}
+
+namespace {
+  inline void copyVector3(const cnoid::Vector3& v, double* o_d) {
+    o_d[0] = v[0]; o_d[1] = v[1]; o_d[2] = v[2];
+  }
+}
+
+void TelemetryRecorder::record(long sec, long nsec, const GaitParam& gaitParam){
+  if(!this->isOpened()) return;
+  telemetry::TelemetryRecord& r = this->records_[this->count_ % this->header_->capacity];
+
+  r.sec = sec;
+  r.nsec = nsec;
+  copyVector3(gaitParam.genCog, r.genCog);
+  copyVector3(gaitParam.genCog + gaitParam.genCogVel / gaitParam.omega, r.genDcm);
+  copyVector3(gaitParam.refZmpTraj[0].getStart(), r.genZmp);
+  copyVector3(gaitParam.stTargetZmp, r.tgtZmp);
+  copyVector3(gaitParam.actCog, r.actCog);
+  copyVector3(gaitParam.actCog + gaitParam.actCogVel.value() / gaitParam.omega, r.actDcm);
+  copyVector3(gaitParam.footstepNodesList[0].dstCoords[RLEG].translation(), r.dstLandingPos);
+  copyVector3(gaitParam.footstepNodesList[0].dstCoords[LLEG].translation(), r.dstLandingPos+3);
+  r.remainTime = gaitParam.footstepNodesList[0].remainTime;
+  copyVector3(gaitParam.genCoords[RLEG].value().translation(), r.genCoords);
+  copyVector3(gaitParam.genCoords[LLEG].value().translation(), r.genCoords+3);
+  copyVector3(gaitParam.genCoords[RLEG].getGoal().translation(), r.genCoords+6);
+  copyVector3(gaitParam.genCoords[LLEG].getGoal().translation(), r.genCoords+9);
+
+  // 可変長のデータは、最大数を超えたぶんを記録しない
+  // region類は頂点数を先に数えて、頂点のリングに書く範囲を予約してから書く. 記録中にTelemetryToLogで読む場合、予約済みの範囲と重なる古い頂点は捨てられる
+  int captureRegionNum = 0;
+  for(int i=0;i<gaitParam.debugData.capturableHulls.size();i++) captureRegionNum += gaitParam.debugData.capturableHulls[i].size();
+  captureRegionNum = std::min(captureRegionNum, telemetry::MAX_CAPTURE_REGION_VERTICES);
+  int steppableRegionNum = 0;
+  int regionNum = 0;
+  for(int i=0;i<gaitParam.steppableRegion.size() && regionNum<telemetry::MAX_STEPPABLE_REGIONS;i++){
+    if(steppableRegionNum + gaitParam.steppableRegion[i].size() > telemetry::MAX_STEPPABLE_REGION_VERTICES) break; // regionの途中で切らない
+    r.steppableRegionVertexNum[regionNum] = gaitParam.steppableRegion[i].size();
+    steppableRegionNum += gaitParam.steppableRegion[i].size();
+    regionNum++;
+  }
+  int strideLimitationHullNum = std::min((int)gaitParam.debugData.strideLimitationHull.size(), telemetry::MAX_STRIDE_LIMITATION_HULL_VERTICES);
+
+  r.vertexBegin = this->vertexCount_;
+  r.captureRegionNum = captureRegionNum;
+  r.steppableRegionNum = regionNum;
+  r.strideLimitationHullNum = strideLimitationHullNum;
+  this->vertexCount_ += captureRegionNum + steppableRegionNum + strideLimitationHullNum;
+  __atomic_store_n(&this->header_->vertexCount, this->vertexCount_, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // 予約の公開が、以降の頂点の書き込みより後に見えることを防ぐ
+
+  uint64_t v = r.vertexBegin;
+  for(int i=0;i<gaitParam.debugData.capturableHulls.size() && v<r.vertexBegin+captureRegionNum;i++){
+    for(int j=0;j<gaitParam.debugData.capturableHulls[i].size() && v<r.vertexBegin+captureRegionNum;j++){
+      this->writeVertex(v++, gaitParam.debugData.capturableHulls[i][j]);
+    }
+  }
+  for(int i=0;i<regionNum;i++){
+    for(int j=0;j<gaitParam.steppableRegion[i].size();j++){
+      this->writeVertex(v++, gaitParam.steppableRegion[i][j]);
+    }
+  }
+  for(int i=0;i<strideLimitationHullNum;i++){
+    this->writeVertex(v++, gaitParam.debugData.strideLimitationHull[i]);
+  }
+
+  r.cpViewerLogNum = std::min((int)gaitParam.debugData.cpViewerLog.size(), telemetry::MAX_CP_VIEWER_LOG);
+  for(int i=0;i<r.cpViewerLogNum;i++) r.cpViewerLog[i] = gaitParam.debugData.cpViewerLog[i];
+  r.ikStatNum = std::min((int)gaitParam.debugData.ikStat.size(), telemetry::MAX_IK_STAT);
+  for(int i=0;i<r.ikStatNum;i++) r.ikStat[i] = gaitParam.debugData.ikStat[i];
+  r.perfStatNum = std::min((int)gaitParam.debugData.perfStat.size(), telemetry::MAX_PERF_STAT);
+  for(int i=0;i<r.perfStatNum;i++) r.perfStat[i] = gaitParam.debugData.perfStat[i];
+  for(int i=0;i<this->header_->eeNum && i<gaitParam.stEETargetWrench.size();i++){
+    for(int j=0;j<6;j++) r.tgtEEWrench[i][j] = gaitParam.stEETargetWrench[i][j];
+  }
+
+  // レコードを書き終えてから公開する. 記録中にTelemetryToLogで読む場合のため
+  this->count_++;
+  __atomic_store_n(&this->header_->count, this->count_, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,47 @@
+#ifndef AutoStabilizer_TelemetryRecorder_H
+#define AutoStabilizer_TelemetryRecorder_H
+
+#include <string>
+#include "GaitParam.h"
+#include "TelemetryRecord.h"
+
+/*
+  毎周期の主要なGaitParamの値を、固定長のバイナリレコードとしてmmapしたリングファイルに書き込む. datalogger経由で多数のportを記録するよりも軽い.
+  - recordはmmap領域に値を書くだけで、システムコールは行わない. openで領域を確保し全ページに一度書き込んでおくので、記録中にブロック確保やページの読み込みは発生しない
+  - ファイルはtmpfs(/dev/shm等)に置くこと. ディスク上のファイルだと、カーネルが書き戻したページは書き込み禁止に戻され、次の書き込みでpage faultが起きる. ファイルシステムによってはそこで書き戻しの完了を待ってブロックする. tmpfsでなければopenで警告する
+  - mapした領域はMAP_SHAREDでファイル全体を常駐させる. mlockall(MCL_FUTURE)中(rt_lock_memory)ならその全てがlockされる. 大きさは約(1.6KB×capacity + 16B×vertexCapacity)
+  - capacity周期ぶんを記録し、古いレコードから上書きする. region類の頂点はvertexCapacity個ぶんを記録し、頂点が上書きされた古いレコードのregion類は変換時に捨てられる
+  - 記録したファイルはAutoStabilizerTelemetryToLog(TelemetryToLog.cpp)でdatalogger形式のテキストに変換できる
+*/
+class TelemetryRecorder{
+public:
+  TelemetryRecorder() {}
+  ~TelemetryRecorder() { this->close(); }
+  TelemetryRecorder(const TelemetryRecorder&) = delete;
+  TelemetryRecorder& operator=(const TelemetryRecorder&) = delete;
+
+  bool open(const std::string& fileName, unsigned long capacity, unsigned long vertexCapacity, const std::vector<std::string>& eeName);
+  void close();
+  bool isOpened() const { return this->header_ != nullptr; }
+
+  // 制御周期のスレッドから毎周期呼ぶ. sec, nsecはm_qRef_.tm
+  void record(long sec, long nsec, const GaitParam& gaitParam);
+
+protected:
+  void* map_ = nullptr;
+  size_t mapSize_ = 0;
+  telemetry::TelemetryHeader* header_ = nullptr;
+  telemetry::TelemetryRecord* records_ = nullptr;
+  telemetry::TelemetryVertex* vertices_ = nullptr;
+  uint64_t count_ = 0;
+  uint64_t vertexCount_ = 0;
+
+  // vertices_のv番目(通し番号)に書く
+  void writeVertex(uint64_t v, const cnoid::Vector3& p) {
+    telemetry::TelemetryVertex& vertex = this->vertices_[v % this->header_->vertexCapacity];
+    vertex.x = p[0];
+    vertex.y = p[1];
+  }
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+  TelemetryRecorderが記録したリングファイルを、datalogger(hrpsys DataLogger)と同じ形式のテキストファイルに変換する.
+  使い方: AutoStabilizerTelemetryToLog <telemetry file> <出力先のprefix> [instance名 (default: ast)]
+  例: AutoStabilizerTelemetryToLog /dev/shm/ast.telemetry /tmp/test_JAXON_JVRC_20221106041023.
+    -> /tmp/test_JAXON_JVRC_20221106041023.ast_genCogOut 等が作られるので、cpviewer.pyやplot用のyamlにそのまま使える
+  記録中のファイルを読んだ場合、変換中に上書きされたレコードは捨てる. region類の頂点だけが上書きされていた場合は、region類を空として出力する
+*/
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include "TelemetryRecord.h"
+
+namespace {
+  class LogFile {
+  public:
+    LogFile(const std::string& fileName) : ofs(fileName.c_str()) {
+      this->ofs << std::setprecision(10);
+    }
+    void begin(const telemetry::TelemetryRecord& r) {
+      this->ofs << std::fixed << std::setprecision(6) << (r.sec + r.nsec / 1e9) << " " << std::defaultfloat << std::setprecision(10);
+    }
+    void values(const double* data, int size) {
+      for(int i=0;i<size;i++) this->ofs << data[i] << " ";
+    }
+    void end() { this->ofs << std::endl; }
+    std::ofstream ofs;
+  };
+}
+
+int main(int argc, char** argv){
+  if(argc < 3){
+    std::cerr << "usage: " << argv[0] << " <telemetry file> <output prefix> [instance name (default: ast)]" << std::endl;
+    return 1;
+  }
+  std::string prefix = std::string(argv[2]) + ((argc >= 4) ? std::string(argv[3]) : std::string("ast")) + "_";
+
+  int fd = open(argv[1], O_RDONLY);
+  if(fd < 0){
+    std::cerr << "failed to open " << argv[1] << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < sizeof(telemetry::TelemetryHeader)){
+    std::cerr << argv[1] << " is not a telemetry file" << std::endl;
+    close(fd);
+    return 1;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED){
+    std::cerr << "failed to mmap " << argv[1] << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  const telemetry::TelemetryHeader& header = *static_cast<const telemetry::TelemetryHeader*>(map);
+  if(std::memcmp(header.magic, telemetry::TELEMETRY_MAGIC, sizeof(header.magic)) != 0 ||
+     header.version != telemetry::TELEMETRY_VERSION ||
+     header.recordSize != sizeof(telemetry::TelemetryRecord) ||
+     header.eeNum > telemetry::MAX_EE ||
+     header.recordOffset + header.recordSize * header.capacity > st.st_size ||
+     header.vertexCapacity < telemetry::MAX_VERTICES_PER_RECORD ||
+     header.vertexOffset + sizeof(telemetry::TelemetryVertex) * header.vertexCapacity > st.st_size){
+    std::cerr << argv[1] << " is not a telemetry file of version " << telemetry::TELEMETRY_VERSION << std::endl;
+    munmap(map, st.st_size);
+    return 1;
+  }
+  const telemetry::TelemetryRecord* records = reinterpret_cast<const telemetry::TelemetryRecord*>(static_cast<const char*>(map) + header.recordOffset);
+  const telemetry::TelemetryVertex* vertices = reinterpret_cast<const telemetry::TelemetryVertex*>(static_cast<const char*>(map) + header.vertexOffset);
+
+  LogFile genCog(prefix+"genCogOut"), genDcm(prefix+"genDcmOut"), genZmp(prefix+"genZmpOut"), tgtZmp(prefix+"tgtZmpOut"), actCog(prefix+"actCogOut"), actDcm(prefix+"actDcmOut");
+  LogFile dstLandingPos(prefix+"dstLandingPosOut"), remainTime(prefix+"remainTimeOut"), genCoords(prefix+"genCoordsOut");
+  LogFile captureRegion(prefix+"captureRegionOut"), steppableRegionLog(prefix+"steppableRegionLogOut"), steppableRegionNumLog(prefix+"steppableRegionNumLogOut"), strideLimitationHull(prefix+"strideLimitationHullOut");
+  LogFile cpViewerLog(prefix+"cpViewerLogOut"), ikStat(prefix+"ikStatOut"), perfStat(prefix+"perfStatOut");
+  std::vector<std::shared_ptr<LogFile> > tgtEEWrench;
+  for(int i=0;i<header.eeNum;i++){
+    std::string eeName(header.eeName[i], strnlen(header.eeName[i], telemetry::MAX_EE_NAME));
+    tgtEEWrench.push_back(std::make_shared<LogFile>(prefix+"tgt"+eeName+"WrenchOut"));
+  }
+
+  uint64_t count = __atomic_load_n(&header.count, __ATOMIC_ACQUIRE);
+  uint64_t begin = (count > header.capacity) ? count - header.capacity : 0;
+  uint64_t written = 0;
+  uint64_t regionDropped = 0;
+  std::vector<double> regionVertices(telemetry::MAX_VERTICES_PER_RECORD*2);
+  for(uint64_t idx=begin;idx<count;idx++){
+    telemetry::TelemetryRecord r = records[idx % header.capacity];
+    // コピー中に記録側に追いつかれて上書きされた可能性があるレコードは捨てる
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&header.count, __ATOMIC_ACQUIRE) >= idx + header.capacity) continue;
+
+    int captureRegionNum = std::min<uint32_t>(r.captureRegionNum, telemetry::MAX_CAPTURE_REGION_VERTICES);
+    int steppableRegionNum = std::min<uint32_t>(r.steppableRegionNum, telemetry::MAX_STEPPABLE_REGIONS);
+    int steppableRegionVertexNum = 0;
+    for(int i=0;i<steppableRegionNum;i++) steppableRegionVertexNum += r.steppableRegionVertexNum[i];
+    steppableRegionVertexNum = std::min(steppableRegionVertexNum, telemetry::MAX_STEPPABLE_REGION_VERTICES);
+    int strideLimitationHullNum = std::min<uint32_t>(r.strideLimitationHullNum, telemetry::MAX_STRIDE_LIMITATION_HULL_VERTICES);
+    int vertexNum = captureRegionNum + steppableRegionVertexNum + strideLimitationHullNum;
+    for(int i=0;i<vertexNum;i++){
+      const telemetry::TelemetryVertex& vertex = vertices[(r.vertexBegin + i) % header.vertexCapacity];
+      regionVertices[i*2+0] = vertex.x;
+      regionVertices[i*2+1] = vertex.y;
+    }
+    // コピー中に記録側に上書きされた可能性がある頂点は捨てる. 記録側は頂点を書く前にvertexCountを進める
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&header.vertexCount, __ATOMIC_ACQUIRE) > r.vertexBegin + header.vertexCapacity){
+      captureRegionNum = 0;
+      steppableRegionNum = 0;
+      steppableRegionVertexNum = 0;
+      strideLimitationHullNum = 0;
+      regionDropped++;
+    }
+
+    genCog.begin(r); genCog.values(r.genCog, 3); genCog.end();
+    genDcm.begin(r); genDcm.values(r.genDcm, 3); genDcm.end();
+    genZmp.begin(r); genZmp.values(r.genZmp, 3); genZmp.end();
+    tgtZmp.begin(r); tgtZmp.values(r.tgtZmp, 3); tgtZmp.end();
+    actCog.begin(r); actCog.values(r.actCog, 3); actCog.end();
+    actDcm.begin(r); actDcm.values(r.actDcm, 3); actDcm.end();
+    dstLandingPos.begin(r); dstLandingPos.values(r.dstLandingPos, 6); dstLandingPos.end();
+    remainTime.begin(r); remainTime.values(&r.remainTime, 1); remainTime.end();
+    genCoords.begin(r); genCoords.values(r.genCoords, 12); genCoords.end();
+    captureRegion.begin(r); captureRegion.values(&regionVertices[0], captureRegionNum*2); captureRegion.end();
+    steppableRegionLog.begin(r); steppableRegionNumLog.begin(r);
+    for(int i=0;i<steppableRegionNum;i++){
+      double num = r.steppableRegionVertexNum[i];
+      steppableRegionNumLog.values(&num, 1);
+    }
+    steppableRegionLog.values(&regionVertices[captureRegionNum*2], steppableRegionVertexNum*2);
+    steppableRegionLog.end(); steppableRegionNumLog.end();
+    strideLimitationHull.begin(r); strideLimitationHull.values(&regionVertices[(captureRegionNum+steppableRegionVertexNum)*2], strideLimitationHullNum*2); strideLimitationHull.end();
+    cpViewerLog.begin(r); cpViewerLog.values(r.cpViewerLog, std::min<uint32_t>(r.cpViewerLogNum, telemetry::MAX_CP_VIEWER_LOG)); cpViewerLog.end();
+    ikStat.begin(r); ikStat.values(r.ikStat, std::min<uint32_t>(r.ikStatNum, telemetry::MAX_IK_STAT)); ikStat.end();
+    perfStat.begin(r); perfStat.values(r.perfStat, std::min<uint32_t>(r.perfStatNum, telemetry::MAX_PERF_STAT)); perfStat.end();
+    for(int i=0;i<tgtEEWrench.size();i++){
+      tgtEEWrench[i]->begin(r); tgtEEWrench[i]->values(r.tgtEEWrench[i], 6); tgtEEWrench[i]->end();
+    }
+    written++;
+  }
+  std::cerr << "converted " << written << " records (" << count << " recorded, capacity " << header.capacity << "). regions of " << regionDropped << " records were overwritten (vertex capacity " << header.vertexCapacity << ")" << std::endl;
+
+  munmap(map, st.st_size);
+  return 0;
+}
@@ -1,4 +1,93 @@
 #include "AutoStabilizerROSBridge.h"
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+namespace {
+  double triangleArea(const geometry_msgs::Point32& a, const geometry_msgs::Point32& b, const geometry_msgs::Point32& c){ // xy平面に投影した面積
+    return 0.5 * std::abs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x));
+  }
+
+  bool isSamePoints(const std::vector<geometry_msgs::Point32>& a, const std::vector<geometry_msgs::Point32>& b){
+    if(a.size() != b.size()) return false;
+    for(size_t i=0;i<a.size();i++){
+      if(a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z) return false;
+    }
+    return true;
+  }
+
+  /*
+    polygonの頂点を間引いてo_pointsにx,y,zの順に入れる.
+    隣り合う頂点とつくる三角形の面積が最も小さい頂点から順に取り除く(Visvalingam-Whyatt). 取り除いた三角形の面積の合計がtolerance以下である間続けるので、xy平面上での面積の変化はtolerance以下になる. 頂点は3つ以上残す
+    toleranceが0以下なら間引かない. workの確保済みの領域を再利用する
+  */
+  template<class SimplifyWork>
+  void simplifyPolygon(const std::vector<geometry_msgs::Point32>& points, double tolerance, SimplifyWork& work, std::vector<double>& o_points){
+    int n = points.size();
+    o_points.clear();
+    if(tolerance <= 0.0 || n <= 3){
+      for(int i=0;i<n;i++){
+        o_points.push_back(points[i].x);
+        o_points.push_back(points[i].y);
+        o_points.push_back(points[i].z);
+      }
+      return;
+    }
+
+    work.prev.resize(n);
+    work.next.resize(n);
+    work.area.resize(n);
+    work.version.assign(n, 0);
+    work.heap.clear();
+    for(int i=0;i<n;i++){
+      work.prev[i] = (i+n-1)%n;
+      work.next[i] = (i+1)%n;
+    }
+    for(int i=0;i<n;i++){
+      work.area[i] = triangleArea(points[work.prev[i]], points[i], points[work.next[i]]);
+      work.heap.push_back(std::make_pair(work.area[i], std::make_pair(i, work.version[i])));
+    }
+    typedef std::greater<std::pair<double, std::pair<int, unsigned int> > > Compare; // areaが小さいものを先頭にする
+    std::make_heap(work.heap.begin(), work.heap.end(), Compare());
+
+    int remain = n;
+    double removedArea = 0.0;
+    while(remain > 3 && work.heap.size() > 0){
+      std::pop_heap(work.heap.begin(), work.heap.end(), Compare());
+      double area = work.heap.back().first;
+      int i = work.heap.back().second.first;
+      unsigned int version = work.heap.back().second.second;
+      work.heap.pop_back();
+      if(version != work.version[i]) continue; // 既に取り除いたか、面積が更新された
+      if(removedArea + area > tolerance) break;
+      removedArea += area;
+      remain--;
+      work.version[i]++;
+      int p = work.prev[i];
+      int q = work.next[i];
+      work.next[p] = q;
+      work.prev[q] = p;
+      int neighbors[2] = {p, q};
+      for(int k=0;k<2;k++){
+        int j = neighbors[k];
+        work.area[j] = triangleArea(points[work.prev[j]], points[j], points[work.next[j]]);
+        work.version[j]++;
+        work.heap.push_back(std::make_pair(work.area[j], std::make_pair(j, work.version[j])));
+        std::push_heap(work.heap.begin(), work.heap.end(), Compare());
+      }
+    }
+
+    int start = 0;
+    while(work.next[work.prev[start]] != start) start++; // 取り除かれた頂点はリストから外れている. 残っている頂点から、元の順番で辿る
+    int i = start;
+    do{
+      o_points.push_back(points[i].x);
+      o_points.push_back(points[i].y);
+      o_points.push_back(points[i].z);
+      i = work.next[i];
+    }while(i != start);
+  }
+}
 
 AutoStabilizerROSBridge::AutoStabilizerROSBridge(RTC::Manager* manager):
   RTC::DataFlowComponentBase(manager),
@@ -18,6 +107,8 @@ RTC::ReturnCode_t AutoStabilizerROSBridge::onInitialize(){
   steppable_region_sub_ = pnh.subscribe("steppable_region", 1, &AutoStabilizerROSBridge::onSteppableRegionCB, this);
   landing_height_sub_ = pnh.subscribe("landing_height", 1, &AutoStabilizerROSBridge::onLandingHeightCB, this);
   landing_target_pub_ = pnh.advertise<auto_stabilizer_msgs::LandingPosition>("landing_target", 1);
+  pnh.param("skip_unchanged_polygons", skip_unchanged_polygons_, false);
+  pnh.param("polygon_simplify_tolerance", polygon_simplify_tolerance_, 0.0);
 
   return RTC::RTC_OK;
 }
@@ -46,15 +137,19 @@ RTC::ReturnCode_t AutoStabilizerROSBridge::onExecute(RTC::UniqueId ec_id){
 
 void AutoStabilizerROSBridge::onSteppableRegionCB(const auto_stabilizer_msgs::SteppableRegion::ConstPtr& msg) {
   size_t convex_num(msg->polygons.size());
-  m_steppableRegion_.data.region.length(convex_num);
+  if(polygon_cache_.size() < convex_num) polygon_cache_.resize(convex_num);
+  for (size_t i = convex_num; i < polygon_cache_.size(); i++) polygon_cache_[i].isValid = false;
+  m_steppableRegion_.data.region.length(convex_num); // CORBAのsequenceは、maximum以下の長さなら確保し直さない
   for (size_t i = 0; i < convex_num; i++) {
-    size_t vs_num(msg->polygons[i].polygon.points.size());
-    m_steppableRegion_.data.region[i].length(3 * vs_num); // x,y,z components
-    for (size_t j = 0; j < vs_num; j++) {
-      m_steppableRegion_.data.region[i][3*j] = msg->polygons[i].polygon.points[j].x;
-      m_steppableRegion_.data.region[i][3*j+1] = msg->polygons[i].polygon.points[j].y;
-      m_steppableRegion_.data.region[i][3*j+2] = msg->polygons[i].polygon.points[j].z;
+    const std::vector<geometry_msgs::Point32>& points = msg->polygons[i].polygon.points;
+    PolygonCache& cache = polygon_cache_[i];
+    if (!(skip_unchanged_polygons_ && cache.isValid && isSamePoints(cache.srcPoints, points))) {
+      simplifyPolygon(points, polygon_simplify_tolerance_, simplify_work_, cache.points);
+      cache.isValid = skip_unchanged_polygons_;
+      if (skip_unchanged_polygons_) cache.srcPoints.assign(points.begin(), points.end()); // 確保済みの領域を再利用する
     }
+    m_steppableRegion_.data.region[i].length(cache.points.size()); // x,y,z components
+    std::copy(cache.points.begin(), cache.points.end(), m_steppableRegion_.data.region[i].get_buffer());
   }
   m_steppableRegion_.data.l_r = msg->l_r;
   m_steppableRegionOut_.write();
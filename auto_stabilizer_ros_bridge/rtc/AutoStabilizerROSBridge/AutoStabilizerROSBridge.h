@@ -12,6 +12,8 @@
 
 #include <ros/ros.h>
 
+#include <vector>
+
 class AutoStabilizerROSBridge : public RTC::DataFlowComponentBase{
 protected:
   ros::NodeHandle nh;
@@ -23,6 +25,24 @@ protected:
   ros::Subscriber steppable_region_sub_;
   auto_stabilizer_msgs::TimedSteppableRegion m_steppableRegion_;
   RTC::OutPort <auto_stabilizer_msgs::TimedSteppableRegion> m_steppableRegionOut_;
+  bool skip_unchanged_polygons_; // trueなら、前回のmsgと同じindexのpolygonの頂点の座標が全て一致すれば、そのpolygonは変化していないとして簡略化をやり直さない. 座標は支持脚の座標系で表されるので、labels等が同じでも座標は変わりうる
+  double polygon_simplify_tolerance_; // [m^2]. 0より大きければ、取り除いた面積の合計がこれ以下の範囲で、各polygonの頂点を間引いてから送る
+  class PolygonCache {
+  public:
+    bool isValid = false; // skip_unchanged_polygons_のときに作ったか
+    std::vector<geometry_msgs::Point32> srcPoints; // msgのpolygonの頂点. 間引く前
+    std::vector<double> points; // 間引いた後の頂点. x,y,z
+  };
+  std::vector<PolygonCache> polygon_cache_; // 要素数を縮めず、各要素の確保済みの領域を次のmsgで再利用する
+  class SimplifyWork {
+  public:
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<double> area;
+    std::vector<unsigned int> version;
+    std::vector<std::pair<double, std::pair<int, unsigned int> > > heap; // (area, (index, version))
+  };
+  SimplifyWork simplify_work_;
 
   ros::Subscriber landing_height_sub_;
   auto_stabilizer_msgs::TimedLandingPosition m_landingHeight_;
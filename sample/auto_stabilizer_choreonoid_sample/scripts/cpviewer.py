@@ -3,6 +3,8 @@
 #####使い方#####
 # ./cpviewer ログの絶対パス（拡張子除く・ピリオドまで）
 # 例　./cpviewer.py /tmp/test_JAXON_JVRC_20221106041023.
+# AutoStabilizerのtelemetry_fileに記録した場合は、先に変換する
+# 例　rosrun auto_stabilizer AutoStabilizerTelemetryToLog /tmp/ast.telemetry /tmp/test_JAXON_JVRC_20221106041023.
 # ドラッグで移動
 # ホイールで拡大縮小（irtviewerの機能、一定以上縮小できない）
 # jでコマ戻し、kでコマ送り
@@ -86,6 +86,8 @@ class JAXON_RED_HrpsysConfigurator(ChoreonoidHrpsysConfigurator):
         if self.ast:
             self.log_svc.add("TimedDoubleSeq","ast_q")
             rtm.connectPorts(rtm.findRTC("ast").port("q"),rtm.findRTC("log").port("ast_q"))
+            self.log_svc.add("TimedDoubleSeq","ast_genTauOut")
+            rtm.connectPorts(rtm.findRTC("ast").port("genTauOut"),rtm.findRTC("log").port("ast_genTauOut"))
             self.log_svc.add("TimedPoint3D","ast_genCogOut")
             rtm.connectPorts(rtm.findRTC("ast").port("genCogOut"),rtm.findRTC("log").port("ast_genCogOut"))
             self.log_svc.add("TimedPoint3D","ast_genDcmOut")
@@ -114,6 +116,10 @@ class JAXON_RED_HrpsysConfigurator(ChoreonoidHrpsysConfigurator):
             rtm.connectPorts(rtm.findRTC("ast").port("strideLimitationHullOut"),rtm.findRTC("log").port("ast_strideLimitationHullOut"))
             self.log_svc.add("TimedDoubleSeq","ast_cpViewerLogOut")
             rtm.connectPorts(rtm.findRTC("ast").port("cpViewerLogOut"),rtm.findRTC("log").port("ast_cpViewerLogOut"))
+            self.log_svc.add("TimedDoubleSeq","ast_ikStatOut")
+            rtm.connectPorts(rtm.findRTC("ast").port("ikStatOut"),rtm.findRTC("log").port("ast_ikStatOut"))
+            self.log_svc.add("TimedDoubleSeq","ast_perfStatOut")
+            rtm.connectPorts(rtm.findRTC("ast").port("perfStatOut"),rtm.findRTC("log").port("ast_perfStatOut"))
             for ee in ["rleg", "lleg", "rarm", "larm"]:
                 self.log_svc.add("TimedDoubleSeq","ast_tgt" + ee + "WrenchOut")
                 rtm.connectPorts(rtm.findRTC("ast").port("tgt" + ee + "WrenchOut"),rtm.findRTC("log").port("ast_tgt" + ee + "WrenchOut"))